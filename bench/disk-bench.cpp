@@ -0,0 +1,166 @@
+// Measure RP07 transfers through the RH20 and its channel, from
+// loading the transfer control register to seeing the done flag
+// between instructions, for sequential and random workloads.
+//
+// Usage: km10-disk-bench [-f IMAGE] [-n TRANSFERS] [-b BLOCKS] [--latency]
+//
+// Without -f the pack is a new sparse file that is removed at the
+// end. Sequential transfers start at the beginning of the pack and
+// random ones anywhere on it. With --latency the drive takes as long
+// as a real RP07 would.
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include <unistd.h>
+
+using namespace std;
+
+#include "km10.hpp"
+#include "rh20.hpp"
+#include "rp07.hpp"
+
+
+using Clock = chrono::steady_clock;
+
+
+static const unsigned list = 01000;
+static const unsigned buf = 010000;
+static const size_t packBlocks = RP07::packWords / RP07::sectorWords;
+
+
+struct Bench {
+  MachineContext context;
+  KM10 km10{256*1024, context};
+  RH20 *rhP;
+
+  Bench(const string &path, RP07::Latency latency) {
+    km10.debugger.interactive = false;
+    rhP = new RH20(0, km10);	// km10 deletes this
+    rhP->attach(0, new RP07(path, 0, latency));
+  }
+
+  void put(unsigned reg, unsigned v) {
+    RH20::DataWord d;
+    d.reg = reg;
+    d.load = 1;
+    d.data = v;
+    rhP->dataO(W36(d.u));
+  }
+
+  // Do one transfer of `blocks` blocks at `lba` and wait for it.
+  bool transfer(unsigned function, size_t lba, unsigned blocks) {
+    const size_t perCylinder = RP07::tracks * RP07::sectors;
+    put(RP07::regDC, lba / perCylinder);
+    put(RP07::regDA, ((lba % perCylinder / RP07::sectors) << 8) | lba % RP07::sectors);
+
+    // The list moves the words in pieces of at most 1920.
+    unsigned k = 0;
+
+    for (unsigned done = 0, left = blocks * RP07::sectorWords; left > 0; ++k) {
+      const unsigned n = min(left, 1920u);
+      Channel::CCW c;
+      c.op = Channel::ccwTransfer | (n == left ? Channel::ccwLast : 0);
+      c.count = n;
+      c.addr = buf + done;
+      km10.physicalP[list + k] = W36(c.u);
+      done += n;
+      left -= n;
+    }
+
+    Channel::CCW jump;
+    jump.op = Channel::ccwJump;
+    jump.addr = list;
+    km10.eptP->channelLogout[0].initialCommand = W36(jump.u);
+
+    RH20::TCR tcr;
+    tcr.function = function;
+    tcr.negBlocks = 02000 - blocks;
+    tcr.resetCLP = 1;
+
+    RH20::DataWord d(tcr.u);
+    d.reg = RH20::regSTCR;
+    d.load = 1;
+    rhP->putConditions(010);	// Clear done
+    rhP->dataO(W36(d.u));
+
+    // What the CPU does between instructions.
+    while (!rhP->status.done) {
+      if (km10.asyncAttention.load(memory_order_relaxed)) km10.serviceAsyncDevices();
+    }
+
+    return (rhP->status.u & 0775000) == 0;
+  }
+};
+
+
+static void run(Bench &b, const char *name, unsigned function, bool random, unsigned n, unsigned blocks) {
+  mt19937_64 rng(1);
+  uniform_int_distribution<size_t> where(0, packBlocks - blocks);
+  size_t lba = 0;
+  bool ok = true;
+
+  const auto start = Clock::now();
+
+  for (unsigned k=0; k < n; ++k) {
+    if (random) lba = where(rng);
+    ok = b.transfer(function, lba, blocks) && ok;
+    lba = (lba + blocks) % (packBlocks - blocks);
+  }
+
+  const double s = chrono::duration<double>(Clock::now() - start).count();
+  const double words = (double) n * blocks * RP07::sectorWords;
+
+  cout << left << setw(20) << name << right << fixed << setprecision(1)
+       << setw(12) << n / s
+       << setw(12) << words / s / 1e6
+       << setw(12) << s / n * 1e6
+       << (ok ? "" : "  ERRORS")
+       << endl;
+}
+
+
+int main(int argc, char *argv[]) {
+  string path;
+  unsigned n = 10000;
+  unsigned blocks = 8;
+  bool latency = false;
+
+  for (int k=1; k < argc; ++k) {
+    if (strcmp(argv[k], "-f") == 0 && k+1 < argc) path = argv[++k];
+    else if (strcmp(argv[k], "-n") == 0 && k+1 < argc) n = stoul(argv[++k]);
+    else if (strcmp(argv[k], "-b") == 0 && k+1 < argc) blocks = stoul(argv[++k]);
+    else if (strcmp(argv[k], "--latency") == 0) latency = true;
+  }
+
+  // The buffer has to fit in memory and the count in the register.
+  blocks = clamp(blocks, 1u, 1000u);
+  const bool tempImage = path.empty();
+
+  if (tempImage) {
+    char name[] = "/tmp/km10-disk-bench-XXXXXX";
+    close(mkstemp(name));
+    path = name;
+  }
+
+  {
+    Bench b(path, latency ? RP07::rp07Latency : RP07::noLatency);
+
+    cout << n << " transfers of " << blocks << " blocks" << endl
+	 << left << setw(20) << "workload" << right
+	 << setw(12) << "xfers/s"
+	 << setw(12) << "Mwords/s"
+	 << setw(12) << "us/xfer"
+	 << endl;
+
+    run(b, "sequential write", RP07::fnWrite, false, n, blocks);
+    run(b, "sequential read", RP07::fnRead, false, n, blocks);
+    run(b, "random write", RP07::fnWrite, true, n, blocks);
+    run(b, "random read", RP07::fnRead, true, n, blocks);
+  }
+
+  if (tempImage) unlink(path.c_str());
+  return 0;
+}
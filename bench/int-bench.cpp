@@ -0,0 +1,150 @@
+// Compare moving bytes into the 10's memory with the PI system's byte
+// interrupt function against doing it with an interrupt handler in
+// the program.
+//
+// Usage: km10-int-bench [-n BYTES]
+//
+// A device keeps requesting an interrupt on level 1 until it has
+// delivered all of its bytes while the program spins waiting for it
+// to say it's done. With the byte function the PI system stores each byte
+// through the DTE20 0 to-10 byte pointer in the EPT during the
+// interrupt cycle. Without it the level 1 vector is a JSR to a
+// handler that does a DATAI and IDPB and dismisses with JEN.
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstring>
+
+using namespace std;
+
+#include "km10.hpp"
+
+
+using Clock = chrono::steady_clock;
+
+
+struct ByteSource: Device {
+  bool useByteIF;
+  unsigned remaining;
+  uint8_t next;
+
+  ByteSource(KM10 &cpu, bool aUseByteIF, unsigned n)
+    : Device(070, "BENCH", cpu),
+      useByteIF(aUseByteIF),
+      remaining(n),
+      next(0)
+  {
+    setIntLevel(1);
+    requestInterrupt();
+  }
+
+  virtual tuple<unsigned,W36> getIntFuncWord() override {
+    W36 ifw(0);
+
+    if (useByteIF) {
+      ifw.intFunction = W36::byteIF;
+      ifw.q = 1;		// Toward the 10
+    } else {
+      ifw.intFunction = W36::standardIF;
+    }
+
+    return {intLevel, ifw};
+  }
+
+  virtual W36 intDepositWord(W36 ifw) override {return next;}
+  virtual void intFunctionDone(W36 ifw, bool ok) override {taken();}
+
+  virtual IResult doDATAI(W36 iw, W36 ea) override {
+    km10.memPut(W36(next));
+    taken();
+    return iNormal;
+  }
+
+  // Each byte is taken as soon as it's asked for, so the next one is
+  // ready at once until there are no more.
+  void taken() {
+    ++next;
+    if (--remaining == 0) clearInterrupt();
+  }
+
+  // Busy until the last byte is taken.
+  virtual unsigned getConditions() override {return remaining != 0;}
+  virtual void putConditions(unsigned v) override {}
+};
+
+
+static const unsigned buf = 02000;
+static const unsigned memWords = 256*1024;	// All of section zero
+
+
+static void bench(const char *name, bool useByteIF, unsigned nBytes) {
+  static const unsigned handler = 01000;
+  static const unsigned bp = 01010;
+  static const unsigned idle = 0100;
+
+  MachineContext context;
+  KM10 km10(memWords, context);
+  km10.debugger.interactive = false;
+
+  // The handler, saving the PC in its first word.
+  km10.eptP->pioInstructions[2*1] = W36(0264000, handler);		// JSR HANDLR
+  km10.memP[handler + 1] = W36(0734040, 1);				// DATAI 700,1
+  km10.memP[handler + 2] = W36(0136040, bp);				// IDPB 1,BP
+  km10.memP[handler + 3] = W36(0254520, handler);			// JEN @HANDLR
+  km10.memP[bp] = W36(0441000, buf);					// POINT 8,BUF
+
+  // The byte function's pointer is the same one.
+  km10.eptP->dte[0].to10BP = km10.memP[bp];
+
+  km10.memP[idle + 0] = W36(0734300, 1);				// CONSZ 700,1
+  km10.memP[idle + 1] = W36(0254000, idle);				// JRST .-1
+  km10.memP[idle + 2] = W36(0254200, 0);				// HALT
+  km10.pc = idle;
+  km10.pi.piState.piOn = 1;
+  km10.pi.piState.levelsOn = 0177;
+
+  ByteSource source(km10, useByteIF, nBytes);
+
+  km10.running = true;
+  const auto start = Clock::now();
+  km10.emulate();
+  const double ns = chrono::duration<double, nano>(Clock::now() - start).count();
+
+  // Check the bytes all landed.
+  const W36 finalBP = useByteIF ? km10.eptP->dte[0].to10BP : km10.memP[bp];
+  bool ok = finalBP.rhu == buf + (nBytes - 1) / 4;
+
+  for (unsigned k=0; ok && k < nBytes; ++k) {
+    const unsigned shift = 28 - 8 * (k % 4);
+    ok = ((km10.memP[buf + k / 4].u >> shift) & 0377) == (k & 0377);
+  }
+
+  cout << left << setw(24) << name << right << fixed << setprecision(2)
+       << setw(12) << ns / nBytes
+       << setw(14) << (double) km10.instructionCounter / nBytes
+       << (ok ? "" : "  WRONG DATA")
+       << endl;
+}
+
+
+int main(int argc, char *argv[]) {
+  unsigned nBytes = 1000 * 1000;
+
+  for (int k=1; k < argc; ++k) {
+    if (strcmp(argv[k], "-n") == 0 && k+1 < argc) nBytes = stoul(argv[++k]);
+  }
+
+  // The bytes have to fit between `buf` and the end of section zero.
+  nBytes = clamp(nBytes, 1u, (memWords - buf) * 4);
+
+  cout << nBytes << " bytes" << endl
+       << left << setw(24) << "method" << right
+       << setw(12) << "ns/byte"
+       << setw(14) << "insns/byte"
+       << endl;
+
+  bench("byte function", true, nBytes);
+  bench("program handler", false, nBytes);
+  return 0;
+}
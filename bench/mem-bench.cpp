@@ -0,0 +1,116 @@
+// Startup time and random access benchmarks for the physical memory
+// backends in physmem.hpp.
+//
+// Usage: km10-mem-bench [-m Kwords] [backend ...]
+//
+// With no backends listed we try all of them, using files in /tmp for
+// the file and shm backends. Backends that can't be set up on this
+// host (e.g., hugetlb with no huge pages reserved) are reported and
+// skipped.
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <unistd.h>
+#include <sys/mman.h>
+
+using namespace std;
+
+#include "physmem.hpp"
+
+
+using Clock = chrono::steady_clock;
+
+static double msSince(Clock::time_point start) {
+  return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+
+// Cheap PRNG so the generator doesn't dominate the measurement.
+static inline uint64_t xorshift(uint64_t &s) {
+  s ^= s << 13;
+  s ^= s >> 7;
+  s ^= s << 17;
+  return s;
+}
+
+
+static void bench(const string &spec, unsigned nWords) {
+  const auto backend = PhysicalMemory::Backend::parse(spec);
+  const unsigned nAccesses = 20 * 1000 * 1000;
+
+  try {
+    // Startup: create the mapping and fault in every page, which is
+    // what loading a big image or a monitor sizing memory does.
+    auto start = Clock::now();
+    PhysicalMemory mem(nWords, backend);
+    const double mapMS = msSince(start);
+
+    for (unsigned a=0; a < nWords; a += PhysicalMemory::pageWords) mem.physicalP[a] = a;
+    const double touchMS = msSince(start) - mapMS;
+
+    // Random reads and read-modify-writes of single words, which is
+    // what guest references look like to the host TLB.
+    uint64_t seed = 0x2545F4914F6CDD1Dull;
+    uint64_t sum = 0;
+    start = Clock::now();
+
+    for (unsigned k=0; k < nAccesses; ++k) {
+      const unsigned a = ((xorshift(seed) >> 32) * nWords) >> 32;
+      sum += mem.physicalP[a].u;
+      if (k & 1) mem.physicalP[a] = W36(sum);
+    }
+
+    const double randomNS = msSince(start) * 1e6 / nAccesses;
+
+    cout << left << setw(32) << spec << right << fixed << setprecision(2)
+	 << setw(10) << mapMS
+	 << setw(12) << touchMS
+	 << setw(12) << randomNS
+	 << (sum == 1 ? " " : "")	// Keep `sum` live
+	 << endl;
+  } catch (const exception &e) {
+    cout << left << setw(32) << spec << "skipped: " << e.what() << endl;
+  }
+
+  if (backend.kind == PhysicalMemory::Backend::file) unlink(backend.path.c_str());
+  if (backend.kind == PhysicalMemory::Backend::shared) shm_unlink(backend.path.c_str());
+}
+
+
+int main(int argc, char *argv[]) {
+  unsigned kWords = 4096;
+  vector<string> specs;
+
+  for (int k=1; k < argc; ++k) {
+
+    if (strcmp(argv[k], "-m") == 0 && k+1 < argc) {
+      kWords = stoul(argv[++k]);
+    } else {
+      specs.push_back(argv[k]);
+    }
+  }
+
+  if (specs.empty()) {
+    specs = {
+      "anon",
+      "thp",
+      "hugetlb",
+      "file:/tmp/km10-mem-bench-" + to_string(getpid()),
+      "shm:km10-mem-bench-" + to_string(getpid()),
+    };
+  }
+
+  cout << "Memory size " << kWords << "K words" << endl
+       << left << setw(32) << "backend" << right
+       << setw(10) << "map ms"
+       << setw(12) << "touch ms"
+       << setw(12) << "random ns"
+       << endl;
+
+  for (auto &spec: specs) bench(spec, kWords * 1024);
+  return 0;
+}
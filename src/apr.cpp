@@ -24,6 +24,20 @@ void APRDevice::endSweep() {
   if (aprState.intLevel != 0 && aprState.enabled_sweepDone) requestInterrupt();
 }
 
+// Interface for memory references to report non-existent memory.
+void APRDevice::nonExistentMemory(unsigned pa) {
+  if (logger.mem) logger.s << "; NXM " << W36(pa).fmtVMA();
+  km10.era = pa;
+  aprState.active_noMemory = 1;
+  if (aprState.intLevel != 0 && aprState.enabled_noMemory) requestInterrupt();
+}
+
+void APRDevice::ioPageFailure() {
+  if (logger.ints) logger.s << "; I/O page fail";
+  aprState.active_ioPageFail = 1;
+  if (aprState.intLevel != 0 && aprState.enabled_ioPageFail) requestInterrupt();
+}
+
 // I/O instruction handlers
 IResult APRDevice::doBLKI(W36 iw, W36 ea) {	// APRID
   km10.memPut(aprIDValue.u);
@@ -36,15 +50,17 @@ IResult APRDevice::doBLKO(W36 iw, W36 ea) {	// WRFIL
 }
 
 
-// XXX implement address breaks under program control.
 IResult APRDevice::doDATAI(W36 iw, W36 ea) {
   km10.memPut(breakState.u);
   return IResult::iNormal;
 }
 
 
+// Address breaks are implemented by PAG's watchpoints.
 IResult APRDevice::doDATAO(W36 iw, W36 ea) {
-  breakState.u = km10.memGet().rhu;
+  breakState.u = km10.memGet().u;
+  if (logger.mem) logger.s << "; address break" << breakState.toString();
+  km10.pag.updateWatchpoints();
   return IResult::iNormal;
 }
 
@@ -57,7 +73,8 @@ void APRDevice::putConditions(unsigned v) {
 
   if (logger.ints) logger.s << km10.pc.fmtVMA() << " WRAPR: intLevel="
 			    << oct << func.intLevel;
-  intLevel = aprState.intLevel = func.intLevel;
+  setIntLevel(func.intLevel);
+  aprState.intLevel = func.intLevel;
 
   if (func.disable) {
     if (logger.ints) logger.s << " disable=" << oct << select;
@@ -89,13 +106,27 @@ void APRDevice::putConditions(unsigned v) {
 
   if (func.clearIO) {
     if (logger.ints) logger.s << " clearIO";
-    Device::clearAll();
+    Device::clearAll(km10);
   }
 
   if (logger.ints) logger.s << logger.endl;
 }
 
 
+void APRDevice::saveState(MachineState &ms) {
+  Device::saveState(ms);
+  ms.put(aprState.u);
+  ms.put(breakState.u);
+}
+
+
+void APRDevice::restoreState(MachineState &ms) {
+  Device::restoreState(ms);
+  aprState.u = ms.get();
+  breakState.u = ms.get();
+}
+
+
 IResult APRDevice::doCONO(W36 iw, W36 ea) {		// WRAPR
   putConditions(ea.rhu);
   return IResult::iNormal;
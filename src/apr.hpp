@@ -239,6 +239,9 @@ struct APRDevice: Device {
   virtual unsigned getConditions();
   virtual void putConditions(unsigned v);
 
+  virtual void saveState(MachineState &ms) override;
+  virtual void restoreState(MachineState &ms) override;
+
   // Interrupt handling
   void requestInterrupt() override;
 
@@ -246,6 +249,12 @@ struct APRDevice: Device {
   void startSweep();
   void endSweep();
 
+  // Interface for memory references to report non-existent memory.
+  void nonExistentMemory(unsigned pa);
+
+  // Interface for PI to report a page fail in an interrupt function.
+  void ioPageFailure();
+
   // I/O instruction handlers
   virtual IResult doDATAI(W36 iw, W36 ea) override;
   virtual IResult doDATAO(W36 iw, W36 ea) override;
@@ -0,0 +1,115 @@
+#include <poll.h>
+#include <stdexcept>
+
+using namespace std;
+
+#include "asyncdev.hpp"
+#include "km10.hpp"
+
+
+// Each of us has a bit in the CPU's 64-bit `asyncAttention`. This
+// checks there's one left before the Device constructor registers us
+// anywhere.
+KM10 &AsyncDevice::withRoom(KM10 &cpu) {
+  if (cpu.asyncDevices.size() >= 64) throw runtime_error("Too many asynchronous devices");
+  return cpu;
+}
+
+
+AsyncDevice::AsyncDevice(unsigned anAddr, string aName, KM10 &cpu)
+  : Device(anAddr, aName, withRoom(cpu)),
+    workerDone(false),
+    inFlight(0),
+    attentionBit(1ull << km10.asyncDevices.size())
+{
+  km10.asyncDevices.push_back(this);
+}
+
+
+AsyncDevice::~AsyncDevice() {
+  stopWorker();
+
+  for (auto &devP: km10.asyncDevices) {
+    if (devP == this) devP = nullptr;
+  }
+}
+
+
+// The worker starts with the first Op rather than in our constructor,
+// where our subclass's perform() doesn't exist yet.
+bool AsyncDevice::submit(const Op &op) {
+  if (!requests.enqueue(op)) return false;
+  ++inFlight;
+
+  if (!worker.joinable()) worker = thread(&AsyncDevice::workerLoop, this);
+  workerWaker.wake();
+  return true;
+}
+
+
+void AsyncDevice::drainCompletions() {
+  Op op;
+
+  while (completions.dequeue(op)) {
+    --inFlight;
+    complete(op);
+  }
+}
+
+
+void AsyncDevice::quiesce() {
+
+  while (inFlight.load() != 0) {
+    drainCompletions();
+    this_thread::yield();
+  }
+}
+
+
+void AsyncDevice::stopWorker() {
+  if (!worker.joinable()) return;
+  workerDone = true;
+  workerWaker.wake();
+  worker.join();
+}
+
+
+void AsyncDevice::saveState(MachineState &ms) {
+  quiesce();
+  Device::saveState(ms);
+}
+
+
+void AsyncDevice::clearIO() {
+  quiesce();
+  Device::clearIO();
+}
+
+
+void AsyncDevice::workerLoop() {
+
+  while (!workerDone) {
+    Op op;
+
+    if (!requests.dequeue(op)) {
+      workerWaker.prepareToSleep();
+
+      if (requests.isEmpty() && !workerDone) {
+	struct pollfd pfd{workerWaker.fd, POLLIN, 0};
+	poll(&pfd, 1, -1);
+	workerWaker.drain();
+      }
+
+      workerWaker.awake();
+      continue;
+    }
+
+    perform(op);
+
+    // The CPU takes completions between instructions, so it will make
+    // room soon.
+    while (!completions.enqueue(op)) this_thread::yield();
+
+    km10.asyncAttention.fetch_or(attentionBit, memory_order_release);
+  }
+}
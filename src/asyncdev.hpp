@@ -0,0 +1,93 @@
+#pragma once
+
+// A device whose slow work (disk or tape transfers, say) runs on a
+// host thread of its own so the CPU never waits for it.
+//
+// The CPU hands the worker thread an Op at a time with submit(). The
+// worker does it in perform(), including any DMA to or from the 10's
+// memory, and hands the Op back through `completions`. Then it sets
+// our bit in KM10's `asyncAttention` word, which the CPU samples
+// between instructions. The CPU takes the Ops back with
+// drainCompletions() and calls complete() for each one, so device
+// status and PI requests only ever change on the CPU thread.
+//
+// Ordering: the worker's DMA stores come before its release store of
+// the completion ring's tail, and that before its release fetch_or of
+// `asyncAttention`. The CPU's acquire exchange of `asyncAttention` and
+// acquire load of the tail mean complete() sees every word the worker
+// stored. The 10 is expected to leave a transfer's buffer alone until
+// it has seen the transfer's interrupt, as it would on real hardware.
+
+#include <cstdint>
+#include <atomic>
+#include <thread>
+
+using namespace std;
+
+#include "word.hpp"
+#include "device.hpp"
+#include "spscring.hpp"
+
+
+struct AsyncDevice: Device {
+
+  // One piece of work. Except for `status`, which perform() sets for
+  // complete() to look at, what the fields mean is up to the device.
+  struct Op {
+    unsigned function;
+    unsigned unit;
+    uint64_t arg[4];
+    int status;
+  };
+
+  static const inline size_t queueSize = 64;
+
+  SPSCRing<Op, queueSize> requests;	// CPU to worker
+  SPSCRing<Op, queueSize> completions;	// Worker to CPU
+  Waker workerWaker;
+
+  thread worker;
+  atomic<bool> workerDone;
+
+  // Ops submitted whose completions the CPU hasn't taken back yet.
+  atomic<unsigned> inFlight;
+
+  // Our bit in KM10's `asyncAttention`.
+  uint64_t attentionBit;
+
+
+  // Constructors. Subclasses MUST call stopWorker() from their
+  // destructors, since the worker calls their perform().
+  AsyncDevice(unsigned anAddr, string aName, KM10 &cpu);
+  virtual ~AsyncDevice();
+
+
+  // CPU side. Returns false if the device is too far behind to take
+  // another Op right now.
+  bool submit(const Op &op);
+
+  // CPU side. Called when our `asyncAttention` bit is set.
+  void drainCompletions();
+
+  // CPU side. Wait for every Op in flight and run its completion.
+  void quiesce();
+
+  void stopWorker();
+
+
+  // Worker side. Do `op`'s work.
+  virtual void perform(Op &op) = 0;
+
+  // CPU side. Update our state (and request an interrupt if we want)
+  // now that `op` is done.
+  virtual void complete(const Op &op) = 0;
+
+
+  // A checkpoint or snapshot must not be taken with an Op half done.
+  virtual void saveState(MachineState &ms) override;
+  virtual void clearIO() override;
+
+private:
+  static KM10 &withRoom(KM10 &cpu);
+  void workerLoop();
+};
@@ -30,7 +30,7 @@ unsigned BytePointer::getByte(KM10 &km10) {
 void BytePointer::putByte(W36 v, KM10 &km10) {
   auto [p, s, a] = getPSA(km10);
   W36 w(km10.memGetN(a));
-  km10.memPutN((w.u & ~W36::bMask(p, s)) | ((v & W36::rMask(p)) << p), a);
+  km10.memPutN((w.u & ~W36::bMask(p, s)) | ((v & W36::rMask(s)) << p), a);
 }
 
 
@@ -43,6 +43,10 @@ bool BytePointer::adjust(unsigned ac, KM10 &km10) {
 }
 
 
+void BytePointer::store(W36 bpa, KM10 &km10) {
+}
+
+
 ////////////////////////////////////////////////////////////////
 PSA BytePointerL1::getPSA(KM10 &km10) {
   unsigned rp = p;
@@ -62,6 +66,11 @@ void BytePointerL1::inc(KM10 &km10) {
   }
 }
 
+
+void BytePointerL1::store(W36 bpa, KM10 &km10) {
+  km10.memPutN(W36(u), bpa);
+}
+
 // Returns true if trap1, overflow, and no-divide flags should be set.
 
 // From KLX microcode 442:
@@ -34,6 +34,9 @@ struct BytePointer {
   void putByte(W36 v, KM10 &cpu);
   virtual void inc(KM10 &cpu);
   virtual bool adjust(unsigned ac, KM10 &cpu);
+
+  // Write the pointer back to `bpa` after inc().
+  virtual void store(W36 bpa, KM10 &cpu);
 };
 
 
@@ -62,6 +65,7 @@ struct BytePointerL1: BytePointer {
   // Accessors
   virtual PSA getPSA(KM10 &cpu);
   virtual void inc(KM10 &cpu);
+  virtual void store(W36 bpa, KM10 &cpu) override;
 
   // Returns true if trap1, overflow, and no-divide flags should be set.
 
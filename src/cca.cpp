@@ -37,6 +37,20 @@ void CCADevice::putConditions(unsigned v) {
 }
 
 
+void CCADevice::saveState(MachineState &ms) {
+  Device::saveState(ms);
+  ms.put(genericConditions);
+  ms.put(sweepCountDown);
+}
+
+
+void CCADevice::restoreState(MachineState &ms) {
+  Device::restoreState(ms);
+  genericConditions = ms.get();
+  sweepCountDown = ms.get();
+}
+
+
 // I/O instruction handlers
 IResult CCADevice::doCONO(W36 iw, W36 ea) {
   startSweep();
@@ -13,7 +13,7 @@ struct CCADevice: Device {
 
   // Constructors
   CCADevice(KM10 &cpu)
-    : Device(014, "CCA", cpu),
+    : Device(003, "CCA", cpu),
       genericConditions(0),
       sweepCountDown(0)
   { }
@@ -33,6 +33,9 @@ struct CCADevice: Device {
   virtual unsigned getConditions();
   virtual void putConditions(unsigned v);
 
+  virtual void saveState(MachineState &ms) override;
+  virtual void restoreState(MachineState &ms) override;
+
   // I/O instruction handlers
   virtual IResult doCONO(W36 iw, W36 ea) override;
   virtual IResult doDATAI(W36 iw, W36 ea); // SWPIA
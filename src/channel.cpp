@@ -0,0 +1,161 @@
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+#include "word.hpp"
+#include "km10.hpp"
+#include "channel.hpp"
+
+
+Channel::Channel(unsigned aNumber, KM10 &cpu)
+  : km10(cpu),
+    number(aNumber & 7),
+    clp(0),
+    ccw(0),
+    halted(false),
+    shortCount(false),
+    nxm(false),
+    runs(0)
+{
+  reset();
+}
+
+
+// The command list starts with the channel's initial command word in
+// the EPT.
+void Channel::reset() {
+  clp = km10.physAddressFor(&km10.eptP->channelLogout[number].initialCommand).u;
+  ccw = CCW(0);
+}
+
+
+void Channel::start() {
+  ccw = CCW(0);
+  halted = shortCount = nxm = false;
+}
+
+
+// Fetch commands until we have a transfer to do. Returns false if
+// the channel halts instead.
+bool Channel::nextCCW() {
+  static const unsigned maxJumps = 16;	// In a row, so a loop can't hang us
+
+  for (unsigned k=0; k < maxJumps; ++k) {
+
+    if (clp >= km10.memorySize) {
+      nxm = true;
+      halted = true;
+      return false;
+    }
+
+    const CCW c(km10.physicalP[clp].u);
+    ++clp;
+
+    if (c.op & ccwTransfer) {
+      ccw = c;
+      return true;
+    } else if (c.op == ccwJump) {
+      clp = c.addr;
+    } else {
+      halted = true;
+      return false;
+    }
+  }
+
+  halted = true;
+  return false;
+}
+
+
+// Move `n` words between `p` and memory starting at `lo`. Going in
+// reverse, the first word of `p` is the last in memory.
+void Channel::move(W36 *p, size_t lo, size_t n, bool reverse, bool toMemory) {
+  W36 *memP = km10.physicalP + lo;
+  ++runs;
+
+  if (!reverse && toMemory) {
+    memcpy(memP, p, n * sizeof(W36));
+  } else if (!reverse) {
+    memcpy(p, memP, n * sizeof(W36));
+  } else if (toMemory) {
+    reverse_copy(p, p + n, memP);
+  } else {
+    reverse_copy(memP, memP + n, p);
+  }
+}
+
+
+// Each command's piece of the buffer is checked and accounted for as
+// we come to it, but the copying waits until the next piece doesn't
+// carry on where this one ends in memory.
+size_t Channel::transfer(W36 *p, size_t n, bool toMemory) {
+  size_t moved = 0;
+
+  // The run waiting to be copied: `runN` words from `p + runStart`,
+  // to or from memory at `runLo` and up.
+  size_t runStart = 0;
+  size_t runLo = 0;
+  size_t runN = 0;
+  bool runReverse = false;
+
+  while (moved < n) {
+
+    if (ccw.count == 0) {
+
+      if (halted || !nextCCW()) {
+	shortCount = true;
+	break;
+      }
+
+      continue;
+    }
+
+    const size_t piece = min<size_t>(ccw.count, n - moved);
+    const bool reverse = ccw.op & ccwReverse;
+    const size_t lo = reverse ? ccw.addr - (piece - 1) : ccw.addr;
+
+    if ((reverse && (size_t) ccw.addr + 1 < piece) || lo + piece > km10.memorySize) {
+      nxm = true;
+      halted = true;
+      break;
+    }
+
+    if (runN != 0 && reverse == runReverse && (reverse ? lo + piece == runLo : runLo + runN == lo)) {
+      if (reverse) runLo = lo;
+      runN += piece;
+    } else {
+      if (runN != 0) move(p + runStart, runLo, runN, runReverse, toMemory);
+      runStart = moved;
+      runLo = lo;
+      runN = piece;
+      runReverse = reverse;
+    }
+
+    ccw.addr = reverse ? ccw.addr - piece : ccw.addr + piece;
+    ccw.count = ccw.count - piece;
+    moved += piece;
+
+    if (ccw.count == 0 && (ccw.op & ccwLast)) halted = true;
+  }
+
+  if (runN != 0) move(p + runStart, runLo, runN, runReverse, toMemory);
+  return moved;
+}
+
+
+// Store the channel's status and its last command, as it was when the
+// transfer ended, in the EPT.
+void Channel::logout(bool deviceOK) {
+  auto &lo = km10.eptP->channelLogout[number];
+  uint64_t sw = csSet | csNoAddrParityErr | (clp & 017777777);
+
+  if (ccw.count != 0) sw |= csCountNotZero;
+  if (nxm) sw |= csNXM;
+  if (!deviceOK) sw |= csRH20Error;
+  if (longCount()) sw |= csLWCE;
+  if (shortCount) sw |= csSWCE;
+
+  lo.statusWord = W36(sw);
+  lo.lastUpdatedCommand = W36(ccw.u);
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+// A KL10 internal channel, the DMA engine behind each RH20.
+//
+// Channel n follows a command list that starts with the initial
+// command word in the EPT's logout area for channel n. Transfer
+// commands move words between a device and memory; jumps go on with
+// the list somewhere else; a halt (or a transfer marked last, when its
+// count runs out) ends it. When a transfer is over the channel can
+// log out its status and last command in the same area.
+//
+// A device moves its data by calling transfer() with a buffer of its
+// own, as often as it likes. We split the buffer across the commands
+// the list has, and where consecutive commands' memory abuts we merge
+// them into one run that is moved with a single copy, so a list made
+// of many small pieces of one buffer costs about what one command
+// would.
+
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+#include "word.hpp"
+
+
+struct KM10;
+
+
+struct Channel {
+
+  // Channel command word
+  union CCW {
+
+    struct ATTRPACKED {
+      unsigned addr: 22;
+      unsigned count: 11;
+      unsigned op: 3;
+    };
+
+    uint64_t u: 36;
+
+    CCW(uint64_t v = 0) : u(v) {}
+  };
+
+  enum CCWOp {
+    ccwHalt = 0,
+    ccwJump = 2,
+    ccwTransfer = 4,		// With these modifier bits:
+    ccwLast = 2,		// Halt when the count runs out
+    ccwReverse = 1,		// Addresses go down
+  };
+
+  // Logout status word bits
+  static const inline uint64_t csSet = 1ull << 35;
+  static const inline uint64_t csNoAddrParityErr = 1ull << 33;
+  static const inline uint64_t csCountNotZero = 1ull << 32;
+  static const inline uint64_t csNXM = 1ull << 31;
+  static const inline uint64_t csRH20Error = 1ull << 25;
+  static const inline uint64_t csLWCE = 1ull << 24;
+  static const inline uint64_t csSWCE = 1ull << 23;
+
+  KM10 &km10;
+  unsigned number;		// Which channel's EPT words we use
+
+  // While a transfer is in flight only the device's worker touches
+  // these.
+  unsigned clp;			// Command list pointer
+  CCW ccw;			// Current command, count and addr updated
+  bool halted;
+  bool shortCount;		// The list ran out before the device did
+  bool nxm;			// A command or data word wasn't in memory
+
+  uint64_t runs;		// Copies made, for tests and benchmarks
+
+
+  // Constructors.
+  Channel(unsigned aNumber, KM10 &cpu);
+
+
+  // Start the command list over at our initial command word.
+  void reset();
+
+  // Get ready for a transfer, which picks up the list where the last
+  // one left it.
+  void start();
+
+  // Move up to `n` words between `p` and memory the way the command
+  // list says. Returns how many moved.
+  size_t transfer(W36 *p, size_t n, bool toMemory);
+
+  // The device is done. Was there a count error or did a word miss
+  // memory?
+  bool longCount() const {return ccw.count != 0 && !shortCount;}
+  bool error() const {return shortCount || nxm || ccw.count != 0;}
+
+  // Store our status and last command in the EPT. `deviceOK` false
+  // says the device finished with an error of its own.
+  void logout(bool deviceOK);
+
+private:
+  bool nextCCW();
+  void move(W36 *p, size_t lo, size_t n, bool reverse, bool toMemory);
+};
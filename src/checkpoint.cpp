@@ -0,0 +1,189 @@
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <algorithm>
+
+using namespace std;
+
+#include "checkpoint.hpp"
+#include "km10.hpp"
+#include "machstate.hpp"
+
+
+static uint64_t roundUpToPage(uint64_t offset) {
+  return (offset + PhysicalMemory::pageBytes - 1) & ~(uint64_t) (PhysicalMemory::pageBytes - 1);
+}
+
+
+static void writeAll(int fd, const void *p, size_t n, uint64_t offset) {
+  const char *cp = (const char *) p;
+
+  while (n > 0) {
+    const ssize_t st = pwrite(fd, cp, n, offset);
+    if (st <= 0) throw runtime_error("Failed to write checkpoint");
+    cp += st;
+    n -= st;
+    offset += st;
+  }
+}
+
+
+static void readAll(int fd, void *p, size_t n, uint64_t offset) {
+  char *cp = (char *) p;
+
+  while (n > 0) {
+    const ssize_t st = pread(fd, cp, n, offset);
+    if (st <= 0) throw runtime_error("Failed to read checkpoint");
+    cp += st;
+    n -= st;
+    offset += st;
+  }
+}
+
+
+Checkpointer::Checkpointer(KM10 &aKM10, const string &aPath, uint64_t anInterval)
+  : km10(aKM10),
+    path(aPath),
+    fd(-1),
+    interval(anInterval),
+    nextAt(aKM10.instructionCounter),
+    nRecords(0),
+    endOffset(0)
+{
+  fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) throw runtime_error("Failed to create checkpoint file " + path);
+}
+
+
+Checkpointer::~Checkpointer() {
+  if (fd >= 0) close(fd);
+}
+
+
+void Checkpointer::checkpoint() {
+  const unsigned nPages = km10.memorySize / PhysicalMemory::pageWords;
+  vector<unsigned> ppns;
+
+  for (unsigned ppn=0; ppn < nPages; ++ppn) {
+    if (nRecords == 0 || km10.physMem.isDirty(ppn)) ppns.push_back(ppn);
+  }
+
+  endOffset += writeRecord(km10, fd, endOffset, nRecords, ppns);
+  ++nRecords;
+
+  // Everything is clean again as of this record.
+  km10.physMem.trackDirtyPages();
+  if (km10.pag.hostMMUP) km10.pag.hostMMUP->writeProtectAll();
+
+  nextAt = km10.instructionCounter + interval;
+}
+
+
+uint64_t Checkpointer::writeRecord(KM10 &km10, int fd, uint64_t offset, unsigned index,
+				   const vector<unsigned> &ppns)
+{
+  MachineState ms;
+  km10.saveState(ms);
+
+  const uint64_t stateOffset = offset + sizeof(RecordHeader);
+  const uint64_t ppnOffset = stateOffset + ms.words.size() * sizeof(uint64_t);
+  const uint64_t dataOffset = roundUpToPage(ppnOffset + ppns.size() * sizeof(uint32_t));
+
+  writeAll(fd, ms.words.data(), ms.words.size() * sizeof(uint64_t), stateOffset);
+
+  vector<uint32_t> ppn32(ppns.begin(), ppns.end());
+  writeAll(fd, ppn32.data(), ppn32.size() * sizeof(uint32_t), ppnOffset);
+
+  // Write each run of consecutive pages at once.
+  for (size_t k=0; k < ppns.size(); ) {
+    size_t end = k + 1;
+    while (end < ppns.size() && ppns[end] == ppns[end-1] + 1) ++end;
+
+    writeAll(fd, km10.physicalP + (size_t) ppns[k] * PhysicalMemory::pageWords,
+	     (end - k) * PhysicalMemory::pageBytes,
+	     dataOffset + k * PhysicalMemory::pageBytes);
+    k = end;
+  }
+
+  RecordHeader h{};
+  h.magic = magicValue;
+  h.version = currentVersion;
+  h.index = index;
+  h.instructionCounter = km10.instructionCounter;
+  h.memoryWords = km10.memorySize;
+  h.nPages = ppns.size();
+  h.stateWords = ms.words.size();
+  h.recordBytes = dataOffset + ppns.size() * PhysicalMemory::pageBytes - offset;
+  writeAll(fd, &h, sizeof(h), offset);
+
+  return h.recordBytes;
+}
+
+
+int Checkpointer::restore(KM10 &km10, const string &path, int index) {
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) throw runtime_error("Failed to open checkpoint file " + path);
+
+  try {
+    struct stat st;
+    if (fstat(fd, &st) != 0) throw runtime_error("Failed to stat checkpoint file " + path);
+
+    // Find the complete records.
+    vector<pair<uint64_t, RecordHeader>> records;
+
+    for (uint64_t offset=0; offset + sizeof(RecordHeader) <= (uint64_t) st.st_size; ) {
+      RecordHeader h;
+      readAll(fd, &h, sizeof(h), offset);
+
+      if (h.magic != magicValue || h.version != currentVersion ||
+	  h.recordBytes == 0 || offset + h.recordBytes > (uint64_t) st.st_size)
+      {
+	break;
+      }
+
+      records.emplace_back(offset, h);
+      offset += h.recordBytes;
+    }
+
+    if (records.empty()) throw runtime_error("No complete checkpoints in " + path);
+    if (index < 0) index = records.size() - 1;
+    if (index >= (int) records.size()) throw runtime_error("No such checkpoint in " + path);
+
+    for (int k=0; k <= index; ++k) {
+      auto [offset, h] = records[k];
+      if (h.memoryWords != km10.memorySize) throw runtime_error("Checkpoint has a different memory size");
+
+      const uint64_t stateOffset = offset + sizeof(RecordHeader);
+      const uint64_t ppnOffset = stateOffset + h.stateWords * sizeof(uint64_t);
+      const uint64_t dataOffset = roundUpToPage(ppnOffset + h.nPages * sizeof(uint32_t));
+
+      vector<uint32_t> ppns(h.nPages);
+      readAll(fd, ppns.data(), ppns.size() * sizeof(uint32_t), ppnOffset);
+
+      // If we are taking checkpoints ourselves memory is write
+      // protected, and the kernel won't read into it. Copying each
+      // page in takes the usual fault that marks it dirty instead.
+      vector<W36> page(PhysicalMemory::pageWords);
+
+      for (unsigned p=0; p < h.nPages; ++p) {
+	if (ppns[p] >= km10.memorySize / PhysicalMemory::pageWords) throw runtime_error("Checkpoint is corrupt");
+	readAll(fd, page.data(), PhysicalMemory::pageBytes, dataOffset + (uint64_t) p * PhysicalMemory::pageBytes);
+	copy(page.begin(), page.end(), km10.physicalP + (size_t) ppns[p] * PhysicalMemory::pageWords);
+      }
+
+      if (k == index) {
+	MachineState ms;
+	ms.words.resize(h.stateWords);
+	readAll(fd, ms.words.data(), ms.words.size() * sizeof(uint64_t), stateOffset);
+	km10.restoreState(ms);
+      }
+    }
+  } catch (...) {
+    close(fd);
+    throw;
+  }
+
+  close(fd);
+  return index;
+}
@@ -0,0 +1,78 @@
+// Incremental checkpoints of a running KM10.
+//
+// A checkpoint file is a sequence of records appended every
+// `interval` instructions. The first record holds all of memory and
+// each later one only the pages written since the record before it,
+// as tracked by PhysicalMemory. Every record also holds the complete
+// processor and device state (see machstate.hpp). Restoring record N
+// applies the memory of records 0..N in order and then the state of
+// record N, so any earlier point of a long run can be restarted.
+//
+// Record layout (host byte order):
+//
+//   RecordHeader
+//   uint64_t state[stateWords]
+//   uint32_t ppn[nPages]		Physical page numbers, ascending
+//   padding to a 4KiB boundary
+//   page data, 4KiB per page in `ppn` order
+//
+// The header is written after the rest of the record, so a record cut
+// short by a crash doesn't look complete and restore ignores it.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+class KM10;
+
+
+struct Checkpointer {
+  static const inline uint64_t magicValue = 0x4B4D3130434B5054ull; // "KM10CKPT"
+  static const inline uint32_t currentVersion = 1;
+
+  struct RecordHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t index;		// 0, 1, 2, ... within the file
+    uint64_t instructionCounter;
+    uint32_t memoryWords;
+    uint32_t nPages;
+    uint64_t stateWords;
+    uint64_t recordBytes;	// Including this header and padding
+  };
+
+  KM10 &km10;
+  string path;
+  int fd;
+
+  // Instructions between checkpoints and the instruction count at
+  // which the next one is due.
+  uint64_t interval;
+  uint64_t nextAt;
+
+  unsigned nRecords;
+  uint64_t endOffset;
+
+
+  // Start a new checkpoint file at `path`, replacing any file there.
+  Checkpointer(KM10 &aKM10, const string &aPath, uint64_t anInterval);
+  ~Checkpointer();
+
+  // Append a checkpoint record. Only call this between instructions.
+  void checkpoint();
+
+  // Restore `km10` to checkpoint record `index` of the file at
+  // `path`, or the last complete one if `index` is negative. Returns
+  // the index we restored.
+  static int restore(KM10 &km10, const string &path, int index = -1);
+
+  // Write one record of the state of `km10` and pages `ppns` of its
+  // memory to `fd` at `offset`. Returns the record's size.
+  static uint64_t writeRecord(KM10 &km10, int fd, uint64_t offset, unsigned index,
+			      const vector<unsigned> &ppns);
+};
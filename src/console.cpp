@@ -0,0 +1,261 @@
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+
+#include "console.hpp"
+
+
+Console *Console::make(const string &spec) {
+  if (spec == "tty") return new TTYConsole;
+  if (spec == "pty") return new PTYConsole;
+  if (spec == "stdio") return new FDConsole(0, 1);
+  if (spec == "null") return new FDConsole(-1, -1);
+  if (spec.starts_with("socket:") && spec.size() > 7) return new SocketConsole(spec.substr(7));
+
+  throw invalid_argument("Console must be tty, pty, socket:PATH, stdio, or null");
+}
+
+
+// Write all of `n` bytes, giving up on errors. There's nothing better
+// to do with CTY output nobody can take.
+static bool writeAll(int fd, const char *bufP, size_t n) {
+
+  while (n > 0) {
+    const ssize_t st = write(fd, bufP, n);
+    if (st <= 0) return false;
+    bufP += st;
+    n -= st;
+  }
+
+  return true;
+}
+
+
+void Console::writeOutputV(const struct iovec *iovP, int n) {
+  for (int k=0; k < n; ++k) writeOutput((const char *) iovP[k].iov_base, iovP[k].iov_len);
+}
+
+
+ssize_t FDConsole::readInput(char *bufP, size_t n) {
+  const ssize_t st = read(inFD, bufP, n);
+  if (st > 0) return st;
+
+  // At end of file (or on a real error) stop polling for more.
+  if (st == 0 || (errno != EINTR && errno != EAGAIN)) inFD = -1;
+  return 0;
+}
+
+
+void FDConsole::writeOutput(const char *bufP, size_t n) {
+  if (outFD >= 0) writeAll(outFD, bufP, n);
+}
+
+
+void FDConsole::writeOutputV(const struct iovec *iovP, int n) {
+  if (outFD < 0) return;
+
+  const ssize_t st = writev(outFD, iovP, n);
+  if (st < 0) return;
+
+  // Finish anything a short write left behind.
+  size_t done = st;
+
+  for (int k=0; k < n; ++k) {
+    const size_t len = iovP[k].iov_len;
+
+    if (done < len) {
+      if (!writeAll(outFD, (const char *) iovP[k].iov_base + done, len - done)) return;
+      done = 0;
+    } else {
+      done -= len;
+    }
+  }
+}
+
+
+TTYConsole::TTYConsole()
+  : FDConsole(-1, -1),
+    origTermios{},
+    isRaw(false)
+{
+  const int fd = open("/dev/tty", O_RDWR | O_CLOEXEC);
+  if (fd < 0) throw runtime_error("can't open /dev/tty (use --console to run without a terminal)");
+  inFD = outFD = fd;
+
+  if (!isatty(fd)) throw runtime_error("MUST be run on a terminal without redirection");
+
+  // Save current termios settings to restore on exit
+  int st = tcgetattr(fd, &origTermios);
+  if (st < 0) throw runtime_error("failed to tcgetattr for tty");
+
+  /* register the tty reset with the exit handler */
+  static bool resetRegistered{false};
+
+  if (!resetRegistered) {
+    if (atexit(resetAtExit) != 0) throw runtime_error("atexit: can't register tty reset");
+    resetRegistered = true;
+  }
+}
+
+
+TTYConsole::~TTYConsole() {
+  disconnect();
+  close(outFD);
+}
+
+
+// Put terminal in Raw mode - see termios(3) for modes.
+void TTYConsole::connect() {
+  struct termios raw{origTermios};
+  cfmakeraw(&raw);
+
+  // Put terminal in Raw mode after flushing
+  if (tcsetattr(outFD, TCSAFLUSH, &raw) < 0) throw runtime_error("can't set TTY Raw mode");
+
+  isRaw = true;
+  rawP = this;
+}
+
+
+void TTYConsole::disconnect() {
+  if (!isRaw) return;
+
+  tcsetattr(outFD, TCSAFLUSH, &origTermios);
+  isRaw = false;
+  rawP = nullptr;
+}
+
+
+// reset tty - useful also for restoring the terminal when this
+// process wishes to temporarily relinquish the tty.
+void TTYConsole::resetAtExit() {
+  if (TTYConsole *consoleP = rawP.load()) consoleP->disconnect();
+}
+
+
+PTYConsole::PTYConsole()
+  : FDConsole(-1, -1),
+    slaveFD(-1)
+{
+  const int fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+  if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0) throw runtime_error("can't allocate a pty");
+  inFD = outFD = fd;
+  slaveName = ptsname(fd);
+
+  // We hold the slave open so output isn't lost (and reads don't fail)
+  // while nobody is attached. It's raw so the line discipline leaves
+  // the CTY's characters alone.
+  slaveFD = open(slaveName.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+  if (slaveFD < 0) throw runtime_error("can't open pty " + slaveName);
+
+  struct termios raw;
+  tcgetattr(slaveFD, &raw);
+  cfmakeraw(&raw);
+  tcsetattr(slaveFD, TCSANOW, &raw);
+
+  cerr << "[Console is on " << slaveName << "]" << endl;
+}
+
+
+PTYConsole::~PTYConsole() {
+  close(slaveFD);
+  close(outFD);
+}
+
+
+SocketConsole::SocketConsole(const string &aPath)
+  : path(aPath),
+    listenFD(-1),
+    clientFD(-1)
+{
+  struct sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) throw runtime_error("Console socket path is too long");
+  strcpy(addr.sun_path, path.c_str());
+
+  listenFD = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listenFD < 0) throw runtime_error("can't create console socket");
+
+  unlink(path.c_str());
+
+  if (bind(listenFD, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(listenFD, 1) != 0) {
+    close(listenFD);
+    throw runtime_error("can't listen on console socket " + path);
+  }
+
+  cerr << "[Console is on socket " << path << "]" << endl;
+}
+
+
+SocketConsole::~SocketConsole() {
+  dropClient();
+  close(listenFD);
+  unlink(path.c_str());
+}
+
+
+int SocketConsole::inputFD() {
+  lock_guard<mutex> lock(clientMutex);
+  return clientFD >= 0 ? clientFD : listenFD;
+}
+
+
+ssize_t SocketConsole::readInput(char *bufP, size_t n) {
+  unique_lock<mutex> lock(clientMutex);
+
+  if (clientFD < 0) {
+    clientFD = accept4(listenFD, nullptr, nullptr, SOCK_CLOEXEC);
+    return 0;
+  }
+
+  const int fd = clientFD;
+  lock.unlock();
+
+  const ssize_t st = read(fd, bufP, n);
+  if (st > 0) return st;
+
+  dropClient();
+  return 0;
+}
+
+
+void SocketConsole::writeOutput(const char *bufP, size_t n) {
+  lock_guard<mutex> lock(clientMutex);
+  if (clientFD < 0) return;
+
+  while (n > 0) {
+    // MSG_NOSIGNAL so a client that has gone away can't kill us with
+    // SIGPIPE.
+    const ssize_t st = send(clientFD, bufP, n, MSG_NOSIGNAL);
+
+    if (st <= 0) {
+      close(clientFD);
+      clientFD = -1;
+      return;
+    }
+
+    bufP += st;
+    n -= st;
+  }
+}
+
+
+void SocketConsole::dropClient() {
+  lock_guard<mutex> lock(clientMutex);
+
+  if (clientFD >= 0) {
+    close(clientFD);
+    clientFD = -1;
+  }
+}
@@ -0,0 +1,118 @@
+// Backends for the DTE20's console terminal (CTY).
+//
+// The CTY can be the controlling terminal (the default), a pty we
+// allocate for something like `screen` to attach to, a Unix-domain
+// socket server that one client at a time can connect to, or a pair
+// of file descriptors such as stdin and stdout. Only the terminal is
+// switched between raw and normal mode as the CPU starts and stops.
+//
+// The DTE20's console I/O thread polls `inputFD()` and calls
+// `readInput()` when it is readable. It also writes the CTY output
+// the CPU has buffered, with `writeOutputV()`.
+
+#pragma once
+
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <termios.h>
+#include <string>
+#include <atomic>
+#include <mutex>
+
+using namespace std;
+
+
+struct Console {
+  virtual ~Console() {}
+
+  // Called as the CPU starts and stops running, so a terminal can be
+  // put in raw mode and back.
+  virtual void connect() {}
+  virtual void disconnect() {}
+
+  // The descriptor to poll for input, or -1 if there is none now.
+  virtual int inputFD() = 0;
+
+  // Read up to `n` bytes of input once `inputFD()` is readable.
+  // Returns how many we got, which may be zero (e.g., when a client
+  // connects or goes away).
+  virtual ssize_t readInput(char *bufP, size_t n) = 0;
+
+  virtual void writeOutput(const char *bufP, size_t n) = 0;
+
+  // Write several pieces at once. By default this writes each in
+  // turn.
+  virtual void writeOutputV(const struct iovec *iovP, int n);
+
+  // Make the console described by `spec`, which is "tty", "pty",
+  // "socket:PATH", "stdio", or "null". This throws invalid_argument
+  // for a bad spec.
+  static Console *make(const string &spec);
+};
+
+
+// Input and output on descriptors someone else owns. Either can be -1
+// for none.
+struct FDConsole: Console {
+  int inFD;
+  int outFD;
+
+  FDConsole(int anInFD, int anOutFD)
+    : inFD(anInFD),
+      outFD(anOutFD)
+  {}
+
+  virtual int inputFD() override {return inFD;}
+  virtual ssize_t readInput(char *bufP, size_t n) override;
+  virtual void writeOutput(const char *bufP, size_t n) override;
+  virtual void writeOutputV(const struct iovec *iovP, int n) override;
+};
+
+
+// The controlling terminal, in raw mode while the CPU runs.
+struct TTYConsole: FDConsole {
+  struct termios origTermios;
+  bool isRaw;
+
+  // There is only one terminal, so this is the console that has put
+  // it in raw mode, for the exit handler to put it back.
+  inline static atomic<TTYConsole *> rawP{nullptr};
+
+  TTYConsole();
+  virtual ~TTYConsole();
+
+  virtual void connect() override;
+  virtual void disconnect() override;
+
+  static void resetAtExit();
+};
+
+
+// A pty we allocate, which a terminal program can attach to by its
+// `slaveName`.
+struct PTYConsole: FDConsole {
+  int slaveFD;
+  string slaveName;
+
+  PTYConsole();
+  virtual ~PTYConsole();
+};
+
+
+// A Unix-domain stream socket server at `path`. One client at a time
+// is the CTY. Output while nobody is connected is discarded.
+struct SocketConsole: Console {
+  string path;
+  int listenFD;
+  int clientFD;
+  mutex clientMutex;
+
+  SocketConsole(const string &aPath);
+  virtual ~SocketConsole();
+
+  virtual int inputFD() override;
+  virtual ssize_t readInput(char *bufP, size_t n) override;
+  virtual void writeOutput(const char *bufP, size_t n) override;
+
+  void dropClient();
+};
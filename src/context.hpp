@@ -0,0 +1,29 @@
+// Per-machine state that lives outside of a KM10.
+//
+// Each KM10 is constructed with a MachineContext that holds its
+// logging settings and its debugger breakpoint tables. These outlive
+// the KM10 so they can be set up from the command line before the
+// machine exists, and so they stick across the debugger's "restart"
+// command, which replaces the KM10 with a new one. Every machine in a
+// process has its own context, so several can run at once (e.g., on
+// separate threads) without seeing each other's state.
+
+#pragma once
+
+#include <unordered_set>
+
+using namespace std;
+
+#include "logger.hpp"
+
+
+struct MachineContext {
+  using BreakpointTable = unordered_set<unsigned>;
+
+  Logger logger;
+
+  BreakpointTable opBPs;	// Opcode breakpoints
+  BreakpointTable addressGBPs;	// Address GET breakpoints
+  BreakpointTable addressPBPs;	// Address PUT breakpoints
+  BreakpointTable executeBPs;	// Execution breakpoints
+};
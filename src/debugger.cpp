@@ -11,12 +11,16 @@
 #include <map>
 #include <vector>
 #include <functional>
+#include <algorithm>
+#include <array>
+#include <atomic>
 
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <sys/wait.h>
 
 using namespace std;
 
@@ -28,26 +32,49 @@ using namespace std;
 #include "pi.hpp"
 #include "device.hpp"
 #include "apr.hpp"
+#include "rh20.hpp"
+
+
+// Every machine in this process. A SIGINT can't be aimed at one of
+// them, so it stops them all.
+static array<atomic<KM10 *>, 64> allMachines{};
 
 
 Debugger::Debugger(KM10 &aKM10)
   : km10(aKM10),
+    logger(aKM10.logger),
     prevLine("help"),
     lastAddr(0),
-    globalSymbols{},
-    localSymbols{},
-    localInvisibleSymbols{},
-    valueToSymbol{},
-    verboseLoad(false),
-    switches(W36(02000,0))
-{}
+    switches(W36(02000,0)),
+    interactive(true),
+    cloneNumber(-1),
+    resultFD(-1),
+    cloneLimit(0),
+    cloneStart(0)
+{
+  // If there's no room we just can't be stopped by SIGINT.
+  for (auto &slot: allMachines) {
+    KM10 *emptyP = nullptr;
+    if (slot.compare_exchange_strong(emptyP, &km10)) break;
+  }
+}
 
 
-static KM10 *cpuForHandlerP;
+Debugger::~Debugger() {
+
+  for (auto &slot: allMachines) {
+    KM10 *usP = &km10;
+    slot.compare_exchange_strong(usP, nullptr);
+  }
+}
+
 
 static void sigintHandler(int signum) {
-  cerr << "[SIGINT handler]" << logger.endl << flush;
-  cpuForHandlerP->running = false;
+  cerr << "[SIGINT handler]\r\n" << flush;
+
+  for (auto &slot: allMachines) {
+    if (KM10 *km10P = slot.load()) km10P->running = false;
+  }
 }
 
 
@@ -112,13 +139,16 @@ Debugger::DebugAction Debugger::debug() {
   };
 
 
+  // A clone that stops is done.
+  if (cloneNumber >= 0) reportCloneResult();
+
+  if (!interactive) return quit;
+
   ////////////////////////////////////////////////////////////////
   // Put console back into normal mode
   km10.dte.disconnect();
 
-  // We have to set this every time but we only install the signal
-  // handler once for this process.
-  cpuForHandlerP = &km10;
+  // We only install the signal handler once for this process.
   static bool firstTime{true};
 
   if (firstTime) {
@@ -142,7 +172,9 @@ Debugger::DebugAction Debugger::debug() {
     if (km10.inInterrupt) cout << " [EXC] ";
 
     cout << prompt << flush;
-    getline(cin, line);
+
+    // There are no more commands once our input is gone.
+    if (!getline(cin, line)) line = "quit";
 
     if (line.length() == 0) {
       line = prevLine;
@@ -275,6 +307,32 @@ Debugger::DebugAction Debugger::debug() {
       action = step;
     });
 
+    COMMAND("fork", nullptr, [&]() {
+      action = forkClones(words);
+    });
+
+    COMMAND("snapshot", nullptr, [&]() {
+
+      if (words.size() != 2) {
+	cout << "Must specify snapshot file name" << logger.endl << flush;
+	return;
+      }
+
+      if (km10.fetchPC.vma != km10.pc.vma || km10.inInterrupt) {
+	cout << "Not between instructions - step first" << logger.endl << flush;
+	return;
+      }
+
+      try {
+	Snapshot::save(km10, words[1]);
+	cout << prefix << "Saved snapshot " << words[1] << logger.endl;
+      } catch (exception &e) {
+	cout << "ERROR: " << e.what() << logger.endl;
+      }
+
+      cout << flush;
+    });
+
     COMMAND("show", nullptr, [&]() {
 
       if (words.size() == 1) {
@@ -289,7 +347,7 @@ Debugger::DebugAction Debugger::debug() {
 	  cout << prefix << km10.flags.toString() << logger.endl;
 	} else if (words[1] == "devs") {
 
-	  for (auto [ioDev, devP]: Device::devices) {
+	  for (auto [ioDev, devP]: km10.devices) {
 	    if (devP->ioAddress == 0777777) continue;
 	    cout << setw(10) << devP->name
 		 << " ioAddr=" << W36(devP->ioAddress).fmt18()
@@ -446,6 +504,11 @@ Debugger::DebugAction Debugger::debug() {
   b,bp [A]      Set breakpoint before execution of address A or display list of breakpoints.
                 Use -A to remove existing breakpoint or 'clear' to clear all breakpoints.
   c,continue    Continue execution at current PC.
+  fork N [sw=S,...] [pc=A,...] [input=T,...] [for=I]
+                Clone the machine N (decimal) times. Clone K runs headless with its
+                output in clone-K.log, using the Kth (or last) switches S, PC A, and
+                console input T (\r \n \s escapes) of each list, for up to I
+                (decimal) instructions. Reports how each clone stopped.
   ?,help        Display this help.
   l,log [ac|io|pc|dte|ea|mem|load|ints|off|all]
                 Display logging flags, toggle one, or turn all on or off.
@@ -460,6 +523,7 @@ Debugger::DebugAction Debugger::debug() {
   pchist [N]    Dump all or some (N) most recent fetch-PC value history in FIFO order.
   restart       Reset and reload as if started from scratch again.
   s,step N      Step N (octal) instructions at current PC.
+  snapshot FILE Save a snapshot of the machine for --restore.
   show apr|pi|flags|devs|counters
                 Display APR, PI state, program flags, or device list.
   stats         Display emulator statistics.
@@ -512,457 +576,191 @@ string Debugger::dump(W36 iw, W36 pc, bool showCharForm) {
 }
 
 
-// Open and mmap a file full of 9-byte (72-bit) chunks. Slurp two
-// successive 36-bit words from each and deposit them into our 36-bit
-// data array, which we return.
-static vector<W36> readFileW36s(const char* filename) {
-  // Open the file.
-  int fd = open(filename, O_RDONLY);
-  if (fd < 0) {
-    throw runtime_error("Failed to open file");
-  }
+// Clone the machine with fork(), which shares unmodified memory
+// copy-on-write. That only works for private memory, so not with the
+// HostMMU or a file or shm backend. Nor with Massbus drives: a clone
+// has no RH20 worker or tape image helper threads, only whatever locks
+// they held, and an RP07 pack is mapped shared with the original.
+Debugger::DebugAction Debugger::forkClones(const vector<string> &args) {
 
-  // Get the file size.
-  struct stat st;
-  if (fstat(fd, &st) < 0) {
-    close(fd);
-    throw runtime_error("Failed to get file size");
+  if (args.size() < 2) {
+    cout << "Must specify number of clones" << logger.endl << flush;
+    return noop;
   }
-  size_t fileSize = static_cast<size_t>(st.st_size);
 
-  // Ensure file size is divisible by 9.
-  if (fileSize % 9 != 0) {
-    close(fd);
-    throw runtime_error("File size is not divisible by 9");
+  if (km10.physMem.fd >= 0) {
+    cout << "Can't fork with --host-mmu or a file or shm memory backend" << logger.endl << flush;
+    return noop;
   }
 
-  // Map the file into memory.
-  void* fileP = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
-  close(fd);	    // We can close the file descriptor after we mmap.
-  if (fileP == MAP_FAILED) {
-    throw runtime_error("Failed to mmap file");
-  }
+  for (RH20 *rhP: km10.rh20s) {
 
-  // Calculate the number of 36-bit values.
-  size_t nWords = (fileSize / 9) * 2;
-
-  // Create the output vector and pre-allocate capacity.
-  vector<W36> output;
-  output.reserve(nWords);
-
-  const uint8_t* inputBytes = static_cast<const uint8_t*>(fileP);
-
-  for (size_t i=0; i < fileSize; i += 9) {
-    // Extract 9 bytes.
-    const uint8_t *wordP = inputBytes + i;
-
-    // Build up the first 36-bit value.
-    uint64_t value1 = static_cast<uint64_t>(wordP[0]) << 28 |
-                      static_cast<uint64_t>(wordP[1]) << 20 |
-                      static_cast<uint64_t>(wordP[2]) << 12 |
-                      static_cast<uint64_t>(wordP[3]) << 4 |
-                      static_cast<uint64_t>(wordP[4]) >> 4;
-
-    // Build up the second 36-bit value.
-    uint64_t value2 = static_cast<uint64_t>(wordP[4] & 0x0F) << 32 |
-                      static_cast<uint64_t>(wordP[5]) << 24 |
-                      static_cast<uint64_t>(wordP[6]) << 16 |
-                      static_cast<uint64_t>(wordP[7]) << 8 |
-                      static_cast<uint64_t>(wordP[8]);
-
-    // Add them to the output vector.
-    output.emplace_back(value1);
-    output.emplace_back(value2);
-  }
-
-  // Unmap the file, effectively closing it finally as well.
-  if (munmap(fileP, fileSize) < 0) {
-    throw runtime_error("Failed to unmap file");
-  }
-
-  return output;
-}
-
-
-struct Radix50Word {
-
-  union {
-
-    struct ATTRPACKED {
-      unsigned rad50: 32;
-      unsigned format: 4;
-    };
-    
-    uint64_t u;
-  };
-
-
-  Radix50Word(unsigned aFormat, unsigned aRad50)
-    : rad50(aRad50),
-      format(aFormat)
-  { }
-
-
-  Radix50Word(W36 w)
-    : rad50(w.u & W36::rMask(32)),
-      format(w.u >> 32)
-  { }
-
-
-  // Human octal readable version of bits 0..3
-  inline unsigned flavor() const {return (unsigned) format << 2; }
-
-  static inline const char RADIX50[] = " 0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ$.%";
-
-
-  string toString() const {
-    unsigned v = rad50;
-    vector<char> s;
-    s.reserve(16);
-
-    for (int k=7; k >= 0 && v != 0; --k) {
-      s.insert(s.begin(), RADIX50[v % 40]);
-      v /= 40;
+    if (rhP && any_of(rhP->drives.begin(), rhP->drives.end(), [](auto dP) {return dP != nullptr;})) {
+      cout << "Can't fork with RH20 drives attached" << logger.endl << flush;
+      return noop;
     }
-
-    string str(s.begin(), s.end());
-    return str;
-  }
-
-
-  // For googletest stringification
-  friend void PrintTo(const Radix50Word& w, ostream* os) {
-    *os << w.toString();
   }
-};
-
-
-void Debugger::loadWord(unsigned addr, W36 value)  {
-  if (verboseLoad) cout << W36(addr).fmtVMA() << ": " << value.fmt36() << endl;
-}
 
+  unsigned nClones;
+  vector<W36> swList, pcList;
+  vector<string> inputList;
+  uint64_t limit = 0;
 
-// Load a listing file (*.REL) to get symbol definitions for symbolic
-// debugging.
-void Debugger::loadREL(const char *fileNameP) {
-  vector<W36> rel = readFileW36s(fileNameP);
-  size_t relSize = rel.size();
-  unsigned rw = 0;     // Relocation word we're working with right now
-  unsigned blockType;
-  unsigned sc;
-  unsigned x;
-  unsigned relX;
+  try {
+    nClones = stoul(args[1]);
 
-  map<unsigned, function<void()>> blockTypeHandler{};
+    for (size_t k=2; k < args.size(); ++k) {
+      const size_t eq = args[k].find('=');
+      if (eq == string::npos) throw invalid_argument(args[k]);
+      const string key = args[k].substr(0, eq);
+      vector<string> values;
 
-
-  // 000: Ignored
-  blockTypeHandler[000] = [&]() {
-    x += sc;
-  };
-
-
-  // 001 Code
-  blockTypeHandler[001] = [&]() {
-    // If "address word" has binary 1100 in top four bits, it's a
-    // symbol we have to relocate address by. Otherwise, I guess we
-    // don't relocate.
-    W36 symOrAddr{rel[x++]};
-    Radix50Word codeSymbol{symOrAddr};
-    unsigned loadAddr;
-
-    if (verboseLoad) {
-
-      if ((symOrAddr >> 18) != 0) {
-	cout << "Symbol " << codeSymbol.toString()
-	     << " flavor=" << codeSymbol.flavor()
-	     << endl;
+      for (stringstream ss(args[k].substr(eq + 1)); !ss.eof(); ) {
+	string v;
+	getline(ss, v, ',');
+	values.push_back(v);
       }
-    }
-
-    // If it's a symbol, we use its value plus the word following as
-    // the load address.
-    if ((symOrAddr >> 32) == 014) {
-      string symbol = codeSymbol.toString();
-      loadAddr = globalSymbols[symbol];
-      if (verboseLoad) cout << "Offset by " << symbol
-			    << "=" << W36(loadAddr).fmtVMA() << endl;
-      loadAddr += rel[x++].u;	// Add the offset
-    } else {
-      loadAddr = symOrAddr;	// Get the load addres
-      ++x;
-    }
-
-    if (verboseLoad) cout << "loadAddr=" << W36(loadAddr).fmtVMA() << endl;
-
-    for (unsigned k=x; k - relX < sc; ++k, ++loadAddr, ++x) {
-      loadWord(loadAddr, rel[k]);
-    }
-  };
-
-
-  blockTypeHandler[002] = [&]() {
-
-    while (x - relX < sc) {
-      unsigned startX = x;
-      Radix50Word sym{rel[x++]};
-      W36 value = W36{rel[x++]};
 
-      switch (sym.flavor()) {
-      case 000:			// ILLEGAL
-      default:
-	cout << "[" << oct << startX << "] ILLEGAL Radix50Word symbol flavor "
-	     << oct << sym.flavor() << endl;
-	break;
+      if (key == "sw") {
+	for (auto &v: values) swList.push_back(W36(v));
+      } else if (key == "pc") {
+	for (auto &v: values) pcList.push_back(W36(v));
+      } else if (key == "input") {
 
-      case 004:			// Global symbol
-	if (verboseLoad) {
-	  cout << "[" << oct << startX << "] Define global " << sym.toString()
-	       << " as " << value.fmt36() << endl;
-	}
-
-	globalSymbols[sym.toString()] = value;
-	break;
+	for (auto &v: values) {
+	  string text;
 
-      case 010:			// Local symbol
-      case 014:			// Block name
-	if (verboseLoad) {
-	  cout << "[" << oct << startX << "] Define local " << sym.toString()
-	       << " as " << value.fmt36() << endl;
-	}
+	  for (size_t c=0; c < v.size(); ++c) {
 
-	localSymbols[sym.toString()] = value;
-	break;
+	    if (v[c] == '\\' && c + 1 < v.size()) {
+	      const char e = v[++c];
+	      text += e == 'r' ? '\r' : e == 'n' ? '\n' : e == 's' ? ' ' : e;
+	    } else {
+	      text += v[c];
+	    }
+	  }
 
-      case 050:			// DDT invisible local symbol
-	if (verboseLoad) {
-	  cout << "[" << oct << startX << "] Define invisible local " << sym.toString()
-	       << " as " << value.fmt36() << endl;
+	  inputList.push_back(text);
 	}
-
-	localInvisibleSymbols[sym.toString()] = value;
-	break;
-
-      case 024:			// Partially defined global symbol
-	break;
+      } else if (key == "for") {
+	limit = stoull(values[0]);
+      } else {
+	throw invalid_argument(args[k]);
       }
     }
-  };
-  
-
-  // HISEG
-  blockTypeHandler[003] = [&]() {
-
-    for (unsigned k=0; k <= sc; ++k) {
-      Radix50Word sym{rel[x++]};
-      cout << "Entry " << sym.toString() << endl;
-    }
-  };
-
-
-  // Entry symbols
-  blockTypeHandler[004] = [&]() {
+  } catch (exception &e) {
+    cout << "Bad fork command - see help" << logger.endl << flush;
+    return noop;
+  }
 
-    for (unsigned k=0; k < sc; ++k) {
-      Radix50Word sym{rel[x++]};
-      if (verboseLoad) cout << "Entry " << sym.toString() << endl;
-    }
+  // The Kth element of a list, or the last one if it's short.
+  auto pick = [](auto &list, unsigned k) {
+    return &list[min<size_t>(k, list.size() - 1)];
   };
 
+  cout << flush;
+  cerr << flush;
 
-  // End of program
-  blockTypeHandler[005] = [&]() {
-    // we ignore this
-  };
+  vector<pair<pid_t, int>> clones;
 
+  for (unsigned k=0; k < nClones; ++k) {
+    int fds[2];
 
-  // Program name
-  blockTypeHandler[006] = [&]() {
-    Radix50Word sym{rel[x++]};
-    if (verboseLoad) cout << "Program " << sym.toString();
-    uint64_t w = rel[x++].u;
-    unsigned cpu = w >> 30;
-    unsigned compiler = (w >> 18) & 07777ul;
-    unsigned lengthOfBlankCommon = w & W36::halfOnes;
-
-    if (verboseLoad) {
-      if (cpu & 010) cout << " KS10";
-      if (cpu & 004) cout << " KL10";
-      if (cpu & 002) cout << " KI10";
-      if (cpu & 001) cout << " KA10";
-
-      if (compiler == 000) cout << " Unknown";
-      if (compiler == 001) cout << " (Not used)";
-      if (compiler == 002) cout << " COBOL-68";
-      if (compiler == 003) cout << " ALGOL";
-      if (compiler == 004) cout << " NELIAC";
-      if (compiler == 005) cout << " PL/I";
-      if (compiler == 006) cout << " BLISS";
-      if (compiler == 007) cout << " SAIL";
-
-      if (compiler == 010) cout << " FORTRAN";
-      if (compiler == 011) cout << " MACRO";
-      if (compiler == 012) cout << " FAIL";
-      if (compiler == 013) cout << " BCPL";
-      if (compiler == 014) cout << " MIDAS";
-      if (compiler == 015) cout << " SIMULA";
-      if (compiler == 016) cout << " COBOL-7";
-      if (compiler == 017) cout << " COBOL";
-
-      if (compiler == 020) cout << " BLISS-36";
-      if (compiler == 021) cout << " BASIC";
-      if (compiler == 022) cout << " SITGO";
-      if (compiler == 023) cout << " (Reserved)";
-      if (compiler == 024) cout << " PASCAL";
-      if (compiler == 025) cout << " JOVIAL";
-      if (compiler == 026) cout << " ADA";
-
-      cout << " common=" << right << oct << lengthOfBlankCommon << endl;
+    if (pipe(fds) < 0) {
+      perror("Can't create clone result pipe");
+      break;
     }
-  };
-
-
-  // Start
-  blockTypeHandler[007] = [&]() {
-    W36 startAddr{rel[x++]};
 
-    if (verboseLoad) cout << "[" << oct << x << "] Start: " << startAddr.fmtVMA();
+    const pid_t pid = fork();
 
-    if (sc >= 2) {
-      Radix50Word sym{rel[x++]};
-
-      if (verboseLoad) {
-	if (sym.flavor() == 060) cout << " offset by " << sym.toString();
-      }
+    if (pid < 0) {
+      perror("Can't fork clone");
+      close(fds[0]);
+      close(fds[1]);
+      break;
     }
 
-    if (verboseLoad) cout << endl;
-  };
-
-
-  cout << "[loading " << fileNameP << "  "
-       << right << oct << relSize << " words]"
-       << endl;
-
-  for (x=0; x < relSize; ) {
-    unsigned startX = x;
+    if (pid == 0) {
+      // We're clone `k`.
+      close(fds[0]);
+      for (auto [otherPID, fd]: clones) close(fd);
 
-    blockType = rel[x].lhu;
+      const string logName = "clone-" + to_string(k) + ".log";
+      const int logFD = open(logName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
 
-    // Length of the block excluding header word and relocation word.
-    sc = rel[x].rhu;
-
-    ++x;			// Consume block header
+      if (logFD >= 0) {
+	dup2(logFD, 1);
+	dup2(logFD, 2);
+	close(logFD);
+      }
 
-    // Relocation word.
-    rw = rel[x++].u;
+      cloneNumber = k;
+      resultFD = fds[1];
+      cloneLimit = limit;
+      cloneStart = km10.instructionCounter;
 
-    // Offset of where our data words start.
-    relX = x;
+      // These belong to the original machine.
+      km10.introspectionP = nullptr;
+      km10.checkpointerP = nullptr;
 
-    if (verboseLoad) {
-      cout << "[" << right << oct << startX << "] Block " << blockType
-	   << " shortCount=" << sc
-	   << " relocationWord=" << W36(rw).fmt36() << endl;
-    }
+      km10.dte.setConsole(new FDConsole(-1, 1));
+      if (!inputList.empty()) for (char c: *pick(inputList, k)) km10.dte.ctyInQ.enqueue(c);
+      if (!swList.empty()) switches = *pick(swList, k);
 
-    auto it = blockTypeHandler.find(blockType);
+      km10.nSteps = limit;
+      km10.running = true;
 
-    if (it != blockTypeHandler.end()) {
-      it->second();		// Invoke the handler
-    } else {
-      if (verboseLoad) cout << "blockType " << right << oct << blockType
-			    << " not defined" << endl;
-      return;			// FOR NOW
-      x += sc;			// Try to skip the block
+      if (pcList.empty()) return run;
+      km10.pc = *pick(pcList, k);
+      return pcChanged;
     }
-  }
 
-  // Build our value-to-symbol reverse lookup table from all symbols
-  // we know about.
-  for (const auto &pair: globalSymbols) {
-    valueToSymbol[pair.second] = pair.first;
+    close(fds[1]);
+    clones.emplace_back(pid, fds[0]);
   }
 
-  for (const auto &pair: localSymbols) {
-    valueToSymbol[pair.second] = pair.first;
-  }
+  cout << "Forked " << clones.size() << " clones, waiting for them to stop" << logger.endl << flush;
 
-#if 0
-  for (const auto &pair: localInvisibleSymbols) {
-    valueToSymbol[pair.second] = pair.first;
-  }
-#endif
+  for (unsigned k=0; k < clones.size(); ++k) {
+    auto [pid, fd] = clones[k];
+    string result;
+    char buf[256];
 
-  // Dump our results proudly to a log file.
-  static const string bannerDash(30, '-');
-  static const string symLogFileName{"rel-symbols.log"};
-  ofstream symLog(symLogFileName);
-
-  if (globalSymbols.size() != 0) {
-    symLog << endl << bannerDash << "GLOBAL SYMBOLS" << bannerDash << endl;
-
-    for (const auto &pair: globalSymbols) {
-      symLog << pair.first << ": " << pair.second.fmt36() << endl;
-    }
-  }
-
-  if (localSymbols.size() != 0) {
-    symLog << endl << bannerDash << "LOCAL SYMBOLS" << bannerDash << endl;
-
-    for (const auto &pair: localSymbols) {
-      symLog << pair.first << ": " << pair.second.fmt36() << endl;
-    }
-  }
+    for (ssize_t n; (n = read(fd, buf, sizeof(buf))) > 0; ) result.append(buf, n);
+    close(fd);
 
-  if (localInvisibleSymbols.size() != 0) {
-    symLog << endl << bannerDash << "LOCAL INVISIBLE SYMBOLS" << bannerDash << endl;
+    int status;
+    waitpid(pid, &status, 0);
 
-    for (const auto &pair: localInvisibleSymbols) {
-      symLog << pair.first << ": " << pair.second.fmt36() << endl;
+    if (result.empty()) {
+      result = "clone " + to_string(k) + " pid " + to_string(pid) + ": died";
+      if (WIFSIGNALED(status)) result += string(" with signal ") + strsignal(WTERMSIG(status));
     }
-  }
 
-  if (valueToSymbol.size() != 0) {
-    symLog << endl << bannerDash << "VALUES TO SYMBOLS" << bannerDash << endl;
-
-    for (const auto &pair: valueToSymbol) {
-      symLog << pair.first.fmt36() << "=" << pair.second << endl;
-    }
+    cout << result << "  (clone-" << k << ".log)" << logger.endl;
   }
 
-  symLog.close();
-  cout << "[symbols dumped to " << symLogFileName << "]" << endl;
-
-  cout << "[done]" << endl << flush;
+  cout << flush;
+  return noop;
 }
 
 
-string Debugger::symbolicForm(W36 w) {
-  static const int64_t maxDelta = 01000;
-  auto it = valueToSymbol.upper_bound(w.u);
-
-  // Find and return the string (+ offset) for a symbol whose value is
-  // no more than maxDelta greater than w. If no such entry exists,
-  // fall through and return just the octal value.
-  if (it != valueToSymbol.begin()) {
-    --it;			// Seek to previous entry
+void Debugger::reportCloneResult() {
+  const uint64_t n = km10.instructionCounter - cloneStart;
+  ostringstream ss;
 
-    int64_t delta = w.u - it->first.u;
+  ss << "clone " << cloneNumber << " pid " << getpid() << ": "
+     << (cloneLimit != 0 && n >= cloneLimit ? "reached instruction limit" : "stopped")
+     << " at " << km10.pc.fmtVMA() << " after " << dec << n << " instructions";
 
-    if (delta == 0) {
-      return it->second;
-    } else if (delta < maxDelta) {
-      stringstream ss;
-      ss << it->second << "+" << oct << right << delta;
-      return ss.str();
-    }
-  }
+  const string s = ss.str();
+  write(resultFD, s.data(), s.size());
+  cout << flush;
+  cerr << flush;
 
-  if (w.lhu != 0)
-    return w.fmt36();
-  else
-    return w.fmt18();
+  // Don't run exit handlers or destructors, which would reset the
+  // terminal and remove the original's shared memory objects.
+  _exit(0);
 }
 
 
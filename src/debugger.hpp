@@ -7,22 +7,31 @@ using namespace std;
 
 #include "word.hpp"
 #include "logger.hpp"
+#include "symbols.hpp"
 
 
-struct Debugger {
+struct Debugger: SymbolTable {
   Debugger(KM10 &aKM10);
+  ~Debugger();
   KM10 &km10;
+  Logger &logger;
   string prevLine;
   W36 lastAddr;
 
-  map<string, W36> globalSymbols;
-  map<string, W36> localSymbols;
-  map<string, W36> localInvisibleSymbols;
-  map<W36, string> valueToSymbol;
+  W36 switches;
 
-  bool verboseLoad;
+  // False for a machine with nobody at the console, like one of
+  // several run on their own threads. When it stops, KM10::emulate()
+  // just returns instead of prompting.
+  bool interactive;
 
-  W36 switches;
+  // Machine cloning with `fork`. In a clone `cloneNumber` is its index
+  // and `resultFD` is where it reports how it stopped. It is -1 in the
+  // original machine.
+  int cloneNumber;
+  int resultFD;
+  uint64_t cloneLimit;
+  uint64_t cloneStart;
 
   static constexpr size_t pcHistorySize = 1024;
 
@@ -56,8 +65,12 @@ struct Debugger {
   DebugAction debug();
 
   string dump(W36 w, W36 pc, bool showCharForm=false);
-  string symbolicForm(W36 w);
 
-  void loadREL(const char *fileNameP);
-  void loadWord(unsigned addr, W36 value);
+  // Clone the machine for the `fork` command. Returns in each clone
+  // with the action it should take, and in the original with `noop`
+  // after all the clones have stopped.
+  DebugAction forkClones(const vector<string> &args);
+
+  // Tell the original how this clone stopped and exit.
+  [[noreturn]] void reportCloneResult();
 };
@@ -10,7 +10,18 @@
 using namespace std;
 
 
-map<unsigned, Device *> Device::devices = {};
+Device::Device(unsigned anAddr, string aName, KM10 &cpu, bool aCanIntLevel0)
+  : ioAddress(anAddr),
+    name(aName),
+    km10(cpu),
+    logger(cpu.logger),
+    intLevel(0),
+    intPending(false),
+    canIntLevel0(aCanIntLevel0)
+{
+  km10.devices[ioAddress] = this;
+  if (ioAddress < km10.ioTable.size()) km10.ioTable[ioAddress] = {this, virtualIO};
+}
 
 
 // Return the device's interrupt function word for its highest
@@ -22,10 +33,22 @@ tuple<unsigned,W36> Device::getIntFuncWord() {
 }
 
 
-// Clear the I/O system by calling each device's clearIO() entry
-// point.
-void Device::clearAll() {
-  for (auto [ioDev, devP]: devices) devP->clearIO();
+// Interrupt functions done in the interrupt cycle. See device.hpp.
+void Device::intExamined(W36 ifw, W36 w) {}
+
+W36 Device::intDepositWord(W36 ifw) {
+  return 0;
+}
+
+void Device::intFunctionDone(W36 ifw, bool ok) {
+  clearInterrupt();
+}
+
+
+// Clear the I/O system by calling each of `km10`'s devices'
+// clearIO() entry point.
+void Device::clearAll(KM10 &km10) {
+  for (auto [ioDev, devP]: km10.devices) devP->clearIO();
 }
 
 
@@ -33,84 +56,147 @@ void Device::clearAll() {
 void Device::requestInterrupt()  {
   if (logger.ints) logger.s << " <<< interrupt requested >>>";
   intPending = true;
+  km10.pi.addRequest(this);
 }
 
 
-// Handle an I/O instruction by calling the appropriate device
-// driver's I/O instruction handler method.
-IResult Device::handleIO(W36 iw, W36 ea) {
-  Device *devP;
+// Withdraw our interrupt request, if we have one.
+void Device::clearInterrupt() {
+  if (!intPending) return;
+  intPending = false;
+  km10.pi.removeRequest(this);
+}
 
-  if (auto it = devices.find((unsigned) iw.ioDev); it != devices.end()) {
-    devP = it->second;
-  } else {
-    devP = devices.at(0777777ul);
-  }
 
-  assert(devP != nullptr);
+// Change our assigned level, moving any request we have pending.
+void Device::setIntLevel(unsigned level) {
+  if (level == intLevel) return;
+  if (intPending) km10.pi.removeRequest(this);
+  intLevel = level;
+  if (intPending) km10.pi.addRequest(this);
+}
 
-  switch (iw.ioOp) {
-  case W36::BLKI:
-    return devP->doBLKI(iw, ea);
 
-  case W36::DATAI:
-    return devP->doDATAI(iw, ea);
+void Device::saveState(MachineState &ms) {
+  ms.put(intLevel);
+  ms.put(intPending);
+}
 
-  case W36::BLKO:
-    return devP->doBLKO(iw, ea);
 
-  case W36::DATAO:
-    return devP->doDATAO(iw, ea);
+void Device::restoreState(MachineState &ms) {
+  clearInterrupt();
+  intLevel = ms.get();
 
-  case W36::CONO:
-    return devP->doCONO(iw, ea);
+  if (ms.get()) {
+    intPending = true;
+    km10.pi.addRequest(this);
+  }
+}
 
-  case W36::CONI:
-    return devP->doCONI(iw, ea);
 
-  case W36::CONSZ:
-    return devP->doCONSZ(iw, ea);
+// Handle an I/O instruction by calling the appropriate device
+// driver's I/O instruction handler method.
+IResult Device::handleIO(KM10 &km10, W36 iw, W36 ea) {
+  const KM10::IOEntry &io = km10.ioTable[iw.ioDev];
+  return io.handlers[iw.ioOp](io.devP, iw, ea);
+}
 
-  case W36::CONSO:
-    return devP->doCONSO(iw, ea);
 
-  default:
-    return IResult::iNYI;
-  }
-}
+const Device::IOHandlers Device::virtualIO{
+  [](Device *d, W36 iw, W36 ea) {return d->doBLKI(iw, ea);},
+  [](Device *d, W36 iw, W36 ea) {return d->doDATAI(iw, ea);},
+  [](Device *d, W36 iw, W36 ea) {return d->doBLKO(iw, ea);},
+  [](Device *d, W36 iw, W36 ea) {return d->doDATAO(iw, ea);},
+  [](Device *d, W36 iw, W36 ea) {return d->doCONO(iw, ea);},
+  [](Device *d, W36 iw, W36 ea) {return d->doCONI(iw, ea);},
+  [](Device *d, W36 iw, W36 ea) {return d->doCONSZ(iw, ea);},
+  [](Device *d, W36 iw, W36 ea) {return d->doCONSO(iw, ea);},
+};
 
 
 // I/O instruction handlers
 void Device::clearIO() {	// Default is to do mostly nothing
-  intPending = false;
+  clearInterrupt();
   intLevel = 0;
   putConditions(0);
 }
 
 
 IResult Device::doBLKI(W36 iw, W36 ea) {
-  W36 e{km10.memGetN(ea)};
-  km10.memPut(W36{++e.lhu, ++e.rhu});
-  doDATAI(iw, e.rhu);
-
-  if (e.lhu != 0) {
-    return IResult::iSkip;
-  } else {
-    return IResult::iNormal;
-  }
+  return doBLK(iw, ea, true);
 }
 
 
 IResult Device::doBLKO(W36 iw, W36 ea) {
+  return doBLK(iw, ea, false);
+}
+
+
+// BLKI and BLKO add one to both halves of the pointer word at `ea`,
+// move a word between the device and the address now in its right
+// half, and skip unless the count in its left half has run out. In
+// an interrupt vector the skip dismisses the interrupt, and running
+// out goes on to the instruction at 41+2n.
+//
+// In an interrupt vector, if the device says it has more than one
+// word ready we move them all now, leaving the pointer and the skip
+// as that many interrupts in a row would have left them.
+IResult Device::doBLK(W36 iw, W36 ea, bool in) {
   W36 e{km10.memGetN(ea)};
-  km10.memPut(W36{++e.lhu, ++e.rhu});
-  doDATAO(iw, e.rhu);
+  const unsigned left = e.lhu ? (W36::halfOnes + 1) - e.lhu : W36::halfOnes + 1;
+  const unsigned n = km10.inInterrupt ? min(blockReady(in, left), left) : 1;
 
-  if (e.lhu != 0) {
-    return IResult::iSkip;
+  if (n <= 1) {
+    e = W36{(e.lhu + 1) & W36::halfOnes, (e.rhu + 1) & W36::halfOnes};
+    km10.memPutN(e, ea);
+
+    // The device's DATAI and DATAO handlers use the CPU's `ea`.
+    km10.ea.rhu = e.rhu;
+
+    if (in)
+      doDATAI(iw, km10.ea);
+    else
+      doDATAO(iw, km10.ea);
   } else {
-    return IResult::iNormal;
+    unsigned k = 0;
+
+    // A page fail leaves the pointer as it would be had the failing
+    // word been the only one.
+    try {
+
+      for (; k < n; ++k) {
+	const W36 a{ea.lhu, (e.rhu + k + 1) & W36::halfOnes};
+
+	if (in)
+	  km10.memPutN(blockInWord(), a);
+	else
+	  blockOutWord(km10.memGetN(a));
+      }
+    } catch (const PAGDevice::PageFail &) {
+      km10.memPutN(W36{(e.lhu + k + 1) & W36::halfOnes, (e.rhu + k + 1) & W36::halfOnes}, ea);
+      throw;
+    }
+
+    e = W36{(e.lhu + n) & W36::halfOnes, (e.rhu + n) & W36::halfOnes};
+    km10.memPutN(e, ea);
   }
+
+  return e.lhu != 0 ? IResult::iSkip : IResult::iNormal;
+}
+
+
+// By default devices move a word per interrupt.
+unsigned Device::blockReady(bool in, unsigned n) {
+  return 1;
+}
+
+
+W36 Device::blockInWord() {
+  return 0;
+}
+
+
+void Device::blockOutWord(W36 w) {
 }
 
 
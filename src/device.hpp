@@ -1,5 +1,6 @@
 #pragma once
 #include <cstdint>
+#include <array>
 #include <map>
 #include <assert.h>
 
@@ -8,6 +9,7 @@ using namespace std;
 #include "word.hpp"
 #include "logger.hpp"
 #include "iresult.hpp"
+#include "machstate.hpp"
 
 
 class KM10;
@@ -16,25 +18,16 @@ struct Device {
   unsigned ioAddress;
   string name;
   KM10 &km10;			// The CPU we belong to.
+  Logger &logger;		// Our CPU's logger.
   unsigned intLevel;
   bool intPending;
 
   // Set this in DTE20 device so it can cause interrupts on level #0.
   bool canIntLevel0;
 
-  static map<unsigned, Device *> devices;
-
-  // Constructors
-  Device(unsigned anAddr, string aName, KM10 &cpu, bool aCanIntLevel0 = false)
-    : ioAddress(anAddr),
-      name(aName),
-      km10(cpu),
-      intLevel(0),
-      intPending(false),
-      canIntLevel0(aCanIntLevel0)
-  {
-    devices[ioAddress] = this;
-  }
+  // Constructors. We add ourselves to our CPU's `devices` and
+  // `ioTable`.
+  Device(unsigned anAddr, string aName, KM10 &cpu, bool aCanIntLevel0 = false);
 
 
   // Return the device's interrupt function word for its highest
@@ -44,18 +37,63 @@ struct Device {
   virtual tuple<unsigned,W36> getIntFuncWord();
 
 
-  // Clear the I/O system by calling each device's clearIO() entry
-  // point.
-  static void clearAll();
+  // The PI system does the increment, examine, deposit, and byte
+  // interrupt functions in the interrupt cycle itself. Examine (and a
+  // byte transfer toward the 11) hands us the word it got with
+  // intExamined(). Deposit (and a byte transfer toward the 10) asks
+  // us for the word with intDepositWord(). When the function is over
+  // we get intFunctionDone(), with `ok` false if it failed. By
+  // default that drops our request.
+  virtual void intExamined(W36 ifw, W36 w);
+  virtual W36 intDepositWord(W36 ifw);
+  virtual void intFunctionDone(W36 ifw, bool ok);
+
+
+  // Clear the I/O system by calling each of `km10`'s devices'
+  // clearIO() entry point.
+  static void clearAll(KM10 &km10);
 
 
   // Request an interrupt at this Device's assigned level.
   virtual void requestInterrupt();
 
+  // Withdraw our interrupt request, if we have one.
+  void clearInterrupt();
+
+  // Change our assigned level, moving any request we have pending.
+  void setIntLevel(unsigned level);
+
 
   // Handle an I/O instruction by calling the appropriate device
   // driver's I/O instruction handler method.
-  static IResult handleIO(W36 iw, W36 ea);
+  static IResult handleIO(KM10 &km10, W36 iw, W36 ea);
+
+  // An I/O instruction handler for each W36::IOOp, as KM10's
+  // `ioTable` holds them. `virtualIO` calls our virtual methods and
+  // works for any device. `directIO<D>` calls class D's methods
+  // without virtual dispatch, for devices whose exact class we know.
+  typedef IResult (*IOHandler)(Device *devP, W36 iw, W36 ea);
+  typedef array<IOHandler, 8> IOHandlers;
+
+  static const IOHandlers virtualIO;
+
+  template <class D>
+  static const inline IOHandlers directIO{
+    [](Device *d, W36 iw, W36 ea) {return static_cast<D *>(d)->D::doBLKI(iw, ea);},
+    [](Device *d, W36 iw, W36 ea) {return static_cast<D *>(d)->D::doDATAI(iw, ea);},
+    [](Device *d, W36 iw, W36 ea) {return static_cast<D *>(d)->D::doBLKO(iw, ea);},
+    [](Device *d, W36 iw, W36 ea) {return static_cast<D *>(d)->D::doDATAO(iw, ea);},
+    [](Device *d, W36 iw, W36 ea) {return static_cast<D *>(d)->D::doCONO(iw, ea);},
+    [](Device *d, W36 iw, W36 ea) {return static_cast<D *>(d)->D::doCONI(iw, ea);},
+    [](Device *d, W36 iw, W36 ea) {return static_cast<D *>(d)->D::doCONSZ(iw, ea);},
+    [](Device *d, W36 iw, W36 ea) {return static_cast<D *>(d)->D::doCONSO(iw, ea);},
+  };
+
+
+  // Save and restore our state for checkpoints and snapshots.
+  // Subclasses with state of their own call these first.
+  virtual void saveState(MachineState &ms);
+  virtual void restoreState(MachineState &ms);
 
 
   // I/O instruction handlers
@@ -67,6 +105,17 @@ struct Device {
   // This is for CONO to write conditions.
   virtual void putConditions(unsigned v) = 0;
 
+  // BLKI and BLKO from an interrupt vector can move a run of words
+  // instead of one per interrupt. blockReady() says how many of the
+  // `n` words the pointer has left the device could move right now,
+  // as if it interrupted for each one back to back. With more than
+  // one, blockInWord() and blockOutWord() move them. Otherwise the
+  // word goes through doDATAI() or doDATAO() as usual.
+  IResult doBLK(W36 iw, W36 ea, bool in);
+  virtual unsigned blockReady(bool in, unsigned n);
+  virtual W36 blockInWord();
+  virtual void blockOutWord(W36 w);
+
   virtual IResult doDATAI(W36 iw, W36 ea);
   virtual IResult doDATAO(W36 iw, W36 ea);
   virtual IResult doBLKI(W36 iw, W36 ea);
@@ -4,11 +4,15 @@
 #include <unistd.h>
 #include <termios.h>
 #include <poll.h>
+#include <sys/uio.h>
 #include <cstdlib>
 #include <cstdio>
+#include <cerrno>
+#include <ctime>
 
 #include <stdexcept>
 #include <thread>
+#include <chrono>
 #include <signal.h>
 
 using namespace std;
@@ -17,9 +21,9 @@ using namespace std;
 #include "device.hpp"
 #include "km10.hpp"
 #include "logger.hpp"
-#include "tsqueue.hpp"
 #include "dte20.hpp"
 #include "iresult.hpp"
+#include "bytepointer.hpp"
 
 
 DTE20::DTE20(unsigned anAddr, KM10 &cpu)
@@ -27,42 +31,43 @@ DTE20::DTE20(unsigned anAddr, KM10 &cpu)
 	   string("DTE20.") + to_string(anAddr & 3),
 	   cpu,
 	   true),
+    status(0),
     protocolMode(SECONDARY),
-    genericConditions(0),
+    consoleP(nullptr),
+    noticesP(&cerr),
+    reportDiagNotice(nullptr),
+    consoleIOThreadDone(false),
     isConnected(false),
-    console("/dev/tty"),
-    endl{"\n"}
-{
-  ttyFD = open("/dev/tty", O_RDWR);
-  if (ttyFD < 0) throw runtime_error("can't open /dev/tty");
+    endl{"\n"},
+    ctyFlushNow(false),
+    attention(false),
+    to11Count(0),
+    to10Count(0),
+    to10Offset(0),
+    to10Posted(false)
+{}
 
-  if (!isatty(ttyFD)) throw runtime_error("MUST be run on a terminal without redirection");
-
-  // Save current termios settings to restore on exit
-  int st = tcgetattr(ttyFD, &origTermios);
-  if (st < 0) throw runtime_error("failed to tcgetattr for tty");
-
-  /* register the tty reset with the exit handler */
-  if (atexit(resetTTY) != 0) throw runtime_error("atexit: can't register tty reset");
+DTE20::~DTE20() {
+  disconnect();
+  delete consoleP;
 }
 
-DTE20::~DTE20() {
+
+void DTE20::setConsole(Console *aConsoleP) {
   disconnect();
+  delete consoleP;
+  consoleP = aConsoleP;
 }
 
 
 void DTE20::connect() {
-  setRaw();
-  endl = "\r\n";
-
-  int pipeFDs[2];
-  int st = pipe(pipeFDs);
-  if (st < 0) perror("Error creation console I/O pipe");
+  if (!consoleP) return;
 
-  fromIOLoopFD = pipeFDs[0];
-  toIOLoopFD = pipeFDs[1];
+  consoleP->connect();
+  endl = "\r\n";
 
-  consoleIOThread = thread(&consoleIOLoop);
+  consoleIOThreadDone = false;
+  consoleIOThread = thread(&DTE20::consoleIOLoop, this);
   isConnected = true;
 }
 
@@ -71,12 +76,10 @@ void DTE20::disconnect() {
 
   if (isConnected) {
     consoleIOThreadDone = true;
-    write(toIOLoopFD, "bye", 3);
+    ioWaker.wake();
     consoleIOThread.join();
-    close(fromIOLoopFD);
-    close(toIOLoopFD);
     isConnected = false;
-    if (isRaw) setNormal();
+    consoleP->disconnect();
     endl = "\n";
   }
 }
@@ -89,22 +92,162 @@ void DTE20::clearIO() {
 
 
 unsigned DTE20::getConditions() {
-  return genericConditions;
+  return status.u;
 }
 
 
 void DTE20::putConditions(unsigned v) {
-  genericConditions = v;
+  status.u = v;
+  updateInterrupt();
+}
+
+
+void DTE20::saveState(MachineState &ms) {
+  Device::saveState(ms);
+  ms.put(status.u);
+  ms.put(protocolMode);
+  ms.put(to11Count);
+  ms.put(to10Count);
+}
+
+
+void DTE20::restoreState(MachineState &ms) {
+  Device::restoreState(ms);
+  status.u = ms.get();
+  protocolMode = ms.get() == PRIMARY ? PRIMARY : SECONDARY;
+  to11Count = ms.get();
+  to10Count = ms.get();
+  to11Packet.clear();
+  to10Q.clear();
+  to10Offset = 0;
+  to10Posted = false;
 }
 
 
+tuple<unsigned,W36> DTE20::getIntFuncWord() {
+  W36 ifw(0);
+  ifw.intFunction = W36::vectorIF;
+  ifw.addrSpace = W36::physical;
+  ifw.intAddr = km10.physAddressFor(&km10.eptP->dte[ioAddress & 3].vectorInsn).u;
+  return tuple<unsigned,W36>(intLevel, ifw);
+}
+
+
+void DTE20::updateInterrupt() {
+  setIntLevel(status.pia);
+
+  if (intLevel != 0 &&
+      (status.to10Doorbell || status.to10Done || status.to11Done || status.to10Error || status.to11Error))
+  {
+    if (!intPending) requestInterrupt();
+  } else {
+    clearInterrupt();
+  }
+}
+
+
+// The CPU calls this between instructions when the console I/O
+// thread has flagged that there's CTY input. In primary protocol it
+// goes to the 10 as line/character pairs for the CTY's line (zero).
+// In secondary protocol we hand it over a character at a time with a
+// to-10 doorbell interrupt, as the front end does, once the program
+// has assigned us a PI level. Until then the program asks for input
+// with the ctyInput command.
+void DTE20::service() {
+  attention = false;
+
+  if (protocolMode == PRIMARY) {
+    vector<uint8_t> data;
+
+    for (char ch; data.size() < 256 && ctyInQ.dequeue(ch); ) {
+      data.push_back(0);
+      data.push_back(ch);
+    }
+
+    if (data.empty()) return;
+    ioWaker.wake();		// The I/O thread may be waiting for room
+    sendPacket(emLineChar, devDLS, data);
+  } else {
+    if (status.pia == 0 || ctyInQ.isEmpty()) return;
+
+    // The program clears this when it has taken the last character
+    // we gave it. Until then we look again after each instruction.
+    if (km10.eptP->DTEKLNotReadyForChar != W36(0)) {
+      attention = true;
+      return;
+    }
+
+    char ch;
+    ctyInQ.dequeue(ch);
+    ioWaker.wake();		// The I/O thread may be waiting for room
+
+    km10.eptP->DTEto10Arg = ch & 0177;
+    km10.eptP->DTEKLNotReadyForChar = W36::all1s;
+    status.to10Doorbell = 1;
+    updateInterrupt();
+    if (logger.dte) logger.s << "; DTE posted ctyIn " << oct << (int) (ch & 0177);
+  }
+
+  // Come back for whatever is left.
+  if (!ctyInQ.isEmpty()) attention = true;
+}
+
+
+// DATAO DTE, starts a to-10 transfer of the byte count in E. The
+// count is negative in the low twelve bits, as the DTE20's to-10 byte
+// count register wants it.
+IResult DTE20::doDATAO(W36 iw, W36 ea) {
+  W36 e{km10.memGetN(ea)};
+  const unsigned count = (-e.rhu) & 07777;
+  if (logger.dte) logger.s << "; DTE DATAO count=" << oct << count;
+
+  if (protocolMode != PRIMARY || to10Q.empty()) {
+    status.to10Error = 1;
+    updateInterrupt();
+    return IResult::iNormal;
+  }
+
+  vector<uint8_t> &packet = to10Q.front();
+  const size_t n = min<size_t>(count, packet.size() - to10Offset);
+
+  if (!transferBytes(km10, km10.eptP->dte[ioAddress & 3].to10BP, packet.data() + to10Offset, n, true)) {
+    status.to10Error = 1;
+  } else {
+    to10Offset += n;
+    status.to10Done = 1;
+
+    if (to10Offset >= packet.size()) {
+      to10Q.pop_front();
+      to10Offset = 0;
+      to10Posted = false;
+    }
+  }
+
+  updateInterrupt();
+  return IResult::iNormal;
+}
+
 
 IResult DTE20::doCONO(W36 iw, W36 ea) {
-  putConditions(ea.rhu);
   CONOMask req(ea);
   if (logger.dte) logger.s << "; DTE CONO " << oct << ea;
 
-  if (req.to11Doorbell) {
+  if (req.loadPI) {
+    status.pia = req.pia;
+    status.pi0Enable = req.pi0Enable;
+  }
+
+  if (req.clearTo10) status.to10Done = status.to10Error = 0;
+  if (req.clearTo11) status.to11Done = status.to11Error = 0;
+  if (req.clearTo10Doorbell) status.to10Doorbell = 0;
+
+  // Input that was waiting for a PI level or for the program to take
+  // the last character may be deliverable now.
+  if ((req.loadPI || req.clearTo10Doorbell) && !ctyInQ.isEmpty()) attention = true;
+
+  if (req.to11Doorbell && protocolMode == PRIMARY) {
+    primaryDoorbell();
+  } else if (req.to11Doorbell) {
     char buf;
 
     MonitorCommand mc{km10.eptP->DTEto11Arg.rhu};
@@ -112,24 +255,30 @@ IResult DTE20::doCONO(W36 iw, W36 ea) {
     if (logger.dte) logger.s << " to11DoorBell arg=" << oct << km10.eptP->DTEto11Arg.rhu
 			     << " data=" << mc.data << " fn=" << mc.fn << endl;
 
+    // Our notices are written directly, so let the CTY output before
+    // them come out first.
+    if (mc.fn == diagNotice || mc.fn == clockControl || mc.fn == getSwitches ||
+	mc.fn == enterSecondaryProtocol || mc.fn == enterPrimaryProtocol)
+      waitForCTY();
+
     switch (mc.fn) {
     case clockControl:		// Control/read the 60Hz clock interrupt from FE.
 
       switch (mc.data) {
       case 000:
-	cerr << "[Clock is now OFF]" << endl;
+	*noticesP << "[Clock is now OFF]" << endl;
 	break;
 
       case 001:
-	cerr << "[Clock is now ON]" << endl;
+	*noticesP << "[Clock is now ON]" << endl;
 	break;
 
       case 003:
-	cerr << "[Reading FE 60Hz clock (NYI)]" << endl;
+	*noticesP << "[Reading FE 60Hz clock (NYI)]" << endl;
 	break;
 
       default:
-	cerr << "[unknown clockControl " << oct << mc.data << "]" << endl;
+	*noticesP << "[unknown clockControl " << oct << mc.data << "]" << endl;
 	break;
       }
 
@@ -140,15 +289,26 @@ IResult DTE20::doCONO(W36 iw, W36 ea) {
     case ctyInputDirect:
     case ctyInput:
 
-      if (ctyQ.isEmpty()) {
-	//	  cerr << "ctyIn [empty]" << endl;
+      if (status.to10Doorbell && km10.eptP->DTEKLNotReadyForChar != W36(0)) {
+	// We've already posted a character with the doorbell and it's
+	// still in DTEto10Arg. The program asked instead of taking the
+	// interrupt, so this is its answer.
+	km10.eptP->DTEKLNotReadyForChar = 0;
+	status.to10Doorbell = 0;
+	if (!ctyInQ.isEmpty()) attention = true;
+      } else if (!ctyInQ.dequeue(buf)) {
 	km10.eptP->DTEto10Arg.rhu = 0;
+
+	// The program is waiting for input, so whatever it said last
+	// (like a prompt) should be on the screen now.
+	flushCTY();
       } else {
-	buf = ctyQ.dequeue() & 0177;
-	cerr << "ctyIn [got "
-	     << hex << setw(2) << setfill('0')
-	     << (int) buf << "]" << endl;
+	buf &= 0177;
+	if (logger.dte) logger.s << " ctyIn [got " << oct << (int) buf << "]";
 	km10.eptP->DTEto10Arg.rhu = buf;
+
+	// The I/O thread may be waiting for room in the ring.
+	ioWaker.wake();
       }
 
       // Acknowledge the command. (rsxt20.l20:5980)
@@ -159,8 +319,7 @@ IResult DTE20::doCONO(W36 iw, W36 ea) {
     case ctyForcedOutput:
     case ctyOutput:
       // In RSX-20F this is an ELSE case vs function numbers 13, 12, 11 (rsxt20.l20:6017).
-      buf = mc.data;
-      write(1, &buf, 1);
+      putCTY(mc.data);
 
       // Acknowledge the command. (rsxt20.l20:5924)
       km10.eptP->DTEMonitorOpComplete = W36(-2 & 0xFFFF);
@@ -169,126 +328,453 @@ IResult DTE20::doCONO(W36 iw, W36 ea) {
       break;
 
     case enterSecondaryProtocol:
-      cerr << "DTE20 enter secondary protocol command with data " << mc.data << " (ignored)."
+      *noticesP << "DTE20 enter secondary protocol command with data " << mc.data << " (ignored)."
 	   << endl;
       break;
 
     case enterPrimaryProtocol:
-      cerr << "DTE20 enter primary protocol command with data " << mc.data << " (ignored)."
-	   << endl;
+      *noticesP << "[DTE20 entering primary protocol]" << endl;
+      enterPrimary();
       break;
 
     case getSwitches:
       km10.eptP->DTEto10Arg = km10.debugger.switches;
-      cerr << "[Get switches " << km10.eptP->DTEto10Arg.fmt36() << "]" << endl;
+      *noticesP << "[Get switches " << km10.eptP->DTEto10Arg.fmt36() << "]" << endl;
 
       // Acknowledge the command. (rsxt20.l20:5980)
       km10.eptP->DTEMonitorOpComplete = W36(-2 & 0xFFFF);
-      cerr << flush;
+      *noticesP << flush;
       break;
 
     case diagNotice:
+      if (reportDiagNotice) reportDiagNotice((DiagNotice) mc.data);
 
       switch (mc.data) {
-      case 005:			// Get clock default word
-	cerr << "[Get default clock word (NYI)]" << endl;
+      case getClockDefault:	// Get clock default word
+	*noticesP << "[Get default clock word (NYI)]" << endl;
 	break;
 
-      case 004:			// End of PASS
-	cerr << "[End of diagnostic PASS]" << endl;
+      case endOfPass:
+	*noticesP << "[End of diagnostic PASS]" << endl;
 	break;
 
-      case 003:
-	cerr << "[End of diagnostic RUN]" << endl;
+      case endOfRun:
+	*noticesP << "[End of diagnostic RUN]" << endl;
 	break;
 
-      case 002:			// End of PASS HALT
-	cerr << "[End of diagnostic FAIL HALT]" << endl;
+      case failHalt:		// End of PASS HALT
+	*noticesP << "[End of diagnostic FAIL HALT]" << endl;
 	km10.running = false;
 	break;
 
-      case 001:			// Program error
-	cerr << "[Diagnostic PROGRAM ERROR]" << endl;
+      case programError:
+	*noticesP << "[Diagnostic PROGRAM ERROR]" << endl;
 	km10.running = false;
 	break;
 
       default:
-	cerr << "[Unknown diagNotice status=" << oct << mc.data << "]" << endl;
+	*noticesP << "[Unknown diagNotice status=" << oct << mc.data << "]" << endl;
 	break;
       }
 
       // Acknowledge the command. (rsxt20.l20:5980)
       km10.eptP->DTEMonitorOpComplete = W36(-2 & 0xFFFF);
-      cerr << flush;
+      *noticesP << flush;
       break;
     }
-  } else {
+  } else if (!req.loadPI && !req.clearTo10 && !req.clearTo11 && !req.clearTo10Doorbell) {
     logger.nyi(km10);
   }
 
+  // When the 10 has taken all of one packet and cleared its done
+  // flag, offer it the next.
+  if (protocolMode == PRIMARY && !to10Q.empty() && !to10Posted && !status.to10Done) postTo10();
+
+  updateInterrupt();
   return IResult::iNormal;
 }
 
 
-// TTY handlers and stuff
-void DTE20::consoleIOLoop() {
-  struct pollfd polls[] = {
-    {.fd=ttyFD, .events=POLLIN, .revents=0},
-    {.fd=fromIOLoopFD, .events=POLLIN, .revents=0},
-  };
+////////////////////////////////////////////////////////////////
+// Primary protocol.
+//
+// We play the part of RSX-20F on the front end. The 10 queues a
+// packet for us by pointing its to-11 byte pointer in the EPT at it,
+// putting its size in `cmQueueCount` and bumping `cm10Count` in its
+// area of the communications region, and ringing our doorbell. We
+// take the whole packet in one transfer and set to-11 done. A packet
+// whose function has `emIndirect` set brings only its header this
+// way. The 10 then points the byte pointer at the data, sets
+// `cmIndirect`, and rings again.
+//
+// For a packet to the 10 we put its size and count in our area and
+// ring the 10's doorbell. It points its to-10 byte pointer at a
+// buffer and starts the transfer with DATAO (perhaps once for the
+// header and again for the rest), and we copy the bytes at once and
+// set to-10 done.
+//
+// Each of these ends in one interrupt through the DTE's EPT vector,
+// where the hardware would have taken one per byte.
+
+void DTE20::enterPrimary() {
+  protocolMode = PRIMARY;
+  W36 *stsP = commWordP(false, cmStatus);
+  to11Count = stsP ? stsP->u & cm10Count : 0;
+  to10Count = 0;
+  to11Packet.clear();
+  to10Q.clear();
+  to10Offset = 0;
+  to10Posted = false;
+
+  // Tell the 10 all our lines are ready for output.
+  sendPacket(emAckAll, devDLS, {});
+}
 
-  while (true) {
-    int st = poll(polls, sizeof(polls) / sizeof(polls[0]), -1);
 
-    if (st < 0) {
-      perror("Error polling for console I/O");
-      continue;
+// Return a pointer to a word of the 10's area (`toTen` false) or ours
+// in the communications region, or nullptr if it's out of reach. The
+// areas are relocated by the examine and deposit area words in our
+// part of the EPT, and we can't reach past their sizes.
+W36 *DTE20::commWordP(bool toTen, unsigned offset) {
+  auto &cb = km10.eptP->dte[ioAddress & 3];
+  const W36 &reloc = toTen ? cb.depositAreaReloc : cb.examineAreaReloc;
+  const W36 &size = toTen ? cb.depositAreaSize : cb.examineAreaSize;
+
+  if (offset >= size.rhu) return nullptr;
+  return &km10.pag.physWord(reloc.rhu + offset);
+}
+
+
+// The 10 has rung our doorbell.
+void DTE20::primaryDoorbell() {
+  auto &cb = km10.eptP->dte[ioAddress & 3];
+  W36 *stsP = commWordP(false, cmStatus);
+  W36 *countP = commWordP(false, cmQueueCount);
+
+  if (!stsP || !countP) {
+    status.to11Error = 1;
+    return;
+  }
+
+  const W36 sts = *stsP;
+
+  // Is this the indirect data for the last packet's header?
+  if (!to11Packet.empty()) {
+    if ((sts.u & cmIndirect) == 0) return;
+
+    const unsigned total = (to11Packet[0] << 8) | to11Packet[1];
+    const size_t have = to11Packet.size();
+    to11Packet.resize(max<size_t>(total, have));
+
+    if (!transferBytes(km10, cb.to11BP, to11Packet.data() + have, to11Packet.size() - have, false)) {
+      status.to11Error = 1;
+      to11Packet.clear();
+      return;
+    }
+
+    status.to11Done = 1;
+    vector<uint8_t> packet;
+    packet.swap(to11Packet);
+    handleTo11Packet(packet);
+    return;
+  }
+
+  // Otherwise it's a new packet if the 10's count has changed.
+  const unsigned count = sts.u & cm10Count;
+  if (count == to11Count) return;
+  to11Count = count;
+
+  vector<uint8_t> packet(countP->rhu & 0177777);
+
+  if (packet.size() < headerBytes || !transferBytes(km10, cb.to11BP, packet.data(), packet.size(), false)) {
+    status.to11Error = 1;
+    return;
+  }
+
+  status.to11Done = 1;
+  const unsigned fn = (packet[2] << 8) | packet[3];
+
+  if ((fn & emIndirect) != 0)
+    to11Packet.swap(packet);	// Wait for the rest
+  else
+    handleTo11Packet(packet);
+}
+
+
+void DTE20::handleTo11Packet(const vector<uint8_t> &packet) {
+  const unsigned fn = ((packet[2] << 8) | packet[3]) & ~emIndirect;
+  const unsigned dev = (packet[4] << 8) | packet[5];
+  const uint8_t *dataP = packet.data() + headerBytes;
+  const size_t nData = packet.size() - headerBytes;
+
+  if (logger.dte) logger.s << " to-11 packet fn=" << oct << fn << " dev=" << dev << " bytes=" << nData;
+
+  switch (fn) {
+  case emString:
+    for (size_t k=0; k < nData; ++k) putCTY(dataP[k]);
+
+    // Tell the 10 it can send the CTY more.
+    sendPacket(emAck, dev, {0, 0});
+    break;
+
+  case emLineChar:
+    // Pairs of line number and character. We have only the CTY.
+    for (size_t k=0; k + 1 < nData; k += 2) putCTY(dataP[k+1]);
+    sendPacket(emAck, dev, {0, 0});
+    break;
+
+  case emRequestStatus:
+    sendPacket(emHereIsStatus, dev, {0, 0, 0, 0});
+    break;
+
+  case emRequestDateTime: {
+    // Validity flag, year, month (from zero), day (from zero), day of
+    // week (from Monday), daylight saving flag, and seconds since
+    // midnight divided by two, each a 16-bit word.
+    const time_t now = time(nullptr);
+    struct tm tm;
+    localtime_r(&now, &tm);
+
+    const unsigned words[] = {
+      0100000,
+      (unsigned) tm.tm_year + 1900,
+      (unsigned) tm.tm_mon,
+      (unsigned) tm.tm_mday - 1,
+      (unsigned) (tm.tm_wday + 6) % 7,
+      tm.tm_isdst > 0 ? 1u : 0u,
+      (unsigned) (tm.tm_hour * 3600 + tm.tm_min * 60 + tm.tm_sec) / 2,
+    };
+
+    vector<uint8_t> data;
+
+    for (unsigned w: words) {
+      data.push_back(w >> 8);
+      data.push_back(w);
     }
 
-    if ((polls[0].revents & POLLIN) != 0) {
-      char buf;
-      int st = read(ttyFD, &buf, sizeof(buf));
-      if (st < 0) throw runtime_error("Error in console TTY read()");
+    sendPacket(emHereIsDateTime, devClock, data);
+    break;
+  }
+
+  case emFlushOutput:
+  case emAck:
+  case emAckAll:
+    break;
 
-      if (buf == 0x1C) {
-	cerr << "[control-\\]\r\n" << flush;
-	kill(getpid(), SIGINT);
+  default:
+    waitForCTY();
+    *noticesP << "[DTE20 primary protocol function " << oct << fn << " for device " << dev
+	      << " (ignored)]" << endl;
+    break;
+  }
+}
+
+
+// Queue a packet for the 10, and ring its doorbell if it isn't busy
+// with another.
+void DTE20::sendPacket(unsigned fn, unsigned dev, const vector<uint8_t> &data) {
+  const unsigned n = headerBytes + data.size();
+  vector<uint8_t> packet{
+    (uint8_t) (n >> 8), (uint8_t) n,
+    (uint8_t) (fn >> 8), (uint8_t) fn,
+    (uint8_t) (dev >> 8), (uint8_t) dev,
+    0, 0,
+  };
+
+  packet.insert(packet.end(), data.begin(), data.end());
+  to10Q.push_back(packet);
+
+  if (!to10Posted && !status.to10Done) postTo10();
+  updateInterrupt();
+}
+
+
+// Tell the 10 about the first packet in `to10Q`.
+void DTE20::postTo10() {
+  W36 *stsP = commWordP(true, cmStatus);
+  W36 *countP = commWordP(true, cmQueueCount);
+
+  if (!stsP || !countP) {
+    status.to10Error = 1;
+    return;
+  }
+
+  to10Count = (to10Count + 1) & cm11Count;
+  *countP = to10Q.front().size();
+  *stsP = cmQueuedProtocol | to10Count;
+  to10Posted = true;
+  status.to10Doorbell = 1;
+}
+
+
+// Move `n` bytes between `bufP` and the 10's memory through the byte
+// pointer `bp` from a DTE20's part of the EPT, updating `bp` as the
+// DTE20's byte transfer hardware would one byte at a time. PI's byte
+// interrupt function uses this too. The pointer must
+// be a one word local pointer without indexing or indirection, and it
+// addresses exec virtual memory. Returns false on a bad pointer or a
+// page fail.
+bool DTE20::transferBytes(KM10 &km10, W36 &bp, uint8_t *bufP, size_t n, bool toTen) {
+  BytePointerL1 p(bp);
+
+  if (p.i || p.x || p.s == 0 || p.s > 36) return false;
+
+  try {
+    W36 *wordP = nullptr;
+
+    for (size_t k=0; k < n; ++k) {
+
+      // Increment first, as ILDB and IDPB do.
+      if (p.s > p.p) {
+	p.p = 36 - p.s;
+	p.y = (p.y + 1) & W36::halfOnes;
+	wordP = nullptr;
       } else {
-	cerr << "[" << setw(2) << setfill('0') << hex << (int) buf << "]\r\n" << flush;
-	ctyQ.enqueue(buf);
+	p.p -= p.s;
       }
-    }
 
-    // Handle messages from our parent thread (usually we're just
-    // told to fuck off and die).
-    if ((polls[1].revents & POLLIN) != 0) {
-      return;			// XXX for now just fuck off on any pipe data
+      if (!wordP) wordP = toTen ? km10.pag.writeP(W36(p.y), false) : km10.pag.readP(W36(p.y), false);
+
+      if (toTen)
+	wordP->u = (wordP->u & ~W36::bMask(p.p, p.s)) | ((bufP[k] & W36::rMask(p.s)) << p.p);
+      else
+	bufP[k] = (wordP->u >> p.p) & W36::rMask(p.s);
     }
+  } catch (const PAGDevice::PageFail &) {
+    return false;
   }
+
+  bp = W36(p.u);
+  return true;
 }
 
 
-// reset tty - useful also for restoring the terminal when this
-// process wishes to temporarily relinquish the tty.
-void DTE20::resetTTY() {
-  /* flush and reset */
-  if (isRaw) setNormal();
+// TTY handlers and stuff
+
+// Send `ch` to the CTY by way of the console I/O thread. To keep
+// system calls down we only wake the thread for a newline or when the
+// ring is getting full. Otherwise it writes what's there when
+// `ctyFlushMS` has passed since the first character of the batch.
+void DTE20::putCTY(char ch) {
+  if (!isConnected) return;
+
+  const bool wasEmpty = ctyOutQ.isEmpty();
+
+  // If the console can't keep up, wait for it.
+  while (!ctyOutQ.enqueue(ch)) {
+    flushCTY();
+    this_thread::yield();
+  }
+
+  if (ch == '\n' || ctyOutQ.size() >= ctyOutQ.capacity / 2)
+    flushCTY();
+  else if (wasEmpty)
+    ioWaker.wake();		// To start the timer
 }
 
 
-void DTE20::setNormal() {
-  tcsetattr(ttyFD, TCSAFLUSH, &origTermios);
-  isRaw = false;
+// Ask the console I/O thread to write CTY output now.
+void DTE20::flushCTY() {
+  if (!isConnected || ctyOutQ.isEmpty()) return;
+  ctyFlushNow = true;
+  ioWaker.wake();
 }
 
 
-// Put terminal in Raw mode - see termios(3) for modes.
-void DTE20::setRaw() {
-  struct termios raw{origTermios};
-  cfmakeraw(&raw);
+// Wait until the console I/O thread has written all CTY output.
+void DTE20::waitForCTY() {
+  while (isConnected && !ctyOutQ.isEmpty()) {
+    flushCTY();
+    this_thread::yield();
+  }
+}
+
+
+// Write everything in the CTY output ring to the console.
+void DTE20::drainCTYOutput() {
+  const char *p0, *p1;
+  size_t n0, n1;
+
+  if (ctyOutQ.peek(p0, n0, p1, n1) == 0) return;
+
+  struct iovec iov[] = {
+    {.iov_base=(void *) p0, .iov_len=n0},
+    {.iov_base=(void *) p1, .iov_len=n1},
+  };
+
+  consoleP->writeOutputV(iov, n1 == 0 ? 1 : 2);
+  ctyOutQ.consume(n0 + n1);
+}
+
+
+void DTE20::consoleIOLoop() {
+  using Clock = chrono::steady_clock;
+  Clock::time_point flushDeadline{Clock::time_point::max()};
+
+  while (true) {
+    int timeout = -1;
+
+    if (!ctyOutQ.isEmpty()) {
+      const auto now = Clock::now();
+
+      if (ctyFlushNow.exchange(false) || now >= flushDeadline) {
+	drainCTYOutput();
+	flushDeadline = Clock::time_point::max();
+      } else {
+	if (flushDeadline == Clock::time_point::max()) flushDeadline = now + chrono::milliseconds(ctyFlushMS);
+	timeout = chrono::ceil<chrono::milliseconds>(flushDeadline - now).count();
+      }
+    }
+
+    // When the input ring is full we leave the console's input where
+    // it is until the CPU makes room and wakes us.
+    const bool wantInput = !ctyInQ.isFull();
+
+    // A console's input descriptor can change (e.g., when a socket
+    // client connects), so ask every time.
+    struct pollfd polls[] = {
+      {.fd=wantInput ? consoleP->inputFD() : -1, .events=POLLIN, .revents=0},
+      {.fd=ioWaker.fd, .events=POLLIN, .revents=0},
+    };
+
+    ioWaker.prepareToSleep();
 
-  // Put terminal in Raw mode after flushing
-  if (tcsetattr(ttyFD, TCSAFLUSH, &raw) < 0) throw runtime_error("can't set TTY Raw mode");
+    // Anything that came in while we were busy means we don't sleep.
+    if (consoleIOThreadDone || ctyFlushNow || (!wantInput && !ctyInQ.isFull())) timeout = 0;
+    if (timeout < 0 && !ctyOutQ.isEmpty()) timeout = 0;
 
-  isRaw = true;
+    int st = poll(polls, sizeof(polls) / sizeof(polls[0]), timeout);
+    ioWaker.awake();
+
+    if (st < 0) {
+      if (errno != EINTR) perror("Error polling for console I/O");
+      continue;
+    }
+
+    if ((polls[1].revents & POLLIN) != 0) ioWaker.drain();
+
+    if (consoleIOThreadDone) {
+      drainCTYOutput();
+      return;
+    }
+
+    if ((polls[0].revents & (POLLIN | POLLHUP | POLLERR)) != 0) {
+      char bufs[64];
+      const size_t room = ctyInQ.capacity - ctyInQ.size();
+      const ssize_t n = consoleP->readInput(bufs, min(sizeof(bufs), room));
+
+      for (ssize_t k=0; k < n; ++k) {
+	const char buf = bufs[k];
+
+	if (buf == 0x1C) {
+	  cerr << "[control-\\]\r\n" << flush;
+	  kill(getpid(), SIGINT);
+	} else {
+	  if (logger.dte) cerr << "[" << setw(2) << setfill('0') << hex << (int) buf << "]\r\n" << flush;
+	  ctyInQ.enqueue(buf);
+	  attention = true;
+	}
+      }
+    }
+  }
 }
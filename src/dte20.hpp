@@ -11,6 +11,11 @@
 
 #include <stdexcept>
 #include <thread>
+#include <atomic>
+#include <functional>
+#include <vector>
+#include <deque>
+#include <tuple>
 #include <signal.h>
 
 using namespace std;
@@ -18,7 +23,8 @@ using namespace std;
 #include "word.hpp"
 #include "device.hpp"
 #include "logger.hpp"
-#include "tsqueue.hpp"
+#include "spscring.hpp"
+#include "console.hpp"
 
 
 struct DTE20: Device {
@@ -33,13 +39,13 @@ struct DTE20: Device {
   union CONOMask {
 
     struct ATTRPACKED {
-      unsigned: 3;
+      unsigned pia: 3;
       unsigned pi0Enable: 1;	// 32
-      unsigned piEnable: 1;
-      unsigned clearTo10: 1;
-      unsigned clearTo11: 1;
+      unsigned loadPI: 1;	// Load `pia` and `pi0Enable`
+      unsigned clearTo10: 1;	// Clear to-10 done and error
+      unsigned clearTo11: 1;	// Clear to-11 done and error
       unsigned: 2;
-      unsigned clear11PI: 1;
+      unsigned clearTo10Doorbell: 1;
       unsigned: 1;
       unsigned setReload11: 1;
       unsigned clearReload11: 1;
@@ -53,9 +59,30 @@ struct DTE20: Device {
     CONOMask(unsigned ea) { u = ea; }
   };
 
-  unsigned piAssigned;
-  bool pi0Enabled;
-  bool restricted;
+  // CONI bits
+  union Status {
+
+    struct ATTRPACKED {
+      unsigned pia: 3;
+      unsigned pi0Enable: 1;	// 32
+      unsigned to10Error: 1;
+      unsigned to10Done: 1;
+      unsigned to11Done: 1;
+      unsigned: 1;
+      unsigned to11Error: 1;
+      unsigned to10Doorbell: 1;
+      unsigned: 3;
+      unsigned to11Doorbell: 1;
+      unsigned dead11: 1;
+      unsigned restricted: 1;
+
+      unsigned: 2;
+    };
+
+    unsigned u: 18;
+
+    Status(unsigned v = 0) : u(v) {}
+  } status;
 
   enum {
     PRIMARY,
@@ -76,6 +103,61 @@ struct DTE20: Device {
     setDateTimeInfo,
   };
 
+  // Status for diagNotice
+  enum DiagNotice {
+    programError = 001,
+    failHalt = 002,
+    endOfRun = 003,
+    endOfPass = 004,
+    getClockDefault = 005,
+  };
+
+  // Primary protocol packet functions. (klcom.mem)
+  enum PrimaryFunction {
+    emString = 003,		// String data for a device
+    emLineChar = 004,		// Line and character pairs
+    emRequestStatus = 005,	// Request device status
+    emHereIsStatus = 007,	// Here is device status
+    emRequestDateTime = 010,	// Request date and time
+    emHereIsDateTime = 011,	// Here is date and time
+    emFlushOutput = 012,	// Flush output
+    emAck = 016,		// Acknowledge output to a line
+    emAckAll = 024,		// Acknowledge all lines
+
+    // Set in a to-11 packet's function when its data follows
+    // separately through an indirect transfer.
+    emIndirect = 0100000,
+  };
+
+  // Primary protocol devices
+  enum PrimaryDevice {
+    devCTY = 001,
+    devDLS = 004,		// All terminal lines together
+    devClock = 007,
+  };
+
+  // Each side's area in the communications region has this layout.
+  // The 10's area (for packets to us) is at the start of its examine
+  // area and we deposit ours (for packets to the 10) at the start of
+  // its deposit area.
+  enum CommArea {
+    cmProcessor = 0,		// Processor number
+    cmStatus = 1,		// Flags and packet counts (below)
+    cmQueueCount = 2,		// Size in bytes of the packet being sent
+    cmKeepAlive = 5,		// Keep alive count
+  };
+
+  // `cmStatus` word bits
+  static const inline uint64_t cmQueuedProtocol = 020000000;
+  static const inline uint64_t cmIndirect = 0400000;
+  static const inline uint64_t cm10Count = 077400;	// To-11 packets the 10 has queued
+  static const inline uint64_t cm11Count = 000377;	// To-10 packets we have queued
+
+  // A packet's header is four 16-bit words, each sent as two 8-bit
+  // bytes with the high byte first: byte count (including the
+  // header), function, device, and a spare.
+  static const inline unsigned headerBytes = 8;
+
   union MonitorCommand {
 
     struct ATTRPACKED {
@@ -88,38 +170,91 @@ struct DTE20: Device {
     MonitorCommand(unsigned v) : u(v) {}
   };
 
-  unsigned genericConditions: 18;
+  // Our CTY, which we own. Without one we are headless: CTY output
+  // is discarded and input comes only from what is put in `ctyInQ`.
+  Console *consoleP;
+
+  // Where our notices (like "[End of diagnostic PASS]") go. This is
+  // cerr unless something running headless machines wants them
+  // elsewhere.
+  ostream *noticesP;
+
+  // If set, this is called with the status of each diagNotice command
+  // before we act on it.
+  function<void(DiagNotice status)> reportDiagNotice;
+
   thread consoleIOThread;
-  bool consoleIOThreadDone;
+  atomic<bool> consoleIOThreadDone;
   bool isConnected;
-  inline static int toIOLoopFD;
-  inline static int fromIOLoopFD;
 
-  inline static bool isRaw{false};
-  inline static int ttyFD{-1};
-  inline static struct termios origTermios{};
-
-  ofstream console;
   string endl;
 
-  inline static TSQueue<char> ctyQ;
+  // CTY characters between the console I/O thread and the CPU. When
+  // the input ring is full the I/O thread stops reading the console
+  // until the CPU catches up, so pasting a big block of text never
+  // holds up the CPU. The I/O thread sleeps on `ioWaker` when it has
+  // nothing to do.
+  SPSCRing<char, 4096> ctyInQ;
+  SPSCRing<char, 16384> ctyOutQ;
+  Waker ioWaker;
+
+  // CTY output is written in batches. A batch goes out at a newline,
+  // when the program waits for input, when the CPU stops, or at the
+  // latest this long after it started.
+  static const inline unsigned ctyFlushMS = 10;
+  atomic<bool> ctyFlushNow;
+
+
+  // The console I/O thread sets this when CTY input arrives, and the
+  // CPU calls `service()` between instructions when it sees it.
+  atomic<bool> attention;
+
+  // Primary protocol state. The packets we have queued for the 10
+  // aren't saved in checkpoints; a restored machine starts with none.
+  unsigned to11Count;		// Last `cm10Count` we took a packet for
+  unsigned to10Count;		// Last `cm11Count` we posted
+  vector<uint8_t> to11Packet;	// To-11 packet waiting for indirect data
+  deque<vector<uint8_t>> to10Q;	// Packets for the 10, oldest first
+  size_t to10Offset;		// How much of the first one it has taken
+  bool to10Posted;		// We've rung its doorbell for the first one
 
 
   virtual unsigned getConditions();
   virtual void putConditions(unsigned v);
 
+  virtual void saveState(MachineState &ms) override;
+  virtual void restoreState(MachineState &ms) override;
+
+  // We interrupt through our vector instruction in the EPT.
+  virtual tuple<unsigned,W36> getIntFuncWord() override;
+
+  // Request or withdraw our interrupt to match `status`.
+  void updateInterrupt();
+
   // I/O instruction handlers
   virtual void clearIO() override;
+  virtual IResult doDATAO(W36 iw, W36 ea) override;
   virtual IResult doCONO(W36 iw, W36 ea) override;
 
-  // TTY handlers and stuff
-  static void consoleIOLoop();
+  // Replace our console with `aConsoleP` (which may be null).
+  void setConsole(Console *aConsoleP);
 
-  // reset tty - useful also for restoring the terminal when this
-  // process wishes to temporarily relinquish the tty.
-  static void resetTTY();
-  static void setNormal();
+  // Called by the CPU between instructions when `attention` is set.
+  void service();
 
-// Put terminal in Raw mode - see termios(3) for modes.
-  static void setRaw();
+  // Primary protocol
+  void enterPrimary();
+  void primaryDoorbell();
+  void handleTo11Packet(const vector<uint8_t> &packet);
+  void sendPacket(unsigned fn, unsigned dev, const vector<uint8_t> &data);
+  void postTo10();
+  W36 *commWordP(bool toTen, unsigned offset);
+  static bool transferBytes(KM10 &km10, W36 &bp, uint8_t *bufP, size_t n, bool toTen);
+
+  // TTY handlers and stuff
+  void consoleIOLoop();
+  void putCTY(char ch);
+  void flushCTY();
+  void waitForCTY();
+  void drainCTYOutput();
 };
@@ -0,0 +1,117 @@
+#include <signal.h>
+#include <string.h>
+#include <stdexcept>
+#include <atomic>
+
+using namespace std;
+
+#include "hostfault.hpp"
+
+
+array<atomic<HostFaultRegion *>, HostFaultRegion::maxRegions> HostFaultRegion::regions{};
+thread_local HostFaultRegion *HostFaultRegion::steppingP{nullptr};
+
+
+static void segvHandler(int sig, siginfo_t *infoP, void *ctxP) {
+
+  for (auto &slot: HostFaultRegion::regions) {
+    HostFaultRegion *regionP = slot.load();
+
+    if (regionP && regionP->contains(infoP->si_addr)) {
+      if (regionP->handleFault(infoP->si_addr, (ucontext_t *) ctxP)) return;
+      break;
+    }
+  }
+
+  // Not ours (or the region declined it). Put back the default action
+  // and return so the faulting instruction crashes us normally.
+  signal(SIGSEGV, SIG_DFL);
+}
+
+
+static void trapHandler(int sig, siginfo_t *infoP, void *ctxP) {
+
+  HostFaultRegion *regionP = HostFaultRegion::steppingP;
+  if (regionP && regionP->handleStep((ucontext_t *) ctxP)) return;
+
+  signal(SIGTRAP, SIG_DFL);
+  raise(SIGTRAP);
+}
+
+
+static void installHandler() {
+  static atomic<bool> installed{false};
+  if (installed) return;
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = segvHandler;
+
+  // SA_NODEFER because handlers may throw out of the signal frame,
+  // which would otherwise leave SIGSEGV blocked forever.
+  sa.sa_flags = SA_SIGINFO | SA_NODEFER;
+  sigemptyset(&sa.sa_mask);
+
+  if (sigaction(SIGSEGV, &sa, nullptr) != 0) throw runtime_error("Failed to install SIGSEGV handler");
+
+  if (HostFaultRegion::canSingleStep) {
+    sa.sa_sigaction = trapHandler;
+    if (sigaction(SIGTRAP, &sa, nullptr) != 0) throw runtime_error("Failed to install SIGTRAP handler");
+  }
+
+  installed = true;
+}
+
+
+void HostFaultRegion::registerRegion(void *aStartP, size_t aSize) {
+  installHandler();
+  unregisterRegion();
+  startP = (char *) aStartP;
+  size = aSize;
+
+  for (auto &slot: regions) {
+    HostFaultRegion *emptyP = nullptr;
+    if (slot.compare_exchange_strong(emptyP, this)) return;
+  }
+
+  throw runtime_error("Too many host fault regions");
+}
+
+
+void HostFaultRegion::unregisterRegion() {
+
+  for (auto &slot: regions) {
+    HostFaultRegion *usP = this;
+    slot.compare_exchange_strong(usP, nullptr);
+  }
+}
+
+
+bool HostFaultRegion::isWriteFault(const ucontext_t *ucP) {
+#if defined(__x86_64__)
+  // Page fault error code bit 1 is set for a write access.
+  return (ucP->uc_mcontext.gregs[REG_ERR] & 2) != 0;
+#else
+  return false;
+#endif
+}
+
+
+#if defined(__x86_64__)
+const bool HostFaultRegion::canSingleStep = true;
+#else
+const bool HostFaultRegion::canSingleStep = false;
+#endif
+
+
+void HostFaultRegion::setSingleStep(ucontext_t *ucP, bool enable) {
+#if defined(__x86_64__)
+  const greg_t tf = 0x100;	// EFLAGS.TF
+  steppingP = enable ? this : nullptr;
+
+  if (enable)
+    ucP->uc_mcontext.gregs[REG_EFL] |= tf;
+  else
+    ucP->uc_mcontext.gregs[REG_EFL] &= ~tf;
+#endif
+}
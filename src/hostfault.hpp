@@ -0,0 +1,90 @@
+// Dispatch of host SIGSEGV faults to the emulator code that owns the
+// faulting region of host address space.
+//
+// Several parts of the emulator deliberately leave host pages
+// inaccessible so that a reference to them traps instead of paying
+// for a check on every reference. Each of these is a subclass of
+// `HostFaultRegion` and registers the range of host addresses it
+// manages. When a SIGSEGV arrives we find the region containing the
+// fault address and let it handle the fault. A handler either fixes
+// things up (e.g., maps the page) and returns true so the faulting
+// host instruction is retried, or throws a C++ exception to abort the
+// emulated instruction. The latter requires that code which can fault
+// is compiled with `-fnon-call-exceptions`.
+//
+// A region can also let one faulting host instruction through and ask
+// for a single step trap (SIGTRAP) after it, to put its protection
+// back. This is how we let references to the unwatched words of a
+// watched page through.
+//
+// A fault outside all registered regions is a real bug and we let it
+// crash the way it would without this handler.
+
+#pragma once
+
+#include <signal.h>
+#include <ucontext.h>
+#include <cstddef>
+#include <array>
+#include <atomic>
+
+using namespace std;
+
+
+struct HostFaultRegion {
+  char *startP;
+  size_t size;
+
+  // Regions of all the machines in the process. Machines on other
+  // threads may register and unregister while we look for a fault's
+  // region, so these are atomic.
+  static const inline unsigned maxRegions = 64;
+  static array<atomic<HostFaultRegion *>, maxRegions> regions;
+
+  // The region that asked for the single step trap pending on this
+  // thread. Another machine's region may be stepping at the same time
+  // on its own thread, so we can't just ask each region if it's ours.
+  static thread_local HostFaultRegion *steppingP;
+
+  HostFaultRegion()
+    : startP(nullptr),
+      size(0)
+  {}
+
+  virtual ~HostFaultRegion() {
+    unregisterRegion();
+  }
+
+
+  // Start dispatching faults in [`aStartP`, `aStartP + aSize`) to us.
+  void registerRegion(void *aStartP, size_t aSize);
+  void unregisterRegion();
+
+  bool contains(const void *p) const {
+    return (const char *) p >= startP && (const char *) p < startP + size;
+  }
+
+
+  // Handle a fault at `addrP`. `ucP` is the signal context so the
+  // handler can tell a write from a read. Return true to retry the
+  // faulting host instruction.
+  virtual bool handleFault(void *addrP, ucontext_t *ucP) = 0;
+
+  // Handle the single step trap requested by `handleFault()`. Return
+  // true if it was ours.
+  virtual bool handleStep(ucontext_t *ucP) {return false;}
+
+
+  // Return true if the fault described by `ucP` was a write, or
+  // false if it was a read or we can't tell on this host.
+  static bool isWriteFault(const ucontext_t *ucP);
+
+  // True if we can single step the host, which `setSingleStep()`
+  // needs.
+  static const bool canSingleStep;
+
+  // Enable or disable the trap after the next host instruction when
+  // we return to the context `ucP`. The trap is handled by our
+  // `handleStep()`.
+  void setSingleStep(ucontext_t *ucP, bool enable);
+};
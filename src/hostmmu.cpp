@@ -0,0 +1,205 @@
+#include <sys/mman.h>
+#include <unistd.h>
+#include <stdexcept>
+
+using namespace std;
+
+#include "hostmmu.hpp"
+#include "pag.hpp"
+#include "logger.hpp"
+
+
+HostMMU::HostMMU(PhysicalMemory &aPhysMem, PAGDevice &aPAG)
+  : pag(aPAG),
+    physMem(aPhysMem),
+    windowP{nullptr, nullptr},
+    stepping(false),
+    stepUser(false),
+    stepVPN(0)
+{
+  if (physMem.fd < 0) throw runtime_error("HostMMU needs physical memory with a file descriptor");
+
+  // Reserve both windows as one PROT_NONE range. Nothing is backed
+  // until PAG maps it.
+  char *windowsP = (char *) mmap(nullptr, 2 * windowBytes, PROT_NONE,
+				 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (windowsP == MAP_FAILED) throw runtime_error("Failed to reserve KM10 virtual memory windows");
+
+  windowP[0] = (W36 *) windowsP;
+  windowP[1] = (W36 *) (windowsP + windowBytes);
+  pageState[0].assign(nVirtualPages, 0);
+  pageState[1].assign(nVirtualPages, 0);
+
+  registerRegion(windowsP, 2 * windowBytes);
+}
+
+
+HostMMU::~HostMMU() {
+  unregisterRegion();
+  if (windowP[0]) munmap(windowP[0], 2 * windowBytes);
+}
+
+
+int HostMMU::hostProt(uint8_t state) {
+
+  // Without single stepping we can't put protection back after
+  // letting a reference through, so watched pages aren't protected.
+  if (!canSingleStep) state &= ~(watchRead | watchWrite);
+
+  // Host pages can't be write-only.
+  if ((state & mappedNXM) != 0 || (state & mappedRead) == 0 || (state & watchRead) != 0) return PROT_NONE;
+  if ((state & mappedWrite) == 0 || (state & watchWrite) != 0) return PROT_READ;
+  return PROT_READ | PROT_WRITE;
+}
+
+
+void HostMMU::mapPage(bool user, unsigned vpn, unsigned ppn, bool writable, bool keep, unsigned watch) {
+  void *pageP = windowP[user] + (size_t) vpn * pageWords;
+  const uint8_t state = mappedRead |
+    (writable ? mappedWrite : 0) |
+    (keep ? keepPage : 0) |
+    ((watch & PAGDevice::watchRead) ? watchRead : 0) |
+    ((watch & PAGDevice::watchWrite) ? watchWrite : 0);
+
+  if (mmap(pageP, pageBytes, hostProt(state), MAP_SHARED | MAP_FIXED,
+	   physMem.fd, (off_t) ppn * pageBytes) == MAP_FAILED)
+  {
+    throw runtime_error("Failed to map KM10 page into host window");
+  }
+
+  pageState[user][vpn] = state;
+  if (writable) physMem.markDirty(ppn);
+}
+
+
+void HostMMU::mapNXMPage(bool user, unsigned vpn) {
+  unmapPage(user, vpn);
+  pageState[user][vpn] = mappedNXM;
+}
+
+
+void HostMMU::unmapPage(bool user, unsigned vpn) {
+  if (pageState[user][vpn] == 0) return;
+
+  // Replace rather than munmap() so nothing else can land in our
+  // reserved range.
+  void *pageP = windowP[user] + (size_t) vpn * pageWords;
+
+  if (mmap(pageP, pageBytes, PROT_NONE,
+	   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED)
+  {
+    throw runtime_error("Failed to unmap KM10 page from host window");
+  }
+
+  pageState[user][vpn] = 0;
+}
+
+
+void HostMMU::unmapAll(bool user, bool keepKeepers) {
+
+  if (keepKeepers) {
+
+    for (unsigned vpn=0; vpn < nVirtualPages; ++vpn) {
+      if ((pageState[user][vpn] & keepPage) == 0) unmapPage(user, vpn);
+    }
+  } else {
+
+    if (mmap(windowP[user], windowBytes, PROT_NONE,
+	     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED)
+    {
+      throw runtime_error("Failed to unmap KM10 host window");
+    }
+
+    pageState[user].assign(nVirtualPages, 0);
+  }
+}
+
+
+void HostMMU::writeProtectAll() {
+
+  for (unsigned user=0; user < 2; ++user) {
+
+    for (unsigned vpn=0; vpn < nVirtualPages; ++vpn) {
+      uint8_t &state = pageState[user][vpn];
+      if ((state & mappedWrite) == 0) continue;
+
+      state &= ~mappedWrite;
+
+      if (mprotect(windowP[user] + (size_t) vpn * pageWords, pageBytes, hostProt(state)) != 0) {
+	throw runtime_error("Failed to write protect KM10 page in host window");
+      }
+    }
+  }
+}
+
+
+// A reference through a window hit a page that isn't mapped, or
+// wrote a page that is mapped read-only. Let PAG translate it, which
+// maps the page or throws PageFail out through the signal frame to
+// abort the emulated instruction.
+bool HostMMU::handleFault(void *addrP, ucontext_t *ucP) {
+  const size_t offset = (char *) addrP - startP;
+  const bool user = offset >= windowBytes;
+  const size_t windowOffset = offset % windowBytes;
+  const unsigned vpn = windowOffset / pageBytes;
+  const W36 va(windowOffset / sizeof(W36));
+
+  // If the page is already readable this must be a write. Otherwise
+  // ask the host. If it can't tell us and this was really a write, we
+  // map the page for reading and take a second fault for the write.
+  const bool forWrite = (hostProt(pageState[user][vpn]) & PROT_READ) || isWriteFault(ucP);
+
+  if (pag.logger.mem) pag.logger.s << "; hostmmu fault " << va.fmtVMA() << (forWrite ? " write" : " read");
+  pag.fill(va, forWrite, user);
+
+  const uint8_t state = pageState[user][vpn];
+  W36 *pageP = windowP[user] + (size_t) vpn * pageWords;
+  const int wantProt = forWrite ? PROT_READ | PROT_WRITE : PROT_READ;
+
+  if (state & mappedNXM) {
+    // PAG has reported the NXM. Let the reference complete against a
+    // zero page we throw away after it, like PhysicalMemory does.
+    if (mmap(pageP, pageBytes, PROT_READ | PROT_WRITE,
+	     MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED)
+    {
+      return false;
+    }
+
+    // Without single stepping the scratch page has to stay.
+    if (!canSingleStep) {
+      pageState[user][vpn] = mappedRead | mappedWrite;
+      return true;
+    }
+  } else {
+    // Retry only if PAG really gave us access, or we'd loop forever.
+    if ((state & (forWrite ? mappedWrite : mappedRead)) == 0) return false;
+    if ((hostProt(state) & wantProt) == wantProt) return true;
+
+    // PAG allowed the reference but the page is watched. Let this one
+    // host instruction through and close the page again after it.
+    if (mprotect(pageP, pageBytes, wantProt) != 0) return false;
+  }
+
+  stepping = true;
+  stepUser = user;
+  stepVPN = vpn;
+  setSingleStep(ucP, true);
+  return true;
+}
+
+
+bool HostMMU::handleStep(ucontext_t *ucP) {
+  if (!stepping) return false;
+
+  stepping = false;
+  setSingleStep(ucP, false);
+  W36 *pageP = windowP[stepUser] + (size_t) stepVPN * pageWords;
+
+  if (pageState[stepUser][stepVPN] & mappedNXM) {
+    mmap(pageP, pageBytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+  } else {
+    mprotect(pageP, pageBytes, hostProt(pageState[stepUser][stepVPN]));
+  }
+
+  return true;
+}
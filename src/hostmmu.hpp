@@ -0,0 +1,110 @@
+// Host-MMU backed KL10 memory.
+//
+// A KL10 page is 512 words, and since we keep each 36-bit word in a
+// uint64_t that is exactly one 4KiB host page. This backend keeps
+// physical memory in a memfd and reserves two host address space
+// "windows", one each for exec and user mode, that cover the whole
+// 23-bit virtual address space. When PAG translates a page it mmaps
+// the corresponding page of the window onto the physical page in the
+// memfd, so after that references through the window cost no more
+// than a normal memory reference. Pages that have not been translated
+// (or have been invalidated since) are PROT_NONE, and referencing one
+// faults into `handleFault()`, which asks PAG to translate the page
+// and either maps it or throws PageFail.
+//
+// Pages are mapped read-only until PAG says a write is allowed, so
+// the first write to a page also faults and lets PAG update its CST
+// "modified" bit.
+//
+// Writes through the windows don't touch PhysicalMemory's own mapping,
+// so for checkpoints we tell it about each page we map writable, and
+// `writeProtectAll()` makes the next write to every page fault again.
+//
+// Pages of non-existent memory stay PROT_NONE. PAG reports the NXM
+// when it translates each reference to one and we then let the
+// reference complete against a scratch page.
+//
+// Pages containing a watched word keep the host protection that traps
+// the watched kind of reference. After PAG has checked a reference to
+// such a page we open the page up, single step the host instruction,
+// and close it again from the resulting SIGTRAP.
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+#include "word.hpp"
+#include "hostfault.hpp"
+#include "physmem.hpp"
+
+
+struct PAGDevice;
+
+
+struct HostMMU: HostFaultRegion {
+  static const inline unsigned pageWords = 512;
+  static const inline size_t pageBytes = pageWords * sizeof(W36);
+  static const inline unsigned nVirtualPages = 32 * 512;
+  static const inline size_t windowBytes = nVirtualPages * pageBytes;
+
+  // Bits in `pageState[]`.
+  enum {
+    mappedRead = 1,
+    mappedWrite = 2,
+    keepPage = 4,
+    watchRead = 8,
+    watchWrite = 16,
+    mappedNXM = 32,
+  };
+
+  PAGDevice &pag;
+
+  // Our windows map pages of this memory's memfd.
+  PhysicalMemory &physMem;
+
+  // Exec [0] and user [1] virtual address windows. These are
+  // contiguous so one HostFaultRegion covers both.
+  W36 *windowP[2];
+
+  // One byte of `mappedRead` etc. per virtual page in each window.
+  vector<uint8_t> pageState[2];
+
+  // The page we opened up for a single step, if `stepping`.
+  bool stepping;
+  bool stepUser;
+  unsigned stepVPN;
+
+
+  HostMMU(PhysicalMemory &aPhysMem, PAGDevice &aPAG);
+  virtual ~HostMMU();
+
+
+  // Make virtual page `vpn` in the `user` window refer to physical
+  // page `ppn`, read-only or read/write. `watch` is PAGDevice's
+  // watchRead/watchWrite bits for the page.
+  void mapPage(bool user, unsigned vpn, unsigned ppn, bool writable, bool keep, unsigned watch = 0);
+
+  // Mark virtual page `vpn` in the `user` window as referring to
+  // non-existent memory.
+  void mapNXMPage(bool user, unsigned vpn);
+
+  // Make virtual page `vpn` in the `user` window inaccessible again.
+  void unmapPage(bool user, unsigned vpn);
+
+  // Unmap every page in the `user` window, or only those not marked
+  // "keep" if `keepKeepers` is set.
+  void unmapAll(bool user, bool keepKeepers = false);
+
+  // Make every page in both windows read-only again, so the next
+  // write to each goes through PAG and `mapPage()`.
+  void writeProtectAll();
+
+  // Host protection for a page given its `pageState[]` bits.
+  static int hostProt(uint8_t state);
+
+  virtual bool handleFault(void *addrP, ucontext_t *ucP) override;
+  virtual bool handleStep(ucontext_t *ucP) override;
+};
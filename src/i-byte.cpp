@@ -11,6 +11,7 @@ struct ByteGroup: KM10 {
 
     if (iw.ac == 0) {		// IBP
       bp->inc(*this);
+      bp->store(ea, *this);
     } else {			// ADJBP
       bp->adjust(iw.ac, *this);
     }
@@ -21,6 +22,7 @@ struct ByteGroup: KM10 {
   IResult doILDB() {
     BytePointer *bp = BytePointer::makeFrom(ea, *this);
     bp->inc(*this);
+    bp->store(ea, *this);
     acPut(bp->getByte(*this));
     return iNormal;
   };
@@ -34,6 +36,7 @@ struct ByteGroup: KM10 {
   IResult doIDPB() {
     BytePointer *bp = BytePointer::makeFrom(ea, *this);
     bp->inc(*this);
+    bp->store(ea, *this);
     bp->putByte(acGet(), *this);
     return iNormal;
   };
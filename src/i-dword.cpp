@@ -77,13 +77,12 @@ struct DWordGroup: KM10 {
     auto a = W72{acGetN(iw.ac+0), acGetN(iw.ac+1)};
     auto b = W72{memGetN(ea.u+0), memGetN(ea.u+1)};
 
-    cout << logger.endl;
-    cout << "DMUL"
-	 << " a=" << W36(a.hi).fmt36()
-	 << " " << W36(a.lo).fmt36()
-	 << " b=" << W36(b.hi).fmt36()
-	 << " " << W36(b.lo).fmt36()
-	 << logger.endl;
+    if (logger.ac) logger.s << "DMUL"
+			   << " a=" << W36(a.hi).fmt36()
+			   << " " << W36(a.lo).fmt36()
+			   << " b=" << W36(b.hi).fmt36()
+			   << " " << W36(b.lo).fmt36()
+			   << logger.endl;
 
     if (a.isMaxNeg() && b.isMaxNeg()) {
       const W36 big1 = W36::fromMag(0, 1);
@@ -92,7 +91,7 @@ struct DWordGroup: KM10 {
       acPutN(big1, iw.ac+1);
       acPutN(big1, iw.ac+2);
       acPutN(big1, iw.ac+3);
-      cout << "DMUL both operands maxNeg; return all four words = 400000,,000000" << logger.endl;
+      if (logger.ac) logger.s << "DMUL both operands maxNeg; return all four words = 400000,,000000" << logger.endl;
       return flags.usr ? iTrap : iNormal;
     } else if ((a.hiSign == 0 && a.hi35 == 0 && a.lo35 == 0) ||
 	       (b.hiSign == 0 && b.hi35 == 0 && b.lo35 == 0))
@@ -101,15 +100,15 @@ struct DWordGroup: KM10 {
       acPutN(0, iw.ac+1);
       acPutN(0, iw.ac+2);
       acPutN(0, iw.ac+3);
-      cout << "DMUL one or both operands zero; return all four words = zero" << logger.endl;
+      if (logger.ac) logger.s << "DMUL one or both operands zero; return all four words = zero" << logger.endl;
       return iNormal;
     } else {
       W144 prod = W144::product(a, b);
-      cout << "DMUL prod="
-	   << W36(prod.u0).fmt36() << " "
-	   << W36(prod.u1).fmt36() << " "
-	   << W36(prod.u2).fmt36() << " "
-	   << W36(prod.u3).fmt36() << logger.endl;
+      if (logger.ac) logger.s << "DMUL prod="
+			     << W36(prod.u0).fmt36() << " "
+			     << W36(prod.u1).fmt36() << " "
+			     << W36(prod.u2).fmt36() << " "
+			     << W36(prod.u3).fmt36() << logger.endl;
 
       acPutN(prod.u0, iw.ac+0);
       acPutN(prod.u1, iw.ac+1);
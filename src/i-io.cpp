@@ -4,7 +4,7 @@ struct IOGroup: KM10 {
 
   IResult doIO() {
     if (logger.io) logger.s << "; ioDev=" << oct << iw.ioDev << " ioOp=" << oct << iw.ioOp;
-    return Device::handleIO(iw, ea);
+    return Device::handleIO(*this, iw, ea);
   }
 };
 
@@ -207,8 +207,10 @@ struct JumpGroup: KM10 {
     }
   }
 
+  // MAP never page fails. It returns the page fail word describing
+  // the reference, with the physical address in the address field.
   IResult doMAP() {
-    logger.nyi(*this);
+    acPut(W36(pag.map(ea, userMode()).u));
     return iNormal;
   }
 
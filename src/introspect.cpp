@@ -0,0 +1,96 @@
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+using namespace std;
+
+#include "introspect.hpp"
+#include "km10.hpp"
+
+
+PhysicalMemory::Backend Introspection::memoryBackendFor(const string &name,
+							 const PhysicalMemory::Backend &backend,
+							 bool &chosen)
+{
+  chosen = false;
+
+  switch (backend.kind) {
+  case PhysicalMemory::Backend::file:
+  case PhysicalMemory::Backend::shared:
+    return backend;
+
+  case PhysicalMemory::Backend::hugeTLB:
+    throw runtime_error("The hugetlb memory backend can't be published");
+
+  default:
+    chosen = true;
+    return PhysicalMemory::Backend::parse("shm:" + name + ".mem");
+  }
+}
+
+
+Introspection::Introspection(KM10 &aKM10, const string &aName, bool anUnlinkMemory)
+  : km10(aKM10),
+    name(aName[0] == '/' ? aName : "/" + aName),
+    unlinkMemory(anUnlinkMemory),
+    fd(-1),
+    stateP(nullptr)
+{
+  fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) throw runtime_error("Failed to create KM10 introspection object " + name);
+  if (ftruncate(fd, sizeof(IntrospectionState)) != 0) throw runtime_error("Failed to size KM10 introspection object");
+
+  void *p = mmap(nullptr, sizeof(IntrospectionState), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) throw runtime_error("Failed to mmap KM10 introspection object");
+
+  // The object reads as zeroes, so `seq` starts out even and `regs`
+  // empty. Readers check `magic` last.
+  stateP = new (p) IntrospectionState;
+  stateP->version = IntrospectionState::currentVersion;
+  stateP->stateBytes = sizeof(IntrospectionState);
+  stateP->memoryWords = km10.memorySize;
+  stateP->pid = getpid();
+  strncpy(stateP->memoryStore, km10.physMem.backend.toString().c_str(), sizeof(stateP->memoryStore) - 1);
+  publish();
+  atomic_thread_fence(memory_order_release);
+  stateP->magic = IntrospectionState::magicValue;
+}
+
+
+Introspection::~Introspection() {
+  if (stateP) munmap(stateP, sizeof(IntrospectionState));
+  if (fd >= 0) close(fd);
+  shm_unlink(name.c_str());
+  if (unlinkMemory) shm_unlink(km10.physMem.backend.path.c_str());
+}
+
+
+void Introspection::publish() {
+  IntrospectionState::Registers &r = stateP->regs;
+  const uint64_t seq = stateP->seq.load(memory_order_relaxed);
+
+  stateP->seq.store(seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  r.instructionCounter = km10.instructionCounter;
+  r.running = km10.running;
+  r.pc = km10.pc.vma;
+  r.flags = km10.flags.u;
+  r.curACBlock = km10.pag.processContext.curACBlock;
+  r.prevACBlock = km10.pag.processContext.prevACBlock;
+  memcpy(r.acBlocks, km10.ACBlocks, sizeof(r.acBlocks));
+
+  r.aprConditions = km10.apr.getConditions();
+  r.piConditions = km10.pi.getConditions();
+  r.pagConditions = km10.pag.getConditions();
+  r.ccaConditions = km10.cca.getConditions();
+  r.timConditions = km10.tim.getConditions();
+  r.mtrConditions = km10.mtr.getConditions();
+  r.dteConditions = km10.dte.getConditions();
+  r.processContext = km10.pag.processContext.u;
+
+  stateP->seq.store(seq + 2, memory_order_release);
+}
@@ -0,0 +1,122 @@
+// Publication of KM10 state for external tools.
+//
+// With `--publish NAME` the emulator creates the POSIX shared memory
+// object /NAME holding an `IntrospectionState`, and keeps guest
+// physical memory in a shared backing store (shm:NAME.mem unless
+// --memory already names a file or shm object). A tool like
+// km10-inspect can map both read-only and look at a running machine
+// without stopping it or costing it a copy.
+//
+// Layout of /NAME (all fields are host byte order):
+//
+//   magic		`magicValue` ("KM10STAT")
+//   version		`currentVersion`; bumped for any layout change
+//   stateBytes		sizeof(IntrospectionState)
+//   memoryWords	Number of words of guest physical memory
+//   pid		Process ID of the emulator
+//   memoryStore	Memory backend spec ("shm:NAME" or "file:PATH")
+//   seq		Sequence lock for `regs`
+//   regs		Processor and device state (see `Registers`)
+//
+// Guest physical memory is the backing store itself: word N is the
+// uint64_t at byte offset 8*N holding the 36-bit word right aligned
+// (see W36). Memory is live and not covered by `seq`, but each word
+// is read and written whole.
+//
+// `regs` is copied from the KM10 every `publishInterval`
+// instructions and whenever the CPU stops. The writer makes `seq` odd
+// while it updates `regs` and even again when it's done, so a reader
+// that sees the same even `seq` before and after copying `regs` has a
+// consistent snapshot. See `snapshot()`.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+using namespace std;
+
+#include "physmem.hpp"
+
+
+struct IntrospectionState {
+  static const inline uint64_t magicValue = 0x4B4D313053544154ull;
+  static const inline uint32_t currentVersion = 1;
+
+  uint64_t magic;
+  uint32_t version;
+  uint32_t stateBytes;
+  uint32_t memoryWords;
+  int32_t pid;
+  char memoryStore[256];
+
+  atomic<uint64_t> seq;
+  static_assert(atomic<uint64_t>::is_always_lock_free);
+
+  struct Registers {
+    uint64_t instructionCounter;
+    uint64_t running;		// Nonzero if the RUN flop is set
+    uint64_t pc;		// 30-bit PC
+    uint64_t flags;		// 13 program flags, PC word bit 0 (OV) is bit 12
+    uint64_t curACBlock;
+    uint64_t prevACBlock;
+    uint64_t acBlocks[8][16];
+
+    // CONI of each internal device, and the DATAI PAG process
+    // context word.
+    uint64_t aprConditions;
+    uint64_t piConditions;
+    uint64_t pagConditions;
+    uint64_t ccaConditions;
+    uint64_t timConditions;
+    uint64_t mtrConditions;
+    uint64_t dteConditions;
+    uint64_t processContext;
+  } regs;
+
+
+  // Copy a consistent `regs` into `r`, retrying while the writer is
+  // busy.
+  void snapshot(Registers &r) const {
+
+    for (;;) {
+      const uint64_t before = seq.load(memory_order_acquire);
+
+      if ((before & 1) == 0) {
+	memcpy(&r, (const void *) &regs, sizeof(r));
+	atomic_thread_fence(memory_order_acquire);
+	if (seq.load(memory_order_relaxed) == before) return;
+      }
+    }
+  }
+};
+
+
+class KM10;
+
+struct Introspection {
+  // How often (a power of two number of instructions) the emulator
+  // refreshes `regs`.
+  static const inline uint64_t publishInterval = 1 << 16;
+
+  KM10 &km10;
+  string name;			// Shared memory object name with leading '/'
+  bool unlinkMemory;		// True if we chose the memory store
+  int fd;
+  IntrospectionState *stateP;
+
+
+  Introspection(KM10 &aKM10, const string &aName, bool anUnlinkMemory);
+  ~Introspection();
+
+  // Return the memory backend to use when publishing as `name`
+  // instead of `backend`. Sets `chosen` if it isn't `backend`.
+  static PhysicalMemory::Backend memoryBackendFor(const string &name,
+						  const PhysicalMemory::Backend &backend,
+						  bool &chosen);
+
+  // Copy processor and device state to `stateP->regs`.
+  void publish();
+};
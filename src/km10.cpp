@@ -8,29 +8,17 @@
 #include <fstream>
 #include <ostream>
 #include <limits>
+#include <bit>
 #include <string>
 #include <ctime>
 using namespace std;
 
-#include <CLI/CLI.hpp>
-
 #include "km10.hpp"
 #include "logger.hpp"
 #include "iresult.hpp"
 #include "bytepointer.hpp"
 
 
-Logger logger{};
-
-
-// We keep these breakpoint sets outside of the looped main and not
-// part of KM10 or Debugger object so they stick across restart.
-static KM10::BreakpointTable aOBPs;
-static KM10::BreakpointTable aGBPs;
-static KM10::BreakpointTable aPBPs;
-static KM10::BreakpointTable eBPs;
-
-
 extern void InstallAOxSOxGroup(KM10 &km10);
 extern void InstallBitRotGroup(KM10 &km10);
 extern void InstallByteGroup(KM10 &km10);
@@ -50,11 +38,17 @@ extern void InstallUUOsGroup(KM10 &km10);
 ////////////////////////////////////////////////////////////////
 // Constructor
 KM10::KM10(unsigned nMemoryWords,
-	   KM10::BreakpointTable &aOBPs,
-	   KM10::BreakpointTable &aGBPs,
-	   KM10::BreakpointTable &aPBPs,
-	   KM10::BreakpointTable &eBPs)
-  : apr{*this},
+	   MachineContext &aContext,
+	   bool useHostMMU,
+	   const PhysicalMemory::Backend &memoryBackend)
+  : context(aContext),
+    logger(aContext.logger),
+    devices{},
+    ioTable{},
+    asyncDevices{},
+    asyncAttention(0),
+    rh20s{},
+    apr{*this},
     cca{*this},
     mtr{*this},
     pag{*this},
@@ -68,6 +62,9 @@ KM10::KM10(unsigned nMemoryWords,
     ea(0),
     fetchPC(0),
     pcOffset(0),
+    physMem(nMemoryWords, memoryBackend, useHostMMU),
+    introspectionP(nullptr),
+    checkpointerP(nullptr),
     running(false),
     restart(false),
     ACBlocks{},
@@ -77,10 +74,10 @@ KM10::KM10(unsigned nMemoryWords,
     AC(ACBlocks[0]),
     memorySize(nMemoryWords),
     nSteps(0),
-    opBPs(aOBPs),
-    addressGBPs(aGBPs),
-    addressPBPs(aPBPs),
-    executeBPs(eBPs),
+    opBPs(aContext.opBPs),
+    addressGBPs(aContext.addressGBPs),
+    addressPBPs(aContext.addressPBPs),
+    executeBPs(aContext.executeBPs),
     instructionCounter(0),
     runNS(0)
 {
@@ -101,19 +98,49 @@ KM10::KM10(unsigned nMemoryWords,
   InstallMulDivGroup(*this);
   InstallTstSetGroup(*this);
 
-  // Note this anonymous mmap() implicitly zeroes the virtual memory.
-  physicalP = (W36 *) mmap(nullptr,
-			   memorySize * sizeof(uint64_t),
-			   PROT_READ | PROT_WRITE,
-			   MAP_PRIVATE | MAP_ANONYMOUS,
-			   0, 0);
-  assert(physicalP != nullptr);
+  for (auto &io: ioTable) {
+    if (!io.devP) io = {&noDevice, Device::virtualIO};
+  }
+
+  // The KL10's own devices see I/O instructions all the time, and we
+  // know just what they are.
+  ioTable[apr.ioAddress].handlers = Device::directIO<APRDevice>;
+  ioTable[cca.ioAddress].handlers = Device::directIO<CCADevice>;
+  ioTable[mtr.ioAddress].handlers = Device::directIO<MTRDevice>;
+  ioTable[pag.ioAddress].handlers = Device::directIO<PAGDevice>;
+  ioTable[pi.ioAddress].handlers = Device::directIO<PIDevice>;
+  ioTable[tim.ioAddress].handlers = Device::directIO<TIMDevice>;
+
+  physicalP = physMem.physicalP;
+  physMem.reportNXM = [this](unsigned pa) {apr.nonExistentMemory(pa);};
+
+  if (useHostMMU) {
+    // Physical memory lives in a memfd and virtual references go
+    // through the host MMU windows.
+    pag.hostMMUP = new HostMMU(physMem, pag);
+    kernelMemP = pag.hostMMUP->windowP[0];
+    userMemP = pag.hostMMUP->windowP[1];
+    memP = kernelMemP;
+  } else {
+    // Initially we have no virtual addressing, so virtual == physical.
+    kernelMemP = userMemP = nullptr;
+    memP = physicalP;
+  }
+
+  // EPT and UPT are mapped to physical addresses based at zero.
+  eptP = (ExecutiveProcessTable *) physicalP;
+  uptP = (UserProcessTable *) physicalP;
+}
+
 
-  // Initially we have no virtual addressing, so virtual == physical
-  // and EPT and UPT are mapped to physical addresses based at zero.
-  memP = physicalP;
-  eptP = (ExecutiveProcessTable *) memP;
-  uptP = (UserProcessTable *) memP;
+void KM10::updateBreakpoints() {
+  executeBPPages.reset();
+  for (auto a: executeBPs) executeBPPages.set((a >> 9) % executeBPPages.size());
+
+  opBPMask.reset();
+  for (auto op: opBPs) if (op < opBPMask.size()) opBPMask.set(op);
+
+  pag.updateWatchpoints();
 }
 
 
@@ -226,22 +253,123 @@ W36 KM10::immediate() {
 
 ////////////////////////////////////////////////////////////////
 KM10::~KM10() {
-  // XXX this eventually must tear down kernel and user virtual
-  // mappings as well.
-  if (physicalP) munmap(physicalP, memorySize * sizeof(uint64_t));
+
+  // Stop the RH20s' workers before anything they use goes away.
+  for (auto rhP: rh20s) delete rhP;
+
+  if (checkpointerP) {
+    delete checkpointerP;
+    checkpointerP = nullptr;
+  }
+
+  if (introspectionP) {
+    delete introspectionP;
+    introspectionP = nullptr;
+  }
+
+  // PhysicalMemory cleans up after itself.
+  if (pag.hostMMUP) {
+    delete pag.hostMMUP;
+    pag.hostMMUP = nullptr;
+  }
 }
 
 
 ////////////////////////////////////////////////////////////////
-// Return the KM10 memory VIRTUAL address (EPT is in kernel virtual
-// space) for the specified pointer into the EPT.
-W36 KM10::eptAddressFor(const W36 *eptEntryP) {
-  return W36(eptEntryP - (W36 *) eptP);
+void KM10::saveState(MachineState &ms) {
+  ms.put(MachineState::currentVersion);
+  ms.put(memorySize);
+  ms.put(instructionCounter);
+  ms.put(pc.u);
+  ms.put(flags.u);
+  ms.put(inInterrupt);
+  ms.put(era.u);
+  ms.put(debugger.switches.u);
+
+  for (auto &block: ACBlocks) {
+    for (auto &ac: block) ms.put(ac.u);
+  }
+
+  // Each device's state is tagged with its I/O address so we can't
+  // restore it into the wrong device.
+  ms.put(devices.size());
+
+  for (auto [ioDev, devP]: devices) {
+    ms.put(ioDev);
+    devP->saveState(ms);
+  }
 }
 
 
+void KM10::restoreState(MachineState &ms) {
+  if (ms.get() != MachineState::currentVersion) throw runtime_error("Saved machine state is from another KM10 version");
+  if (ms.get() != memorySize) throw runtime_error("Saved machine state has a different memory size");
+
+  instructionCounter = ms.get();
+  pc.u = ms.get();
+  fetchPC = pc;
+  flags.u = ms.get();
+  inInterrupt = ms.get();
+  era.u = ms.get();
+  debugger.switches.u = ms.get();
+
+  for (auto &block: ACBlocks) {
+    for (auto &ac: block) ac.u = ms.get();
+  }
+
+  if (ms.get() != devices.size()) throw runtime_error("Saved machine state has different devices");
+
+  for (auto [ioDev, devP]: devices) {
+    if (ms.get() != ioDev) throw runtime_error("Saved machine state has different devices");
+    devP->restoreState(ms);
+  }
+}
+
+
+////////////////////////////////////////////////////////////////
+// Return the PHYSICAL address for the specified pointer into the EPT
+// or UPT. Interrupt and trap vectors are fetched from here.
+W36 KM10::physAddressFor(const W36 *entryP) {
+  return W36(entryP - physicalP);
+}
+
+
+// The acquire here pairs with the release in each worker's fetch_or
+// so we see what it did before it set its bit.
+void KM10::serviceAsyncDevices() {
+
+  for (uint64_t bits = asyncAttention.exchange(0, memory_order_acquire); bits; bits &= bits - 1) {
+    if (AsyncDevice *devP = asyncDevices[countr_zero(bits)]) devP->drainCompletions();
+  }
+}
+
+
+// Abort the current instruction and run the page fail trap. The
+// page fail word, flags, and PC of the failing instruction are
+// stored in the UPT and we continue in exec mode at the UPT's new PC.
+void KM10::pageFailTrap(const PAGDevice::PageFail &pf) {
+  if (logger.mem || logger.ints) logger.s << ">>>>> page fail pfw=" << W36(pf.pfw.u).fmt36()
+					  << " PC=" << pc.fmtVMA()
+					  << logger.endl << flush;
+
+  uptP->pfWord = pf.pfw.u;
+  uptP->pfFlags = flagsWord(0);
+  uptP->pfOldPC = pc.vma;
+
+  ProgramFlags newFlags{0};
+  newFlags.pcu = flags.usr;
+  flags.u = newFlags.u;
+
+  pc = uptP->pfNewPC.vma;
+  fetchPC = pc;
+  inInterrupt = false;
+}
+
+
+// Multiword instructions address AC+1 etc., which wrap around the AC
+// block in the hardware.
 W36 KM10::acGetN(unsigned n) {
-  assert(n < 16);
+  n &= 017;
   W36 value = AC[n];
   if (logger.mem) logger.s << "; ac" << oct << n << ":" << value.fmt36();
   return value;
@@ -257,41 +385,54 @@ W36 KM10::acGetEA(unsigned n) {
 
 
 void KM10::acPutN(W36 value, unsigned n) {
-  assert(n < 16);
+  n &= 017;
   AC[n] = value;
   if (logger.mem) logger.s << "; ac" << oct << n << "=" << value.fmt36();
 }
 
 
+// Watchpoints on memory are handled by PAG on its slow path. ACs
+// don't go through PAG, so they are checked here if page zero is
+// being watched at all.
 W36 KM10::memGetN(W36 a) {
-  W36 value = a.rhu < 020 ? acGetEA(a.rhu) : memP[a.rhu];
+  W36 value;
+
+  if (a.rhu < 020) {
+    if (pag.watchedPages[0]) pag.checkWatch(a, false, flags.usr);
+    value = acGetEA(a.rhu);
+  } else {
+    value = *pag.readP(a, flags.usr);
+  }
+
   if (logger.mem) logger.s << "; " << a.fmtVMA() << ":" << value.fmt36();
-  if (addressGBPs.contains(a.vma)) running = false;
   return value;
 }
 
 
 void KM10::memPutN(W36 value, W36 a) {
 
-  if (a.rhu < 020)
+  if (a.rhu < 020) {
+    if (pag.watchedPages[0]) pag.checkWatch(a, true, flags.usr);
     acPutN(value, a.rhu);
-  else 
-    memP[a.rhu] = value;
+  } else {
+    *pag.writeP(a, flags.usr) = value;
+  }
 
   if (logger.mem) logger.s << "; " << a.fmtVMA() << "=" << value.fmt36();
-  if (addressPBPs.contains(a.vma)) running = false;
 }
 
 
+// The UPT is referenced physically, never through the pager.
 void KM10::uptPutN(W36 value, unsigned uptWordOffset) {
-  W36 memWordAddr = ((W36 *) uptP - (W36 *) memP) + uptWordOffset;
-  memPutN(value, memWordAddr);
+  W36 *wordP = (W36 *) uptP + uptWordOffset;
+  *wordP = value;
+  if (logger.mem) logger.s << "; upt" << oct << uptWordOffset << "=" << value.fmt36();
 }
 
 
 W36 KM10::uptGetN(unsigned uptWordOffset) {
-  W36 memWordAddr = (W36 *) uptP - (W36 *) memP;
-  W36 result = memGetN(memWordAddr + uptWordOffset);
+  W36 result = ((W36 *) uptP)[uptWordOffset];
+  if (logger.mem) logger.s << "; upt" << oct << uptWordOffset << ":" << result.fmt36();
   return result;
 }
 
@@ -333,8 +474,10 @@ bool KM10::userMode() {return !!flags.usr;}
 
 
 // Given add operands a and b and sum, set flags for an ADD operation.
+// Overflow sets OV and TR1 in exec mode as well as user mode, as
+// single word ADD does. The trap cycle vectors through the EPT or UPT
+// accordingly.
 IResult KM10::setADDFlags(W36 a, W36 b, W36 sum) {
-  const int trapAllowed = flags.usr;
   int canTrap = 0;
 
   if (a.sign) {
@@ -343,10 +486,8 @@ IResult KM10::setADDFlags(W36 a, W36 b, W36 sum) {
 
       if (sum.sign)
 	flags.cy0 = flags.cy1 = 1;
-      else if (trapAllowed)
-	canTrap = flags.ov = flags.tr1 = flags.cy0 = 1;
       else
-	flags.cy0 = 1;
+	canTrap = flags.ov = flags.tr1 = flags.cy0 = 1;
 
     } else if (!sum.sign) {
       flags.cy0 = flags.cy1 = 1;
@@ -355,28 +496,20 @@ IResult KM10::setADDFlags(W36 a, W36 b, W36 sum) {
 
     if (!b.sign) {
 
-      if (sum.sign) {
-
-	if (trapAllowed)
-	  canTrap = flags.ov = flags.tr1 = flags.cy1 = 1;
-	else
-	  flags.cy1 = 1;
-      }
+      if (sum.sign)
+	canTrap = flags.ov = flags.tr1 = flags.cy1 = 1;
     } else if (!sum.sign) {
       flags.cy0 = flags.cy1 = 1;
     }
   }
 
-  // XXX not sure of this: Apparently OV is NOT a trap in exec mode on a KL10?
-  if (!flags.usr && canTrap) canTrap = 0;
-
   return canTrap ? iTrap : iNormal;
 }
 
 
-// Given add operands a and b and resulting diff, set flags for a SUB operation.
+// Given add operands a and b and resulting diff, set flags for a SUB
+// operation. As for setADDFlags(), overflow is flagged in either mode.
 IResult KM10::setSUBFlags(W36 a, W36 b, W36 diff) {
-  const int trapAllowed = flags.usr;
   int canTrap = 0;
 
   if (!a.sign) {
@@ -385,13 +518,8 @@ IResult KM10::setSUBFlags(W36 a, W36 b, W36 diff) {
       if (!diff.sign) flags.cy0 = flags.cy1 = 1;
     } else {
 
-      if (diff.sign) {
-
-	if (trapAllowed)
-	  canTrap = flags.ov = flags.tr1 = flags.cy1 = 1;
-	else
-	  flags.cy1 = 1;
-      }
+      if (diff.sign)
+	canTrap = flags.ov = flags.tr1 = flags.cy1 = 1;
     }
   } else {
 
@@ -399,18 +527,13 @@ IResult KM10::setSUBFlags(W36 a, W36 b, W36 diff) {
 
       if (diff.sign)
 	flags.cy0 = flags.cy1 = 1;
-      else if (trapAllowed)
-	canTrap = flags.cy0 = flags.ov = flags.tr1 = 1;
       else
-	flags.cy0 = 1;
+	canTrap = flags.cy0 = flags.ov = flags.tr1 = 1;
     } else {
       if (!diff.sign) flags.cy0 = flags.cy1 = 1;
     }
   }
 
-  // XXX not sure of this: Apparently OV is NOT a trap in exec mode on a KL10?
-  if (!flags.usr && canTrap) canTrap = 0;
-
   return canTrap ? iTrap : iNormal;
 }
 
@@ -533,7 +656,7 @@ void KM10::NoDevice::putConditions(unsigned v) {
 //     |   |<---- and at the 'E' four chars later at exit.
 // T ^,AEh,E,LF@,E,O?m,FC,E,Aru,Lj@,F,AEv,F@@,E,,AJB,L,AnT,F@@,E,Arz,Lk@,F,AEw,F@@,E,E,ND@,K,B,NJ@,E,B`K
 
-static uint16_t getWord(ifstream &inS, [[maybe_unused]] const char *whyP) {
+static uint16_t getWord(ifstream &inS, Logger &logger, [[maybe_unused]] const char *whyP) {
   unsigned v = 0;
 
   for (;;) {
@@ -575,9 +698,9 @@ tuple<unsigned, unsigned> KM10::loadA10(const char *fileNameP) {
     inS.get();
 
     // Count of words on this line.
-    uint16_t wc = getWord(inS, "wc");
+    uint16_t wc = getWord(inS, logger, "wc");
 
-    addr = getWord(inS, "addr");
+    addr = getWord(inS, logger, "addr");
     addr |= wc & 0xC000;
     wc &= ~0xC000;
 
@@ -590,7 +713,7 @@ tuple<unsigned, unsigned> KM10::loadA10(const char *fileNameP) {
 
     switch (recType) {
     case 'Z':
-      zeroCount = getWord(inS, "zeroCount");
+      zeroCount = getWord(inS, logger, "zeroCount");
 
       if (zeroCount == 0) zeroCount = 64*1024;
 
@@ -603,7 +726,7 @@ tuple<unsigned, unsigned> KM10::loadA10(const char *fileNameP) {
 
 	if (a > highestAddr) highestAddr = a;
 	if (a < lowestAddr) lowestAddr = a;
-	memP[a].u = 0;
+	physicalP[a].u = 0;
       }
 
       break;
@@ -612,9 +735,9 @@ tuple<unsigned, unsigned> KM10::loadA10(const char *fileNameP) {
       if (wc == 0) {pc.lhu = 0; pc.rhu = addr;}
 
       for (unsigned offset = 0; offset < wc/3; ++offset) {
-	uint64_t w0 = getWord(inS, "w0");
-	uint64_t w1 = getWord(inS, "w1");
-	uint64_t w2 = getWord(inS, "w2");
+	uint64_t w0 = getWord(inS, logger, "w0");
+	uint64_t w1 = getWord(inS, logger, "w1");
+	uint64_t w2 = getWord(inS, logger, "w2");
 	uint64_t w = ((w2 & 0x0F) << 32) | (w1 << 16) | w0;
 	uint64_t a = addr + offset;
 	W36 w36(w);
@@ -629,7 +752,7 @@ tuple<unsigned, unsigned> KM10::loadA10(const char *fileNameP) {
 		   << logger.endl;
 	}
 
-	memP[a].u = w;
+	physicalP[a].u = w;
       }
 
       inS.ignore(numeric_limits<streamsize>::max(), '\n');
@@ -649,7 +772,7 @@ tuple<unsigned, unsigned> KM10::loadA10(const char *fileNameP) {
 
 static uint64_t getCPUTimeNS() {
   struct timespec ts;
-  if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts) != 0) throw runtime_error("Failed to get CPU time");
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) throw runtime_error("Failed to get CPU time");
   return (uint64_t) ts.tv_sec * 1000ll*1000ll*1000ll + ts.tv_nsec;
 }
 
@@ -664,88 +787,145 @@ void KM10::emulate() {
 
   // The instruction loop.
   fetchPC = pc;
+  updateBreakpoints();		// Breakpoints survive restart
+
+  // True while `fetchPC` is the PHYSICAL address of a trap or
+  // interrupt vector instruction in the EPT or UPT.
+  bool vectorFetch = false;
+
+  // True while the instruction about to run came from a PI vector
+  // rather than a trap vector.
+  bool piVector = false;
 
   for (;;) {
 
     // Keep the cache sweep timer ticking until it goes DING.
     cca.handleSweep();
 
-    // Handle execution breakpoints.
-    if (executeBPs.contains(fetchPC.vma)) running = false;
+    // Let the DTE20 pass along CTY input the console I/O thread has
+    // for it.
+    if (dte.attention.load(memory_order_relaxed)) dte.service();
+
+    // Likewise devices that have finished work on their own threads.
+    if (asyncAttention.load(memory_order_relaxed)) serviceAsyncDevices();
+
+    // Refresh what external tools see of us now and then.
+    if (introspectionP && (instructionCounter & (Introspection::publishInterval - 1)) == 0) {
+      introspectionP->publish();
+    }
+
+    // Take a checkpoint when one is due, but only between whole
+    // instructions.
+    if (checkpointerP && instructionCounter >= checkpointerP->nextAt &&
+	!vectorFetch && !inInterrupt && fetchPC.vma == pc.vma)
+    {
+      checkpointerP->checkpoint();
+    }
+
+    // Handle execution breakpoints. Only look for the exact address
+    // if there is a breakpoint somewhere on this page.
+    if (executeBPPages[fetchPC.vma >> 9] && executeBPs.contains(fetchPC.vma)) running = false;
 
     // Prepare to fetch next iw and remember if it's an interrupt or
     // trap.
     if ((flags.tr1 || flags.tr2) && pag.pagerEnabled()) {
       // We have a trap.
-      fetchPC = eptAddressFor(flags.tr1 ? &eptP->trap1Insn : &eptP->stackOverflowInsn);
+      // Exec mode traps vector through the EPT, user mode through the UPT.
+      W36 *trap1P = flags.usr ? &uptP->trap1Insn : &eptP->trap1Insn;
+      W36 *trap2P = flags.usr ? &uptP->stackOverflowInsn : &eptP->stackOverflowInsn;
+      fetchPC = physAddressFor(flags.tr1 ? trap1P : trap2P);
+      flags.tr1 = flags.tr2 = 0;	// Taking the trap clears them
+      vectorFetch = true;
       inInterrupt = true;
+      piVector = false;
       /* if (logger.ints) */ logger.s << ">>>>> trap cycle PC now=" << pc.fmtVMA()
 				      << logger.endl << flush;
     } else if (W36 vec = pi.setUpInterruptCycleIfPending(); vec != W36(0)) {
       // We have an active interrupt.
       fetchPC = vec;
+      vectorFetch = true;
       inInterrupt = true;
+      piVector = true;
       if (logger.ints) logger.s << ">>>>> interrupt cycle PC=" << pc.fmtVMA()
 				<< "  vector=" << fetchPC.fmtVMA()
 				<< logger.endl << flush;
     }
 
-    // Fetch the instruction and save PC (fetch, really) history.
-    ++instructionCounter;
-    iw = memGetN(fetchPC);
-    debugger.pcRing.add(fetchPC);
+    IResult result;
 
-    if (opBPs.contains(iw.op)) running = false;
+    // A page fail anywhere from the fetch through the end of the
+    // instruction aborts the instruction and runs the page fail trap.
+    try {
+      // Fetch the instruction and save PC (fetch, really) history.
+      ++instructionCounter;
+      iw = vectorFetch ? pag.physWord(fetchPC.vma) : memGetN(fetchPC);
+      debugger.pcRing.add(fetchPC);
 
-    // If we're debugging, this is where we pause to let the user
-    // inspect and change things. The debugger tells us what our next
-    // action should be based on its return value.
-    if (!running) {
-      runNS += getCPUTimeNS() - startNS;
+      if (opBPMask[iw.op]) running = false;
 
-      switch (debugger.debug()) {
-      case Debugger::step:		// Debugger has set step count in nSteps.
-	break;
+      // If we're debugging, this is where we pause to let the user
+      // inspect and change things. The debugger tells us what our next
+      // action should be based on its return value.
+      if (!running) {
+	runNS += getCPUTimeNS() - startNS;
+	if (introspectionP) introspectionP->publish();
 
-      case Debugger::run:		// Continue from current PC.
-	break;
+	switch (debugger.debug()) {
+	case Debugger::step:		// Debugger has set step count in nSteps.
+	  break;
 
-      case Debugger::quit:		// Quit from emulator.
-	return;
+	case Debugger::run:		// Continue from current PC.
+	  break;
 
-      case Debugger::restart:		// Restart emulator - total reboot
-	return;
+	case Debugger::quit:		// Quit from emulator.
+	  return;
 
-      case Debugger::pcChanged:		// PC changed by debugger - go fetch again
-	fetchPC = pc;
-	startNS = getCPUTimeNS();	// Restart time - debugger is exiting.
-	continue;
+	case Debugger::restart:		// Restart emulator - total reboot
+	  return;
+
+	case Debugger::pcChanged:		// PC changed by debugger - go fetch again
+	  fetchPC = pc;
+	  vectorFetch = false;
+	  updateBreakpoints();
+	  startNS = getCPUTimeNS();	// Restart time - debugger is exiting.
+	  continue;
+
+	default:				// This should never happen...
+	  assert("Debugger returned unknown action" == nullptr);
+	  return;
+	}
 
-      default:				// This should never happen...
-	assert("Debugger returned unknown action" == nullptr);
-	return;
+	updateBreakpoints();			// In case the debugger changed them
+	startNS = getCPUTimeNS();		// Restart time - debugger is exiting.
       }
 
-      startNS = getCPUTimeNS();		// Restart time - debugger is exiting.
-    }
 
+      // Handle nSteps so we don't keep running if we run out of step
+      // count. THIS instruction is our single remaining step. If
+      // nSteps is zero we just keep going "forever".
+      if (nSteps > 0) {
+	if (--nSteps <= 0) running = false;
+      }
 
-    // Handle nSteps so we don't keep running if we run out of step
-    // count. THIS instruction is our single remaining step. If
-    // nSteps is zero we just keep going "forever".
-    if (nSteps > 0) {
-      if (--nSteps <= 0) running = false;
-    }
+      if (logger.loggingToFile && logger.pc) {
+	logger.s << fetchPC.fmtVMA() << ": " << debugger.dump(iw, fetchPC);
+      }
 
-    if (logger.loggingToFile && logger.pc) {
-      logger.s << fetchPC.fmtVMA() << ": " << debugger.dump(iw, fetchPC);
-    }
+      // Compute effective address.
+      ea.u = getEA(iw.i, iw.x, iw.y);
 
-    // Compute effective address.
-    ea.u = getEA(iw.i, iw.x, iw.y);
+      // Execute the instruction in `iw`.
+      result = (this->*ops[iw.op])();
+    } catch (const PAGDevice::PageFail &pf) {
+      pageFailTrap(pf);
+      vectorFetch = false;
+      continue;
+    }
 
-    // Execute the instruction in `iw`.
-    IResult result = (this->*ops[iw.op])();
+    // Only the second word of a trap or interrupt vector is fetched
+    // physically. Anything else changes `fetchPC` to a virtual address.
+    const bool wasVectorFetch = vectorFetch;
+    vectorFetch = false;
 
     // If we "continue" we have to set up `fetchPC` to point to the
     // instruction to fetch and execute next. If we "break" (from the
@@ -753,10 +933,18 @@ void KM10::emulate() {
     switch (result) {
     case iNormal:
 
+      // A trap instruction that neither jumps nor skips is the whole
+      // trap: resume at PC, which is already past the instruction
+      // that trapped. The next EPT/UPT word is a different trap's.
+      //
       // If we're in an interrupt vector and we get iNormal, just
       // fetch next word in the vector.
-      if (inInterrupt) {
+      if (inInterrupt && !piVector) {
+	inInterrupt = false;
+	pcOffset = 0;
+      } else if (inInterrupt) {
 	fetchPC = fetchPC.vma + 1; // Increment to second word in vector.
+	vectorFetch = wasVectorFetch;
 	pcOffset = 0;
 	continue;
       } else {
@@ -769,8 +957,14 @@ void KM10::emulate() {
       // Any skip instruction that skips.
 
       // If we're in an interrupt vector and we get iSkip, vector is
-      // done so resume normal flow.
-      if (inInterrupt) {
+      // done so resume normal flow. A PI vector instruction that
+      // skips dismisses its interrupt and returns to the instruction
+      // it interrupted, which hasn't run yet. Only its own level is
+      // released; a lower one it interrupted is still being served.
+      if (inInterrupt && piVector) {
+	pcOffset = 0;
+	pi.releaseLevel();
+      } else if (inInterrupt) {
 	pcOffset = 1;
 	inInterrupt = false;
       } else {
@@ -822,117 +1016,12 @@ void KM10::emulate() {
 
     if (logger.pc || logger.mem || logger.ac || logger.io || logger.dte)
       logger.s << logger.endl << flush;
-
-    cout << flush;
   }
 
+  // Whatever instructions have said on stdout should show up now
+  // we've stopped.
+  cout << flush;
+
   // Restore console to normal
   dte.disconnect();
 }
-
-
-//////////////////////////////////////////////////////////////
-// This is invoked in a loop to allow the "restart" command to work
-// properly. Therefore this needs to clean up the state of the machine
-// before it returns. This is mostly done by auto destructors.
-static int loopedMain(int argc, char *argv[]) {
-  CLI::App app;
-
-  // Definitions for our command line options
-  app.option_defaults()->always_capture_default();
-
-  bool dVal{true};
-  //    app.add_option("-d,--debug", dVal, "run the built-in debugger instead of starting execution");
-
-  
-  unsigned mVal{4096};
-  app.add_option("-m", mVal, "Size (in Kwords) of KM10 main memory")
-    ->check([](const string &str) {
-      unsigned size = atol(str.c_str());
-
-      if (size >= 256 && size <= 4096 && (size & 0xFF) == 0) {
-	return string{};	// Good value!
-      } else {
-	return string{"The '-m' size in Kwords must be a multiple of 256 from 256K to 4096K words."};
-      }
-    });
-  
-  //  string lVal{"../images/klad/dfkaa.a10"};
-  vector<string> lVal{
-    //    "../images/klad20-a10s/diamon.a10",
-    "../images/klad20-a10s/subrtn.a10",
-    "../images/klad20-a10s/dfkcb.a10",
-  };
-  app.add_option("-l,--load", lVal, ".A10 file(s) to load (may be used muliple times)")
-    ->delimiter(',')
-    ->expected(0,-1);
-
-  //  string rVal{"../images/klad/dfkaa.rel"};
-  //  string rVal{"../images/klad-compiled/dfkcb.rel"};
-  vector<string> rVal{};
-  app.add_option("-r,--rel", rVal, ".REL file(s) to load symbols from (may be used multiple times)")
-    ->delimiter(',')
-    ->expected(0,-1);
-
-  string logFileVal;
-  app.add_option("--log-file", logFileVal, "file to log to");
-
-  vector<string> logVal;
-  app.add_option("-L,--log", logVal, "--log=X,Y,Z (ac,io,pc,dte,mem,load,ea,ints)")
-    ->delimiter(',')
-    ->each([](string s) {
-      if (s == "ac")        logger.ac = true;
-      else if (s == "io")   logger.io = true;
-      else if (s == "pc")   logger.pc = true;
-      else if (s == "dte")  logger.dte = true;
-      else if (s == "mem")  logger.mem = true;
-      else if (s == "load") logger.load = true;
-      else if (s == "ea")   logger.ea = true;
-      else if (s == "ints") logger.ints = true;
-      else
-	throw CLI::ValidationError(s, "Not a valid logger type flag");
-    });
-
-  try {
-    app.parse(argc, argv);
-  } catch(const CLI::Error &e) {
-    cerr << "Command line error: " << endl << flush;
-    return app.exit(e);
-  }
-
-  if (logFileVal != "") logger.logToFile(logFileVal);
-
-  KM10 km10(mVal*1024, aOBPs, aGBPs, aPBPs, eBPs);
-  assert(sizeof(*km10.eptP) == 512 * 8);
-  assert(sizeof(*km10.uptP) == 512 * 8);
-
-  for (auto s: lVal) {
-    auto [low, hi] = km10.loadA10(s.c_str());
-    cerr << "[Loaded " << s << "  " << W36(low).fmt18() << " .. " << W36(hi).fmt18();
-    if (km10.pc.u != 0) cerr << "  start=" << km10.pc.fmtVMA();
-    cerr << "]" << logger.endl;
-    
-  }
-
-  for (auto s: rVal) km10.debugger.loadREL(s.c_str());
-
-  // Make sure we defined very ops entry.
-  if (dVal) for (unsigned op=0; op < 512; ++op) assert(km10.ops[op] != nullptr);
-
-  km10.running = !dVal;
-  km10.emulate();
-
-  return km10.restart ? 1 : 0;
-}
-
-
-////////////////////////////////////////////////////////////////
-int main(int argc, char *argv[]) {
-  int st;
-  
-  while ((st = loopedMain(argc, argv)) > 0) {
-    cerr << "[restarting]" << endl;
-  }
-
-  return st;
-}
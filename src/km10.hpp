@@ -60,19 +60,29 @@
 #include <array>
 #include <assert.h>
 #include <unordered_set>
+#include <bitset>
 #include <atomic>
 #include <string>
 
 using namespace std;
 
 #include "word.hpp"
+#include "context.hpp"
+#include "logger.hpp"
 #include "apr.hpp"
 #include "cca.hpp"
 #include "mtr.hpp"
 #include "pag.hpp"
+#include "physmem.hpp"
+#include "introspect.hpp"
+#include "checkpoint.hpp"
+#include "snapshot.hpp"
+#include "machstate.hpp"
 #include "pi.hpp"
 #include "tim.hpp"
 #include "dte20.hpp"
+#include "asyncdev.hpp"
+#include "rh20.hpp"
 #include "device.hpp"
 #include "debugger.hpp"
 #include "iresult.hpp"
@@ -81,6 +91,36 @@ using namespace std;
 class KM10 {
 
 public:
+  // Our logging settings and breakpoint tables. These must come
+  // before our devices, which use them as they're constructed.
+  MachineContext &context;
+  Logger &logger;
+
+  // Our devices, indexed by I/O device number. Each adds itself here
+  // as it is constructed.
+  map<unsigned, Device *> devices;
+
+  // What I/O instructions dispatch through, indexed by the seven bit
+  // device number in the instruction. Each device puts itself here
+  // as it is constructed, and numbers with no device go to
+  // `noDevice`.
+  struct IOEntry {
+    Device *devP;
+    Device::IOHandlers handlers;
+  };
+
+  array<IOEntry, 128> ioTable;
+
+  // Devices that do their work on threads of their own (see
+  // asyncdev.hpp), and a bit for each that has finished work for us
+  // to pick up between instructions.
+  vector<AsyncDevice *> asyncDevices;
+  atomic<uint64_t> asyncAttention;
+
+  // The RH20s we were configured with, by number. Each adds itself
+  // here as it is constructed, and we delete them.
+  array<RH20 *, 8> rh20s;
+
   APRDevice apr;
   CCADevice cca;
   MTRDevice mtr;
@@ -102,7 +142,7 @@ public:
   Debugger debugger;
 
 
-  using BreakpointTable = unordered_set<unsigned>;
+  using BreakpointTable = MachineContext::BreakpointTable;
 
 
   // This is an implementation of an opcode to be saved in the ops[].
@@ -118,10 +158,9 @@ public:
 
   // Constructor and destructor
   KM10(unsigned nMemoryWords,
-       BreakpointTable &aOBPs,
-       BreakpointTable &aGBPs,
-       BreakpointTable &aPBPs,
-       BreakpointTable &eBPs);
+       MachineContext &aContext,
+       bool useHostMMU = false,
+       const PhysicalMemory::Backend &memoryBackend = PhysicalMemory::Backend{});
 
   ~KM10();
 
@@ -136,18 +175,31 @@ public:
   // placed here.
   unsigned pcOffset;
 
+  // Physical memory, which reports NXM for references past
+  // `memorySize`.
+  PhysicalMemory physMem;
+
   // Pointer to physical memory.
   W36 *physicalP;
 
   // Pointer to current virtual memory mapping.
   W36 *memP;
 
-  // Pointer to kernel mode virtual memory mapping.
+  // Pointer to kernel mode virtual memory mapping. This is only
+  // non-null when we use the HostMMU backend.
   W36 *kernelMemP;
 
-  // Pointer to user mode virtual memory mapping.
+  // Pointer to user mode virtual memory mapping. This is only
+  // non-null when we use the HostMMU backend.
   W36 *userMemP;
   
+  // Our state published for external tools, or null if we aren't
+  // publishing.
+  Introspection *introspectionP;
+
+  // Our checkpointer, or null if we aren't taking checkpoints.
+  Checkpointer *checkpointerP;
+
   // The "RUN flop"
   volatile atomic<bool> running;
 
@@ -317,16 +369,33 @@ public:
   unordered_set<unsigned> &addressGBPs; // Address GET breakpoints
   unordered_set<unsigned> &addressPBPs; // Address PUT breakpoints
   unordered_set<unsigned> &executeBPs;	// Execution breakpoints
+
+  // Precomputed from `executeBPs` and `opBPs` by `updateBreakpoints()`
+  // so the instruction loop tests a bit instead of hashing. A page's
+  // bit is set if any execution breakpoint is on that page.
+  bitset<HostMMU::nVirtualPages> executeBPPages;
+  bitset<512> opBPMask;
   uint64_t instructionCounter;
   uint64_t runNS;
 
+  // Recompute breakpoint and watchpoint bitmaps after the debugger
+  // has changed the breakpoint sets.
+  void updateBreakpoints();
+
   // Call by PAG when DATAO changes current AC block number.
   void updateACBlock(unsigned acBlock);
 
 
-  // Return the KM10 memory VIRTUAL address (EPT is in kernel virtual
-  // space) for the specified pointer into the EPT.
-  W36 eptAddressFor(const W36 *eptEntryP);
+  // Return the PHYSICAL address for the specified pointer into the
+  // EPT or UPT. Interrupt and trap vectors are fetched from here.
+  W36 physAddressFor(const W36 *entryP);
+
+  // Abort the current instruction and run the page fail trap.
+  void pageFailTrap(const PAGDevice::PageFail &pf);
+
+  // Run the completions of asynchronous devices that have flagged
+  // them in `asyncAttention`.
+  void serviceAsyncDevices();
 
   // AC and memory accessors.
   W36 acGet();
@@ -367,6 +436,12 @@ public:
 
   tuple<unsigned, unsigned> loadA10(const char *fileNameP);
 
+  // Save and restore processor and device state (but not memory) for
+  // checkpoints and snapshots. This is only meaningful between
+  // instructions, when `fetchPC` is `pc`.
+  void saveState(MachineState &ms);
+  void restoreState(MachineState &ms);
+
 
   // This is how our subclasses (separately compiled) install their
   // OpcodeHandlers.
@@ -22,7 +22,15 @@ struct Logger {
 
 
   Logger()
-    : endl("\n")
+    : ac(false),
+      io(false),
+      pc(false),
+      dte(false),
+      mem(false),
+      load(false),
+      ea(false),
+      ints(false),
+      endl("\n")
   {
     logToTTY();
   }
@@ -49,6 +57,10 @@ struct Logger {
   void logToTTY() {
     if (s.is_open()) s.close();
     s.open("/dev/tty");
+
+    // Without a terminal (e.g., under a job scheduler) use stderr.
+    if (!s.is_open()) s.open("/dev/stderr", ios::app);
+
     destination = "tty";
     endl = "\r\n";
     loggingToFile = false;
@@ -58,5 +70,3 @@ struct Logger {
   void nsd(KM10 &cpu, const string &context = "");
 };
 
-
-extern Logger logger;
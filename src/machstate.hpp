@@ -0,0 +1,37 @@
+// Processor and device state (everything but memory) as a flat list
+// of words, for checkpoints and snapshots.
+//
+// KM10 and each Device append their state with `put()` in a fixed
+// order and read it back in the same order with `get()`. Anything
+// that changes what or how much some part of the machine saves must
+// bump `currentVersion`, since old state can't be read any other way.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <stdexcept>
+
+using namespace std;
+
+
+struct MachineState {
+  static const inline uint64_t currentVersion = 3;
+
+  vector<uint64_t> words;
+  size_t next;
+
+  MachineState()
+    : words{},
+      next(0)
+  {}
+
+  void put(uint64_t w) {
+    words.push_back(w);
+  }
+
+  uint64_t get() {
+    if (next >= words.size()) throw runtime_error("Saved machine state is truncated");
+    return words[next++];
+  }
+};
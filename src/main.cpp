@@ -0,0 +1,255 @@
+#include <iostream>
+#include <assert.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+#include <CLI/CLI.hpp>
+
+#include "km10.hpp"
+#include "rp07.hpp"
+#include "tu78.hpp"
+#include "logger.hpp"
+
+
+//////////////////////////////////////////////////////////////
+// This is invoked in a loop to allow the "restart" command to work
+// properly. Therefore this needs to clean up the state of the machine
+// before it returns. This is mostly done by auto destructors.
+static int loopedMain(int argc, char *argv[], MachineContext &context) {
+  Logger &logger = context.logger;
+  CLI::App app;
+
+  // Definitions for our command line options
+  app.option_defaults()->always_capture_default();
+
+  bool dVal{true};
+  //    app.add_option("-d,--debug", dVal, "run the built-in debugger instead of starting execution");
+
+  
+  unsigned mVal{4096};
+  app.add_option("-m", mVal, "Size (in Kwords) of KM10 main memory")
+    ->check([](const string &str) {
+      unsigned size = atol(str.c_str());
+
+      if (size >= 256 && size <= 4096 && (size & 0xFF) == 0) {
+	return string{};	// Good value!
+      } else {
+	return string{"The '-m' size in Kwords must be a multiple of 256 from 256K to 4096K words."};
+      }
+    });
+  
+  //  string lVal{"../images/klad/dfkaa.a10"};
+  vector<string> lVal{
+    //    "../images/klad20-a10s/diamon.a10",
+    "../images/klad20-a10s/subrtn.a10",
+    "../images/klad20-a10s/dfkcb.a10",
+  };
+  app.add_option("-l,--load", lVal, ".A10 file(s) to load (may be used muliple times)")
+    ->delimiter(',')
+    ->expected(0,-1);
+
+  //  string rVal{"../images/klad/dfkaa.rel"};
+  //  string rVal{"../images/klad-compiled/dfkcb.rel"};
+  vector<string> rVal{};
+  app.add_option("-r,--rel", rVal, ".REL file(s) to load symbols from (may be used multiple times)")
+    ->delimiter(',')
+    ->expected(0,-1);
+
+  string memoryVal{"anon"};
+  app.add_option("--memory", memoryVal, "Memory backend: anon, thp, hugetlb, file:PATH, or shm:NAME")
+    ->check([](const string &str) {
+
+      try {
+	PhysicalMemory::Backend::parse(str);
+	return string{};
+      } catch (const invalid_argument &e) {
+	return string{e.what()};
+      }
+    });
+
+  string publishVal;
+  app.add_option("--publish", publishVal, "Publish machine state as shared memory object NAME for km10-inspect");
+
+  string checkpointVal;
+  app.add_option("--checkpoint", checkpointVal, "Write incremental checkpoints to this file");
+
+  unsigned checkpointIntervalVal{100};
+  app.add_option("--checkpoint-interval", checkpointIntervalVal, "Millions of instructions between checkpoints");
+
+  string resumeVal;
+  app.add_option("--resume", resumeVal, "Resume from checkpoint FILE[:N] (default is the last in FILE)");
+
+  string snapshotVal;
+  app.add_option("--snapshot", snapshotVal, "Save a snapshot of the machine to this file after loading");
+
+  string restoreVal;
+  app.add_option("--restore", restoreVal, "Start from a snapshot instead of loading .A10 and .REL files");
+
+  string consoleVal{"tty"};
+  app.add_option("--console", consoleVal, "CTY console: tty, pty, socket:PATH, stdio, or null");
+
+  vector<string> rp07Val;
+  app.add_option("--rp07", rp07Val, "RP07 pack image for units 0, 1, ... on RH20 0 (may be used multiple times)");
+
+  vector<string> tu78Val;
+  app.add_option("--tu78", tu78Val, "TU78 tape image (.tap) for the units on RH20 0 after the RP07s (may be used multiple times)");
+
+  bool diskLatencyVal{false};
+  app.add_flag("--disk-latency", diskLatencyVal, "Make disk seeks and transfers take as long as a real RP07's");
+
+  bool runVal{false};
+  app.add_flag("--run", runVal, "Start running instead of stopping in the debugger");
+
+  bool hostMMUVal{false};
+  app.add_flag("--host-mmu", hostMMUVal, "Keep memory in a memfd and translate through host MMU windows");
+
+  string logFileVal;
+  app.add_option("--log-file", logFileVal, "file to log to");
+
+  vector<string> logVal;
+  app.add_option("-L,--log", logVal, "--log=X,Y,Z (ac,io,pc,dte,mem,load,ea,ints)")
+    ->delimiter(',')
+    ->each([&](string s) {
+      if (s == "ac")        logger.ac = true;
+      else if (s == "io")   logger.io = true;
+      else if (s == "pc")   logger.pc = true;
+      else if (s == "dte")  logger.dte = true;
+      else if (s == "mem")  logger.mem = true;
+      else if (s == "load") logger.load = true;
+      else if (s == "ea")   logger.ea = true;
+      else if (s == "ints") logger.ints = true;
+      else
+	throw CLI::ValidationError(s, "Not a valid logger type flag");
+    });
+
+  try {
+    app.parse(argc, argv);
+  } catch(const CLI::Error &e) {
+    cerr << "Command line error: " << endl << flush;
+    return app.exit(e);
+  }
+
+  if (logFileVal != "") logger.logToFile(logFileVal);
+
+  // Published memory has to be in a store other processes can map.
+  PhysicalMemory::Backend memoryBackend = PhysicalMemory::Backend::parse(memoryVal);
+  bool publishedMemory = false;
+  if (publishVal != "") memoryBackend = Introspection::memoryBackendFor(publishVal, memoryBackend, publishedMemory);
+
+  KM10 km10(mVal*1024, context, hostMMUVal, memoryBackend);
+
+  try {
+    km10.dte.setConsole(Console::make(consoleVal));
+  } catch (const exception &e) {
+    cerr << "Console error: " << e.what() << endl;
+    return -1;
+  }
+
+  if (rp07Val.size() + tu78Val.size() > 8) {
+    cerr << "An RH20 has room for only eight drives" << endl;
+    return -1;
+  }
+
+  if (!rp07Val.empty() || !tu78Val.empty()) {
+    RH20 *rhP = new RH20(0, km10);	// km10 deletes this
+    unsigned unit = 0;
+
+    try {
+
+      for (auto &path: rp07Val) {
+	rhP->attach(unit, new RP07(path, unit, diskLatencyVal ? RP07::rp07Latency : RP07::noLatency));
+	++unit;
+      }
+
+      for (auto &path: tu78Val) {
+	rhP->attach(unit, new TU78(path, unit));
+	++unit;
+      }
+    } catch (const exception &e) {
+      cerr << "Disk or tape error: " << e.what() << endl;
+      return -1;
+    }
+  }
+  if (publishVal != "") km10.introspectionP = new Introspection(km10, publishVal, publishedMemory);
+
+  assert(sizeof(*km10.eptP) == 512 * 8);
+  assert(sizeof(*km10.uptP) == 512 * 8);
+
+  if (restoreVal != "" && resumeVal != "") {
+    cerr << "Command line error: use only one of --restore and --resume" << endl;
+    return -1;
+  }
+
+  // A snapshot or checkpoint has all of memory and the symbols, so
+  // there's nothing to load.
+  if (restoreVal != "") {
+    Snapshot::restore(km10, restoreVal);
+    cerr << "[Restored snapshot " << restoreVal << "  PC=" << km10.pc.fmtVMA() << "]" << logger.endl;
+    lVal.clear();
+    rVal.clear();
+  }
+
+  if (resumeVal != "") {
+    string path = resumeVal;
+    int index = -1;
+
+    if (auto colon = path.rfind(':'); colon != string::npos && colon + 1 < path.size() &&
+	path.find_first_not_of("0123456789", colon + 1) == string::npos)
+    {
+      index = stoi(path.substr(colon + 1));
+      path = path.substr(0, colon);
+    }
+
+    index = Checkpointer::restore(km10, path, index);
+    cerr << "[Resumed from checkpoint " << index << " of " << path
+	 << " at " << km10.instructionCounter << " instructions  PC=" << km10.pc.fmtVMA() << "]"
+	 << logger.endl;
+    lVal.clear();
+  }
+
+  for (auto s: lVal) {
+    auto [low, hi] = km10.loadA10(s.c_str());
+    cerr << "[Loaded " << s << "  " << W36(low).fmt18() << " .. " << W36(hi).fmt18();
+    if (km10.pc.u != 0) cerr << "  start=" << km10.pc.fmtVMA();
+    cerr << "]" << logger.endl;
+    
+  }
+
+  // Loading symbols leaves a dump of them behind only if asked.
+  if (logger.load) km10.debugger.logFileName = "rel-symbols.log";
+  for (auto s: rVal) km10.debugger.loadREL(s.c_str());
+
+  if (snapshotVal != "") {
+    Snapshot::save(km10, snapshotVal);
+    cerr << "[Saved snapshot " << snapshotVal << "]" << logger.endl;
+  }
+
+  if (checkpointVal != "") {
+    km10.checkpointerP = new Checkpointer(km10, checkpointVal, (uint64_t) checkpointIntervalVal * 1000 * 1000);
+  }
+
+  // Make sure we defined very ops entry.
+  if (dVal) for (unsigned op=0; op < 512; ++op) assert(km10.ops[op] != nullptr);
+
+  km10.running = !dVal || runVal;
+  km10.emulate();
+
+  return km10.restart ? 1 : 0;
+}
+
+
+////////////////////////////////////////////////////////////////
+int main(int argc, char *argv[]) {
+  int st;
+
+  // Our context is outside of the looped main so breakpoints stick
+  // across restart.
+  MachineContext context;
+  
+  while ((st = loopedMain(argc, argv, context)) > 0) {
+    cerr << "[restarting]" << endl;
+  }
+
+  return st;
+}
@@ -13,3 +13,15 @@ unsigned MTRDevice::getConditions() {
 void MTRDevice::putConditions(unsigned v) {
   mtrState.u =  v;
 }
+
+
+void MTRDevice::saveState(MachineState &ms) {
+  Device::saveState(ms);
+  ms.put(mtrState.u);
+}
+
+
+void MTRDevice::restoreState(MachineState &ms) {
+  Device::restoreState(ms);
+  mtrState.u = ms.get();
+}
@@ -51,11 +51,14 @@ struct MTRDevice: Device {
 
   // Constructors
   MTRDevice(KM10 &cpu):
-    Device(024, "MTR", cpu),
+    Device(005, "MTR", cpu),
     mtrState(0)
   { }
 
 
   virtual unsigned getConditions();
   virtual void putConditions(unsigned v);
+
+  virtual void saveState(MachineState &ms) override;
+  virtual void restoreState(MachineState &ms) override;
 };
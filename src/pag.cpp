@@ -1,16 +1,20 @@
 #include "word.hpp"
 #include "device.hpp"
 #include "pag.hpp"
+#include "apr.hpp"
 #include "km10.hpp"
 #include "iresult.hpp"
 
 
 // Constructors
 PAGDevice::PAGDevice(KM10 &cpu):
-  Device(003, "PAG", cpu)
+  Device(002, "PAG", cpu),
+  hostMMUP(nullptr),
+  watchedPages(HostMMU::nVirtualPages, 0)
 {
   processContext.u = 0;
   pagState.u = 0;
+  invalidateAll();
 }
 
 
@@ -26,13 +30,324 @@ W36 PAGDevice::getPCW() const {
 }
 
 
+// Reference a physical word for the pager or a device. Physical
+// addresses are 22 bits. PhysicalMemory reports references to
+// non-existent memory when they are made.
+W36 &PAGDevice::physWord(unsigned pa) {
+  return km10.physicalP[pa & (PhysicalMemory::maxWords - 1)];
+}
+
+
+// Check age and update the CST entry for physical page `ppn`.
+// Returns false if the age field says the page must fail.
+bool PAGDevice::updateCST(unsigned ppn, bool forWrite, PFWord &pfw) {
+  const W36 cstBase = km10.ACBlocks[6][2];
+
+  // Monitor isn't using a CST.
+  if (cstBase.u == 0) return true;
+
+  W36 &cste = physWord(cstBase.vma + ppn);
+
+  // Age of zero means the monitor wants to know about this
+  // reference.
+  if ((cste.u >> 30) == 0) return false;
+
+  cste = (cste.u & km10.ACBlocks[6][0].u) | km10.ACBlocks[6][1].u | (forWrite ? 1 : 0);
+  pfw.modified = cste.u & 1;
+  return true;
+}
+
+
+// Evaluate a pointer chain starting at `p`, accumulating access bits
+// into `access`, and return true with `ppn` set to the physical page
+// it resolves to. Returns false if the chain ends in a pointer that
+// denies access or a page that is not in core.
+bool PAGDevice::evalPointer(PagePointer p, bool update,
+			    PagePointer &access, PFWord &pfw, unsigned &ppn)
+{
+  const unsigned sptBase = km10.ACBlocks[6][3].vma;
+
+  // A real KL10 will loop forever (interruptibly) on a circular
+  // indirect chain. We give up instead.
+  for (unsigned depth=0; depth < maxIndirections; ++depth) {
+    access.writable &= p.writable;
+    access.publicAccess &= p.publicAccess;
+    access.cache &= p.cache;
+    access.keep &= p.keep;
+
+    switch (p.type) {
+    case PagePointer::immediate:
+      if (p.storageMedium != 0) return false;
+      ppn = p.ppn;
+      return true;
+
+    case PagePointer::shared: {
+      PagePointer spte{physWord(sptBase + p.sptIndex)};
+      if (spte.storageMedium != 0) return false;
+      ppn = spte.ppn;
+      return true;
+    }
+
+    case PagePointer::indirect: {
+      PagePointer spte{physWord(sptBase + p.sptIndex)};
+      if (spte.storageMedium != 0) return false;
+      if (update && !updateCST(spte.ppn, false, pfw)) return false;
+      p = physWord((spte.ppn << 9) + p.mapIndex).u;
+      break;
+    }
+
+    default:			// No access or reserved pointer type
+      return false;
+    }
+  }
+
+  return false;
+}
+
+
+// Walk the page tables for `va`. Returns true with `ppn` and
+// `access` set if the reference is allowed. In all cases `pfw` is set
+// up as the page fail word describing the reference.
+bool PAGDevice::walk(W36 va, bool forWrite, bool user, bool update,
+		     unsigned &ppn, PagePointer &access, PFWord &pfw)
+{
+  pfw.u = 0;
+  pfw.va = va.vma;
+  pfw.user = user;
+  pfw.paged = 1;
+  pfw.writeRef = forWrite;
+
+  access.u = 0;
+  access.writable = access.publicAccess = access.cache = access.keep = 1;
+
+  const unsigned section = va.vma >> 18;
+  const unsigned page = (va.vma >> 9) & 0777;
+  W36 *sectionTable = user ? km10.uptP->userSection : km10.eptP->execSection;
+
+  unsigned mapPage;
+  if (!evalPointer(sectionTable[section].u, update, access, pfw, mapPage)) return false;
+  if (update && !updateCST(mapPage, false, pfw)) return false;
+
+  if (!evalPointer(physWord((mapPage << 9) + page).u, update, access, pfw, ppn)) return false;
+
+  pfw.accessible = 1;
+  pfw.writable = access.writable;
+  pfw.publicAccess = access.publicAccess;
+  pfw.cache = access.cache;
+
+  if (forWrite && !access.writable) return false;
+  if (update && !updateCST(ppn, forWrite, pfw)) return false;
+  return true;
+}
+
+
+// Translate `va` by walking the page tables, then fill the TLB entry
+// for it. Throws PageFail if the reference is not allowed.
+W36 *PAGDevice::fill(W36 va, bool forWrite, bool user) {
+  const unsigned vpn = va.vma >> 9;
+  TLBEntry &e = tlb[user][vpn % tlbSize];
+  unsigned ppn;
+  bool writable;
+  bool keep;
+
+  if (!pagState.enablePager || !pagState.tops2Paging) {
+    // Unpaged references use only the in-section address.
+    ppn = vpn & 0777;
+    writable = true;
+    keep = false;
+  } else {
+    PagePointer access;
+    PFWord pfw;
+
+    if (!walk(va, forWrite, user, true, ppn, access, pfw)) {
+      if (logger.mem) logger.s << "; page fail " << W36(pfw.u).fmt36();
+      throw PageFail(pfw);
+    }
+
+    // The page is only valid for writes once its CST modified bit
+    // has been set by a write reference (or if there is no CST).
+    writable = access.writable && (forWrite || km10.ACBlocks[6][2].u == 0);
+    keep = access.keep;
+  }
+
+  const unsigned pa = (ppn << 9) | (va.vma & 0777);
+
+  const unsigned watch = watchedPages[vpn];
+  if (watch) checkWatch(va, forWrite, user);
+
+  // References through this TLB entry to non-existent memory fault
+  // in PhysicalMemory, which reports the NXM. The host MMU window
+  // can't map non-existent memory, so we report those here on each
+  // translation.
+  if (hostMMUP && pa >= km10.memorySize) {
+    km10.apr.nonExistentMemory(pa);
+    hostMMUP->mapNXMPage(user, vpn);
+    return &physWord(pa);
+  }
+
+  // A read fill of a page we already had for writing must not lose
+  // write access.
+  const bool wasWritable = e.writeVPN == vpn;
+  writable = writable || wasWritable;
+  e.pageP = km10.physicalP + (ppn << 9);
+  e.readVPN = (watch & watchRead) ? invalidVPN : vpn;
+  e.writeVPN = (writable && !(watch & watchWrite)) ? vpn : invalidVPN;
+  e.keep = keep;
+  if (hostMMUP) hostMMUP->mapPage(user, vpn, ppn, writable, keep, watch);
+  return e.pageP + (va.vma & 0777);
+}
+
+
+// Translate `va` without side effects on the TLB or CST for MAP.
+// Returns a page fail word, with the physical address in the `va`
+// field if the translation succeeded.
+PAGDevice::PFWord PAGDevice::map(W36 va, bool user) {
+  PFWord pfw;
+
+  if (!pagState.enablePager || !pagState.tops2Paging) {
+    pfw.va = va.rhu;
+    pfw.accessible = pfw.writable = 1;
+    return pfw;
+  }
+
+  unsigned ppn;
+  PagePointer access;
+  if (walk(va, false, user, false, ppn, access, pfw)) pfw.va = (ppn << 9) | (va.vma & 0777);
+  return pfw;
+}
+
+
+void PAGDevice::updateWatchpoints() {
+  vector<uint8_t> newWatched(HostMMU::nVirtualPages, 0);
+
+  for (auto a: km10.addressGBPs) newWatched[(a >> 9) % HostMMU::nVirtualPages] |= watchRead;
+  for (auto a: km10.addressPBPs) newWatched[(a >> 9) % HostMMU::nVirtualPages] |= watchWrite;
+
+  const auto &brk = km10.apr.breakState;
+  if (brk.read || brk.fetch) newWatched[brk.vma >> 9] |= watchRead;
+  if (brk.write) newWatched[brk.vma >> 9] |= watchWrite;
+
+  // Drop translations for pages whose watch status changed so the
+  // next reference refills them with the right access.
+  for (unsigned vpn=0; vpn < HostMMU::nVirtualPages; ++vpn) {
+
+    if (newWatched[vpn] != watchedPages[vpn]) {
+      watchedPages[vpn] = newWatched[vpn];
+      invalidatePage(W36(vpn << 9));
+    }
+  }
+}
+
+
+void PAGDevice::checkWatch(W36 va, bool forWrite, bool user) {
+
+  if ((forWrite ? km10.addressPBPs : km10.addressGBPs).contains(va.vma)) {
+    if (logger.mem) logger.s << "; watchpoint " << va.fmtVMA();
+    km10.running = false;
+  }
+
+  // We can't tell an instruction fetch from a data read here, so a
+  // read of the word we are about to execute counts as a fetch.
+  const auto &brk = km10.apr.breakState;
+  const bool brkMatch = forWrite ? brk.write : (brk.read || (brk.fetch && va.vma == km10.fetchPC.vma));
+
+  if (brkMatch && brk.vma == va.vma && brk.user == user && !km10.flags.afi) {
+    PFWord pfw;
+    pfw.va = va.vma;
+    pfw.code = PFWord::addressBreakCode;
+    if (logger.mem) logger.s << "; address break " << va.fmtVMA();
+    throw PageFail(pfw);
+  }
+}
+
+
+// TLB invalidation.
+void PAGDevice::invalidateAll() {
+
+  for (auto &space: tlb) {
+
+    for (auto &e: space) {
+      e.readVPN = e.writeVPN = invalidVPN;
+      e.keep = false;
+    }
+  }
+
+  if (hostMMUP) {
+    hostMMUP->unmapAll(false);
+    hostMMUP->unmapAll(true);
+  }
+}
+
+
+// Drop all user translations and any exec translations that aren't
+// marked "keep".
+void PAGDevice::invalidateUser() {
+
+  for (auto &e: tlb[1]) e.readVPN = e.writeVPN = invalidVPN;
+
+  for (auto &e: tlb[0]) {
+    if (!e.keep) e.readVPN = e.writeVPN = invalidVPN;
+  }
+
+  if (hostMMUP) {
+    hostMMUP->unmapAll(true);
+    hostMMUP->unmapAll(false, true);
+  }
+}
+
+
+void PAGDevice::invalidatePage(W36 va) {
+  const unsigned vpn = va.vma >> 9;
+
+  for (auto &space: tlb) {
+    TLBEntry &e = space[vpn % tlbSize];
+    if (e.readVPN == vpn || e.writeVPN == vpn) e.readVPN = e.writeVPN = invalidVPN;
+  }
+
+  if (hostMMUP) {
+    hostMMUP->unmapPage(false, vpn);
+    hostMMUP->unmapPage(true, vpn);
+  }
+}
+
+
 unsigned PAGDevice::getConditions() {
   return pagState.u;
 }
 
 
 void PAGDevice::putConditions(unsigned v) {
+  const bool wasPaged = pagState.enablePager && pagState.tops2Paging;
   pagState.u = v;
+
+  // An EPT in non-existent memory reports NXM when it is referenced.
+  km10.eptP = (KM10::ExecutiveProcessTable *) &physWord(pagState.execBasePage << 9);
+
+  // Unpaged translations don't depend on anything CONO PAG can
+  // change, so there's no need to flush them if we stay unpaged.
+  // Diagnostics do a lot of CONO PAG with paging off.
+  if (wasPaged || (pagState.enablePager && pagState.tops2Paging)) invalidateAll();
+}
+
+
+void PAGDevice::saveState(MachineState &ms) {
+  Device::saveState(ms);
+  ms.put(processContext.u);
+  ms.put(pagState.u);
+}
+
+
+// Our translations and the CPU's view of the EPT, UPT, and current
+// AC block all follow from the restored state.
+void PAGDevice::restoreState(MachineState &ms) {
+  Device::restoreState(ms);
+  processContext.u = ms.get();
+  pagState.u = ms.get();
+
+  km10.eptP = (KM10::ExecutiveProcessTable *) &physWord(pagState.execBasePage << 9);
+  km10.uptP = (KM10::UserProcessTable *) &physWord(processContext.userBaseAddress << 9);
+  km10.updateACBlock(processContext.curACBlock);
+  invalidateAll();
 }
 
 
@@ -41,7 +356,13 @@ IResult PAGDevice::doDATAO(W36 iw, W36 ea) {
   if (logger.mem) logger.s << "; " << ea.fmt18();
   ProcessContext newContext{km10.memGet()};
 
-  if (newContext.loadUserBase) processContext.userBaseAddress = newContext.userBaseAddress;
+  if (newContext.loadUserBase) {
+    processContext.userBaseAddress = newContext.userBaseAddress;
+    km10.uptP = (KM10::UserProcessTable *) &physWord(processContext.userBaseAddress << 9);
+
+    invalidateUser();
+  }
+
   if (newContext.selectPrevContext) processContext.prevSection = newContext.prevSection;
 
   if (newContext.selectACBlocks) {
@@ -49,18 +370,27 @@ IResult PAGDevice::doDATAO(W36 iw, W36 ea) {
     processContext.curACBlock = newContext.curACBlock;
     km10.updateACBlock(newContext.curACBlock);
   }
-    
+
   // XXX We do not implement accounting, so ignore `doNotUpdateAccounts`.
 
   return iNormal;
 }
 
 
+// DFKEA expects the three "select" bits to read back as ones.
 IResult PAGDevice::doDATAI(W36 iw, W36 ea) {
   ProcessContext result{processContext};
-  result.loadUserBase = 0;
-  result.selectPrevContext = 0;
-  result.selectACBlocks = 0;
+  result.loadUserBase = 1;
+  result.selectPrevContext = 1;
+  result.selectACBlocks = 1;
   km10.memPut(result.u);
   return iNormal;
 }
+
+
+// CLRPT
+IResult PAGDevice::doBLKO(W36 iw, W36 ea) {
+  if (logger.mem) logger.s << "; CLRPT " << ea.fmtVMA();
+  invalidatePage(ea);
+  return iNormal;
+}
@@ -1,19 +1,53 @@
+// KL10 pager with TOPS-20 paging.
+//
+// Virtual addresses are 23 bits: a 5-bit section number, a 9-bit
+// page number, and a 9-bit word number. A reference is translated by
+// looking up the section pointer in the EPT (exec) or UPT (user)
+// section table, which yields the page map for that section. The
+// page map entry for the page then yields the physical page. Each of
+// these pointers can be immediate, shared (via the SPT), or indirect
+// (via the SPT into another page map). See 1982_ProcRefMan.pdf
+// Chapter 4 for the details.
+//
+// The real KL10 keeps a hardware page table (a cache of completed
+// translations) that monitor software must explicitly invalidate when
+// it changes a mapping. We emulate that with a direct-mapped software
+// TLB for each of exec and user space. A TLB entry is filled by a
+// full translation the first time a page is referenced and is only
+// invalidated by CLRPT, by DATAO PAG changing the UBR, or by CONO
+// PAG. On a hit, translation costs a single compare.
+//
+// With the optional HostMMU backend, references instead go straight
+// through host virtual address windows and the TLB fill path is only
+// reached via a host page fault. See hostmmu.hpp.
+//
+// KL10 microcode keeps paging state in AC block 6:
+//   AC0: CST mask
+//   AC1: CST data (a.k.a. "PUR")
+//   AC2: CST base address (physical)
+//   AC3: SPT base address (physical)
+
 #pragma once
 
+#include <array>
+#include <vector>
+
 #include "word.hpp"
 #include "device.hpp"
 #include "iresult.hpp"
+#include "hostmmu.hpp"
 
 
 class KM10;
 
 struct PAGDevice: Device {
 
-  // CONO PAG state bits
+  // DATAO/DATAI PAG process context word
   union ProcessContext {
 
     struct ATTRPACKED {
       unsigned userBaseAddress: 13;
+      unsigned: 4;
       unsigned doNotUpdateAccounts: 1;
       unsigned prevSection: 5;
       unsigned: 1;
@@ -48,6 +82,123 @@ struct PAGDevice: Device {
   } pagState;
 
 
+  // Section pointers, page map entries, and the "storage address"
+  // words in the SPT all share this format. Only the fields that
+  // apply to the pointer's `type` are meaningful.
+  union PagePointer {
+
+    struct ATTRPACKED {
+      unsigned ppn: 13;		// Physical page number (immediate and SPT words)
+      unsigned: 5;
+      unsigned storageMedium: 6; // Nonzero means "not in core"
+      unsigned: 5;
+      unsigned cache: 1;
+      unsigned keep: 1;		// Survives UBR change
+      unsigned writable: 1;
+      unsigned publicAccess: 1;
+      unsigned type: 3;
+    };
+
+    struct ATTRPACKED {
+      unsigned sptIndex: 18;	// Shared and indirect pointers
+      unsigned mapIndex: 9;	// Indirect pointers only
+      unsigned: 9;
+    };
+
+    uint64_t u: 36;
+
+    enum {
+      noAccess = 0,
+      immediate = 1,
+      shared = 2,
+      indirect = 3,
+    };
+
+    PagePointer(uint64_t v = 0) :u(v) {}
+  };
+
+
+  // Page fail word as stored in UPT 500.
+  union PFWord {
+
+    struct ATTRPACKED {
+      unsigned va: 23;
+      unsigned: 3;
+      unsigned paged: 1;
+      unsigned cache: 1;
+      unsigned publicAccess: 1;
+      unsigned: 1;
+      unsigned writeRef: 1;
+      unsigned writable: 1;
+      unsigned modified: 1;
+      unsigned accessible: 1;
+      unsigned hard: 1;
+      unsigned user: 1;
+    };
+
+    // Hard failures put a failure code in the top six bits.
+    struct ATTRPACKED {
+      unsigned: 30;
+      unsigned code: 6;
+    };
+
+    uint64_t u: 36;
+
+    enum {
+      addressBreakCode = 023,
+    };
+
+    PFWord(uint64_t v = 0) :u(v) {}
+  };
+
+
+  // Thrown by translation when a reference cannot complete. The CPU
+  // catches this at instruction level, aborts the instruction, and
+  // runs the page fail trap.
+  struct PageFail: exception {
+    PFWord pfw;
+
+    PageFail(PFWord aPFW) :pfw(aPFW) {}
+    const char *what() const noexcept override {return "page fail";}
+  };
+
+
+  // One entry in the software TLB. `readVPN` and `writeVPN` are the
+  // virtual page numbers this entry translates for reads and writes
+  // respectively, or `invalidVPN`. A page is only valid for writes
+  // once we have set its CST "modified" bit.
+  struct TLBEntry {
+    unsigned readVPN;
+    unsigned writeVPN;
+    W36 *pageP;
+    bool keep;
+  };
+
+  static const inline unsigned tlbSize = 512;
+  static const inline unsigned invalidVPN = ~0u;
+
+  // Indexed by `usr` flag: [0] is exec and [1] is user.
+  array<array<TLBEntry, tlbSize>, 2> tlb;
+
+  // Host MMU backend, or nullptr if we translate through the TLB.
+  HostMMU *hostMMUP;
+
+  // Watchpoints. A page containing a word watched by the debugger
+  // (`gbp` and `pbp`) or by the APR address break is never given a
+  // TLB tag (or HostMMU window access) for the kind of reference
+  // being watched. References to unwatched memory therefore cost
+  // nothing extra, and only references to a watched page reach
+  // `checkWatch()` via `fill()`.
+  enum {
+    watchRead = 1,
+    watchWrite = 2,
+  };
+
+  // Indexed by virtual page number and applied to both exec and user
+  // space.
+  vector<uint8_t> watchedPages;
+
+
   // Constructors
   PAGDevice(KM10 &cpu);
 
@@ -56,12 +207,81 @@ struct PAGDevice: Device {
   bool pagerEnabled();
 
 
+  // Return host pointer to the word at virtual address `va` for a
+  // read or a write reference in the specified mode. These are the
+  // CPU's hot path and must stay small.
+  inline W36 *readP(W36 va, bool user) {
+    if (hostMMUP) return hostMMUP->windowP[user] + va.vma;
+    const unsigned vpn = va.vma >> 9;
+    TLBEntry &e = tlb[user][vpn % tlbSize];
+    if (e.readVPN == vpn) return e.pageP + (va.vma & 0777);
+    return fill(va, false, user);
+  }
+
+  inline W36 *writeP(W36 va, bool user) {
+    if (hostMMUP) return hostMMUP->windowP[user] + va.vma;
+    const unsigned vpn = va.vma >> 9;
+    TLBEntry &e = tlb[user][vpn % tlbSize];
+    if (e.writeVPN == vpn) return e.pageP + (va.vma & 0777);
+    return fill(va, true, user);
+  }
+
+  // Translate `va` by walking the page tables, then fill the TLB
+  // entry for it. Throws PageFail if the reference is not allowed.
+  W36 *fill(W36 va, bool forWrite, bool user);
+
+  // Translate `va` without side effects on the TLB or CST for MAP.
+  // Returns a page fail word, with the physical address in the `va`
+  // field if the translation succeeded.
+  PFWord map(W36 va, bool user);
+
+  // Reference a physical word for the pager or a device. Physical
+  // addresses are 22 bits. PhysicalMemory reports references to
+  // non-existent memory when they are made.
+  W36 &physWord(unsigned pa);
+
+  // Recompute `watchedPages` after the debugger's watchpoint sets or
+  // the APR break address change.
+  void updateWatchpoints();
+
+  // Check a reference to a watched page against the exact watched
+  // words. A debugger watchpoint stops the CPU after this instruction
+  // and an APR address break throws PageFail.
+  void checkWatch(W36 va, bool forWrite, bool user);
+
+  // TLB invalidation.
+  void invalidateAll();
+  void invalidateUser();
+  void invalidatePage(W36 va);
+
   virtual unsigned getConditions();
   virtual void putConditions(unsigned v);
 
+  virtual void saveState(MachineState &ms) override;
+  virtual void restoreState(MachineState &ms) override;
+
   // I/O instruction handlers
   virtual IResult doDATAI(W36 iw, W36 ea) override;
   virtual IResult doDATAO(W36 iw, W36 ea) override;
+  virtual IResult doBLKO(W36 iw, W36 ea) override; // CLRPT
 
   W36 getPCW() const;
+
+  // Longest indirect pointer chain we will follow before failing.
+  static const inline unsigned maxIndirections = 64;
+
+  // Walk the page tables for `va`. Returns true with `ppn` and
+  // `access` set if the reference is allowed. If `update` is set the
+  // CST entries for the pages we touch are checked and updated.
+  bool walk(W36 va, bool forWrite, bool user, bool update,
+	    unsigned &ppn, PagePointer &access, PFWord &pfw);
+
+  // Evaluate a pointer chain starting at `p`, accumulating access
+  // bits into `access`. Returns true with `ppn` set to the physical
+  // page it resolves to.
+  bool evalPointer(PagePointer p, bool update,
+		   PagePointer &access, PFWord &pfw, unsigned &ppn);
+
+  // Check age and update the CST entry for physical page `ppn`.
+  bool updateCST(unsigned ppn, bool forWrite, PFWord &pfw);
 };
@@ -0,0 +1,240 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdexcept>
+
+using namespace std;
+
+#include "physmem.hpp"
+
+
+PhysicalMemory::Backend PhysicalMemory::Backend::parse(const string &spec) {
+  if (spec == "anon") return Backend{anonymous};
+  if (spec == "thp") return Backend{transparentHugePages};
+  if (spec == "hugetlb") return Backend{hugeTLB};
+  if (spec.starts_with("file:") && spec.size() > 5) return Backend{file, spec.substr(5)};
+
+  if (spec.starts_with("shm:") && spec.size() > 4) {
+    string name{spec.substr(4)};
+    if (name[0] != '/') name = "/" + name;
+    return Backend{shared, name};
+  }
+
+  throw invalid_argument("Memory backend must be anon, thp, hugetlb, file:PATH, or shm:NAME");
+}
+
+
+string PhysicalMemory::Backend::toString() const {
+
+  switch (kind) {
+  case anonymous:	      return "anon";
+  case transparentHugePages:  return "thp";
+  case hugeTLB:		      return "hugetlb";
+  case file:		      return "file:" + path;
+  case shared:		      return "shm:" + path.substr(1);
+  }
+
+  return "?";
+}
+
+
+PhysicalMemory::PhysicalMemory(unsigned aMemorySize, const Backend &aBackend, bool needFD)
+  : backend(aBackend),
+    memorySize(aMemorySize),
+    fd(-1),
+    physicalP(nullptr),
+    reservationP(nullptr),
+    reservationBytes(0),
+    reportNXM([](unsigned pa) {}),
+    trackingDirty(false),
+    dirtyPages{},
+    stepping(false),
+    stepPage(0)
+{
+  if (memorySize > maxWords) throw runtime_error("KM10 memory size is larger than 4MW");
+
+  // Reserve the whole physical address space, with slop so we can
+  // align it for huge pages.
+  const size_t maxBytes = (size_t) maxWords * sizeof(W36);
+  reservationBytes = maxBytes + hugePageBytes;
+  reservationP = mmap(nullptr, reservationBytes, PROT_NONE,
+		      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (reservationP == MAP_FAILED) throw runtime_error("Failed to reserve KM10 physical address space");
+
+  const uintptr_t base = ((uintptr_t) reservationP + hugePageBytes - 1) & ~(hugePageBytes - 1);
+  physicalP = (W36 *) base;
+
+  // Our destructor won't run if we throw from here on, so give back
+  // the reservation and any backing store we opened ourselves.
+  try {
+    setUpBackend(needFD);
+    registerRegion(physicalP, maxBytes);
+  } catch (...) {
+    release();
+    throw;
+  }
+}
+
+
+PhysicalMemory::~PhysicalMemory() {
+  unregisterRegion();
+  release();
+}
+
+
+void PhysicalMemory::release() {
+  if (reservationP) munmap(reservationP, reservationBytes);
+  reservationP = nullptr;
+  physicalP = nullptr;
+
+  if (fd >= 0) close(fd);
+  fd = -1;
+}
+
+
+// Map the first `memorySize` words of the reservation from the
+// backing store `backend` says.
+void PhysicalMemory::setUpBackend(bool needFD) {
+  const size_t memoryBytes = (size_t) memorySize * sizeof(W36);
+  const int rw = PROT_READ | PROT_WRITE;
+  void *p = MAP_FAILED;
+
+  switch (backend.kind) {
+  case Backend::anonymous:
+  case Backend::transparentHugePages:
+
+    if (needFD) {
+      // A new memfd reads as zeroes, just like anonymous memory.
+      fd = memfd_create("km10-memory", MFD_CLOEXEC);
+      if (fd < 0) throw runtime_error("Failed to create memfd for KM10 memory");
+      if (ftruncate(fd, memoryBytes) != 0) throw runtime_error("Failed to size memfd for KM10 memory");
+      p = mmap(physicalP, memoryBytes, rw, MAP_SHARED | MAP_FIXED, fd, 0);
+    } else {
+      p = mmap(physicalP, memoryBytes, rw, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    }
+
+    // This is only advice. Whether shmem (memfd) gets huge pages
+    // depends on /sys/kernel/mm/transparent_hugepage/shmem_enabled.
+    if (p != MAP_FAILED && backend.kind == Backend::transparentHugePages) {
+      madvise(p, memoryBytes, MADV_HUGEPAGE);
+    }
+
+    break;
+
+  case Backend::hugeTLB:
+
+    // The HostMMU windows map individual 4KiB pages, which a hugetlbfs
+    // file can't provide.
+    if (needFD) throw runtime_error("The hugetlb memory backend can't be used with --host-mmu");
+
+    p = mmap(physicalP, memoryBytes, rw, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_FIXED, -1, 0);
+    if (p == MAP_FAILED) throw runtime_error("Failed to mmap KM10 memory from huge pages"
+					     " (is /proc/sys/vm/nr_hugepages big enough?)");
+    break;
+
+  case Backend::file:
+  case Backend::shared:
+    fd = backend.kind == Backend::file ?
+      open(backend.path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644) :
+      shm_open(backend.path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) throw runtime_error("Failed to open KM10 memory backing store " + backend.toString());
+
+    // Grow (never shrink) the backing store to our memory size. What
+    // was there before is preserved.
+    struct stat st;
+    if (fstat(fd, &st) != 0) throw runtime_error("Failed to stat KM10 memory backing store");
+
+    if ((size_t) st.st_size < memoryBytes && ftruncate(fd, memoryBytes) != 0) {
+      throw runtime_error("Failed to size KM10 memory backing store");
+    }
+
+    p = mmap(physicalP, memoryBytes, rw, MAP_SHARED | MAP_FIXED, fd, 0);
+    break;
+  }
+
+  if (p == MAP_FAILED) throw runtime_error("Failed to mmap KM10 physical memory");
+}
+
+
+void PhysicalMemory::trackDirtyPages() {
+  for (auto &w: dirtyPages) w.store(0, memory_order_relaxed);
+  trackingDirty = true;
+
+  if (mprotect(physicalP, (size_t) memorySize * sizeof(W36), PROT_READ) != 0) {
+    throw runtime_error("Failed to write protect KM10 memory");
+  }
+}
+
+
+bool PhysicalMemory::loadFrom(int fromFD, off_t offset) {
+  const size_t memoryBytes = (size_t) memorySize * sizeof(W36);
+
+  // All of memory changes, so if we're tracking it is all dirty and
+  // needn't be write protected.
+  if (trackingDirty) {
+    for (auto &w: dirtyPages) w.store(~0ull, memory_order_relaxed);
+    mprotect(physicalP, memoryBytes, PROT_READ | PROT_WRITE);
+  }
+
+  if (fd < 0 && backend.kind != Backend::hugeTLB) {
+    void *p = mmap(physicalP, memoryBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fromFD, offset);
+    if (p == MAP_FAILED) throw runtime_error("Failed to mmap KM10 memory image");
+    return true;
+  }
+
+  for (size_t done=0; done < memoryBytes; ) {
+    const ssize_t st = pread(fromFD, (char *) physicalP + done, memoryBytes - done, offset + done);
+    if (st <= 0) throw runtime_error("Failed to read KM10 memory image");
+    done += st;
+  }
+
+  return false;
+}
+
+
+// Either the first write to a page since `trackDirtyPages()` or a
+// reference to non-existent memory. For the latter, report it and let
+// the host instruction complete against a zero page we throw away
+// after it.
+bool PhysicalMemory::handleFault(void *addrP, ucontext_t *ucP) {
+  const unsigned pa = (W36 *) addrP - physicalP;
+
+  if (pa < memorySize) {
+    if (!trackingDirty) return false;
+
+    const unsigned ppn = pa / pageWords;
+    setDirty(ppn);
+    return mprotect(physicalP + ppn * pageWords, pageBytes, PROT_READ | PROT_WRITE) == 0;
+  }
+
+  reportNXM(pa);
+
+  stepPage = pa & ~(pageWords - 1);
+
+  if (mmap(physicalP + stepPage, pageBytes, PROT_READ | PROT_WRITE,
+	   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED)
+  {
+    return false;
+  }
+
+  // Without single stepping the scratch page has to stay, and only
+  // the first reference to this page reports NXM.
+  if (canSingleStep) {
+    stepping = true;
+    setSingleStep(ucP, true);
+  }
+
+  return true;
+}
+
+
+bool PhysicalMemory::handleStep(ucontext_t *ucP) {
+  if (!stepping) return false;
+
+  stepping = false;
+  setSingleStep(ucP, false);
+  mmap(physicalP + stepPage, pageBytes, PROT_NONE,
+       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+  return true;
+}
@@ -0,0 +1,136 @@
+// KL10 physical memory.
+//
+// We reserve host address space for the largest physical memory a
+// KL10 can address (4MW, 22 bits of word address) and back only the
+// first `memorySize` words of it. The rest is PROT_NONE, so a
+// reference anywhere in the KL10 physical address space is a plain
+// host load or store with no bounds check. References to
+// non-existent memory fault into `handleFault()`, which reports NXM
+// via `reportNXM` and then lets the reference complete against a
+// scratch page that reads as zero and discards writes.
+//
+// The backing store for the first `memorySize` words is selectable:
+//
+//   anon		Anonymous private memory (the default).
+//   thp		Anonymous memory advised to use transparent huge
+//			pages. A 4MW machine is 32MiB, so 2MiB pages cut
+//			host TLB misses a lot.
+//   hugetlb		Explicit huge pages from the hugetlbfs pool
+//			(see /proc/sys/vm/nr_hugepages).
+//   file:PATH		A file mapped shared, so memory survives restart
+//			and even process exit.
+//   shm:NAME		A POSIX named shared memory object, so other
+//			processes can map our memory.
+//
+// For incremental checkpoints we can also track which pages have been
+// written. While tracking, clean pages are write protected and the
+// first write to each faults into `handleFault()`, which marks the
+// page dirty and opens it up again. After that writes to the page
+// cost nothing until the next checkpoint protects it again.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <functional>
+#include <atomic>
+
+using namespace std;
+
+#include "word.hpp"
+#include "hostfault.hpp"
+
+
+struct PhysicalMemory: HostFaultRegion {
+  static const inline unsigned maxWords = 4096 * 1024;
+  static const inline unsigned pageWords = 512;
+  static const inline size_t pageBytes = pageWords * sizeof(W36);
+  static const inline size_t hugePageBytes = 2 * 1024 * 1024;
+
+  struct Backend {
+    enum Kind {
+      anonymous,
+      transparentHugePages,
+      hugeTLB,
+      file,
+      shared,
+    } kind;
+
+    string path;		// File path or shm object name
+
+    Backend(Kind aKind = anonymous, string aPath = "")
+      : kind(aKind),
+	path(aPath)
+    {}
+
+    // Parse a command line backend spec as documented above. Throws
+    // invalid_argument if it isn't one.
+    static Backend parse(const string &spec);
+
+    string toString() const;
+  } backend;
+
+  unsigned memorySize;
+
+  // File descriptor of the memory backing store, or -1 for anonymous
+  // memory. The HostMMU backend needs one of these, so we use a memfd
+  // for anonymous memory if asked for `needFD`.
+  int fd;
+
+  // Base of the 4MW reservation, aligned for huge pages.
+  W36 *physicalP;
+
+  // The whole host reservation including the alignment slop.
+  void *reservationP;
+  size_t reservationBytes;
+
+  // Called for each reference to non-existent memory.
+  function<void(unsigned pa)> reportNXM;
+
+  // Pages written since `trackDirtyPages()`, if `trackingDirty`, a
+  // bit per page. Channel transfers fault on the device's worker
+  // thread while the CPU faults on its own, so the words are atomic
+  // and bits are only ever ORed in.
+  bool trackingDirty;
+  atomic<uint64_t> dirtyPages[maxWords / pageWords / 64];
+
+  // The non-existent page we mapped a scratch page at so the
+  // faulting reference can complete, if `stepping`.
+  bool stepping;
+  unsigned stepPage;
+
+
+  PhysicalMemory(unsigned aMemorySize, const Backend &aBackend = Backend{}, bool needFD = false);
+  virtual ~PhysicalMemory();
+
+  // Start over tracking writes: clear `dirtyPages` and write protect
+  // all of memory.
+  void trackDirtyPages();
+
+  // Replace the contents of memory with `memorySize` words from file
+  // `fd` at page aligned `offset`. Private anonymous memory is
+  // replaced by a copy-on-write mapping of the file, so this costs
+  // nothing until pages are referenced. Other backends are copied.
+  // Returns true if we mapped rather than copied.
+  bool loadFrom(int fd, off_t offset);
+
+  // Note a write to page `ppn` made other than through `physicalP`.
+  void markDirty(unsigned ppn) {
+    if (trackingDirty && ppn < memorySize / pageWords) setDirty(ppn);
+  }
+
+  bool isDirty(unsigned ppn) const {
+    return dirtyPages[ppn / 64].load(memory_order_relaxed) & (1ull << ppn % 64);
+  }
+
+  virtual bool handleFault(void *addrP, ucontext_t *ucP) override;
+  virtual bool handleStep(ucontext_t *ucP) override;
+
+private:
+  void setUpBackend(bool needFD);
+  void release();
+
+  void setDirty(unsigned ppn) {
+    dirtyPages[ppn / 64].fetch_or(1ull << ppn % 64, memory_order_relaxed);
+  }
+};
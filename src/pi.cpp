@@ -32,6 +32,8 @@
 // executed instead of the return.
 
 
+#include <bit>
+
 #include "word.hpp"
 #include "device.hpp"
 #include "pi.hpp"
@@ -41,7 +43,9 @@
 
 // Constructors
 PIDevice::PIDevice(KM10 &cpu):
-  Device(001, "PI", cpu)
+  Device(001, "PI", cpu),
+  requesters{},
+  requestedLevels(0)
 {
   clearIO();
 }
@@ -67,67 +71,168 @@ string PIDevice::levelsToStr(unsigned levels) {
 // nothing if there is no pending interrupt. Returns true if an
 // interrupt is to be handled.
 W36 PIDevice::setUpInterruptCycleIfPending() {
-  if (!piState.piOn || piState.levelsOn == 0) return 0;
-
-  // Find highest pending interrupt and its mask.
-  unsigned highestLevel = 99;
-  Device *highestDevP = nullptr;
-  unsigned highestMask = 0;
-
-  // Search device list for highest leveled device that has an
-  // interrupt pending.
-  for (auto [ioDev, devP]: Device::devices) {
-
-    // We don't bother ordering the devices by physical ID as KL10
-    // does. Instead, we just service the first one we find that has
-    // an interrupt pending.
-    if (devP->intPending) {
-      const unsigned levelMask = 1 << (7 - devP->intLevel);
-
-      if ((levelMask & piState.levelsOn) && devP->intLevel < highestLevel) {
-	highestLevel = devP->intLevel;
-	highestMask = levelMask;
-	highestDevP = devP;
-      }
-    }
+  if (!piState.piOn) return 0;
+
+  // Levels numerically lower than the one we're servicing (if any).
+  const unsigned aboveCurrent = 0177 & ~((0400u >> piState.currentLevel) - 1);
+  const unsigned ready = requestedLevels & piState.levelsOn & aboveCurrent;
+  if (ready == 0) return 0;
+
+  // The highest priority level that's ready, and the first device
+  // requesting on it. We don't bother ordering the devices by
+  // physical ID as KL10 does. Instead, we just service the lowest
+  // device code.
+  const unsigned highestLevel = 8 - bit_width(ready);
+  const unsigned highestMask = levelBit(highestLevel);
+  Device *highestDevP = requesters[highestLevel].front();
+
+  // Ask device about its interrupt.
+  auto [level, ifw] = highestDevP->getIntFuncWord();
+
+  if (logger.ints) {
+    logger.s << "<<<<INTERRUPT>>>> by " << highestDevP->name
+	     << ": pc=" << km10.pc.fmtVMA()
+	     << " level=" << level
+	     << " ifw=" << ifw.fmt36()
+	     << logger.endl << flush;
   }
 
-  if (highestLevel < piState.currentLevel) {
+  // Function word is saved here by KL10 microcode. Does anyone
+  // look at this? Who knows?
+  km10.ACBlocks[7][3] = ifw;
 
-    // We have a pending interrupt at `highestLevel` level that isn't being serviced.
-    piState.held |= highestMask;		// Mark this level as held - i.e., ACTIVELY RUNNING.
-    piState.currentLevel = highestLevel;	// Remember we are running at this level.
+  W36 vector;
 
-    // Ask device about its interrupt.
-    auto [level, ifw] = highestDevP->getIntFuncWord();
+  switch (ifw.intFunction) {
+  case W36::zeroIF:
+  case W36::standardIF:
+    vector = km10.physAddressFor(&km10.eptP->pioInstructions[2*highestLevel]);
+    break;
 
-    if (logger.ints) {
-      logger.s << "<<<<INTERRUPT>>>> by " << highestDevP->name
-	       << ": pc=" << km10.pc.fmtVMA()
-	       << " level=" << level
-	       << " ifw=" << ifw.fmt36()
-	       << logger.endl << flush;
+  case W36::vectorIF:		// Execute the instruction at the address in the IFW
+
+    try {
+      vector = km10.physAddressFor(intFunctionWordP(ifw, false));
+    } catch (const PAGDevice::PageFail &) {
+      km10.apr.ioPageFailure();
+      highestDevP->intFunctionDone(ifw, false);
+      return 0;
     }
 
-    // Function word is saved here by KL10 microcode. Does anyone
-    // look at this? Who knows?
-    km10.ACBlocks[7][3] = ifw;
-
-    switch (ifw.intFunction) {
-    case W36::zeroIF:
-    case W36::standardIF:
-      return km10.eptAddressFor(&km10.eptP->pioInstructions[2*highestLevel]);
-
-    default:
-      if (logger.ints) logger.s << "PI got IFW from '" << highestDevP->name
-				<< "' specifying function "
-				<< (int) ifw.intFunction << ", which is not implemented yet."
-				<< logger.endl;
-      break;
+    break;
+
+  case W36::incIF:
+  case W36::examineIF:
+  case W36::depositIF:
+  case W36::byteIF:
+    // These are over before the next instruction. The level is
+    // never held and no vector is taken.
+    doIntFunction(highestDevP, ifw);
+    return 0;
+
+  default:
+    if (logger.ints) logger.s << "PI got IFW from '" << highestDevP->name
+			      << "' specifying function "
+			      << (int) ifw.intFunction << ", which doesn't exist."
+			      << logger.endl;
+    highestDevP->intFunctionDone(ifw, false);
+    return 0;
+  }
+
+  // We have a pending interrupt at `highestLevel` level that isn't being serviced.
+  piState.held |= highestMask;		// Mark this level as held - i.e., ACTIVELY RUNNING.
+  piState.currentLevel = highestLevel;	// Remember we are running at this level.
+  return vector;
+}
+
+
+// Return a pointer to the word the IFW `ifw` addresses, in the
+// address space it names. EPT addresses are relative to the EPT and
+// exec virtual ones go through the pager, so this can throw
+// PageFail. Returns nullptr for an address space we don't have.
+W36 *PIDevice::intFunctionWordP(W36 ifw, bool forWrite) {
+
+  switch (ifw.addrSpace) {
+  case W36::execPT:
+    return &km10.pag.physWord(km10.physAddressFor((W36 *) km10.eptP).u + ifw.intAddr);
+
+  case W36::execVA:
+    return forWrite ? km10.pag.writeP(W36(ifw.intAddr), false) : km10.pag.readP(W36(ifw.intAddr), false);
+
+  case W36::physical:
+    return &km10.pag.physWord(ifw.intAddr);
+
+  default:
+    return nullptr;
+  }
+}
+
+
+// Do the increment, examine, deposit, or byte function `ifw` for
+// `devP` entirely within the interrupt cycle, as the KL10 microcode
+// does, without running any of the program's instructions.
+//
+// * Increment adds one to the word (or subtracts one if `q` is set).
+// * Examine hands the device the word.
+// * Deposit stores the word the device gives us.
+// * Byte moves one byte between the device and memory through the
+//   byte pointer in the EPT area of DTE20 number `device`, toward the
+//   10 through `to10BP` if `q` is set and otherwise toward the 11
+//   through `to11BP`.
+//
+// A page fail on the word sets the APR's I/O page fail flag. A byte
+// transfer with a bad byte pointer just fails. Either way the device
+// hears how it went through intFunctionDone().
+void PIDevice::doIntFunction(Device *devP, W36 ifw) {
+  bool ok = true;
+
+  try {
+
+    if (ifw.intFunction == W36::byteIF) {
+      auto &cb = km10.eptP->dte[ifw.device & 3];
+      uint8_t b = ifw.q ? devP->intDepositWord(ifw).u : 0;
+
+      ok = DTE20::transferBytes(km10, ifw.q ? cb.to10BP : cb.to11BP, &b, 1, ifw.q);
+      if (ok && !ifw.q) devP->intExamined(ifw, W36(b));
+    } else if (W36 *wordP = intFunctionWordP(ifw, ifw.intFunction != W36::examineIF); !wordP) {
+      ok = false;
+    } else if (ifw.intFunction == W36::incIF) {
+      *wordP = W36(wordP->s + (ifw.q ? -1 : 1));
+    } else if (ifw.intFunction == W36::examineIF) {
+      devP->intExamined(ifw, *wordP);
+    } else {
+      *wordP = devP->intDepositWord(ifw);
     }
+  } catch (const PAGDevice::PageFail &) {
+    km10.apr.ioPageFailure();
+    ok = false;
   }
 
-  return 0;
+  if (logger.ints) logger.s << "PI did IFW function " << (int) ifw.intFunction
+			    << " for '" << devP->name << "'"
+			    << (ok ? "" : " (failed)")
+			    << logger.endl;
+
+  devP->intFunctionDone(ifw, ok);
+}
+
+
+void PIDevice::addRequest(Device *devP) {
+  auto &v = requesters[devP->intLevel];
+  auto it = v.begin();
+
+  while (it != v.end() && (*it)->ioAddress < devP->ioAddress) ++it;
+  if (it != v.end() && *it == devP) return;
+
+  v.insert(it, devP);
+  requestedLevels |= levelBit(devP->intLevel);
+}
+
+
+void PIDevice::removeRequest(Device *devP) {
+  auto &v = requesters[devP->intLevel];
+  erase(v, devP);
+  if (v.empty()) requestedLevels &= ~levelBit(devP->intLevel);
 }
 
 
@@ -142,6 +247,17 @@ void PIDevice::dismissInterrupt() {
 }
 
 
+void PIDevice::releaseLevel() {
+  if (piState.currentLevel != PIState::noLevel) piState.held &= ~levelBit(piState.currentLevel);
+
+  // The highest priority level still held is the one we go back to.
+  piState.currentLevel = piState.held ? 8 - bit_width((unsigned) piState.held) : PIState::noLevel;
+  km10.inInterrupt = false;
+  if (logger.ints) logger.s << " <<< releaseLevel, end piState="
+			    << W36(piState.u).fmt18() << logger.endl << flush;
+}
+
+
 // I/O instruction handlers
 void PIDevice::clearIO() {
   // This is apparently only supposed to be a partial reset based on
@@ -197,7 +313,7 @@ void PIDevice::putConditions(unsigned v) {
 	unsigned thisLevel = 1;
 	for (; (pif.levels & levelMask) == 0; ++thisLevel, levelMask>>=1) ;
 
-	if (levelMask == 0 || thisLevel < piState.currentLevel) intLevel = thisLevel;
+	if (levelMask == 0 || thisLevel < piState.currentLevel) setIntLevel(thisLevel);
       }
 
       piState.prLevels |= pif.levels;
@@ -205,10 +321,24 @@ void PIDevice::putConditions(unsigned v) {
       if (logger.ints) logger.s << " <<< CONO PI, has triggered an interrupt on level "
 				<< intLevel << " >>>" << logger.endl << flush;
     } else {
-      intPending = false;
+      clearInterrupt();
     }
   }
 
   if (logger.ints) logger.s << " <<< CONO PI, end piState="
 			    << W36(piState.u).fmt18() << logger.endl << flush;
 }
+
+
+void PIDevice::saveState(MachineState &ms) {
+  Device::saveState(ms);
+  ms.put(piState.u);
+  ms.put(piState.currentLevel);
+}
+
+
+void PIDevice::restoreState(MachineState &ms) {
+  Device::restoreState(ms);
+  piState.u = ms.get();
+  piState.currentLevel = ms.get();
+}
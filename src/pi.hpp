@@ -41,6 +41,9 @@
 
 #pragma once
 
+#include <array>
+#include <vector>
+
 #include "word.hpp"
 #include "device.hpp"
 #include "iresult.hpp"
@@ -153,6 +156,18 @@ struct PIDevice: Device {
   } piState;
 
 
+  // The devices requesting an interrupt at each level, each list in
+  // order of device code, and a bit for each level that has any (in
+  // the same positions as `levelsOn`, with level zero's bit just
+  // above them). Devices keep these up to date through
+  // requestInterrupt() and clearInterrupt(), so finding whether an
+  // interrupt is due is a couple of ANDs.
+  array<vector<Device *>, 8> requesters;
+  unsigned requestedLevels;
+
+  static unsigned levelBit(unsigned level) {return 0200u >> level;}
+
+
   // Constructors
   PIDevice(KM10 &cpu);
 
@@ -169,9 +184,25 @@ struct PIDevice: Device {
   // This ends interrupt service.
   void dismissInterrupt();
 
+  // This ends service of just the level being serviced, as when its
+  // vector instruction skips, leaving any lower priority levels it
+  // interrupted held.
+  void releaseLevel();
+
+  // Interrupt functions other than standard and vector.
+  W36 *intFunctionWordP(W36 ifw, bool forWrite);
+  void doIntFunction(Device *devP, W36 ifw);
+
+  // Add or remove `devP` as requesting an interrupt at its level.
+  void addRequest(Device *devP);
+  void removeRequest(Device *devP);
+
   virtual unsigned getConditions();
   virtual void putConditions(unsigned v);
 
+  virtual void saveState(MachineState &ms) override;
+  virtual void restoreState(MachineState &ms) override;
+
   // I/O instruction handlers
   virtual void clearIO() override;
 };
@@ -0,0 +1,393 @@
+#include <stdexcept>
+
+using namespace std;
+
+#include "word.hpp"
+#include "km10.hpp"
+#include "rh20.hpp"
+#include "iresult.hpp"
+
+
+RH20::RH20(unsigned aNumber, KM10 &cpu)
+  : AsyncDevice(0130 + (aNumber & 7), string("RH20.") + to_string(aNumber), cpu),
+    status(0),
+    number(aNumber & 7),
+    drives{},
+    stcr(0),
+    ptcr(0),
+    sbar(0),
+    pbar(0),
+    ivir(0),
+    lastSelect(0),
+    channel(aNumber, cpu)
+{
+  km10.rh20s[number] = this;
+  status.channelReady = 1;
+}
+
+
+RH20::~RH20() {
+  stopWorker();
+  for (auto driveP: drives) delete driveP;
+  km10.rh20s[number] = nullptr;
+}
+
+
+void RH20::attach(unsigned unit, MassbusDrive *driveP) {
+  quiesce();
+  delete drives[unit & 7];
+  drives[unit & 7] = driveP;
+}
+
+
+////////////////////////////////////////////////////////////////
+// Registers
+
+void RH20::dataO(W36 w) {
+  const DataWord d(w.u);
+
+  // DATAI reads back whatever this selects.
+  lastSelect = d;
+  lastSelect.load = 0;
+
+  if (d.reg >= 040) {
+    if (!d.load) return;
+
+    switch (d.reg) {
+    case regSBAR: sbar = d.data & 0177777; break;
+    case regSTCR: loadTransfer(TCR(w.u)); break;
+    case regIVIR: ivir = d.data & 0777; break;
+    default: break;		// Read only or not here
+    }
+
+    updateInterrupt();
+    return;
+  }
+
+  MassbusDrive *driveP = drives[d.drive];
+
+  if (!driveP) {
+    status.rae = 1;
+    updateInterrupt();
+    return;
+  }
+
+  if (!d.load) return;
+
+  if (d.reg == MassbusDrive::regAS) {
+
+    // Each drive whose bit is set drops its attention.
+    for (unsigned unit=0; unit < drives.size(); ++unit) {
+      if (drives[unit] && (d.data & (1u << unit))) drives[unit]->clearAttention();
+    }
+  } else if (d.reg == MassbusDrive::regCS1 && (d.data & 1) && (d.data & 077) >= 050) {
+
+    // Data transfers have to come through our transfer control
+    // register so the channel knows about them.
+    status.rae = 1;
+  } else {
+    startFunction(d.drive, driveP->writeRegister(d.reg, d.data & 0177777), 0);
+  }
+
+  updateInterrupt();
+}
+
+
+W36 RH20::dataI() {
+  DataWord d = lastSelect;
+
+  if (d.reg >= 040) {
+
+    switch (d.reg) {
+    case regSBAR: d.data = sbar; break;
+    case regPBAR: d.data = pbar; break;
+    case regIVIR: d.data = ivir; break;
+
+    case regSTCR:
+    case regPTCR:
+      d = DataWord((d.reg == regSTCR ? stcr : ptcr).u);
+      d.reg = lastSelect.reg;
+      d.load = 0;
+      break;
+
+    default: d.data = 0; break;
+    }
+
+    return W36(d.u);
+  }
+
+  MassbusDrive *driveP = drives[d.drive];
+
+  if (!driveP) {
+    status.rae = 1;
+    updateInterrupt();
+    d.data = 0;
+    return W36(d.u);
+  }
+
+  d.transferReceived = 1;
+
+  if (d.reg == MassbusDrive::regAS) {
+    unsigned as = 0;
+
+    for (unsigned unit=0; unit < drives.size(); ++unit) {
+      if (drives[unit] && drives[unit]->attention()) as |= 1u << unit;
+    }
+
+    d.data = as;
+  } else {
+    d.data = driveP->readRegister(d.reg) & 0177777;
+  }
+
+  return W36(d.u);
+}
+
+
+// The program has loaded our secondary transfer control register. It
+// becomes the primary at once unless a transfer is still going.
+void RH20::loadTransfer(TCR tcr) {
+  stcr = tcr;
+  status.scrFull = 1;
+  status.channelReady = 0;
+  if (!status.pcrFull) startTransfer();
+}
+
+
+void RH20::startTransfer() {
+  ptcr = stcr;
+  pbar = sbar;
+  status.scrFull = 0;
+  status.channelReady = 1;
+  if (ptcr.resetCLP) channel.reset();
+
+  MassbusDrive *driveP = drives[ptcr.drive];
+
+  if (!driveP) {
+    status.dre = 1;
+    status.done = 1;
+    return;
+  }
+
+  const MassbusDrive::Start s = driveP->writeRegister(MassbusDrive::regCS1, ptcr.function);
+
+  if (s == MassbusDrive::readData || s == MassbusDrive::writeData) {
+    status.pcrFull = 1;
+  } else {
+
+    // The drive didn't take it as a transfer, so there's nothing for
+    // the channel to do.
+    status.done = 1;
+    if (s == MassbusDrive::noFunction) status.exception = 1;
+  }
+
+  startFunction(ptcr.drive, s, ptcr.blocks());
+}
+
+
+void RH20::startFunction(unsigned unit, MassbusDrive::Start s, unsigned blocks) {
+  if (s == MassbusDrive::noFunction) return;
+
+  // Each drive has at most one function going, so the ring can't
+  // fill.
+  if (!submit(Op{s, unit, {blocks, 0, 0, 0}, 0})) throw runtime_error("RH20 request ring overflowed");
+}
+
+
+void RH20::controllerReset() {
+  quiesce();
+
+  for (auto driveP: drives) {
+    if (driveP) driveP->reset();
+  }
+
+  status.u = 0;
+  status.channelReady = 1;
+  stcr = ptcr = TCR(0);
+  sbar = pbar = 0;
+  lastSelect = DataWord(0);
+  channel.reset();
+}
+
+
+////////////////////////////////////////////////////////////////
+// Worker and completions
+
+void RH20::perform(Op &op) {
+  MassbusDrive *driveP = drives[op.unit];
+  const auto s = (MassbusDrive::Start) op.function;
+
+  if (s == MassbusDrive::positioning) {
+    op.status = driveP->perform(s, 0, *this);
+    return;
+  }
+
+  channel.start();
+  const bool ok = driveP->perform(s, op.arg[0], *this);
+  op.status = ok;
+
+  if (!ok || channel.error() || ptcr.storeStatus) channel.logout(ok);
+}
+
+
+void RH20::complete(const Op &op) {
+  const auto s = (MassbusDrive::Start) op.function;
+  drives[op.unit]->complete(s);
+
+  if (s == MassbusDrive::readData || s == MassbusDrive::writeData) {
+    status.pcrFull = 0;
+    status.done = 1;
+    if (!op.status) status.exception = 1;
+    if (channel.shortCount) status.swce = 1;
+    if (channel.longCount()) status.lwce = 1;
+    if (channel.nxm) status.channelError = 1;
+
+    // The next transfer goes only if this one went well.
+    if (status.scrFull && !status.exception && !status.swce && !status.lwce && !status.channelError) {
+      startTransfer();
+    }
+  }
+
+  updateInterrupt();
+}
+
+
+////////////////////////////////////////////////////////////////
+// Interrupts and conditions
+
+unsigned RH20::getConditions() {
+  return status.u;
+}
+
+
+// This is what CONO does.
+void RH20::putConditions(unsigned v) {
+  CONOMask req(v);
+
+  if (req.reset) controllerReset();
+
+  status.pia = req.pia;
+  status.attnEnable = req.attnEnable;
+  status.mbEnable = req.mbEnable;
+
+  if (req.clearDone) status.done = 0;
+  if (req.clearRAE) status.rae = 0;
+
+  if (req.clearXferErr) {
+    status.dbpe = status.exception = status.lwce = status.swce = 0;
+    status.channelError = status.dre = status.overrun = 0;
+  }
+
+  if (req.deleteSCR) {
+    status.scrFull = 0;
+    status.channelReady = 1;
+  }
+
+  if (req.resetCLP && !status.pcrFull) channel.reset();
+
+  // A transfer in flight can't be stopped partway; it just finishes.
+  updateInterrupt();
+}
+
+
+tuple<unsigned,W36> RH20::getIntFuncWord() {
+  W36 ifw(0);
+
+  if (ivir != 0) {
+    ifw.intFunction = W36::vectorIF;
+    ifw.addrSpace = W36::execPT;
+    ifw.intAddr = ivir;
+  } else {
+    ifw.intFunction = W36::standardIF;
+  }
+
+  return tuple<unsigned,W36>(intLevel, ifw);
+}
+
+
+void RH20::intFunctionDone(W36 ifw, bool ok) {}
+
+
+void RH20::updateInterrupt() {
+  status.attention = 0;
+
+  for (auto driveP: drives) {
+    if (driveP && driveP->attention()) status.attention = 1;
+  }
+
+  setIntLevel(status.pia);
+
+  if (intLevel != 0 && (status.done || (status.attention && status.attnEnable))) {
+    if (!intPending) requestInterrupt();
+  } else {
+    clearInterrupt();
+  }
+}
+
+
+////////////////////////////////////////////////////////////////
+// State
+
+void RH20::saveState(MachineState &ms) {
+  AsyncDevice::saveState(ms);
+  ms.put(status.u);
+  ms.put(stcr.u);
+  ms.put(ptcr.u);
+  ms.put(sbar);
+  ms.put(pbar);
+  ms.put(ivir);
+  ms.put(lastSelect.u);
+  ms.put(channel.clp);
+  ms.put(channel.ccw.u);
+
+  for (auto driveP: drives) {
+    ms.put(driveP != nullptr);
+    if (driveP) driveP->saveState(ms);
+  }
+}
+
+
+void RH20::restoreState(MachineState &ms) {
+  quiesce();
+  AsyncDevice::restoreState(ms);
+  status.u = ms.get();
+  stcr = TCR(ms.get());
+  ptcr = TCR(ms.get());
+  sbar = ms.get();
+  pbar = ms.get();
+  ivir = ms.get();
+  lastSelect = DataWord(ms.get());
+  channel.clp = ms.get();
+  channel.ccw = Channel::CCW(ms.get());
+
+  for (auto driveP: drives) {
+    if (ms.get() != (driveP != nullptr)) throw runtime_error(name + " drives don't match the saved state");
+    if (driveP) driveP->restoreState(ms);
+  }
+}
+
+
+////////////////////////////////////////////////////////////////
+// I/O instructions
+
+void RH20::clearIO() {
+  AsyncDevice::clearIO();
+  controllerReset();
+}
+
+
+IResult RH20::doDATAO(W36 iw, W36 ea) {
+  dataO(km10.memGetN(ea));
+  return IResult::iNormal;
+}
+
+
+IResult RH20::doDATAI(W36 iw, W36 ea) {
+  km10.memPut(dataI());
+  return IResult::iNormal;
+}
+
+
+IResult RH20::doCONO(W36 iw, W36 ea) {
+  putConditions(ea.rhu);
+  return IResult::iNormal;
+}
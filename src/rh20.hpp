@@ -0,0 +1,257 @@
+#pragma once
+
+// RH20 Massbus controller. There can be eight, each with its own KL10
+// internal channel: RH20 number n is device 540+4n and uses channel
+// n's words in the EPT. Each has up to eight drives on its Massbus.
+//
+// The program reads and writes drive registers (00-37) and our own
+// (70-77) with DATAI and DATAO. A data transfer starts when it writes
+// a read or write function with a block count to our transfer control
+// register. Our channel (see channel.hpp) then follows the command
+// list starting with the word in the EPT's logout area for the
+// channel, moving the drive's words to or from memory as the list
+// says.
+//
+// Drive functions that take time (seeks and transfers) run on our
+// worker thread (see asyncdev.hpp), so the CPU never waits for the
+// disk or for the latency a drive pretends to have.
+
+#include <cstdint>
+#include <array>
+
+using namespace std;
+
+#include "word.hpp"
+#include "asyncdev.hpp"
+#include "channel.hpp"
+
+
+struct RH20;
+
+
+// A drive on an RH20's Massbus.
+struct MassbusDrive {
+
+  // What writing a drive's control register started.
+  enum Start {
+    noFunction,			// Nothing, or done already
+    positioning,		// A seek or the like
+    readData,			// A transfer to memory
+    writeData,			// A transfer from memory
+  };
+
+  // Massbus register numbers drives share.
+  enum Register {
+    regCS1 = 000,		// Control and status 1
+    regDS = 001,		// Drive status
+    regER1 = 002,		// Error 1
+    regMR = 003,		// Maintenance
+    regAS = 004,		// Attention summary (the RH20 does this one)
+    regDT = 006,		// Drive type
+    regSN = 010,		// Serial number
+  };
+
+  // Drive status (DS) bits most drives have
+  static const inline unsigned dsATA = 0100000;	// Attention active
+  static const inline unsigned dsERR = 0040000;	// Composite error
+  static const inline unsigned dsPIP = 0020000;	// Positioning in progress
+  static const inline unsigned dsMOL = 0010000;	// Medium on line
+  static const inline unsigned dsWRL = 0004000;	// Write locked
+  static const inline unsigned dsDPR = 0000400;	// Drive present
+  static const inline unsigned dsDRY = 0000200;	// Drive ready
+
+  virtual ~MassbusDrive() {}
+
+  // CPU side. Read or write one of our registers. Writing the control
+  // register with GO set starts a function, and we say which kind.
+  virtual unsigned readRegister(unsigned reg) = 0;
+  virtual Start writeRegister(unsigned reg, unsigned v) = 0;
+
+  // CPU side. Our attention flag, which shows in the RH20's attention
+  // summary register and is cleared by writing our bit there.
+  virtual bool attention() = 0;
+  virtual void clearAttention() = 0;
+
+  // CPU side. Massbus initialize.
+  virtual void reset() = 0;
+
+  // Worker side. Do the function writeRegister() started. A transfer
+  // of up to `blocks` blocks moves its words with `rh`'s transfer().
+  // Returns false if the drive finished with an error.
+  virtual bool perform(Start s, unsigned blocks, RH20 &rh) = 0;
+
+  // CPU side. The function perform() did is over.
+  virtual void complete(Start s) = 0;
+
+  virtual void saveState(MachineState &ms) = 0;
+  virtual void restoreState(MachineState &ms) = 0;
+};
+
+
+struct RH20: AsyncDevice {
+
+  // CONO bits
+  union CONOMask {
+
+    struct ATTRPACKED {
+      unsigned pia: 3;
+      unsigned clearDone: 1;	// 32
+      unsigned stop: 1;		// Stop transfer
+      unsigned attnEnable: 1;
+      unsigned deleteSCR: 1;	// Forget the secondary command
+      unsigned resetCLP: 1;	// Reset command list pointer
+      unsigned mbEnable: 1;	// Massbus enable
+      unsigned clearXferErr: 1;	// Clear transfer errors
+      unsigned reset: 1;	// Controller and Massbus reset
+      unsigned clearRAE: 1;	// Clear register access error
+
+      unsigned: 6;
+    };
+
+    unsigned u: 18;
+
+    CONOMask(unsigned ea) { u = ea; }
+  };
+
+  // CONI bits
+  union Status {
+
+    struct ATTRPACKED {
+      unsigned pia: 3;
+      unsigned done: 1;		// 32 Transfer done
+      unsigned pcrFull: 1;	// Primary command register full
+      unsigned attnEnable: 1;
+      unsigned scrFull: 1;	// Secondary command register full
+      unsigned attention: 1;	// Some drive wants attention
+      unsigned mbEnable: 1;
+      unsigned overrun: 1;
+      unsigned channelReady: 1;	// Secondary command register free
+      unsigned rae: 1;		// Register access error
+      unsigned dre: 1;		// Drive response error
+      unsigned channelError: 1;	// Channel error (see logout)
+      unsigned swce: 1;		// Short word count error
+      unsigned lwce: 1;		// Long word count error
+      unsigned exception: 1;	// Drive error during transfer
+      unsigned dbpe: 1;		// Data bus parity error
+    };
+
+    unsigned u: 18;
+
+    Status(unsigned v = 0) : u(v) {}
+  } status;
+
+  // DATAO word, and DATAI word with `load` off.
+  union DataWord {
+
+    struct ATTRPACKED {
+      unsigned data: 18;	// Sixteen for drive registers
+      unsigned drive: 3;
+      unsigned: 5;
+      unsigned raeDisable: 1;	// Don't stop for register access error
+      unsigned transferReceived: 1; // DATAI: the drive answered
+      unsigned: 1;
+      unsigned load: 1;		// Write the register
+      unsigned reg: 6;
+    };
+
+    uint64_t u: 36;
+
+    DataWord(uint64_t v = 0) : u(v) {}
+  };
+
+  // Our own register numbers
+  enum Register {
+    regSBAR = 070,		// Secondary block address
+    regSTCR = 071,		// Secondary transfer control
+    regPBAR = 072,		// Primary block address
+    regPTCR = 073,		// Primary transfer control
+    regIVIR = 074,		// Interrupt vector index
+  };
+
+  // Transfer control register
+  union TCR {
+
+    struct ATTRPACKED {
+      unsigned function: 6;
+      unsigned negBlocks: 10;	// Minus the block count
+      unsigned: 2;
+      unsigned drive: 3;
+      unsigned: 4;
+      unsigned storeStatus: 1;	// Log out even without an error
+      unsigned: 2;
+      unsigned resetCLP: 1;	// Reset command list pointer
+      unsigned: 7;
+    };
+
+    uint64_t u: 36;
+
+    TCR(uint64_t v = 0) : u(v) {}
+
+    unsigned blocks() const {return negBlocks ? 02000 - negBlocks : 02000;}
+  };
+
+  // Words per block, for drives that care (disks).
+  static const inline unsigned blockWords = 128;
+
+  unsigned number;		// Our channel number
+  array<MassbusDrive *, 8> drives; // We own these
+
+  TCR stcr, ptcr;
+  unsigned sbar, pbar;
+  unsigned ivir;
+  DataWord lastSelect;		// What DATAI reads back
+
+  Channel channel;
+
+
+  // Constructors. We are RH20 `aNumber`, device 540+4*`aNumber`, and
+  // our CPU deletes us.
+  RH20(unsigned aNumber, KM10 &cpu);
+  virtual ~RH20();
+
+  // Put `driveP` (which we now own) on our Massbus as `unit`.
+  void attach(unsigned unit, MassbusDrive *driveP);
+
+
+  // CPU side. What DATAO and DATAI do with their words.
+  void dataO(W36 w);
+  W36 dataI();
+
+  // Worker side, for drives. Move up to `n` words between `p` and
+  // memory the way our channel's command list says. Returns how many
+  // moved.
+  size_t transfer(W36 *p, size_t n, bool toMemory) {
+    return channel.transfer(p, n, toMemory);
+  }
+
+
+  virtual void perform(Op &op) override;
+  virtual void complete(const Op &op) override;
+
+  virtual unsigned getConditions() override;
+  virtual void putConditions(unsigned v) override;
+
+  // We interrupt through the vector our IVIR points to in the EPT if
+  // it's set, and through the usual 40+2n location if not.
+  virtual tuple<unsigned,W36> getIntFuncWord() override;
+
+  // Our request stays until the program clears what caused it.
+  virtual void intFunctionDone(W36 ifw, bool ok) override;
+
+  // Request or withdraw our interrupt to match `status`.
+  void updateInterrupt();
+
+  virtual void saveState(MachineState &ms) override;
+  virtual void restoreState(MachineState &ms) override;
+
+  virtual void clearIO() override;
+  virtual IResult doDATAO(W36 iw, W36 ea) override;
+  virtual IResult doDATAI(W36 iw, W36 ea) override;
+  virtual IResult doCONO(W36 iw, W36 ea) override;
+
+private:
+  void loadTransfer(TCR tcr);
+  void startTransfer();
+  void startFunction(unsigned unit, MassbusDrive::Start s, unsigned blocks);
+  void controllerReset();
+};
@@ -0,0 +1,395 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+#include <stdexcept>
+#include <algorithm>
+#include <thread>
+
+using namespace std;
+
+#include "word.hpp"
+#include "rp07.hpp"
+#include "rh20.hpp"
+
+
+using Clock = chrono::steady_clock;
+
+
+RP07::RP07(const string &aPath, unsigned aSerial, Latency aLatency)
+  : path(aPath),
+    fd(-1),
+    imageP(nullptr),
+    writeLocked(false),
+    latency(aLatency),
+    function(0),
+    er1(0),
+    er2(0),
+    er3(0),
+    mr(0),
+    da(0),
+    dc(0),
+    cc(0),
+    of(0),
+    serial(aSerial),
+    ata(false),
+    busy(false),
+    pip(false),
+    vv(false),
+    newDA(0),
+    newDC(0),
+    newCC(0),
+    newER1(0)
+{
+  const size_t packBytes = packWords * sizeof(W36);
+
+  fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+
+  if (fd < 0) {
+    fd = open(path.c_str(), O_RDONLY);
+    writeLocked = true;
+  }
+
+  if (fd < 0) throw runtime_error("Can't open RP07 image " + path + ": " + strerror(errno));
+
+  struct stat st;
+
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    throw runtime_error("Can't stat RP07 image " + path + ": " + strerror(errno));
+  }
+
+  // Growing the file this way allocates nothing, so a new pack is
+  // all holes that read as zeros.
+  if ((size_t) st.st_size < packBytes) {
+
+    if (writeLocked || ftruncate(fd, packBytes) < 0) {
+      close(fd);
+      throw runtime_error("RP07 image " + path + " is too small and can't be extended");
+    }
+  }
+
+  void *p = mmap(nullptr, packBytes, PROT_READ | (writeLocked ? 0 : PROT_WRITE), MAP_SHARED, fd, 0);
+
+  if (p == MAP_FAILED) {
+    close(fd);
+    throw runtime_error("Can't map RP07 image " + path + ": " + strerror(errno));
+  }
+
+  imageP = (W36 *) p;
+}
+
+
+RP07::~RP07() {
+  munmap(imageP, packWords * sizeof(W36));
+  close(fd);
+}
+
+
+////////////////////////////////////////////////////////////////
+// Registers
+
+unsigned RP07::readRegister(unsigned reg) {
+
+  switch (reg) {
+  case regCS1:
+    return 04000 | (busy ? function : function & ~1u); // Drive available
+
+  case regDS:
+    return (ata ? dsATA : 0) |
+      (er1 || er2 || er3 ? dsERR : 0) |
+      (pip ? dsPIP : 0) |
+      dsMOL |
+      (writeLocked ? dsWRL : 0) |
+      (dc == cylinders - 1 && da == (((tracks - 1) << 8) | (sectors - 1)) ? dsLST : 0) |
+      dsDPR |
+      (busy ? 0 : dsDRY) |
+      (vv ? dsVV : 0);
+
+  case regER1: return er1;
+  case regMR: return mr;
+  case regDA: return da;
+  case regDT: return driveType;
+  case regLA: return sectorAt(Clock::now()) << 6;
+  case regSN: return serial;
+  case regOF: return of;
+  case regDC: return dc;
+  case regCC: return cc;
+  case regER2: return er2;
+  case regER3: return er3;
+  case 016: return 0;		// ECC position
+  case 017: return 0;		// ECC pattern
+
+  default:
+    er1 |= er1ILR;
+    return 0;
+  }
+}
+
+
+MassbusDrive::Start RP07::writeRegister(unsigned reg, unsigned v) {
+
+  // Nothing changes under a function that's going.
+  if (busy) {
+    er1 |= er1RMR;
+    return noFunction;
+  }
+
+  switch (reg) {
+  case regCS1:
+    function = v & 077;
+    return (v & 1) ? doFunction(function) : noFunction;
+
+  case regER1: er1 = v; break;
+  case regMR: mr = v; break;
+  case regDA: da = v & 017477; break;
+  case regOF: of = v; break;
+  case regDC: dc = v & 01777; break;
+  case regER2: er2 = v; break;
+  case regER3: er3 = v; break;
+
+  case regDS:
+  case regDT:
+  case regLA:
+  case regSN:
+  case regCC:
+  case 016:
+  case 017:
+    break;			// Read only
+
+  default:
+    er1 |= er1ILR;
+    break;
+  }
+
+  return noFunction;
+}
+
+
+MassbusDrive::Start RP07::doFunction(unsigned fn) {
+
+  switch (fn) {
+  case fnNOP:
+  case fnRelease:
+    return noFunction;
+
+  case fnDriveClear:
+    er1 = er2 = er3 = 0;
+    ata = false;
+    return noFunction;
+
+  // There's nobody to hand the pack to, so it just goes invalid.
+  case fnUnload:
+    vv = false;
+    ata = true;
+    return noFunction;
+
+  // The heads don't really move for these.
+  case fnOffset:
+  case fnReturnToCenter:
+    ata = true;
+    return noFunction;
+
+  case fnReadInPreset:
+    vv = true;
+    da = dc = of = 0;
+    return noFunction;
+
+  case fnPackAck:
+    vv = true;
+    return noFunction;
+
+  case fnRecalibrate:
+    dc = 0;
+    busy = pip = true;
+    return positioning;
+
+  case fnSeek:
+  case fnSearch:
+
+    if (dc >= cylinders) {
+      er1 |= er1IAE;
+      ata = true;
+      return noFunction;
+    }
+
+    busy = pip = true;
+    return positioning;
+
+  case fnRead:
+  case fnWrite:
+
+    if (dc >= cylinders || ((da >> 8) & 037) >= tracks || (da & 077) >= sectors) {
+      er1 |= er1IAE;
+      ata = true;
+      return noFunction;
+    }
+
+    if (fn == fnWrite && writeLocked) {
+      er1 |= er1WLE;
+      ata = true;
+      return noFunction;
+    }
+
+    busy = true;
+    return fn == fnRead ? readData : writeData;
+
+  // Write check and the header functions are for formatting and
+  // diagnostics, which we don't do.
+  default:
+    er1 |= er1ILF;
+    ata = true;
+    return noFunction;
+  }
+}
+
+
+bool RP07::attention() {
+  return ata;
+}
+
+
+void RP07::clearAttention() {
+  ata = false;
+}
+
+
+void RP07::reset() {
+  er1 = er2 = er3 = 0;
+  function = 0;
+  of = 0;
+  ata = false;
+}
+
+
+////////////////////////////////////////////////////////////////
+// Latency
+
+// The sector passing under the heads at time `t`.
+unsigned RP07::sectorAt(Clock::time_point t) {
+  if (latency.revolutionUS == 0) return 0;
+  const int64_t sectorNS = latency.revolutionUS * 1000ll / sectors;
+  return (chrono::duration_cast<chrono::nanoseconds>(t.time_since_epoch()).count() / sectorNS) % sectors;
+}
+
+
+// When a function that moves the heads from cylinder `from` to `to`
+// and then reads or writes `n` sectors starting at `sector` started
+// now would be done.
+Clock::time_point RP07::readyAt(unsigned from, unsigned to, unsigned sector, unsigned n) {
+  auto t = Clock::now();
+
+  if (from != to) {
+    t += chrono::microseconds(latency.settleUS);
+    t += chrono::nanoseconds((int64_t) latency.cylinderNS * (from > to ? from - to : to - from));
+  }
+
+  if (latency.revolutionUS != 0 && n != 0) {
+    const chrono::nanoseconds sectorTime(latency.revolutionUS * 1000ll / sectors);
+    t += sectorTime * ((sector + sectors - sectorAt(t)) % sectors + n);
+  }
+
+  return t;
+}
+
+
+////////////////////////////////////////////////////////////////
+// Worker and completions
+
+bool RP07::perform(Start s, unsigned blocks, RH20 &rh) {
+  newDA = da;
+  newDC = dc;
+  newCC = cc;
+  newER1 = 0;
+
+  if (s == positioning) {
+    this_thread::sleep_until(readyAt(cc, dc, 0, 0));
+    newCC = dc;
+    return true;
+  }
+
+  const unsigned track = (da >> 8) & 037;
+  const unsigned sector = da & 077;
+  size_t lba = ((size_t) dc * tracks + track) * sectors + sector;
+
+  // A transfer can't go past the end of the pack.
+  const size_t wanted = (size_t) blocks * sectorWords;
+  const size_t n = min(wanted, packWords - lba * sectorWords);
+  const auto ready = readyAt(cc, dc, sector, (n + sectorWords - 1) / sectorWords);
+
+  W36 *p = imageP + lba * sectorWords;
+  const size_t moved = rh.transfer(p, n, s == readData);
+
+  // A write that stops partway through a sector fills the rest of it
+  // with zeros.
+  if (s == writeData && moved % sectorWords != 0) {
+    fill_n(p + moved, sectorWords - moved % sectorWords, W36(0));
+  }
+
+  if (moved == n && n < wanted) newER1 |= er1AOE;
+
+  // Leave the address at the next sector.
+  lba += (moved + sectorWords - 1) / sectorWords;
+  newDC = lba / (tracks * sectors);
+  newDA = ((lba / sectors % tracks) << 8) | lba % sectors;
+  newCC = min(newDC, cylinders - 1);
+
+  this_thread::sleep_until(ready);
+  return newER1 == 0;
+}
+
+
+void RP07::complete(Start s) {
+  busy = false;
+
+  if (s == positioning) {
+    cc = newCC;
+    pip = false;
+    ata = true;
+    return;
+  }
+
+  da = newDA;
+  dc = newDC;
+  cc = newCC;
+  er1 |= newER1;
+  if (newER1) ata = true;
+}
+
+
+////////////////////////////////////////////////////////////////
+// State
+
+void RP07::saveState(MachineState &ms) {
+  ms.put(function);
+  ms.put(er1);
+  ms.put(er2);
+  ms.put(er3);
+  ms.put(mr);
+  ms.put(da);
+  ms.put(dc);
+  ms.put(cc);
+  ms.put(of);
+  ms.put(ata);
+  ms.put(vv);
+}
+
+
+void RP07::restoreState(MachineState &ms) {
+  function = ms.get();
+  er1 = ms.get();
+  er2 = ms.get();
+  er3 = ms.get();
+  mr = ms.get();
+  da = ms.get();
+  dc = ms.get();
+  cc = ms.get();
+  of = ms.get();
+  ata = ms.get();
+  vv = ms.get();
+  busy = pip = false;
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+// RP07 disk drive on an RH20's Massbus.
+//
+// The pack is an image file of 64-bit little endian words, one per 36
+// bit word, the way SIMH and KLH10 keep PDP-10 disks. We map the whole
+// file, so a transfer is a copy between the mapping and the 10's
+// memory. A new image is made as a sparse file of the full size, so a
+// pack costs no disk space until it's written.
+//
+// Seeks and transfers take as long as `latency` says. With the
+// default `noLatency` they finish as fast as we can copy.
+
+#include <cstdint>
+#include <string>
+#include <chrono>
+
+using namespace std;
+
+#include "word.hpp"
+#include "rh20.hpp"
+
+
+struct RP07: MassbusDrive {
+
+  // Geometry in 18/36 bit format
+  static const inline unsigned cylinders = 630;
+  static const inline unsigned tracks = 32;
+  static const inline unsigned sectors = 43;
+  static const inline unsigned sectorWords = 128;
+  static const inline size_t packWords = (size_t) cylinders * tracks * sectors * sectorWords;
+
+  static const inline unsigned driveType = 020042;
+
+  // How long things take.
+  struct Latency {
+    unsigned settleUS;		// Any seek that moves the heads at all
+    unsigned cylinderNS;	// Each cylinder the heads cross
+    unsigned revolutionUS;	// A turn of the pack; zero means none of this
+  };
+
+  // As fast as we can go, and about what a real RP07 does.
+  static const inline Latency noLatency{0, 0, 0};
+  static const inline Latency rp07Latency{5000, 55000, 16600};
+
+  // Functions, with GO
+  enum Function {
+    fnNOP = 001,
+    fnUnload = 003,
+    fnSeek = 005,
+    fnRecalibrate = 007,
+    fnDriveClear = 011,
+    fnRelease = 013,
+    fnOffset = 015,
+    fnReturnToCenter = 017,
+    fnReadInPreset = 021,
+    fnPackAck = 023,
+    fnSearch = 031,
+    fnWriteCheck = 051,
+    fnWriteCheckHeader = 053,
+    fnWrite = 061,
+    fnWriteHeader = 063,
+    fnRead = 071,
+    fnReadHeader = 073,
+  };
+
+  // Registers of our own
+  enum Register {
+    regDA = 005,		// Desired track and sector
+    regLA = 007,		// Look ahead (sector under the heads)
+    regOF = 011,		// Offset
+    regDC = 012,		// Desired cylinder
+    regCC = 013,		// Current cylinder
+    regER2 = 014,
+    regER3 = 015,
+  };
+
+  // DS bits only disks have
+  static const inline unsigned dsLST = 0002000;	// Last sector transferred
+  static const inline unsigned dsVV = 0000100;	// Volume valid
+
+  // ER1 bits
+  static const inline unsigned er1WLE = 0004000;	// Write lock error
+  static const inline unsigned er1IAE = 0002000;	// Invalid address
+  static const inline unsigned er1AOE = 0001000;	// Address overflow
+  static const inline unsigned er1RMR = 0000004;	// Register modify refused
+  static const inline unsigned er1ILR = 0000002;	// Illegal register
+  static const inline unsigned er1ILF = 0000001;	// Illegal function
+
+  string path;
+  int fd;
+  W36 *imageP;
+  bool writeLocked;
+  Latency latency;
+
+  // Registers
+  unsigned function;
+  unsigned er1, er2, er3;
+  unsigned mr, da, dc, cc, of;
+  unsigned serial;
+  bool ata;
+  bool busy;			// A function is in flight
+  bool pip;
+  bool vv;
+
+  // What perform() leaves for complete().
+  unsigned newDA, newDC, newCC;
+  unsigned newER1;
+
+
+  // Constructors. Opens (or makes) the image at `aPath`. If it can't be
+  // written we are write locked.
+  RP07(const string &aPath, unsigned aSerial = 0, Latency aLatency = noLatency);
+  virtual ~RP07();
+
+
+  virtual unsigned readRegister(unsigned reg) override;
+  virtual Start writeRegister(unsigned reg, unsigned v) override;
+  virtual bool attention() override;
+  virtual void clearAttention() override;
+  virtual void reset() override;
+  virtual bool perform(Start s, unsigned blocks, RH20 &rh) override;
+  virtual void complete(Start s) override;
+  virtual void saveState(MachineState &ms) override;
+  virtual void restoreState(MachineState &ms) override;
+
+private:
+  Start doFunction(unsigned fn);
+  unsigned sectorAt(chrono::steady_clock::time_point t);
+  chrono::steady_clock::time_point readyAt(unsigned from, unsigned to, unsigned sector, unsigned n);
+};
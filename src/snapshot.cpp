@@ -0,0 +1,106 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdexcept>
+
+using namespace std;
+
+#include "snapshot.hpp"
+#include "km10.hpp"
+#include "machstate.hpp"
+
+
+void Snapshot::save(KM10 &km10, const string &path) {
+  MachineState ms;
+  km10.saveState(ms);
+  const string symbols = km10.debugger.toText();
+
+  Header h{};
+  h.magic = magicValue;
+  h.version = currentVersion;
+  h.memoryWords = km10.memorySize;
+  h.stateWords = ms.words.size();
+  h.symbolBytes = symbols.size();
+
+  const size_t stateBytes = ms.words.size() * sizeof(uint64_t);
+  h.memoryOffset = (sizeof(h) + stateBytes + symbols.size() + PhysicalMemory::pageBytes - 1)
+    & ~(uint64_t) (PhysicalMemory::pageBytes - 1);
+
+  const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) throw runtime_error("Failed to create snapshot " + path);
+
+  // The header goes last so a partly written snapshot is rejected.
+  struct {
+    const void *p;
+    size_t n;
+    uint64_t offset;
+  } pieces[] = {
+    {ms.words.data(), stateBytes, sizeof(h)},
+    {symbols.data(), symbols.size(), sizeof(h) + stateBytes},
+    {km10.physicalP, (size_t) km10.memorySize * sizeof(W36), h.memoryOffset},
+    {&h, sizeof(h), 0},
+  };
+
+  for (auto [p, n, offset]: pieces) {
+
+    for (size_t done=0; done < n; ) {
+      const ssize_t st = pwrite(fd, (const char *) p + done, n - done, offset + done);
+
+      if (st <= 0) {
+	close(fd);
+	throw runtime_error("Failed to write snapshot " + path);
+      }
+
+      done += st;
+    }
+  }
+
+  close(fd);
+}
+
+
+void Snapshot::restore(KM10 &km10, const string &path) {
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) throw runtime_error("Failed to open snapshot " + path);
+
+  Header h;
+  MachineState ms;
+  string symbols;
+
+  try {
+    auto readAll = [&](void *p, size_t n, uint64_t offset) {
+
+      for (size_t done=0; done < n; ) {
+	const ssize_t st = pread(fd, (char *) p + done, n - done, offset + done);
+	if (st <= 0) throw runtime_error("Snapshot " + path + " is truncated");
+	done += st;
+      }
+    };
+
+    readAll(&h, sizeof(h), 0);
+    if (h.magic != magicValue) throw runtime_error(path + " is not a KM10 snapshot");
+    if (h.version != currentVersion) throw runtime_error("Snapshot " + path + " is from another KM10 version");
+    if (h.memoryWords != km10.memorySize) throw runtime_error("Snapshot " + path + " has a different memory size");
+
+    ms.words.resize(h.stateWords);
+    readAll(ms.words.data(), h.stateWords * sizeof(uint64_t), sizeof(h));
+
+    symbols.resize(h.symbolBytes);
+    readAll(symbols.data(), h.symbolBytes, sizeof(h) + h.stateWords * sizeof(uint64_t));
+
+    // Make sure all of memory is there before we map it, or a short
+    // file would fault (SIGBUS) when referenced.
+    W36 lastWord;
+    readAll(&lastWord, sizeof(lastWord), h.memoryOffset + ((uint64_t) h.memoryWords - 1) * sizeof(W36));
+
+    km10.physMem.loadFrom(fd, h.memoryOffset);
+  } catch (...) {
+    close(fd);
+    throw;
+  }
+
+  // A copy-on-write mapping keeps the file referenced after close.
+  close(fd);
+
+  km10.restoreState(ms);
+  km10.debugger.fromText(symbols);
+}
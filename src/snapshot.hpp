@@ -0,0 +1,49 @@
+// Whole-machine snapshots for instant startup.
+//
+// A snapshot captures everything needed to start a configured
+// machine without loading any .A10 or .REL files: processor and
+// device state (see machstate.hpp, which includes the console
+// switches), the debugger's symbol tables, and all of memory.
+//
+// Layout (host byte order):
+//
+//   Header			At offset 0
+//   uint64_t state[stateWords]
+//   char symbols[symbolBytes]	SymbolTable::toText()
+//   padding to a 4KiB boundary
+//   memory			`memoryWords` words at `memoryOffset`
+//
+// Memory is page aligned so that restoring into anonymous memory is
+// just a copy-on-write mmap of the file.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+
+class KM10;
+
+
+struct Snapshot {
+  static const inline uint64_t magicValue = 0x4B4D3130534E4150ull; // "KM10SNAP"
+  static const inline uint32_t currentVersion = 1;
+
+  struct Header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t memoryWords;
+    uint64_t stateWords;
+    uint64_t symbolBytes;
+    uint64_t memoryOffset;
+  };
+
+  // Write a snapshot of `km10` to `path`. Only call this between
+  // instructions.
+  static void save(KM10 &km10, const string &path);
+
+  // Restore `km10` from the snapshot at `path`.
+  static void restore(KM10 &km10, const string &path);
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+// A lock-free ring buffer for exactly one producer thread and one
+// consumer thread, like the CTY's input (console thread to CPU) and
+// output (CPU to console thread).
+//
+// Neither side ever blocks. A consumer that wants to sleep when its
+// ring is empty pairs the ring with a Waker (below).
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cstddef>
+#include <atomic>
+#include <array>
+#include <algorithm>
+
+using namespace std;
+
+
+template <class T, size_t N>
+struct SPSCRing {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "SPSCRing size must be a power of two");
+
+  // `head` and `tail` count forever, and wrap modulo N to index
+  // `buf`. Each is written by only one side, so each gets its own
+  // cache line to keep the two sides from bouncing it.
+  alignas(64) atomic<size_t> head{0};	// Next to dequeue (consumer's)
+  alignas(64) atomic<size_t> tail{0};	// Next to enqueue (producer's)
+  alignas(64) array<T, N> buf;
+
+  static const inline size_t capacity = N;
+
+
+  // Producer side. Returns false if the ring is full.
+  bool enqueue(T t) {
+    const size_t t0 = tail.load(memory_order_relaxed);
+    if (t0 - head.load(memory_order_acquire) >= N) return false;
+    buf[t0 % N] = t;
+    tail.store(t0 + 1, memory_order_release);
+    return true;
+  }
+
+  // Producer side. Enqueue as many of the `n` items at `p` as fit and
+  // return how many that was.
+  size_t enqueue(const T *p, size_t n) {
+    const size_t t0 = tail.load(memory_order_relaxed);
+    n = min(n, N - (t0 - head.load(memory_order_acquire)));
+    for (size_t k=0; k < n; ++k) buf[(t0 + k) % N] = p[k];
+    tail.store(t0 + n, memory_order_release);
+    return n;
+  }
+
+  // Consumer side. Returns false if the ring is empty.
+  bool dequeue(T &t) {
+    const size_t h0 = head.load(memory_order_relaxed);
+    if (h0 == tail.load(memory_order_acquire)) return false;
+    t = buf[h0 % N];
+    head.store(h0 + 1, memory_order_release);
+    return true;
+  }
+
+  // Consumer side. The items ready to dequeue are in at most two
+  // contiguous pieces of `buf` (the second when they wrap). Point
+  // `p0`/`p1` at them and return how many there are in all. Nothing
+  // is dequeued until `consume()`.
+  size_t peek(const T *&p0, size_t &n0, const T *&p1, size_t &n1) const {
+    const size_t h0 = head.load(memory_order_relaxed);
+    const size_t n = tail.load(memory_order_acquire) - h0;
+    n0 = min(n, N - h0 % N);
+    n1 = n - n0;
+    p0 = &buf[h0 % N];
+    p1 = &buf[0];
+    return n;
+  }
+
+  // Consumer side. Drop `n` items we've used from `peek()`.
+  void consume(size_t n) {
+    head.store(head.load(memory_order_relaxed) + n, memory_order_release);
+  }
+
+  // Either side can ask these, though the answer may be stale by the
+  // time it returns.
+  size_t size() const {return tail.load(memory_order_acquire) - head.load(memory_order_acquire);}
+  bool isEmpty() const {return size() == 0;}
+  bool isFull() const {return size() >= N;}
+};
+
+
+// Wakes a thread that sleeps in poll() when it runs out of work. The
+// sleeper calls `prepareToSleep()`, checks once more for work, and
+// polls `fd` only if there still isn't any. Whoever gives it work
+// then calls `wake()`, which only makes a system call if the sleeper
+// is actually asleep (or about to be).
+struct Waker {
+  int fd;
+  atomic<bool> sleeping{false};
+
+  Waker()
+    : fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+  {}
+
+  ~Waker() {close(fd);}
+
+  // The fences keep the sleeper's store of `sleeping` from passing
+  // its re-check of the rings, and the waker's ring update from
+  // passing its check of `sleeping`. Otherwise each could miss the
+  // other and the sleeper would sleep on work that's ready.
+  void prepareToSleep() {
+    sleeping.store(true, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+  }
+
+  void awake() {sleeping.store(false, memory_order_relaxed);}
+
+  void wake() {
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (sleeping.load(memory_order_relaxed) && sleeping.exchange(false)) {
+      const uint64_t one = 1;
+      [[maybe_unused]] ssize_t st = write(fd, &one, sizeof(one));
+    }
+  }
+
+  // The sleeper calls this after poll() says `fd` is readable.
+  void drain() {
+    uint64_t n;
+    [[maybe_unused]] ssize_t st = read(fd, &n, sizeof(n));
+  }
+};
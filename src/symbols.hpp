@@ -0,0 +1,43 @@
+// Symbol tables loaded from MACRO-10 REL files, for symbolic
+// disassembly and debugging. This is shared by the inline debugger
+// and by external tools like the inspector.
+#pragma once
+#include <map>
+#include <string>
+
+using namespace std;
+
+#include "word.hpp"
+
+
+struct SymbolTable {
+  map<string, W36> globalSymbols;
+  map<string, W36> localSymbols;
+  map<string, W36> localInvisibleSymbols;
+  map<W36, string> valueToSymbol;
+
+  bool verboseLoad;
+
+  // Where loadREL() dumps the symbols it loaded, or nowhere if empty.
+  string logFileName;
+
+  SymbolTable()
+    : globalSymbols{},
+      localSymbols{},
+      localInvisibleSymbols{},
+      valueToSymbol{},
+      verboseLoad(false),
+      logFileName{}
+  {}
+
+  string symbolicForm(W36 w);
+
+  void loadREL(const char *fileNameP);
+  void dumpSymbols();
+  void loadWord(unsigned addr, W36 value);
+
+  // Save all of our tables as text for snapshots, one "KIND VALUE
+  // NAME" line per entry, and replace them with ones read back.
+  string toText() const;
+  void fromText(const string &text);
+};
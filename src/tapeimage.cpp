@@ -0,0 +1,312 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+#include <stdexcept>
+#include <algorithm>
+
+using namespace std;
+
+#include "tapeimage.hpp"
+
+
+static uint32_t getLE32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+
+static void putLE32(uint8_t *p, uint32_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+
+TapeImage::TapeImage(const string &aPath)
+  : path(aPath),
+    fd(-1),
+    writeLocked(false),
+    scanOffset(0),
+    scanned(false),
+    generation(0),
+    nextRead(0),
+    aheadNext(0),
+    aheadBytes(0),
+    helperDone(false)
+{
+  fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+
+  if (fd < 0) {
+    fd = open(path.c_str(), O_RDONLY);
+    writeLocked = true;
+  }
+
+  if (fd < 0) throw runtime_error("Can't open tape image " + path + ": " + strerror(errno));
+
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  helper = thread(&TapeImage::helperLoop, this);
+}
+
+
+TapeImage::~TapeImage() {
+
+  {
+    lock_guard<mutex> lock(m);
+    helperDone = true;
+  }
+
+  wanted.notify_all();
+  helper.join();
+  close(fd);
+}
+
+
+////////////////////////////////////////////////////////////////
+// The helper
+
+void TapeImage::helperLoop() {
+  unique_lock<mutex> lock(m);
+
+  while (!helperDone) {
+
+    // Reading ahead comes first, since a drive may be waiting for it.
+    if (readAhead(lock)) continue;
+    if (!scanned && scanChunk(lock)) continue;
+    wanted.wait(lock);
+  }
+}
+
+
+// Index the records in the next piece of the file. The file is read
+// without holding `m`, and what we found is thrown away if a write
+// changed the tape meanwhile.
+bool TapeImage::scanChunk(unique_lock<mutex> &lock) {
+  static const size_t chunkSize = 1 << 20;
+
+  const uint64_t start = scanOffset;
+  const unsigned gen = generation;
+  lock.unlock();
+
+  struct stat st;
+  const uint64_t fileSize = fstat(fd, &st) == 0 ? st.st_size : 0;
+  vector<uint8_t> buf(chunkSize);
+  const ssize_t got = start < fileSize ? pread(fd, buf.data(), chunkSize, start) : 0;
+
+  vector<Record> found;
+  uint64_t k = 0;
+  bool end = got <= 0;
+
+  while (!end && k + 4 <= (uint64_t) got) {
+    const uint32_t count = getLE32(buf.data() + k);
+
+    if (count == 0xFFFFFFFF) {	// End of medium
+      end = true;
+    } else if (count == 0xFFFFFFFE) {	// Erase gap
+      k += 4;
+    } else if (count == 0) {
+      found.push_back(Record{start + k, markLength, false});
+      k += 4;
+    } else {
+      const uint32_t length = count & 0x7FFFFFFF;
+      const uint64_t size = 4 + ((length + 1ull) & ~1ull) + 4;
+
+      // A record cut short by the end of the file isn't there.
+      if (start + k + size > fileSize) {
+	end = true;
+      } else {
+	found.push_back(Record{start + k, length, (count & 0x80000000) != 0});
+	k += size;
+      }
+    }
+  }
+
+  if (start + k >= fileSize) end = true;
+
+  lock.lock();
+
+  if (gen == generation) {
+
+    for (auto &r: found) {
+      if (r.isMark()) marks.push_back(index.size());
+      index.push_back(r);
+    }
+
+    scanOffset = start + k;
+    if (end) scanned = true;
+  }
+
+  indexed.notify_all();
+  return true;
+}
+
+
+// Read the data of the next record after the last one read that we
+// don't have yet, if there's room for it.
+bool TapeImage::readAhead(unique_lock<mutex> &lock) {
+  if (aheadBytes >= aheadLimit) return false;
+
+  const size_t n = max(aheadNext, nextRead);
+  if (n >= index.size()) return false;
+
+  const Record r = index[n];
+  aheadNext = n + 1;
+
+  if (r.isMark()) {
+    ahead[n] = vector<uint8_t>{};
+    return true;
+  }
+
+  const unsigned gen = generation;
+  lock.unlock();
+
+  vector<uint8_t> data(r.length);
+  const bool ok = pread(fd, data.data(), r.length, r.offset + 4) == (ssize_t) r.length;
+
+  lock.lock();
+
+  if (ok && gen == generation && n >= nextRead) {
+    aheadBytes += data.size();
+    ahead[n] = move(data);
+  }
+
+  return ok;
+}
+
+
+////////////////////////////////////////////////////////////////
+// The drive's side
+
+// Wait until record `n` is indexed or there's no such record.
+void TapeImage::waitFor(unique_lock<mutex> &lock, size_t n) {
+  indexed.wait(lock, [&] {return index.size() > n || scanned;});
+}
+
+
+size_t TapeImage::recordsUpTo(size_t n) {
+  if (n == 0) return 0;
+
+  unique_lock<mutex> lock(m);
+  waitFor(lock, n - 1);
+  return min(n, index.size());
+}
+
+
+TapeImage::Record TapeImage::record(size_t n) {
+  lock_guard<mutex> lock(m);
+  return index.at(n);
+}
+
+
+size_t TapeImage::markAtOrAfter(size_t n, size_t limit) {
+  unique_lock<mutex> lock(m);
+
+  for (;;) {
+    auto it = lower_bound(marks.begin(), marks.end(), n);
+    if (it != marks.end()) return *it < limit ? *it : none;
+    if (scanned || index.size() >= limit) return none;
+    indexed.wait(lock);
+  }
+}
+
+
+size_t TapeImage::markBefore(size_t n) {
+  lock_guard<mutex> lock(m);
+  auto it = lower_bound(marks.begin(), marks.end(), n);
+  return it == marks.begin() ? none : *(it - 1);
+}
+
+
+bool TapeImage::read(size_t n, vector<uint8_t> &data) {
+  unique_lock<mutex> lock(m);
+  waitFor(lock, n);
+  if (n >= index.size()) return false;
+
+  const Record r = index[n];
+  bool have = false;
+
+  // Reading somewhere else than where we left off makes whatever we
+  // read ahead useless.
+  if (n != nextRead) {
+    ahead.clear();
+    aheadBytes = 0;
+    aheadNext = n;
+  }
+
+  auto it = ahead.find(n);
+
+  if (it != ahead.end()) {
+    aheadBytes -= it->second.size();
+    data = move(it->second);
+    ahead.erase(it);
+    have = true;
+  }
+
+  nextRead = n + 1;
+  lock.unlock();
+  wanted.notify_one();
+
+  if (have || r.isMark()) {
+    if (r.isMark()) data.clear();
+    return true;
+  }
+
+  data.resize(r.length);
+  return pread(fd, data.data(), r.length, r.offset + 4) == (ssize_t) r.length;
+}
+
+
+bool TapeImage::write(size_t n, const vector<uint8_t> &data) {
+  return append(n, data.size(), data.data());
+}
+
+
+bool TapeImage::writeMark(size_t n) {
+  return append(n, markLength, nullptr);
+}
+
+
+// Writing a record ends the tape after it, as it would on a real
+// drive.
+bool TapeImage::append(size_t n, uint32_t length, const uint8_t *p) {
+  if (writeLocked) return false;
+
+  unique_lock<mutex> lock(m);
+  indexed.wait(lock, [&] {return index.size() >= n || scanned;});
+  n = min(n, index.size());
+
+  const uint64_t offset = n < index.size() ? index[n].offset : scanOffset;
+  vector<uint8_t> bytes;
+
+  if (length == markLength) {
+    bytes.assign(4, 0);
+  } else {
+    const size_t padded = (length + 1ull) & ~1ull;
+    bytes.assign(4 + padded + 4, 0);
+    putLE32(bytes.data(), length);
+    memcpy(bytes.data() + 4, p, length);
+    putLE32(bytes.data() + 4 + padded, length);
+  }
+
+  ++generation;
+  const bool ok = pwrite(fd, bytes.data(), bytes.size(), offset) == (ssize_t) bytes.size() &&
+    ftruncate(fd, offset + bytes.size()) == 0;
+
+  index.resize(n);
+  index.push_back(Record{offset, length, false});
+  while (!marks.empty() && marks.back() >= n) marks.pop_back();
+  if (length == markLength) marks.push_back(n);
+  scanOffset = offset + bytes.size();
+  scanned = true;
+
+  for (auto it = ahead.lower_bound(n); it != ahead.end(); it = ahead.erase(it)) {
+    aheadBytes -= it->second.size();
+  }
+
+  nextRead = aheadNext = n + 1;
+  indexed.notify_all();
+  return ok;
+}
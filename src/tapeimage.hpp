@@ -0,0 +1,106 @@
+#pragma once
+
+// A magtape as a SIMH ".tap" image file.
+//
+// Each record in the file is a 32-bit little endian byte count, the
+// data padded to an even length, and the count again. A count of zero
+// is a tape mark, 0xFFFFFFFE is an erase gap, and 0xFFFFFFFF (or the
+// end of the file) is the end of the medium. Bit 31 of a count flags
+// a record that was read with an error.
+//
+// A helper thread scans the file once from the beginning, building an
+// index of where each record is and which records are tape marks, so
+// spacing over records or files and rewinding go straight to the
+// right record instead of reading the tape to find it. The same
+// thread reads ahead of the records being read forward, so a long
+// restore doesn't wait on the host file system a record at a time.
+//
+// Everything here except the constructor and destructor is called on
+// the tape drive's worker thread, and waits for the helper if it has
+// to.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+
+struct TapeImage {
+
+  struct Record {
+    uint64_t offset;		// Of its leading byte count
+    uint32_t length;		// Of its data in bytes, or `markLength`
+    bool bad;			// SIMH flagged it as read with an error
+
+    bool isMark() const {return length == markLength;}
+  };
+
+  static const inline uint32_t markLength = ~0u;
+  static const inline size_t none = ~(size_t) 0;
+
+  // How far the helper reads ahead of the record being read.
+  static const inline size_t aheadLimit = 4 << 20;
+
+  string path;
+  int fd;
+  bool writeLocked;
+
+
+  // Constructors. Opens (or makes) the image at `aPath`. If it can't
+  // be written we are write locked.
+  TapeImage(const string &aPath);
+  ~TapeImage();
+
+
+  // How many records there are, if it's fewer than `n`, and otherwise
+  // `n`. Waits for the helper to index that far.
+  size_t recordsUpTo(size_t n);
+
+  // Record `n`, which must exist.
+  Record record(size_t n);
+
+  // The first tape mark at or after record `n` and before record
+  // `limit`, or the last one before record `n`. Returns `none` if there
+  // isn't one.
+  size_t markAtOrAfter(size_t n, size_t limit = none);
+  size_t markBefore(size_t n);
+
+  // Read record `n`'s data into `data`. Returns false if there's no
+  // such record.
+  bool read(size_t n, vector<uint8_t> &data);
+
+  // Write `data` as record `n`, or a tape mark there, ending the tape
+  // after it. Returns false if the file can't be written.
+  bool write(size_t n, const vector<uint8_t> &data);
+  bool writeMark(size_t n);
+
+private:
+  mutex m;
+  condition_variable indexed;	// The helper has indexed or read ahead more
+  condition_variable wanted;	// There's something for the helper to do
+
+  vector<Record> index;
+  vector<size_t> marks;		// Records that are tape marks, in order
+  uint64_t scanOffset;		// Where indexing goes on
+  bool scanned;			// All of the tape is indexed
+  unsigned generation;		// Bumped when a write changes the tape
+
+  size_t nextRead;		// Record after the last one read
+  size_t aheadNext;		// Next record to read ahead
+  map<size_t, vector<uint8_t>> ahead;	// Data read ahead, by record
+  size_t aheadBytes;
+
+  bool helperDone;
+  thread helper;
+
+  void helperLoop();
+  bool scanChunk(unique_lock<mutex> &lock);
+  bool readAhead(unique_lock<mutex> &lock);
+  void waitFor(unique_lock<mutex> &lock, size_t n);
+  bool append(size_t n, uint32_t length, const uint8_t *p);
+};
@@ -21,3 +21,15 @@ unsigned TIMDevice::getConditions() {
 void TIMDevice::putConditions(unsigned v) {
   timState.u = v;
 }
+
+
+void TIMDevice::saveState(MachineState &ms) {
+  Device::saveState(ms);
+  ms.put(timState.u);
+}
+
+
+void TIMDevice::restoreState(MachineState &ms) {
+  Device::restoreState(ms);
+  timState.u = ms.get();
+}
@@ -39,7 +39,7 @@ struct TIMDevice: Device {
 
   // Constructors
   TIMDevice(KM10 &cpu):
-    Device(020, "TIM", cpu),
+    Device(004, "TIM", cpu),
     timState(0)
   { }
 
@@ -53,4 +53,7 @@ struct TIMDevice: Device {
 
   virtual unsigned getConditions();
   virtual void putConditions(unsigned v);
+
+  virtual void saveState(MachineState &ms) override;
+  virtual void restoreState(MachineState &ms) override;
 };
@@ -0,0 +1,441 @@
+#include <algorithm>
+
+using namespace std;
+
+#include "word.hpp"
+#include "tu78.hpp"
+#include "rh20.hpp"
+
+
+TU78::TU78(const string &aPath, unsigned aSerial)
+  : tape(aPath),
+    available(true),
+    function(0),
+    dti(0),
+    tc(0),
+    bc(0),
+    mr1(0),
+    ndi(0),
+    ndc(0),
+    serial(aSerial),
+    ata(false),
+    busy(false),
+    pos(0),
+    newPos(0),
+    newCode(0),
+    newCount(0),
+    newBC(0)
+{}
+
+
+////////////////////////////////////////////////////////////////
+// Registers
+
+unsigned TU78::readRegister(unsigned reg) {
+
+  switch (reg) {
+  case regCS1:
+    return 04000 | (busy ? function : function & ~1u); // Drive available
+
+  case regDTI: return dti;
+  case regTC: return tc;
+  case regMR1: return mr1;
+  case regBC: return bc;
+  case regDT: return driveType;
+  case regSN: return serial;
+  case regNDI: return ndi;
+  case regNDC0: return ndc;
+
+  case regUS:
+    return (busy ? 0 : usRDY) |
+      usPRES |
+      (available ? usONL : 0) |
+      usPE |
+      (pos == 0 ? usBOT : 0) |
+      (tape.writeLocked ? usFPT : 0);
+
+  default:
+    return 0;			// Units 1-3 and what we don't have
+  }
+}
+
+
+MassbusDrive::Start TU78::writeRegister(unsigned reg, unsigned v) {
+
+  // The formatter does one thing at a time.
+  if (busy) return noFunction;
+
+  switch (reg) {
+  case regCS1:
+    function = v & 077;
+    if ((v & 1) == 0) return noFunction;
+
+    if (!available) {
+      dti = icNotReady;
+      ata = true;
+      return noFunction;
+    }
+
+    switch (function) {
+    case fnReadForward:
+    case fnReadReverse:
+      busy = true;
+      return readData;
+
+    case fnWritePE:
+    case fnWriteGCR:
+
+      if (tape.writeLocked) {
+	dti = icFileProtect;
+	ata = true;
+	return noFunction;
+      }
+
+      busy = true;
+      return writeData;
+
+    // The rest go in the non-data command registers.
+    default:
+      dti = icNotCapable;
+      ata = true;
+      return noFunction;
+    }
+
+  case regTC: tc = v; break;
+  case regMR1: mr1 = v; break;
+  case regBC: bc = v; break;
+  case regNDC0: return startNonData(v);
+
+  case regNDC0 + 1:
+  case regNDC0 + 2:
+  case regNDC3:
+
+    if (v & 1) {
+      ndi = ((reg - regNDC0) << 8) | icNonExistent;
+      ata = true;
+    }
+
+    break;
+
+  default:
+    break;			// Read only, or nothing there
+  }
+
+  return noFunction;
+}
+
+
+MassbusDrive::Start TU78::startNonData(unsigned v) {
+  ndc = v;
+  if ((v & 1) == 0) return noFunction;
+
+  const unsigned fn = v & 077;
+  ata = true;			// Every non-data function ends with attention
+
+  if (!available) {
+    ndi = icNotReady;
+    return noFunction;
+  }
+
+  switch (fn) {
+  case fnNOP:
+  case fnSense:
+    ndi = icDone;
+    return noFunction;
+
+  case fnWriteMarkPE:
+  case fnWriteMarkGCR:
+
+    if (tape.writeLocked) {
+      ndi = icFileProtect;
+      return noFunction;
+    }
+
+    [[fallthrough]];
+
+  case fnUnload:
+  case fnRewind:
+  case fnSpaceForwardRecord:
+  case fnSpaceReverseRecord:
+  case fnSpaceForwardFile:
+  case fnSpaceReverseFile:
+    ata = false;
+    busy = true;
+    return positioning;
+
+  default:
+    ndi = icNotCapable;
+    return noFunction;
+  }
+}
+
+
+bool TU78::attention() {
+  return ata;
+}
+
+
+void TU78::clearAttention() {
+  ata = false;
+}
+
+
+void TU78::reset() {
+  function = 0;
+  dti = ndi = 0;
+  ata = false;
+}
+
+
+////////////////////////////////////////////////////////////////
+// Formats
+
+unsigned TU78::framesPerWord() {
+  return ((tc >> 12) & 017) == fmtIndustry ? 4 : 5;
+}
+
+
+// Core dump format puts bits 0-31 in four frames and bits 32-35 in
+// the low half of a fifth. Industry compatible format leaves out bits
+// 32-35.
+void TU78::wordsToFrames(const vector<W36> &words, vector<uint8_t> &frames) {
+  const unsigned fpw = framesPerWord();
+  frames.resize(words.size() * fpw);
+  uint8_t *p = frames.data();
+
+  for (const W36 w: words) {
+    *p++ = w.u >> 28;
+    *p++ = w.u >> 20;
+    *p++ = w.u >> 12;
+    *p++ = w.u >> 4;
+    if (fpw == 5) *p++ = w.u & 017;
+  }
+}
+
+
+// A record that isn't a whole number of words ends with a word whose
+// missing frames are zeros.
+void TU78::framesToWords(const vector<uint8_t> &frames, vector<W36> &words) {
+  const unsigned fpw = framesPerWord();
+  words.resize((frames.size() + fpw - 1) / fpw);
+
+  for (size_t k=0; k < words.size(); ++k) {
+    uint8_t f[5] = {0, 0, 0, 0, 0};
+    copy_n(frames.begin() + k*fpw, min<size_t>(fpw, frames.size() - k*fpw), f);
+    words[k] = W36(((uint64_t) f[0] << 28) | (f[1] << 20) | (f[2] << 12) | (f[3] << 4) | (f[4] & 017));
+  }
+}
+
+
+////////////////////////////////////////////////////////////////
+// Worker and completions
+
+// Space over up to `count` records or files from `newPos`, leaving the
+// new position in `newPos` and how many weren't spaced over in
+// `newCount`. Returns the interrupt code. The index makes each of
+// these a lookup instead of a pass over the tape.
+unsigned TU78::space(unsigned fn, unsigned count) {
+  newCount = 0;
+
+  switch (fn) {
+  case fnSpaceForwardRecord: {
+    const size_t target = newPos + count;
+    const size_t mark = tape.markAtOrAfter(newPos, target);
+
+    // A tape mark stops us just past it.
+    if (mark != TapeImage::none) {
+      newCount = target - (mark + 1);
+      newPos = mark + 1;
+      return icTapeMark;
+    }
+
+    const size_t there = tape.recordsUpTo(target);
+    newCount = target - max(there, newPos);
+    newPos = max(there, newPos);
+    return newCount ? icEOT : icDone;
+  }
+
+  case fnSpaceReverseRecord: {
+    const size_t target = newPos >= count ? newPos - count : 0;
+    const size_t mark = tape.markBefore(newPos);
+
+    // A tape mark stops us just before it.
+    if (mark != TapeImage::none && mark >= target) {
+      newCount = count - (newPos - mark);
+      newPos = mark;
+      return icTapeMark;
+    }
+
+    newCount = count - (newPos - target);
+    newPos = target;
+    return newCount ? icBOT : icDone;
+  }
+
+  case fnSpaceForwardFile:
+
+    for (; count > 0; --count) {
+      const size_t mark = tape.markAtOrAfter(newPos);
+
+      if (mark == TapeImage::none) {
+	newPos = tape.recordsUpTo(TapeImage::none);
+	newCount = count;
+	return icEOT;
+      }
+
+      newPos = mark + 1;
+    }
+
+    return icDone;
+
+  case fnSpaceReverseFile:
+
+    for (; count > 0; --count) {
+      const size_t mark = tape.markBefore(newPos);
+
+      if (mark == TapeImage::none) {
+	newPos = 0;
+	newCount = count;
+	return icBOT;
+      }
+
+      newPos = mark;
+    }
+
+    return icDone;
+  }
+
+  return icNotCapable;
+}
+
+
+bool TU78::perform(Start s, unsigned blocks, RH20 &rh) {
+  newPos = pos;
+  newCount = 0;
+  newBC = bc;
+
+  if (s == positioning) {
+    const unsigned fn = ndc & 077;
+    const unsigned count = (ndc >> 8) & 0377 ? (ndc >> 8) & 0377 : 0400;
+
+    switch (fn) {
+    case fnUnload:
+    case fnRewind:
+      newPos = 0;
+      newCode = icDone;
+      break;
+
+    case fnWriteMarkPE:
+    case fnWriteMarkGCR:
+      newCode = tape.writeMark(newPos) ? icDone : icFileProtect;
+      ++newPos;
+      break;
+
+    default:
+      newCode = space(fn, count);
+      break;
+    }
+
+    return newCode == icDone;
+  }
+
+  vector<W36> words;
+  vector<uint8_t> frames;
+
+  if (s == writeData) {
+
+    // The byte count says how long the record is. Without one the
+    // transfer's block count does.
+    const unsigned fpw = framesPerWord();
+    const size_t bytes = bc ? bc : (size_t) blocks * RH20::blockWords * fpw;
+    words.resize((bytes + fpw - 1) / fpw);
+    words.resize(rh.transfer(words.data(), words.size(), false));
+    wordsToFrames(words, frames);
+    frames.resize(min(frames.size(), bytes));
+
+    newCode = tape.write(newPos, frames) ? icDone : icFileProtect;
+    newBC = frames.size();
+    ++newPos;
+    return newCode == icDone;
+  }
+
+  const bool backward = function == fnReadReverse;
+
+  if (backward ? newPos == 0 : tape.recordsUpTo(newPos + 1) <= newPos) {
+    newCode = backward ? icBOT : icEOT;
+    return false;
+  }
+
+  const size_t n = backward ? newPos - 1 : newPos;
+  const TapeImage::Record r = tape.record(n);
+  newPos = backward ? n : n + 1;
+
+  if (r.isMark()) {
+    newCode = icTapeMark;
+    newBC = 0;
+    return false;
+  }
+
+  if (!tape.read(n, frames)) {
+    newCode = icUnreadable;
+    return false;
+  }
+
+  // Reading backward delivers the last word first.
+  framesToWords(frames, words);
+  if (backward) reverse(words.begin(), words.end());
+  rh.transfer(words.data(), words.size(), true);
+
+  newBC = frames.size();
+  newCode = r.bad ? icUnreadable : icDone;
+  return newCode == icDone;
+}
+
+
+void TU78::complete(Start s) {
+  busy = false;
+  pos = newPos;
+
+  if (s == positioning) {
+    ndi = newCode;
+    ndc = (ndc & 0377) | ((newCount & 0377) << 8);
+    if ((ndc & 077) == fnUnload) available = false;
+    ata = true;
+    return;
+  }
+
+  dti = newCode;
+  bc = newBC;
+  if (newCode != icDone) ata = true;
+}
+
+
+////////////////////////////////////////////////////////////////
+// State
+
+void TU78::saveState(MachineState &ms) {
+  ms.put(function);
+  ms.put(dti);
+  ms.put(tc);
+  ms.put(bc);
+  ms.put(mr1);
+  ms.put(ndi);
+  ms.put(ndc);
+  ms.put(ata);
+  ms.put(available);
+  ms.put(pos);
+}
+
+
+void TU78::restoreState(MachineState &ms) {
+  function = ms.get();
+  dti = ms.get();
+  tc = ms.get();
+  bc = ms.get();
+  mr1 = ms.get();
+  ndi = ms.get();
+  ndc = ms.get();
+  ata = ms.get();
+  available = ms.get();
+  pos = ms.get();
+  busy = false;
+}
@@ -0,0 +1,141 @@
+#pragma once
+
+// TU78 tape drive and its TM78 formatter on an RH20's Massbus.
+//
+// A TM78 can have four TU78s, but each of ours has just one, its unit
+// zero. The tape is a SIMH ".tap" image (see tapeimage.hpp), whose
+// index lets spacing over records and files and rewinding be done
+// without reading the tape.
+//
+// The TM78 takes data transfer functions (reads and writes) in its
+// control register, from the RH20's transfer control register, and
+// reports how they went in the data transfer interrupt register. It
+// takes other functions (spacing, rewinding, tape marks) with a count
+// in one non-data command register per unit and reports them in the
+// non-data interrupt register, raising attention.
+//
+// 36-bit words are written in core dump format (five frames per
+// word, the last with the low four bits) or industry compatible
+// format (four frames per word, bits 0-31), as the tape control
+// register says.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#include "word.hpp"
+#include "rh20.hpp"
+#include "tapeimage.hpp"
+
+
+struct TU78: MassbusDrive {
+
+  static const inline unsigned driveType = 0101;
+
+  // Registers of our own
+  enum Register {
+    regDTI = 001,		// Data transfer interrupt code
+    regTC = 002,		// Tape control (format)
+    regMR1 = 003,		// Maintenance 1
+    regBC = 005,		// Byte count
+    regUS = 007,		// Unit status
+    regNDI = 013,		// Non-data interrupt code
+    regNDC0 = 014,		// Non-data command, units 0-3
+    regNDC3 = 017,
+  };
+
+  // Functions, with GO
+  enum Function {
+    fnNOP = 003,
+    fnUnload = 005,
+    fnRewind = 007,
+    fnSense = 011,
+    fnWriteMarkPE = 015,
+    fnWriteMarkGCR = 017,
+    fnSpaceForwardRecord = 021,
+    fnSpaceReverseRecord = 023,
+    fnSpaceForwardFile = 025,
+    fnSpaceReverseFile = 027,
+    fnWritePE = 061,
+    fnWriteGCR = 063,
+    fnReadForward = 071,
+    fnReadReverse = 077,
+  };
+
+  // Interrupt codes
+  enum Code {
+    icDone = 001,
+    icTapeMark = 002,
+    icBOT = 003,
+    icEOT = 004,
+    icFileProtect = 010,
+    icNotReady = 011,
+    icNonExistent = 014,
+    icNotCapable = 015,
+    icUnreadable = 024,
+  };
+
+  // Tape control register formats
+  enum Format {
+    fmtCoreDump = 0,
+    fmtIndustry = 1,
+  };
+
+  // Unit status bits
+  static const inline unsigned usRDY = 0100000;	// Ready
+  static const inline unsigned usPRES = 0040000;	// Present
+  static const inline unsigned usONL = 0020000;	// On line
+  static const inline unsigned usPE = 0004000;	// Phase encoded
+  static const inline unsigned usBOT = 0002000;	// At the load point
+  static const inline unsigned usEOT = 0001000;	// Past the end of the tape
+  static const inline unsigned usFPT = 0000400;	// File protected
+
+  TapeImage tape;
+  bool available;		// Not unloaded
+
+  // Registers
+  unsigned function;		// Data transfer function
+  unsigned dti;			// Data transfer interrupt code
+  unsigned tc;
+  unsigned bc;
+  unsigned mr1;
+  unsigned ndi;			// Non-data interrupt code
+  unsigned ndc;			// Unit zero's non-data command and count
+  unsigned serial;
+  bool ata;
+  bool busy;
+
+  size_t pos;			// Records between us and the load point
+
+  // What perform() leaves for complete().
+  size_t newPos;
+  unsigned newCode;
+  unsigned newCount;
+  unsigned newBC;
+
+
+  // Constructors. Opens (or makes) the image at `aPath`. If it can't be
+  // written the tape has no write ring.
+  TU78(const string &aPath, unsigned aSerial = 0);
+  virtual ~TU78() {}
+
+
+  virtual unsigned readRegister(unsigned reg) override;
+  virtual Start writeRegister(unsigned reg, unsigned v) override;
+  virtual bool attention() override;
+  virtual void clearAttention() override;
+  virtual void reset() override;
+  virtual bool perform(Start s, unsigned blocks, RH20 &rh) override;
+  virtual void complete(Start s) override;
+  virtual void saveState(MachineState &ms) override;
+  virtual void restoreState(MachineState &ms) override;
+
+private:
+  Start startNonData(unsigned v);
+  unsigned space(unsigned fn, unsigned count);
+  unsigned framesPerWord();
+  void wordsToFrames(const vector<W36> &words, vector<uint8_t> &frames);
+  void framesToWords(const vector<uint8_t> &frames, vector<W36> &words);
+};
@@ -1,9 +1,10 @@
 #include <cstdint>
 #include <sstream>
 #include <iomanip>
+#include <iostream>
 
 #include "word.hpp"
-#include "debugger.hpp"
+#include "symbols.hpp"
 
 
 W36 W36::negate() const {
@@ -140,12 +141,6 @@ W72 W72::negate() const {
 }
 
 
-// Octal 12 digit with leading zeros iomanip settings thingie.
-static ostream &oct12(ostream &os) {
-  return os << oct << setfill('0') << setw(12);
-}
-
-
 W144 W144::negate() const {
   // Complement low 35 bits of each word.
   W36 r3, r2, r1, r0;
@@ -167,16 +162,6 @@ W144 W144::negate() const {
   
   W144 result{r0, r1, r2, r3};
   result.setSign(!sign0);
-
-  cout << "W144::negate mag="
-       << oct12 << mag0 << " " << oct12 << mag1 << " " << oct12 << mag2 << " " << oct12 << mag3
-       << logger.endl
-       << "               r="
-       << oct12 << r0 << " " << oct12 << r1 << " " << oct12 << r2 << " " << oct12 << r3
-       << logger.endl
-       << "            sign=" << result.sign0
-       << logger.endl;
-
   return result;
 }
 
@@ -325,11 +310,6 @@ uint128_t toMag() const {
 // either of the original signs was negative, but not both, and return
 // a W144.
 W144 W144::product(W72 a, W72 b) {
-  cout << "W144::product"
-       << " a=" << W36(a.hi).fmt36() << " " << W36(a.lo).fmt36() << " "
-       << " b=" << W36(b.hi).fmt36() << " " << W36(b.lo).fmt36()
-       << logger.endl;
-
   int aSign = a.hiSign;
   int bSign = b.hiSign;
 
@@ -353,33 +333,14 @@ W144 W144::product(W72 a, W72 b) {
     bAbsHi.u += bAbsLo.u >> 35;
   }
 
-  cout << "W144::product will multiple "
-       << " abs a=" << aAbsHi.fmt36() << " " << aAbsLo.fmt36() << " * "
-       << " abs b=" << bAbsHi.fmt36() << " " << bAbsLo.fmt36()
-       << logger.endl;
-
   W256 p256;
   p256  = W256((uint128_t) aAbsLo * (uint128_t) bAbsLo) << 0;
-  cout << "  1:   " << aAbsLo.fmt36() << " * " << bAbsLo.fmt36() << "=" 
-       << p256.toOct() << "   (lo*lo)<< 0" << logger.endl;
-
   p256 += W256((uint128_t) aAbsHi * (uint128_t) bAbsLo) << 35;
-  cout << "  2: + " << aAbsHi.fmt36() << " * " << bAbsLo.fmt36() << "=" 
-       << p256.toOct() << "   (hi*lo)<<35" << logger.endl;
-
   p256 += W256((uint128_t) aAbsLo * (uint128_t) bAbsHi) << 35;
-  cout << "  3: + " << aAbsLo.fmt36() << " * " << bAbsHi.fmt36() << "=" 
-       << p256.toOct() <<  "   (lo*hi)<<35" << logger.endl;
-
   p256 += W256((uint128_t) aAbsHi * (uint128_t) bAbsHi) << 70;
-  cout << "  4: + " << aAbsHi.fmt36() << " * " << bAbsHi.fmt36() << "=" 
-       << p256.toOct() << "   (hi*hi)<<70" << logger.endl;
-
-  cout << "p256=" << p256.toOct() << logger.endl;
 
   uint128_t hi70 = (uint128_t) (p256 >> 70).lo;
   uint128_t lo70 = (uint128_t) p256.lo & mask70;
-  cout << "hi70=" << W72::fmt128(hi70) << "  lo70=" << W72::fmt128(lo70) << logger.endl;
 
   // 377777777777777777777776
   // 377777,,777777 777777,,777776
@@ -424,7 +385,7 @@ void W144::setSign(const int aSign) {
 
 
 // Disassembly of instruction words
-string W36::disasm(Debugger *debuggerP) {
+string W36::disasm(SymbolTable *symbolsP) {
   ostringstream s;
   bool isIO = false;
 
@@ -953,12 +914,12 @@ string W36::disasm(Debugger *debuggerP) {
 
   if (i != 0) eas << "@";
 
-  if (debuggerP != nullptr) {
+  if (symbolsP != nullptr) {
 
     if (x == 0) {
-      eas << oct << left << setw(6) << debuggerP->symbolicForm(y);
+      eas << oct << left << setw(6) << symbolsP->symbolicForm(y);
     } else {
-      eas << oct << debuggerP->symbolicForm(y) << "(" << oct << x << ")";
+      eas << oct << symbolsP->symbolicForm(y) << "(" << oct << x << ")";
     }
   } else {
 
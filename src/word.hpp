@@ -15,7 +15,7 @@ typedef unsigned __int128 uint128_t;
 typedef signed __int128 int128_t;
 
 
-class Debugger;
+struct SymbolTable;
 
 
 #define ATTRPACKED    __attribute__((packed))
@@ -202,7 +202,7 @@ struct W36 {
   string ascii() const;
 
   // Disassembly of instruction words
-  string disasm(Debugger *debuggerP);
+  string disasm(SymbolTable *symbolsP);
 };
 
 
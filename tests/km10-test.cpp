@@ -12,9 +12,6 @@ using namespace std;
 #include "logger.hpp"
 
 
-Logger logger{};
-
-
 int main(int argc, char *argv[]) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
@@ -16,7 +16,8 @@ struct KM10Test: testing::Test {
 public:
 
   KM10Test()
-    : km10{1024*1024},
+    : context{},
+      km10{1024*1024, context},
       pc(01000),
       opnLoc(02000),
       acLoc(5),
@@ -25,11 +26,14 @@ public:
       bNeg(0400000u, 0123456u),
       bNg1(0400000u, 0111111u),
       bPos(0000000u, 0123456u)
-  { }
+  {
+    km10.debugger.interactive = false;
+  }
 
 
   using CallbackFn = void (KM10Test::*)();
 
+  MachineContext context;
   KM10 km10;
   W36 a;
   W36 b;
@@ -119,7 +123,7 @@ public:
 
   virtual void test(VW36 insns, CallbackFn checker, CallbackFn flagChecker) {
     km10.pc.u = pc;
-    km10.maxInsns = 1;
+    km10.nSteps = 1;
     km10.running = true;
 
     setupMachine();
@@ -0,0 +1,106 @@
+// These are tests of devices that do their work on threads of their
+// own and hand it back to the CPU between instructions.
+#include <gtest/gtest.h>
+#include <memory>
+
+#include "word.hpp"
+#include "km10.hpp"
+#include "asyncdev.hpp"
+
+
+////////////////////////////////////////////////////////////////
+struct AsyncDeviceTest: testing::Test {
+
+  // Each Op fills arg[1] words at physical address arg[0] with
+  // arg[2], arg[2]+1, .... Its completion checks they're all there.
+  struct FillDevice: AsyncDevice {
+    unsigned nCompleted{0};
+    unsigned nWrong{0};
+
+    FillDevice(KM10 &cpu)
+      : AsyncDevice(070, "FILL", cpu)
+    {}
+
+    virtual ~FillDevice() {stopWorker();}
+
+    virtual void perform(Op &op) override {
+      for (unsigned k=0; k < op.arg[1]; ++k) km10.physicalP[op.arg[0] + k] = W36(op.arg[2] + k);
+      op.status = 1;
+    }
+
+    virtual void complete(const Op &op) override {
+      ++nCompleted;
+
+      for (unsigned k=0; k < op.arg[1]; ++k) {
+	if (op.status != 1 || km10.physicalP[op.arg[0] + k] != W36(op.arg[2] + k)) ++nWrong;
+      }
+
+      requestInterrupt();
+    }
+
+    virtual unsigned getConditions() override {return 0;}
+    virtual void putConditions(unsigned v) override {}
+  };
+
+  MachineContext context;
+  KM10 km10{256*1024, context};
+  FillDevice dev{km10};
+
+  AsyncDeviceTest() {
+    km10.debugger.interactive = false;
+    dev.setIntLevel(3);
+  }
+
+  AsyncDevice::Op fill(unsigned addr, unsigned n, unsigned value) {
+    return AsyncDevice::Op{0, 0, {addr, n, value, 0}, 0};
+  }
+
+  // What the CPU does between instructions.
+  void poll() {
+    if (km10.asyncAttention.load(memory_order_relaxed)) km10.serviceAsyncDevices();
+  }
+};
+
+
+TEST_F(AsyncDeviceTest, CompletionSeesTransferredData) {
+  const unsigned nOps = 2000;
+  unsigned nSubmitted = 0;
+
+  while (dev.nCompleted < nOps) {
+    // Keep no more in flight than there are buffers.
+    if (nSubmitted < nOps && dev.inFlight < 64 &&
+	dev.submit(fill(010000 + (nSubmitted % 64) * 512, 512, nSubmitted * 1000)))
+    {
+      ++nSubmitted;
+    }
+
+    poll();
+  }
+
+  EXPECT_EQ(dev.nWrong, 0u);
+  EXPECT_EQ(dev.inFlight, 0u);
+  EXPECT_NE(km10.pi.requestedLevels & PIDevice::levelBit(3), 0u);
+}
+
+
+TEST_F(AsyncDeviceTest, QuiesceFinishesEverything) {
+  for (unsigned k=0; k < 10; ++k) ASSERT_TRUE(dev.submit(fill(020000 + k * 100, 100, k)));
+
+  dev.quiesce();
+  EXPECT_EQ(dev.nCompleted, 10u);
+  EXPECT_EQ(dev.nWrong, 0u);
+}
+
+
+// There's no attention bit for a 65th device, so it mustn't get
+// registered anywhere before it's refused.
+TEST_F(AsyncDeviceTest, TooManyDevicesAreRefused) {
+  vector<unique_ptr<FillDevice>> more;
+  while (km10.asyncDevices.size() < 64) more.push_back(make_unique<FillDevice>(km10));
+
+  Device *lastP = more.back().get();
+  EXPECT_THROW(FillDevice extra(km10), runtime_error);
+  EXPECT_EQ(km10.devices.at(070), lastP);
+  EXPECT_EQ(km10.ioTable[070].devP, lastP);
+  EXPECT_EQ(km10.asyncDevices.size(), 64u);
+}
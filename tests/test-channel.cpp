@@ -0,0 +1,248 @@
+// These are tests of the KL10 internal channel, by itself and on an
+// RH20 with a stand-in Massbus drive.
+#include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "word.hpp"
+#include "km10.hpp"
+#include "channel.hpp"
+#include "rh20.hpp"
+
+
+// A drive that reads as a counting pattern and keeps what's written
+// to it, moving its words in pieces of `piece` to show the channel
+// carries on from one call to the next.
+struct StandInDrive: MassbusDrive {
+  unsigned piece = 100;
+  vector<W36> written;
+
+  virtual unsigned readRegister(unsigned reg) override {return reg == regDT ? 077 : 0;}
+
+  virtual Start writeRegister(unsigned reg, unsigned v) override {
+    if (reg != regCS1 || (v & 1) == 0) return noFunction;
+    return (v & 077) == 071 ? readData : (v & 077) == 061 ? writeData : noFunction;
+  }
+
+  virtual bool attention() override {return false;}
+  virtual void clearAttention() override {}
+  virtual void reset() override {}
+
+  virtual bool perform(Start s, unsigned blocks, RH20 &rh) override {
+    vector<W36> words(blocks * RH20::blockWords);
+
+    for (size_t k=0; k < words.size(); ++k) words[k] = W36(0500000000000ull + k);
+
+    for (size_t done=0; done < words.size(); ) {
+      const size_t n = min<size_t>(piece, words.size() - done);
+      const size_t moved = rh.transfer(words.data() + done, n, s == readData);
+      done += moved;
+      if (moved < n) break;
+    }
+
+    if (s == writeData) written = words;
+    return true;
+  }
+
+  virtual void complete(Start s) override {}
+  virtual void saveState(MachineState &ms) override {}
+  virtual void restoreState(MachineState &ms) override {}
+};
+
+
+////////////////////////////////////////////////////////////////
+struct ChannelTest: testing::Test {
+  static const inline unsigned list = 01000;	// Channel command list
+  static const inline unsigned buf = 010000;
+
+  MachineContext context;
+  KM10 km10{256*1024, context};
+  Channel channel{1, km10};
+  vector<W36> data;
+
+  ChannelTest() {
+    km10.debugger.interactive = false;
+    for (unsigned k=0; k < 1024; ++k) data.push_back(W36(0300000000000ull + k));
+  }
+
+  static W36 ccw(unsigned op, unsigned count, unsigned addr) {
+    Channel::CCW c;
+    c.op = op;
+    c.count = count;
+    c.addr = addr;
+    return W36(c.u);
+  }
+
+  // Start `channel` on the list at `list`, whose words are `ccws`.
+  void begin(initializer_list<W36> ccws) {
+    unsigned a = list;
+    for (auto w: ccws) km10.physicalP[a++] = w;
+    km10.eptP->channelLogout[1].initialCommand = ccw(Channel::ccwJump, 0, list);
+    channel.reset();
+    channel.start();
+  }
+};
+
+
+TEST_F(ChannelTest, AdjacentCommandsAreOneCopy) {
+  begin({
+      ccw(Channel::ccwTransfer, 32, buf),
+      ccw(Channel::ccwTransfer, 32, buf + 32),
+      ccw(Channel::ccwJump, 0, list + 3),
+      ccw(Channel::ccwTransfer, 32, buf + 64),
+      ccw(Channel::ccwTransfer | Channel::ccwLast, 32, buf + 96),
+    });
+
+  EXPECT_EQ(channel.transfer(data.data(), 128, true), 128u);
+  EXPECT_EQ(channel.runs, 1u);
+  EXPECT_FALSE(channel.error());
+
+  for (unsigned k=0; k < 128; ++k) ASSERT_EQ(km10.physicalP[buf + k], data[k]) << k;
+}
+
+
+TEST_F(ChannelTest, ScatterAndGather) {
+  begin({
+      ccw(Channel::ccwTransfer, 10, buf + 1000),
+      ccw(Channel::ccwTransfer, 10, buf),
+      ccw(Channel::ccwTransfer | Channel::ccwLast, 10, buf + 10),
+    });
+
+  EXPECT_EQ(channel.transfer(data.data(), 30, true), 30u);
+  EXPECT_EQ(channel.runs, 2u);
+  EXPECT_EQ(km10.physicalP[buf + 1009], data[9]);
+  EXPECT_EQ(km10.physicalP[buf + 0], data[10]);
+  EXPECT_EQ(km10.physicalP[buf + 19], data[29]);
+
+  // And gather it back in the same order.
+  vector<W36> back(30);
+  channel.reset();
+  channel.start();
+  EXPECT_EQ(channel.transfer(back.data(), 30, false), 30u);
+  EXPECT_TRUE(equal(back.begin(), back.end(), data.begin()));
+}
+
+
+TEST_F(ChannelTest, ReverseCommandsMerge) {
+  begin({
+      ccw(Channel::ccwTransfer | Channel::ccwReverse, 16, buf + 31),
+      ccw(Channel::ccwTransfer | Channel::ccwReverse | Channel::ccwLast, 16, buf + 15),
+    });
+
+  EXPECT_EQ(channel.transfer(data.data(), 32, true), 32u);
+  EXPECT_EQ(channel.runs, 1u);
+  EXPECT_EQ(km10.physicalP[buf + 31], data[0]);
+  EXPECT_EQ(km10.physicalP[buf + 0], data[31]);
+}
+
+
+TEST_F(ChannelTest, ShortAndLongCounts) {
+  begin({ccw(Channel::ccwTransfer | Channel::ccwLast, 20, buf)});
+  EXPECT_EQ(channel.transfer(data.data(), 30, true), 20u);
+  EXPECT_TRUE(channel.shortCount);
+  EXPECT_FALSE(channel.longCount());
+
+  begin({ccw(Channel::ccwTransfer | Channel::ccwLast, 20, buf)});
+  EXPECT_EQ(channel.transfer(data.data(), 10, true), 10u);
+  EXPECT_TRUE(channel.longCount());
+
+  channel.logout(true);
+  const W36 sw = km10.eptP->channelLogout[1].statusWord;
+  EXPECT_NE(sw.u & Channel::csLWCE, 0u);
+  EXPECT_NE(sw.u & Channel::csCountNotZero, 0u);
+  EXPECT_EQ(sw.u & Channel::csSWCE, 0u);
+  EXPECT_EQ(Channel::CCW(km10.eptP->channelLogout[1].lastUpdatedCommand.u).count, 10u);
+}
+
+
+TEST_F(ChannelTest, MissingMemoryHalts) {
+  begin({ccw(Channel::ccwTransfer | Channel::ccwLast, 100, km10.memorySize - 50)});
+  EXPECT_EQ(channel.transfer(data.data(), 100, true), 0u);
+  EXPECT_TRUE(channel.nxm);
+
+  channel.logout(true);
+  EXPECT_NE(km10.eptP->channelLogout[1].statusWord.u & Channel::csNXM, 0u);
+}
+
+
+// The same channel under an RH20, with a drive that moves its data in
+// pieces that don't line up with the commands.
+TEST_F(ChannelTest, StandInDriveThroughRH20) {
+  RH20 *rhP = new RH20(1, km10);	// km10 deletes this
+  StandInDrive *driveP = new StandInDrive;
+  rhP->attach(0, driveP);
+
+  km10.physicalP[list + 0] = ccw(Channel::ccwTransfer, 64, buf);
+  km10.physicalP[list + 1] = ccw(Channel::ccwTransfer, 64, buf + 64);
+  km10.physicalP[list + 2] = ccw(Channel::ccwTransfer | Channel::ccwLast, 128, buf + 4000);
+  km10.eptP->channelLogout[1].initialCommand = ccw(Channel::ccwJump, 0, list);
+
+  RH20::TCR tcr;
+  tcr.function = 071;
+  tcr.negBlocks = 02000 - 2;
+  tcr.resetCLP = 1;
+  tcr.storeStatus = 1;
+
+  RH20::DataWord d(tcr.u);
+  d.reg = RH20::regSTCR;
+  d.load = 1;
+  rhP->dataO(W36(d.u));
+
+  const auto until = chrono::steady_clock::now() + chrono::seconds(10);
+
+  while (!rhP->status.done && chrono::steady_clock::now() < until) {
+    if (km10.asyncAttention.load(memory_order_relaxed)) km10.serviceAsyncDevices();
+    this_thread::yield();
+  }
+
+  ASSERT_TRUE(rhP->status.done);
+  EXPECT_EQ(rhP->status.u & 0775000, 0u);	// No errors
+  EXPECT_EQ(km10.physicalP[buf + 127], W36(0500000000000ull + 127));
+  EXPECT_EQ(km10.physicalP[buf + 4000], W36(0500000000000ull + 128));
+  EXPECT_EQ(km10.physicalP[buf + 4127], W36(0500000000000ull + 255));
+
+  // Three calls from the drive, and the first two commands abut.
+  EXPECT_EQ(rhP->channel.runs, 4u);
+
+  const W36 sw = km10.eptP->channelLogout[1].statusWord;
+  EXPECT_NE(sw.u & Channel::csSet, 0u);
+  EXPECT_EQ(sw.u & (Channel::csNXM | Channel::csLWCE | Channel::csSWCE | Channel::csRH20Error), 0u);
+  EXPECT_EQ(sw.u & 017777777, list + 3u);
+}
+
+
+// While checkpointing tracks writes, a transfer on the RH20's worker
+// marks the pages it writes dirty just as CPU stores would.
+TEST_F(ChannelTest, WorkerWritesAreDirty) {
+  RH20 *rhP = new RH20(1, km10);	// km10 deletes this
+  rhP->attach(0, new StandInDrive);
+
+  km10.physicalP[list] = ccw(Channel::ccwTransfer | Channel::ccwLast, 1024, buf);
+  km10.eptP->channelLogout[1].initialCommand = ccw(Channel::ccwJump, 0, list);
+  km10.physMem.trackDirtyPages();
+
+  RH20::TCR tcr;
+  tcr.function = 071;
+  tcr.negBlocks = 02000 - 8;
+  tcr.resetCLP = 1;
+
+  RH20::DataWord d(tcr.u);
+  d.reg = RH20::regSTCR;
+  d.load = 1;
+  rhP->dataO(W36(d.u));
+
+  const auto until = chrono::steady_clock::now() + chrono::seconds(10);
+
+  while (!rhP->status.done && chrono::steady_clock::now() < until) {
+    if (km10.asyncAttention.load(memory_order_relaxed)) km10.serviceAsyncDevices();
+    this_thread::yield();
+  }
+
+  ASSERT_TRUE(rhP->status.done);
+  const unsigned first = buf / PhysicalMemory::pageWords;
+  EXPECT_FALSE(km10.physMem.isDirty(first - 1));
+  EXPECT_TRUE(km10.physMem.isDirty(first));
+  EXPECT_TRUE(km10.physMem.isDirty(first + 1));
+  EXPECT_FALSE(km10.physMem.isDirty(first + 2));
+}
@@ -0,0 +1,123 @@
+// These are tests of incremental checkpoints and restoring from them.
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <stdexcept>
+
+#include "word.hpp"
+#include "km10.hpp"
+#include "checkpoint.hpp"
+
+
+////////////////////////////////////////////////////////////////
+struct CheckpointTest: testing::Test {
+
+  // What we expect to get back from a checkpoint.
+  struct Expected {
+    vector<W36> memory;
+    vector<W36> acs;
+    W36 pc;
+    uint64_t instructionCounter;
+  };
+
+  MachineContext context;
+  KM10 km10{256*1024, context};
+  string path;
+
+  CheckpointTest() {
+    km10.debugger.interactive = false;
+
+    char name[] = "/tmp/km10-ckpt-XXXXXX";
+    close(mkstemp(name));
+    path = name;
+
+    km10.physicalP[01000] = W36(0350, 1, 0, 0, 020000);	// AOS 1,20000
+    km10.physicalP[01001] = W36(0350, 2, 0, 0, 030000);	// AOS 2,30000
+    km10.physicalP[01002] = W36(0254, 0, 0, 0, 01000);	// JRST 1000
+    km10.pc = 01000;
+  }
+
+  ~CheckpointTest() {
+    unlink(path.c_str());
+  }
+
+  void run(unsigned n) {
+    km10.nSteps = n;
+    km10.running = true;
+    km10.emulate();
+  }
+
+  Expected current() {
+    return Expected{
+      {km10.physicalP, km10.physicalP + km10.memorySize},
+      {&km10.ACBlocks[0][0], &km10.ACBlocks[0][0] + 8*16},
+      km10.pc,
+      km10.instructionCounter,
+    };
+  }
+
+  static unsigned openFDs() {
+    unsigned n = 0;
+    DIR *dirP = opendir("/proc/self/fd");
+    while (readdir(dirP)) ++n;
+    closedir(dirP);
+    return n;
+  }
+};
+
+
+TEST_F(CheckpointTest, RestoreEachRecord) {
+  vector<Expected> expected;
+
+  {
+    Checkpointer cp(km10, path, 1000);
+
+    for (unsigned k=0; k < 3; ++k) {
+      run(10 + k);
+      if (k == 1) km10.physicalP[040000] = W36(0777);
+      cp.checkpoint();
+      expected.push_back(current());
+    }
+  }
+
+  // Change everything a later restore has to put back.
+  run(7);
+  km10.physicalP[040000] = W36(0666);
+  km10.physicalP[050000] = W36(0555);
+  km10.ACBlocks[3][4] = W36(0444);
+
+  for (int index: {1, 0, 2}) {
+    EXPECT_EQ(Checkpointer::restore(km10, path, index), index);
+    const Expected &e = expected[index];
+    Expected now = current();
+
+    EXPECT_TRUE(now.memory == e.memory) << "memory of record " << index;
+    EXPECT_TRUE(now.acs == e.acs) << "ACs of record " << index;
+    EXPECT_EQ(now.pc, e.pc);
+    EXPECT_EQ(now.instructionCounter, e.instructionCounter);
+  }
+
+  // The last complete record is the default.
+  run(3);
+  EXPECT_EQ(Checkpointer::restore(km10, path), 2);
+  EXPECT_EQ(km10.physicalP[020000], expected[2].memory[020000]);
+}
+
+
+TEST_F(CheckpointTest, FailedRestoreClosesFile) {
+  {
+    Checkpointer cp(km10, path, 1000);
+    cp.checkpoint();
+  }
+
+  const unsigned before = openFDs();
+  EXPECT_THROW(Checkpointer::restore(km10, path, 5), runtime_error);
+  EXPECT_EQ(openFDs(), before);
+
+  MachineContext smallContext;
+  KM10 small{128*1024, smallContext};
+  const unsigned smallBefore = openFDs();
+  EXPECT_THROW(Checkpointer::restore(small, path), runtime_error);
+  EXPECT_EQ(openFDs(), smallBefore);
+}
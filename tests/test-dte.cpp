@@ -0,0 +1,217 @@
+// Tests for the DTE20's CTY input and its primary protocol, with the
+// test playing the part of the 10's DTE service routines.
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#include <gtest/gtest.h>
+
+#include "word.hpp"
+#include "km10.hpp"
+#include "bytepointer.hpp"
+
+
+// A CTY that just remembers what it was sent.
+struct StringConsole: Console {
+  string output;
+
+  virtual int inputFD() override {return -1;}
+  virtual ssize_t readInput(char *bufP, size_t n) override {return 0;}
+  virtual void writeOutput(const char *bufP, size_t n) override {output.append(bufP, n);}
+};
+
+
+struct DTE20Test: testing::Test {
+  static const inline unsigned examineArea = 010000;
+  static const inline unsigned depositArea = 011000;
+  static const inline unsigned to11Buffer = 012000;
+  static const inline unsigned to10Buffer = 013000;
+
+  MachineContext context;
+  KM10 km10;
+  DTE20 &dte;
+  StringConsole *consoleP;
+  ostringstream notices;
+
+  DTE20Test()
+    : context{},
+      km10{256*1024, context},
+      dte(km10.dte),
+      consoleP(new StringConsole)
+  {
+    dte.setConsole(consoleP);
+    dte.noticesP = &notices;
+
+    auto &cb = km10.eptP->dte[0];
+    cb.examineAreaReloc = examineArea;
+    cb.examineAreaSize = 020;
+    cb.depositAreaReloc = depositArea;
+    cb.depositAreaSize = 020;
+
+    cono(020 | 3);		// PIA 3
+  }
+
+  ~DTE20Test() {
+    dte.disconnect();
+  }
+
+  void cono(unsigned bits) {
+    dte.doCONO(W36(0), W36(bits));
+  }
+
+  // Point `bp` at `addr` for 8-bit bytes, as POINT 8,addr does.
+  static W36 point8(unsigned addr) {
+    BytePointerL1 p(0);
+    p.p = 36;
+    p.s = 8;
+    p.y = addr;
+    return W36(p.u);
+  }
+
+  void putBytes(unsigned addr, const vector<uint8_t> &bytes) {
+    for (size_t k=0; k < bytes.size(); ++k) {
+      W36 &w = km10.memP[addr + k/4];
+      const unsigned p = 28 - 8*(k % 4);
+      w.u = (w.u & ~W36::bMask(p, 8)) | ((uint64_t) bytes[k] << p);
+    }
+  }
+
+  vector<uint8_t> getBytes(unsigned addr, size_t n) {
+    vector<uint8_t> bytes;
+    for (size_t k=0; k < n; ++k) bytes.push_back(km10.memP[addr + k/4].u >> (28 - 8*(k % 4)));
+    return bytes;
+  }
+
+  static vector<uint8_t> packet(unsigned fn, unsigned dev, const string &data) {
+    const unsigned n = 8 + data.size();
+    vector<uint8_t> p{(uint8_t) (n >> 8), (uint8_t) n, (uint8_t) (fn >> 8), (uint8_t) fn,
+		      (uint8_t) (dev >> 8), (uint8_t) dev, 0, 0};
+    p.insert(p.end(), data.begin(), data.end());
+    return p;
+  }
+
+  void enterPrimary() {
+    km10.eptP->DTEto11Arg = DTE20::enterPrimaryProtocol << 8;
+    cono(020000);
+  }
+
+  // Take the packet the DTE has posted, the way the 10 would.
+  vector<uint8_t> takeTo10Packet() {
+    EXPECT_TRUE(dte.status.to10Doorbell);
+    cono(01000);		// Clear the doorbell
+
+    const unsigned n = km10.memP[depositArea + DTE20::cmQueueCount].rhu;
+    km10.eptP->dte[0].to10BP = point8(to10Buffer);
+    km10.memP[0100] = W36(-(int64_t) n);
+    dte.doDATAO(W36(0), W36(0100));
+
+    EXPECT_TRUE(dte.status.to10Done);
+    cono(040);			// Clear to-10 done
+    return getBytes(to10Buffer, n);
+  }
+
+  // Queue `p` for the DTE the way the 10 would.
+  void sendTo11(const vector<uint8_t> &p, unsigned count) {
+    putBytes(to11Buffer, p);
+    km10.eptP->dte[0].to11BP = point8(to11Buffer);
+    km10.memP[examineArea + DTE20::cmQueueCount] = p.size();
+    km10.memP[examineArea + DTE20::cmStatus] = DTE20::cmQueuedProtocol | (count << 8);
+    cono(020000);
+  }
+};
+
+
+TEST_F(DTE20Test, EnterPrimaryAndAckAll) {
+  enterPrimary();
+  EXPECT_EQ(dte.protocolMode, DTE20::PRIMARY);
+
+  // We're told about a packet with a doorbell interrupt through the
+  // DTE's EPT vector.
+  EXPECT_TRUE(dte.intPending);
+  auto [level, ifw] = dte.getIntFuncWord();
+  EXPECT_EQ(level, 3u);
+  EXPECT_EQ(ifw.intFunction, W36::vectorIF);
+  EXPECT_EQ(ifw.intAddr, 0142u);
+  EXPECT_EQ(km10.memP[depositArea + DTE20::cmStatus].u & DTE20::cm11Count, 1u);
+
+  EXPECT_EQ(takeTo10Packet(), packet(DTE20::emAckAll, DTE20::devDLS, ""));
+  EXPECT_FALSE(dte.intPending);
+
+  // The to-10 byte pointer has moved past the two words of the packet.
+  EXPECT_EQ(km10.eptP->dte[0].to10BP.rhu, to10Buffer + 1);
+}
+
+
+TEST_F(DTE20Test, StringToCTY) {
+  dte.connect();
+  enterPrimary();
+  takeTo10Packet();
+
+  sendTo11(packet(DTE20::emString, DTE20::devCTY, "HELLO, WORLD\r\n"), 1);
+  EXPECT_TRUE(dte.status.to11Done);
+  cono(0100);
+
+  // The CTY gets the string and the 10 gets an ACK for the line.
+  EXPECT_EQ(takeTo10Packet(), packet(DTE20::emAck, DTE20::devCTY, string(2, '\0')));
+
+  dte.disconnect();
+  EXPECT_EQ(consoleP->output, "HELLO, WORLD\r\n");
+}
+
+
+TEST_F(DTE20Test, IndirectString) {
+  dte.connect();
+  enterPrimary();
+  takeTo10Packet();
+
+  // The header goes first with the indirect flag, then the data.
+  const string text = "INDIRECT DATA";
+  auto p = packet(DTE20::emString | DTE20::emIndirect, DTE20::devCTY, text);
+  p.resize(8);
+  p[1] = 8 + text.size();
+  sendTo11(p, 1);
+  EXPECT_TRUE(dte.status.to11Done);
+  cono(0100);
+
+  putBytes(to11Buffer, vector<uint8_t>(text.begin(), text.end()));
+  km10.eptP->dte[0].to11BP = point8(to11Buffer);
+  km10.memP[examineArea + DTE20::cmStatus].u |= DTE20::cmIndirect;
+  cono(020000);
+  EXPECT_TRUE(dte.status.to11Done);
+
+  dte.disconnect();
+  EXPECT_EQ(consoleP->output, text);
+}
+
+
+TEST_F(DTE20Test, SecondaryInputByDoorbell) {
+  auto &ept = *km10.eptP;
+
+  // Without a PI level, input waits for the program to ask for it.
+  cono(020);
+  dte.ctyInQ.enqueue('a');
+  dte.ctyInQ.enqueue('b');
+  dte.service();
+  EXPECT_FALSE(dte.status.to10Doorbell);
+
+  cono(020 | 3);
+  EXPECT_TRUE(dte.attention);
+  dte.service();
+  EXPECT_EQ(ept.DTEto10Arg, W36('a'));
+  EXPECT_NE(ept.DTEKLNotReadyForChar, W36(0));
+  EXPECT_TRUE(dte.status.to10Doorbell);
+  EXPECT_TRUE(dte.intPending);
+
+  // The next character waits until the program has taken this one.
+  dte.service();
+  EXPECT_EQ(ept.DTEto10Arg, W36('a'));
+
+  ept.DTEKLNotReadyForChar = 0;
+  cono(01000);
+  EXPECT_FALSE(dte.intPending);
+  dte.service();
+  EXPECT_EQ(ept.DTEto10Arg, W36('b'));
+  EXPECT_TRUE(dte.intPending);
+}
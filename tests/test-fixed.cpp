@@ -10,13 +10,30 @@ using namespace std;
 #include "km10-test.hpp"
 
 
+// The 70-bit signed value of a doubleword, ignoring the low word's
+// sign.
+static int128_t s70(W72 w) {
+  const int128_t mag = ((int128_t) w.hi35 << 35) | w.lo35;
+  return w.hiSign ? mag - ((int128_t) 1 << 70) : mag;
+}
+
+
+// And back, with the low word's sign a copy of the high word's.
+static W72 dw(int128_t v) {
+  W36 hi{(int64_t) (v >> 35)};
+  W36 lo{(int64_t) (v & W36::magMask)};
+  lo.sign = hi.sign;
+  return W72{hi, lo};
+}
+
+
 ////////////////////////////////////////////////////////////////
 TEST(BasicStructures, ExecutiveProcessTable) {
-  ASSERT_EQ(sizeof(KMState::ExecutiveProcessTable), 512 * 8);
+  ASSERT_EQ(sizeof(KM10::ExecutiveProcessTable), 512 * 8);
 }
 
 TEST(BasicStructures, UserProcessTable) {
-  ASSERT_EQ(sizeof(KMState::UserProcessTable), 512 * 8);
+  ASSERT_EQ(sizeof(KM10::UserProcessTable), 512 * 8);
 }
 
 
@@ -256,7 +273,7 @@ public:
     : KM10Test()
   {}
 
-  W72 a;
+  W72 a{(uint128_t) 0};
 
   using CallbackFn72 = void (InstructionDIV::*)(W72 result72);
 
@@ -565,19 +582,15 @@ public:
     : KM10Test()
   {}
 
-  W72 a;
-  W72 b;
+  W72 a{(uint128_t) 0};
+  W72 b{(uint128_t) 0};
 
   using CallbackFn72 = void (InstructionDADD::*)(W72 result72);
 
   using ResultF = function<W72(W72,W72)>;
 
   static inline ResultF defaultResultF = [](W72 a1, W72 a2) {
-    int128_t s1 = a1.toS70();
-    int128_t s2 = a2.toS70();
-    int128_t sum128 = s1 + s2;
-    auto [hi36, lo36] = W72::toDW(sum128);
-    return W72{hi36, lo36};
+    return dw(s70(a1) + s70(a2));
   };
 
   virtual void setupMachine() override {
@@ -690,26 +703,22 @@ public:
     : KM10Test()
   {}
 
-  W72 a;
-  W72 b;
+  W72 a{(uint128_t) 0};
+  W72 b{(uint128_t) 0};
 
   using CallbackFn72 = void (InstructionDSUB::*)(W72 result72);
 
   using ResultF = function<W72(W72,W72)>;
 
   static inline ResultF defaultResultF = [](W72 a1, W72 a2) {
-    int128_t s1 = a1.toS70();
-    int128_t s2 = a2.toS70();
-    int128_t diff128 = s1 - s2;
-    auto [hi36, lo36] = W72::toDW(diff128);
-    return W72{hi36, lo36};
+    return dw(s70(a1) - s70(a2));
   };
 
   virtual void setupMachine() override {
-    km10.memP[opnLoc+0] = a.hi;
-    km10.memP[opnLoc+1] = a.lo;
-    km10.AC[acLoc+0] = b.hi;
-    km10.AC[acLoc+1] = b.lo;
+    km10.AC[acLoc+0] = a.hi;
+    km10.AC[acLoc+1] = a.lo;
+    km10.memP[opnLoc+0] = b.hi;
+    km10.memP[opnLoc+1] = b.lo;
   }
 
   virtual void test(VW36 insns,
@@ -737,6 +746,14 @@ public:
     EXPECT_EQ(km10.flags.cy1, 0);
   }
 
+  // Without a borrow there is a carry out of both bits 0 and 1.
+  virtual void checkFlagsC01() {
+    EXPECT_EQ(km10.flags.tr1, 0);
+    EXPECT_EQ(km10.flags.ov, 0);
+    EXPECT_EQ(km10.flags.cy0, 1);
+    EXPECT_EQ(km10.flags.cy1, 1);
+  }
+
   virtual void checkFlagsC0() override {
     EXPECT_EQ(km10.flags.tr1, 1);
     EXPECT_EQ(km10.flags.ov, 1);
@@ -767,7 +784,7 @@ TEST_F(InstructionDSUB, CY1) {
 
 TEST_F(InstructionDSUB, CY0) {
   a = W72{W72::bit0};
-  b = W72{W72::bit0};
+  b = W72{(uint128_t) 1};
   test(VW36{W36(0115, acLoc, 0, 0, opnLoc)},
        &InstructionDSUB::check72,
        &KM10Test::checkFlagsC0);
@@ -781,12 +798,12 @@ TEST_F(InstructionDSUB, NCpp) {
        &KM10Test::checkFlagsNC);
 };
 
-TEST_F(InstructionDSUB, NCnn) {
+TEST_F(InstructionDSUB, CY01lo) {
   a = W72{W36{0700000u}, W36{0123456u, 0654321u}};
   b = W72{W36{0700000u}, W36{0123456u, 0123456u}};
   test(VW36{W36(0115, acLoc, 0, 0, opnLoc)},
        &InstructionDSUB::check72,
-       &KM10Test::checkFlagsNC);
+       (CallbackFn) &InstructionDSUB::checkFlagsC01);
 };
 
 
@@ -799,12 +816,12 @@ TEST_F(InstructionDSUB, NCnp) {
 };
 
 
-TEST_F(InstructionDSUB, NCpn) {
+TEST_F(InstructionDSUB, CY01hi) {
   a = W72{W36{0123456u, 0654321u}, W36{0654321u, 0654321u}};
   b = W72{W36{0700000u}, W36{0123456u, 0123456u}};
   test(VW36{W36(0115, acLoc, 0, 0, opnLoc)},
        &InstructionDSUB::check72,
-       &KM10Test::checkFlagsNC);
+       (CallbackFn) &InstructionDSUB::checkFlagsC01);
 }
 
 
@@ -815,8 +832,8 @@ public:
     : KM10Test()
   {}
 
-  W72 a;
-  W72 b;
+  W72 a{(uint128_t) 0};
+  W72 b{(uint128_t) 0};
 
   using CallbackFn140 = void (InstructionDMUL::*)(W144 result140);
   using CallbackFn = void (InstructionDMUL::*)();
@@ -824,7 +841,7 @@ public:
   using ResultF = function<W144(W72,W72)>;
 
   static inline ResultF defaultResultF = [](W72 a, W72 b) {
-    return W144::product(a.toU70(), b.toU70(), (a.s < 0) ^ (b.s < 0));
+    return W144::product(a, b);
   };
 
   virtual void setupMachine() override {
@@ -866,11 +883,10 @@ public:
 
 
   virtual void check140(W144 result140) {
-    auto const [a0, a1, a2, a3] = result140.toQuadWord();
-    EXPECT_EQ(km10.AC[acLoc+0], a0);
-    EXPECT_EQ(km10.AC[acLoc+1], a1);
-    EXPECT_EQ(km10.AC[acLoc+2], a2);
-    EXPECT_EQ(km10.AC[acLoc+3], a3);
+    EXPECT_EQ(km10.AC[acLoc+0], W36(result140.u0));
+    EXPECT_EQ(km10.AC[acLoc+1], W36(result140.u1));
+    EXPECT_EQ(km10.AC[acLoc+2], W36(result140.u2));
+    EXPECT_EQ(km10.AC[acLoc+3], W36(result140.u3));
   }
 
 
@@ -894,8 +910,8 @@ TEST_F(InstructionDMUL, T1) {
 };
 
 TEST_F(InstructionDMUL, NCpp) {
-  a = W72{077777ul};
-  b = W72{055555ul};
+  a = W72{(uint128_t) 077777};
+  b = W72{(uint128_t) 055555};
   test(VW36{W36(0116, acLoc, 0, 0, opnLoc)},
        &InstructionDMUL::check140,
        &InstructionDMUL::checkFlagsNC);
@@ -113,7 +113,7 @@ TEST_F(InstructionMOVS, MOVSM) {
 TEST_F(InstructionMOVS, MOVSSnon0AC) {
   a = aBig;
   b = aNeg;
-  expectMem = expectAC = W36{a.rhu, a.lhu};
+  expectMem = expectAC = W36{b.rhu, b.lhu};
   test(VW36{W36(0207, acLoc, 0, 0, opnLoc)},
        &InstructionMOVS::check,
        &InstructionMOVS::checkAllFlagsUnmodified);
@@ -124,7 +124,7 @@ TEST_F(InstructionMOVS, MOVSS0AC) {
   acLoc = 0;
   a = expectAC = aBig;
   b = aNeg;
-  expectMem = W36{a.rhu, a.lhu};
+  expectMem = W36{b.rhu, b.lhu};
   test(VW36{W36(0207, acLoc, 0, 0, opnLoc)},
        &InstructionMOVS::check,
        &InstructionMOVS::checkAllFlagsUnmodified);
@@ -144,8 +144,8 @@ public:
 
 
 TEST_F(InstructionMOVN, CY1) {
-  a = expectAC = aBig;
-  b = expectMem = W36::bit0;
+  a = aBig;
+  b = expectMem = expectAC = W36::bit0;
   result = b;
   test(VW36{W36(0210, acLoc, 0, 0, opnLoc)},
        &InstructionMOVN::check,
@@ -153,8 +153,8 @@ TEST_F(InstructionMOVN, CY1) {
 };
 
 TEST_F(InstructionMOVN, CY01) {
-  a = expectAC = aBig;
-  b = expectMem = 0;
+  a = aBig;
+  b = expectMem = expectAC = 0;
   result = b;
   test(VW36{W36(0210, acLoc, 0, 0, opnLoc)},
        &InstructionMOVN::check,
@@ -200,7 +200,7 @@ TEST_F(InstructionMOVN, MOVNM) {
 TEST_F(InstructionMOVN, MOVNS) {
   a = aBig;
   b = bPos;
-  result = expectAC = expectMem = -(int64_t) a;
+  result = expectAC = expectMem = -b.s;
   test(VW36{W36(0213, acLoc, 0, 0, opnLoc)},
        &InstructionMOVN::check,
        &InstructionMOVN::checkFlagsNC);
@@ -213,8 +213,8 @@ class InstructionMOVM: public KM10Test {
 
 
 TEST_F(InstructionMOVM, CY1) {
-  a = expectAC = aBig;
-  b = expectMem = W36::bit0;
+  a = aBig;
+  b = expectMem = expectAC = W36::bit0;
   result = b;
   test(VW36{W36(0214, acLoc, 0, 0, opnLoc)},
        &InstructionMOVM::check,
@@ -260,7 +260,7 @@ TEST_F(InstructionMOVM, MOVMM) {
 TEST_F(InstructionMOVM, MOVMS) {
   a = aNeg;
   b = bPos;
-  result = expectAC = expectMem = -(int64_t) a;
+  result = expectAC = expectMem = b;
   test(VW36{W36(0217, acLoc, 0, 0, opnLoc)},
        &InstructionMOVM::check,
        &InstructionMOVM::checkFlagsNC);
@@ -0,0 +1,89 @@
+// These are tests that verify several KM10s can run at once in one
+// process, each on its own thread, without seeing each other's state.
+#include <assert.h>
+#include <functional>
+#include <memory>
+#include <thread>
+
+using namespace std;
+
+#include <gtest/gtest.h>
+
+#include "word.hpp"
+#include "km10.hpp"
+
+
+////////////////////////////////////////////////////////////////
+struct MultiMachineTest: testing::Test {
+  static const inline unsigned nMachines = 4;
+
+  // Each machine counts AC1 down to zero and AC2 up from zero, then
+  // halts. Each gets a different count.
+  struct Machine {
+    Machine(unsigned aCount)
+      : context{},
+	km10{256*1024, context},
+	count(aCount)
+    {
+      km10.debugger.interactive = false;
+
+      km10.memP[01000] = W36{MOVEI, 2, 0, 0, 0};
+      km10.memP[01001] = W36{ADDI, 2, 0, 0, 1};
+      km10.memP[01002] = W36{SOJG, 1, 0, 0, 01001};
+      km10.memP[01003] = W36{JRST, 4, 0, 0, 0};	// HALT
+
+      km10.AC[1] = count;
+      km10.pc = 01000;
+      km10.running = true;
+    }
+
+    MachineContext context;
+    KM10 km10;
+    unsigned count;
+  };
+
+  enum Opcodes {
+    MOVEI = 0201,
+    ADDI = 0271,
+    SOJG = 0367,
+    JRST = 0254,
+  };
+};
+
+
+TEST_F(MultiMachineTest, DevicesArePerMachine) {
+  Machine m0(1), m1(1);
+
+  EXPECT_EQ(m0.km10.devices.at(040), &m0.km10.dte);
+  EXPECT_EQ(m1.km10.devices.at(040), &m1.km10.dte);
+  EXPECT_EQ(m0.km10.devices.size(), m1.km10.devices.size());
+  EXPECT_EQ(m0.km10.ioTable[040].devP, &m0.km10.dte);
+  EXPECT_EQ(m0.km10.ioTable[0177].devP, &m0.km10.noDevice);
+  EXPECT_EQ(&m0.km10.logger, &m0.context.logger);
+  EXPECT_NE(&m0.km10.logger, &m1.km10.logger);
+}
+
+
+TEST_F(MultiMachineTest, BreakpointsArePerMachine) {
+  Machine m0(1), m1(1);
+
+  m0.km10.executeBPs.insert(01002);
+  EXPECT_TRUE(m0.context.executeBPs.contains(01002));
+  EXPECT_TRUE(m1.context.executeBPs.empty());
+}
+
+
+TEST_F(MultiMachineTest, RunOnThreads) {
+  vector<unique_ptr<Machine>> machines;
+  for (unsigned k=0; k < nMachines; ++k) machines.push_back(make_unique<Machine>(100000 * (k + 1)));
+
+  vector<thread> threads;
+  for (auto &mP: machines) threads.emplace_back([&]() {mP->km10.emulate();});
+  for (auto &t: threads) t.join();
+
+  for (auto &mP: machines) {
+    EXPECT_EQ(mP->km10.AC[1].u, 0u);
+    EXPECT_EQ(mP->km10.AC[2].u, mP->count);
+    EXPECT_EQ(mP->km10.pc.rhu, 01003u);
+  }
+}
@@ -0,0 +1,411 @@
+// These are tests of the pager: TOPS-20 page table walks, the CST,
+// the software TLB and what invalidates it, page fail traps, MAP, and
+// watched pages with and without the HostMMU.
+#include <gtest/gtest.h>
+
+#include "word.hpp"
+#include "km10.hpp"
+#include "apr.hpp"
+
+
+////////////////////////////////////////////////////////////////
+struct PAGTest: testing::Test {
+  using PagePointer = PAGDevice::PagePointer;
+  using PFWord = PAGDevice::PFWord;
+
+  // Physical pages
+  static const inline unsigned eptPage = 1;
+  static const inline unsigned uptPage = 2;
+  static const inline unsigned execMapPage = 3;
+  static const inline unsigned userMapPage = 4;
+  static const inline unsigned sptPage = 6;
+  static const inline unsigned cstPage = 7;
+
+  // Exec pages below this are mapped to the same physical page.
+  static const inline unsigned execPages = 0100;
+  static const inline unsigned code = 010100;
+
+  MachineContext context;
+  KM10 km10{256*1024, context};
+
+  PAGTest() {
+    km10.debugger.interactive = false;
+
+    for (unsigned vpn=0; vpn < execPages; ++vpn) execMap(vpn) = immediate(vpn).u;
+
+    km10.pag.processContext.userBaseAddress = uptPage;
+    km10.uptP = (KM10::UserProcessTable *) &km10.physicalP[uptPage << 9];
+    km10.ACBlocks[6][3] = sptPage << 9;
+
+    PAGDevice::PAGState s;
+    s.execBasePage = eptPage;
+    s.enablePager = 1;
+    s.tops2Paging = 1;
+    km10.pag.putConditions(s.u);
+
+    // Access bits are ANDed along the chain, so with "keep" on here
+    // an exec page's own map entry says whether it is kept.
+    km10.eptP->execSection[0] = immediate(execMapPage, true, true).u;
+    km10.uptP->userSection[0] = immediate(userMapPage).u;
+  }
+
+  static PagePointer immediate(unsigned ppn, bool writable = true, bool keep = false) {
+    PagePointer p;
+    p.type = PagePointer::immediate;
+    p.ppn = ppn;
+    p.writable = writable;
+    p.keep = keep;
+    p.publicAccess = p.cache = 1;
+    return p;
+  }
+
+  static PagePointer shared(unsigned sptIndex) {
+    PagePointer p;
+    p.type = PagePointer::shared;
+    p.sptIndex = sptIndex;
+    p.writable = p.publicAccess = p.cache = 1;
+    return p;
+  }
+
+  static PagePointer indirect(unsigned sptIndex, unsigned mapIndex) {
+    PagePointer p{shared(sptIndex)};
+    p.type = PagePointer::indirect;
+    p.mapIndex = mapIndex;
+    return p;
+  }
+
+  W36 &execMap(unsigned vpn) {return km10.physicalP[(execMapPage << 9) + vpn];}
+  W36 &userMap(unsigned vpn) {return km10.physicalP[(userMapPage << 9) + vpn];}
+  W36 &spt(unsigned n) {return km10.physicalP[(sptPage << 9) + n];}
+  W36 &cst(unsigned ppn) {return km10.physicalP[(cstPage << 9) + ppn];}
+  W36 *page(unsigned ppn) {return km10.physicalP + (ppn << 9);}
+
+  // Turn on the CST with every page's age nonzero.
+  void useCST(W36 data = 0) {
+    for (unsigned ppn=0; ppn < 512; ++ppn) cst(ppn) = W36(1ull << 30);
+    km10.ACBlocks[6][0] = W36(0777777777777ull);
+    km10.ACBlocks[6][1] = data;
+    km10.ACBlocks[6][2] = cstPage << 9;
+  }
+
+  // Run `insn` at `code` in exec mode.
+  void execute(W36 insn) {
+    km10.physicalP[code] = insn;
+    km10.pc = code;
+    km10.nSteps = 1;
+    km10.running = true;
+    km10.emulate();
+  }
+
+  PFWord failFor(W36 va, bool forWrite, bool user) {
+
+    try {
+      forWrite ? km10.pag.writeP(va, user) : km10.pag.readP(va, user);
+    } catch (const PAGDevice::PageFail &pf) {
+      return pf.pfw;
+    }
+
+    ADD_FAILURE() << "no page fail for " << va.fmtVMA();
+    return PFWord{};
+  }
+};
+
+
+TEST_F(PAGTest, ImmediatePointers) {
+  userMap(5) = immediate(0120).u;
+  EXPECT_EQ(km10.pag.readP(W36(05123), true), page(0120) + 0123);
+  EXPECT_EQ(km10.pag.writeP(W36(05777), true), page(0120) + 0777);
+
+  // Exec and user space are separate.
+  EXPECT_EQ(km10.pag.readP(W36(05123), false), page(5) + 0123);
+}
+
+
+TEST_F(PAGTest, SharedPointers) {
+  spt(3) = immediate(0121).u;
+  userMap(6) = shared(3).u;
+  EXPECT_EQ(km10.pag.readP(W36(06010), true), page(0121) + 010);
+
+  // A shared section pointer finds the section's page map in the SPT.
+  spt(5) = immediate(5).u;
+  page(5)[0] = immediate(0124).u;
+  km10.uptP->userSection[1] = shared(5).u;
+  EXPECT_EQ(km10.pag.readP(W36(01000100), true), page(0124) + 0100);
+}
+
+
+TEST_F(PAGTest, IndirectPointers) {
+  // SPT 4 is a page map whose word 7 maps the page.
+  spt(4) = immediate(0122).u;
+  page(0122)[7] = immediate(0123).u;
+  userMap(7) = indirect(4, 7).u;
+  EXPECT_EQ(km10.pag.readP(W36(07001), true), page(0123) + 1);
+
+  // A read-only pointer anywhere in the chain makes the page read-only.
+  page(0122)[7] = immediate(0123, false).u;
+  km10.pag.invalidateAll();
+  EXPECT_EQ(km10.pag.readP(W36(07001), true), page(0123) + 1);
+
+  PFWord pfw{failFor(W36(07001), true, true)};
+  EXPECT_EQ(pfw.va, 07001u);
+  EXPECT_TRUE(pfw.user);
+  EXPECT_TRUE(pfw.writeRef);
+  EXPECT_TRUE(pfw.accessible);
+  EXPECT_FALSE(pfw.writable);
+}
+
+
+TEST_F(PAGTest, IndirectionLimit) {
+  // An indirect pointer that points at itself.
+  spt(010) = immediate(0125).u;
+  page(0125)[0] = indirect(010, 0).u;
+  userMap(010) = indirect(010, 0).u;
+
+  PFWord pfw{failFor(W36(010000), false, true)};
+  EXPECT_EQ(pfw.va, 010000u);
+  EXPECT_TRUE(pfw.paged);
+  EXPECT_FALSE(pfw.accessible);
+
+  // A chain of exactly the longest length resolves, and one more
+  // pointer is too many.
+  const unsigned last = PAGDevice::maxIndirections - 2;
+  for (unsigned k=0; k < last; ++k) page(0125)[k] = indirect(010, k + 1).u;
+  page(0125)[last] = immediate(0126).u;
+  EXPECT_EQ(km10.pag.readP(W36(010000), true), page(0126));
+
+  page(0125)[last] = indirect(010, last + 1).u;
+  page(0125)[last + 1] = immediate(0126).u;
+  km10.pag.invalidateAll();
+  EXPECT_FALSE(failFor(W36(010000), false, true).accessible);
+}
+
+
+TEST_F(PAGTest, NoAccessAndNotInCore) {
+  PFWord pfw{failFor(W36(011000), false, true)};
+  EXPECT_FALSE(pfw.accessible);
+
+  PagePointer p{immediate(0127)};
+  p.storageMedium = 1;
+  userMap(011) = p.u;
+  pfw = failFor(W36(011000), false, true);
+  EXPECT_FALSE(pfw.accessible);
+}
+
+
+TEST_F(PAGTest, CSTUpdates) {
+  useCST(W36(020));
+  userMap(5) = immediate(0120).u;
+
+  // A read sets the CST data bits but not "modified", and doesn't
+  // give write access.
+  km10.pag.readP(W36(05000), true);
+  EXPECT_EQ(cst(0120).u, (1ull << 30) | 020);
+  EXPECT_EQ(cst(userMapPage).u, (1ull << 30) | 020);
+  EXPECT_EQ(km10.pag.tlb[1][5].writeVPN, PAGDevice::invalidVPN);
+
+  km10.pag.writeP(W36(05000), true);
+  EXPECT_EQ(cst(0120).u, (1ull << 30) | 021);
+  EXPECT_EQ(km10.pag.tlb[1][5].writeVPN, 5u);
+
+  // Age zero means the monitor wants to hear about the reference.
+  userMap(6) = immediate(0121).u;
+  cst(0121) = 0;
+  PFWord pfw{failFor(W36(06000), false, true)};
+  EXPECT_EQ(pfw.va, 06000u);
+  EXPECT_EQ(cst(0121).u, 0u);
+}
+
+
+TEST_F(PAGTest, CLRPTDropsOnePage) {
+  userMap(5) = immediate(0120).u;
+  userMap(6) = immediate(0121).u;
+  km10.pag.readP(W36(05000), true);
+  km10.pag.readP(W36(06000), true);
+
+  // Changing the map isn't seen until the TLB entry goes.
+  userMap(5) = immediate(0130).u;
+  userMap(6) = immediate(0131).u;
+  EXPECT_EQ(km10.pag.readP(W36(05000), true), page(0120));
+
+  km10.pag.doBLKO(W36(0), W36(05000));
+  EXPECT_EQ(km10.pag.readP(W36(05000), true), page(0130));
+  EXPECT_EQ(km10.pag.readP(W36(06000), true), page(0121));
+}
+
+
+TEST_F(PAGTest, DATAOKeepsKeepPages) {
+  execMap(070) = immediate(0140, true, true).u;
+  execMap(071) = immediate(0141).u;
+  userMap(5) = immediate(0120).u;
+  km10.pag.readP(W36(070000), false);
+  km10.pag.readP(W36(071000), false);
+  km10.pag.readP(W36(05000), true);
+
+  execMap(070) = immediate(0150, true, true).u;
+  execMap(071) = immediate(0151).u;
+  userMap(5) = immediate(0130).u;
+
+  // A new UBR drops user pages and exec pages that aren't "keep".
+  PAGDevice::ProcessContext pc;
+  pc.loadUserBase = 1;
+  pc.userBaseAddress = uptPage;
+  km10.physicalP[020000] = pc.u;
+  km10.ea = 020000;
+  km10.pag.doDATAO(W36(0), km10.ea);
+
+  EXPECT_EQ(km10.pag.readP(W36(070000), false), page(0140));
+  EXPECT_EQ(km10.pag.readP(W36(071000), false), page(0151));
+  EXPECT_EQ(km10.pag.readP(W36(05000), true), page(0130));
+
+  // Selecting AC blocks alone doesn't touch the TLB.
+  userMap(5) = immediate(0120).u;
+  pc.u = 0;
+  pc.selectACBlocks = 1;
+  km10.physicalP[020000] = pc.u;
+  km10.pag.doDATAO(W36(0), km10.ea);
+  EXPECT_EQ(km10.pag.readP(W36(05000), true), page(0130));
+}
+
+
+TEST_F(PAGTest, CONODropsEverything) {
+  execMap(070) = immediate(0140, true, true).u;
+  userMap(5) = immediate(0120).u;
+  km10.pag.readP(W36(070000), false);
+  km10.pag.readP(W36(05000), true);
+
+  execMap(070) = immediate(0150, true, true).u;
+  userMap(5) = immediate(0130).u;
+  km10.pag.putConditions(km10.pag.getConditions());
+
+  EXPECT_EQ(km10.pag.readP(W36(070000), false), page(0150));
+  EXPECT_EQ(km10.pag.readP(W36(05000), true), page(0130));
+}
+
+
+TEST_F(PAGTest, PageFailTrap) {
+  km10.uptP->pfNewPC = W36(030000);
+  km10.flags.ov = 1;
+  execute(W36(0200, 1, 0, 0, 0170123));	// MOVE 1,170123 (unmapped)
+
+  PFWord pfw{km10.uptP->pfWord.u};
+  EXPECT_EQ(pfw.va, 0170123u);
+  EXPECT_TRUE(pfw.paged);
+  EXPECT_FALSE(pfw.user);
+  EXPECT_FALSE(pfw.writeRef);
+  EXPECT_FALSE(pfw.accessible);
+
+  KM10::ProgramFlags oldFlags{(unsigned) km10.uptP->pfFlags.pcFlags};
+  EXPECT_TRUE(oldFlags.ov);
+  EXPECT_EQ(km10.uptP->pfOldPC, W36(code));
+  EXPECT_EQ(km10.pc, W36(030000));
+  EXPECT_FALSE(km10.flags.ov);
+}
+
+
+TEST_F(PAGTest, MAP) {
+  useCST();
+  userMap(5) = immediate(0120, false).u;
+  km10.flags.usr = 0;
+
+  // MAP of an exec page gives the physical address.
+  execute(W36(0257, 1, 0, 0, 070123));	// MAP 1,70123
+  PFWord pfw{km10.AC[1].u};
+  EXPECT_TRUE(pfw.accessible);
+  EXPECT_TRUE(pfw.writable);
+  EXPECT_EQ(pfw.va, 070123u);
+
+  execute(W36(0257, 1, 0, 0, 0170123));	// MAP 1,170123
+  pfw = km10.AC[1].u;
+  EXPECT_FALSE(pfw.accessible);
+
+  // MAP leaves the TLB and CST alone.
+  EXPECT_EQ(km10.pag.tlb[0][0170].readVPN, PAGDevice::invalidVPN);
+  EXPECT_EQ(cst(070).u, 1ull << 30);
+
+  // Unpaged, MAP gives back the address.
+  km10.pag.putConditions(eptPage);
+  pfw = km10.pag.map(W36(05123), true);
+  EXPECT_EQ(pfw.va, 05123u);
+}
+
+
+TEST_F(PAGTest, AddressBreak) {
+  APRDevice::APRBreakState brk;
+  brk.vma = 020123;
+  brk.write = 1;
+  km10.physicalP[020000] = W36(brk.u);
+  km10.ea = 020000;
+  km10.apr.doDATAO(W36(0), km10.ea);
+
+  km10.uptP->pfNewPC = W36(030000);
+  km10.AC[1] = W36(0123);
+  execute(W36(0202, 1, 0, 0, 020123));	// MOVEM 1,20123
+
+  PFWord pfw{km10.uptP->pfWord.u};
+  EXPECT_EQ(pfw.code, (unsigned) PFWord::addressBreakCode);
+  EXPECT_EQ(pfw.va, 020123u);
+  EXPECT_EQ(km10.physicalP[020123], W36(0));
+  EXPECT_EQ(km10.pc, W36(030000));
+
+  // Reading the word, or writing its neighbor, doesn't break.
+  execute(W36(0200, 2, 0, 0, 020123));	// MOVE 2,20123
+  EXPECT_EQ(km10.pc, W36(code + 1));
+  execute(W36(0202, 1, 0, 0, 020124));	// MOVEM 1,20124
+  EXPECT_EQ(km10.physicalP[020124], W36(0123));
+}
+
+
+////////////////////////////////////////////////////////////////
+// With the HostMMU backend references to a watched page fault into
+// PAG instead of missing in the TLB.
+struct HostMMUTest: testing::Test {
+  MachineContext context;
+  KM10 km10{256*1024, context, true};
+
+  HostMMUTest() {
+    km10.debugger.interactive = false;
+    km10.uptP->pfNewPC = W36(02000);
+    km10.AC[1] = W36(0123);
+  }
+
+  // Run `n` instructions starting at 1000.
+  void run(unsigned n) {
+    km10.pc = 01000;
+    km10.nSteps = n;
+    km10.running = true;
+    km10.emulate();
+  }
+};
+
+
+TEST_F(HostMMUTest, WatchedWrite) {
+  context.addressPBPs.insert(030123);
+  km10.physicalP[01000] = W36(0202, 1, 0, 0, 030123);	// MOVEM 1,30123
+  km10.physicalP[01001] = W36(0202, 1, 0, 0, 030124);	// MOVEM 1,30124
+  run(2);
+
+  // The write completes and then the machine stops.
+  EXPECT_EQ(km10.physicalP[030123], W36(0123));
+  EXPECT_EQ(km10.physicalP[030124], W36(0));
+  EXPECT_EQ(km10.pc, W36(01001));
+}
+
+
+TEST_F(HostMMUTest, AddressBreak) {
+  km10.apr.breakState.vma = 030123;
+  km10.apr.breakState.write = 1;
+  km10.pag.updateWatchpoints();
+
+  km10.physicalP[01000] = W36(0202, 1, 0, 0, 030123);	// MOVEM 1,30123
+  km10.physicalP[02000] = W36(0202, 1, 0, 0, 030124);	// MOVEM 1,30124
+  run(2);
+
+  PAGDevice::PFWord pfw{km10.uptP->pfWord.u};
+  EXPECT_EQ(pfw.code, (unsigned) PAGDevice::PFWord::addressBreakCode);
+  EXPECT_EQ(pfw.va, 030123u);
+  EXPECT_EQ(km10.physicalP[030123], W36(0));
+
+  // The rest of the page is still writable.
+  EXPECT_EQ(km10.physicalP[030124], W36(0123));
+  EXPECT_EQ(km10.pc, W36(02001));
+}
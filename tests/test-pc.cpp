@@ -14,9 +14,11 @@ using namespace std;
 ////////////////////////////////////////////////////////////////
 struct PCTest: testing::Test {
   PCTest()
-    : km10{1024*1024}
+    : context{},
+      km10{1024*1024, context}
   { }
 
+  MachineContext context;
   KM10 km10;
 
   unsigned pcSB;
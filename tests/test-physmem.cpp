@@ -0,0 +1,60 @@
+// These are tests of references to non-existent memory, which fault
+// on the guard pages above `memorySize`.
+#include <gtest/gtest.h>
+
+#include "word.hpp"
+#include "km10.hpp"
+#include "apr.hpp"
+
+
+////////////////////////////////////////////////////////////////
+struct NXMTest: testing::Test {
+  static const inline unsigned nxm = 0500123;
+
+  MachineContext context;
+  KM10 km10{128*1024, context};
+
+  NXMTest() {
+    km10.debugger.interactive = false;
+  }
+
+  // Run `insn` at 1000, after forgetting any earlier NXM.
+  void execute(W36 insn) {
+    km10.apr.aprState.active_noMemory = 0;
+    km10.era = 0;
+    km10.physicalP[01000] = insn;
+    km10.pc = 01000;
+    km10.nSteps = 1;
+    km10.running = true;
+    km10.emulate();
+  }
+};
+
+
+TEST_F(NXMTest, ReadsAreZeroAndEachIsReported) {
+  // Without single stepping the scratch page stays mapped and only
+  // the first reference to it is reported.
+  const unsigned n = HostFaultRegion::canSingleStep ? 3 : 1;
+
+  for (unsigned k=0; k < n; ++k) {
+    km10.AC[1] = W36(0123456);
+    execute(W36(0200, 1, 0, 0, nxm));	// MOVE 1,500123
+    EXPECT_EQ(km10.AC[1], W36(0)) << "reference " << k;
+    EXPECT_TRUE(km10.apr.aprState.active_noMemory) << "reference " << k;
+    EXPECT_EQ(km10.era, W36(nxm)) << "reference " << k;
+    EXPECT_EQ(km10.pc, W36(01001));
+  }
+}
+
+
+TEST_F(NXMTest, WritesAreDropped) {
+  km10.AC[1] = W36(0123456);
+  execute(W36(0202, 1, 0, 0, nxm));	// MOVEM 1,500123
+  EXPECT_TRUE(km10.apr.aprState.active_noMemory);
+
+  execute(W36(0200, 2, 0, 0, nxm));	// MOVE 2,500123
+  EXPECT_EQ(km10.AC[2], W36(0));
+
+  // Memory below `memorySize` is untouched.
+  EXPECT_EQ(km10.physicalP[nxm & 0377777], W36(0));
+}
@@ -0,0 +1,311 @@
+// These are tests of how the PI system picks which interrupt to take.
+#include <gtest/gtest.h>
+
+#include "word.hpp"
+#include "km10.hpp"
+
+
+////////////////////////////////////////////////////////////////
+struct PITest: testing::Test {
+  MachineContext context;
+  KM10 km10{256*1024, context};
+
+  PITest() {
+    km10.debugger.interactive = false;
+    km10.pi.piState.piOn = 1;
+    km10.pi.piState.levelsOn = 0177;
+  }
+
+  W36 vectorFor(unsigned level) {
+    return km10.physAddressFor(&km10.eptP->pioInstructions[2*level]);
+  }
+};
+
+
+TEST_F(PITest, HighestLevelThenLowestDeviceCode) {
+  km10.tim.setIntLevel(5);
+  km10.tim.requestInterrupt();
+  km10.dte.setIntLevel(3);
+  km10.dte.requestInterrupt();
+  km10.apr.setIntLevel(3);
+  km10.apr.requestInterrupt();
+
+  EXPECT_EQ(km10.pi.setUpInterruptCycleIfPending(), vectorFor(3));
+  EXPECT_EQ(km10.pi.piState.currentLevel, 3u);
+
+  // The APR's request, not the DTE's, should be the one taken.
+  EXPECT_EQ(km10.ACBlocks[7][3].u, get<1>(km10.apr.getIntFuncWord()).u);
+}
+
+
+TEST_F(PITest, HeldLevelBlocksLowerPriority) {
+  km10.tim.setIntLevel(3);
+  km10.tim.requestInterrupt();
+  ASSERT_EQ(km10.pi.setUpInterruptCycleIfPending(), vectorFor(3));
+
+  // Nothing at or below level 3 can interrupt level 3's handler.
+  km10.apr.setIntLevel(5);
+  km10.apr.requestInterrupt();
+  EXPECT_EQ(km10.pi.setUpInterruptCycleIfPending(), W36(0));
+
+  // Moving the request above level 3 lets it through.
+  km10.apr.setIntLevel(1);
+  EXPECT_EQ(km10.pi.setUpInterruptCycleIfPending(), vectorFor(1));
+  EXPECT_EQ(km10.pi.piState.currentLevel, 1u);
+}
+
+
+TEST_F(PITest, ClearedRequestIsForgotten) {
+  km10.apr.setIntLevel(2);
+  km10.apr.requestInterrupt();
+  km10.apr.requestInterrupt();
+  km10.apr.clearInterrupt();
+
+  EXPECT_EQ(km10.pi.requestedLevels, 0u);
+  EXPECT_EQ(km10.pi.setUpInterruptCycleIfPending(), W36(0));
+}
+
+
+////////////////////////////////////////////////////////////////
+// A device that asks for whatever interrupt function we give it.
+struct IFWTest: PITest {
+
+  struct TestDevice: Device {
+    W36 ifw;
+    W36 given{0};
+    W36 examined{0};
+    unsigned nDone{0};
+    bool lastOK{false};
+
+    TestDevice(KM10 &cpu)
+      : Device(070, "TEST", cpu)
+    {}
+
+    virtual tuple<unsigned,W36> getIntFuncWord() override {return {intLevel, ifw};}
+    virtual void intExamined(W36 ifw, W36 w) override {examined = w;}
+    virtual W36 intDepositWord(W36 ifw) override {return given;}
+
+    virtual void intFunctionDone(W36 ifw, bool ok) override {
+      ++nDone;
+      lastOK = ok;
+      Device::intFunctionDone(ifw, ok);
+    }
+
+    virtual unsigned getConditions() override {return 0;}
+    virtual void putConditions(unsigned v) override {}
+  } dev{km10};
+
+  // Request `function` of the word at physical `addr`, and return
+  // what the PI system wants the CPU to fetch next.
+  W36 request(W36::IntFunction function, unsigned addr, bool q = false) {
+    dev.ifw = 0;
+    dev.ifw.intFunction = function;
+    dev.ifw.addrSpace = W36::physical;
+    dev.ifw.intAddr = addr;
+    dev.ifw.q = q;
+    dev.setIntLevel(2);
+    dev.requestInterrupt();
+    return km10.pi.setUpInterruptCycleIfPending();
+  }
+};
+
+
+TEST_F(IFWTest, IncrementInInterruptCycle) {
+  km10.memP[02000] = W36(41);
+
+  EXPECT_EQ(request(W36::incIF, 02000), W36(0));
+  EXPECT_EQ(km10.memP[02000], W36(42));
+  EXPECT_EQ(request(W36::incIF, 02000, true), W36(0));
+  EXPECT_EQ(km10.memP[02000], W36(41));
+
+  // Nothing was held and nothing is still requested.
+  EXPECT_EQ(dev.nDone, 2u);
+  EXPECT_EQ(km10.pi.piState.held, 0u);
+  EXPECT_EQ(km10.pi.piState.currentLevel, PIDevice::PIState::noLevel);
+  EXPECT_EQ(km10.pi.requestedLevels, 0u);
+}
+
+
+TEST_F(IFWTest, ExamineAndDeposit) {
+  km10.memP[02000] = W36(0123, 0456);
+  request(W36::examineIF, 02000);
+  EXPECT_EQ(dev.examined, W36(0123, 0456));
+
+  dev.given = W36(0654, 0321);
+  request(W36::depositIF, 02001);
+  EXPECT_EQ(km10.memP[02001], W36(0654, 0321));
+  EXPECT_TRUE(dev.lastOK);
+}
+
+
+TEST_F(IFWTest, BytesThroughDTEPointers) {
+  // POINT 8,2000 (ahead of the first byte) for each direction.
+  km10.eptP->dte[0].to10BP = W36(0441000, 02000);
+  km10.eptP->dte[0].to11BP = W36(0441000, 03000);
+  km10.memP[03000] = W36(0xAAull << 28 | 0x55ull << 20);
+
+  dev.given = W36(0x12);
+  request(W36::byteIF, 0, true);
+  dev.given = W36(0x34);
+  request(W36::byteIF, 0, true);
+  EXPECT_EQ(km10.memP[02000].u, 0x12ull << 28 | 0x34ull << 20);
+  EXPECT_EQ(km10.eptP->dte[0].to10BP, W36(0241000, 02000));
+
+  request(W36::byteIF, 0, false);
+  EXPECT_EQ(dev.examined, W36(0xAA));
+  request(W36::byteIF, 0, false);
+  EXPECT_EQ(dev.examined, W36(0x55));
+}
+
+
+TEST_F(IFWTest, VectorHoldsLevel) {
+  EXPECT_EQ(request(W36::vectorIF, 02000), W36(02000));
+  EXPECT_EQ(km10.pi.piState.currentLevel, 2u);
+  EXPECT_EQ(dev.nDone, 0u);
+}
+
+
+////////////////////////////////////////////////////////////////
+// A device that has a run of words ready for BLKI, or room for a run
+// from BLKO, and (unless `coalesce` is off) says so. It stops asking
+// for an interrupt when the run is gone.
+struct BlockTest: PITest {
+
+  struct BlockDevice: Device {
+    bool coalesce{true};
+    unsigned ready{0};
+    unsigned next{0100};
+    vector<W36> taken;
+
+    BlockDevice(KM10 &cpu)
+      : Device(070, "BLOCK", cpu)
+    {}
+
+    virtual unsigned blockReady(bool in, unsigned n) override {return coalesce ? ready : 1;}
+    virtual W36 blockInWord() override {used(); return next++;}
+    virtual void blockOutWord(W36 w) override {used(); taken.push_back(w);}
+
+    virtual IResult doDATAI(W36 iw, W36 ea) override {
+      used();
+      km10.memPut(next++);
+      return iNormal;
+    }
+
+    virtual IResult doDATAO(W36 iw, W36 ea) override {
+      used();
+      taken.push_back(km10.memGet());
+      return iNormal;
+    }
+
+    void used() {
+      if (--ready == 0) clearInterrupt();
+    }
+
+    virtual unsigned getConditions() override {return 0;}
+    virtual void putConditions(unsigned v) override {}
+  } dev{km10};
+
+  static const inline unsigned ptr = 01000;
+  static const inline unsigned buf = 02000;
+
+  // Run BLKI or BLKO as an interrupt instruction until the device has
+  // nothing more ready, and return the results.
+  vector<IResult> run(bool in) {
+    vector<IResult> results;
+    km10.inInterrupt = true;
+
+    while (dev.ready > 0) {
+      km10.ea = ptr;
+      results.push_back(in ? dev.doBLKI(0, ptr) : dev.doBLKO(0, ptr));
+    }
+
+    return results;
+  }
+};
+
+
+TEST_F(BlockTest, BLKIMatchesOneWordAtATime) {
+  vector<W36> words[2];
+  W36 pointers[2];
+  vector<IResult> results[2];
+
+  for (unsigned pass=0; pass < 2; ++pass) {
+    for (unsigned k=0; k < 8; ++k) km10.memP[buf + k] = 0;
+    km10.memP[ptr] = W36(-5 & W36::halfOnes, buf - 1);
+    dev.coalesce = pass == 1;
+    dev.ready = 5;
+    dev.next = 0100;
+
+    results[pass] = run(true);
+    for (unsigned k=0; k < 8; ++k) words[pass].push_back(km10.memP[buf + k]);
+    pointers[pass] = km10.memP[ptr];
+  }
+
+  EXPECT_EQ(results[0].size(), 5u);
+  EXPECT_EQ(results[1].size(), 1u);
+  EXPECT_EQ(results[0].back(), iNormal);	// Count ran out
+  EXPECT_EQ(results[1].back(), iNormal);
+  EXPECT_EQ(words[0], words[1]);
+  EXPECT_EQ(words[1][4], W36(0104));
+  EXPECT_EQ(words[1][5], W36(0));
+  EXPECT_EQ(pointers[0], W36(0, buf + 4));
+  EXPECT_EQ(pointers[1], pointers[0]);
+}
+
+
+TEST_F(BlockTest, BLKOStopsWhereDeviceDoes) {
+  for (unsigned k=0; k < 8; ++k) km10.memP[buf + k] = W36(k + 1);
+  km10.memP[ptr] = W36(-8 & W36::halfOnes, buf - 1);
+  dev.ready = 3;
+
+  const auto results = run(false);
+  ASSERT_EQ(results.size(), 1u);
+  EXPECT_EQ(results[0], iSkip);		// More to go
+  EXPECT_EQ(dev.taken, (vector<W36>{W36(1), W36(2), W36(3)}));
+  EXPECT_EQ(km10.memP[ptr], W36(-5 & W36::halfOnes, buf + 2));
+}
+
+
+TEST_F(BlockTest, NotCoalescedOutsideInterrupts) {
+  km10.memP[ptr] = W36(-4 & W36::halfOnes, buf - 1);
+  dev.ready = 4;
+  km10.inInterrupt = false;
+  km10.ea = ptr;
+
+  EXPECT_EQ(dev.doBLKI(0, ptr), iSkip);
+  EXPECT_EQ(dev.ready, 3u);
+  EXPECT_EQ(km10.memP[buf], W36(0100));
+}
+
+
+// A BLKI at level 3 that skips, taken while level 5 is being served,
+// ends level 3's service but not level 5's.
+TEST_F(BlockTest, SkipReleasesOnlyItsLevel) {
+  km10.tim.setIntLevel(5);
+  km10.tim.requestInterrupt();
+  ASSERT_EQ(km10.pi.setUpInterruptCycleIfPending(), vectorFor(5));
+  km10.tim.clearInterrupt();
+
+  // Level 5's handler is at 01000 when level 3 interrupts it.
+  W36 blki(0, ptr);
+  blki.ioSeven = 7;
+  blki.ioDev = dev.ioAddress;
+  blki.ioOp = W36::BLKI;
+  km10.eptP->pioInstructions[2*3] = blki;
+  km10.memP[ptr] = W36(-4 & W36::halfOnes, buf - 1);
+  dev.coalesce = false;
+  dev.ready = 1;
+  dev.setIntLevel(3);
+  dev.requestInterrupt();
+
+  km10.pc = 01000;
+  km10.nSteps = 1;
+  km10.running = true;
+  km10.emulate();
+
+  EXPECT_EQ(km10.memP[buf], W36(0100));
+  EXPECT_EQ(km10.pc.rhu, 01000u);
+  EXPECT_EQ(km10.pi.piState.held, PIDevice::levelBit(5));
+  EXPECT_EQ(km10.pi.piState.currentLevel, 5u);
+  EXPECT_FALSE(km10.inInterrupt);
+}
@@ -0,0 +1,169 @@
+// These are tests of the RH20 and its channel with an RP07 on it.
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <chrono>
+#include <thread>
+
+#include "word.hpp"
+#include "km10.hpp"
+#include "rh20.hpp"
+#include "rp07.hpp"
+
+
+////////////////////////////////////////////////////////////////
+struct RH20Test: testing::Test {
+  static const inline unsigned list = 01000;	// Channel command list
+  static const inline unsigned buf = 02000;
+
+  MachineContext context;
+  KM10 km10{256*1024, context};
+  string path;
+  RH20 *rhP;
+  RP07 *rpP;
+
+  RH20Test() {
+    km10.debugger.interactive = false;
+    km10.pi.piState.piOn = 1;
+    km10.pi.piState.levelsOn = 0177;
+
+    char name[] = "/tmp/km10-rp07-XXXXXX";
+    close(mkstemp(name));
+    path = name;
+
+    rhP = new RH20(0, km10);	// km10 deletes this
+    rpP = new RP07(path);
+    rhP->attach(0, rpP);
+  }
+
+  ~RH20Test() {
+    unlink(path.c_str());
+  }
+
+  void put(unsigned reg, unsigned v) {
+    RH20::DataWord d;
+    d.reg = reg;
+    d.load = 1;
+    d.data = v;
+    rhP->dataO(W36(d.u));
+  }
+
+  unsigned get(unsigned reg) {
+    RH20::DataWord d;
+    d.reg = reg;
+    rhP->dataO(W36(d.u));
+    return RH20::DataWord(rhP->dataI().u).data;
+  }
+
+  // Start a transfer of `blocks` blocks with the command list at
+  // `list`.
+  void transfer(unsigned function, unsigned blocks) {
+    km10.eptP->channelLogout[0].initialCommand = ccw(Channel::ccwJump, 0, list);
+
+    RH20::TCR tcr;
+    tcr.function = function;
+    tcr.negBlocks = 02000 - blocks;
+    tcr.resetCLP = 1;
+    tcr.storeStatus = 1;
+
+    RH20::DataWord d(tcr.u);
+    d.reg = RH20::regSTCR;
+    d.load = 1;
+    rhP->dataO(W36(d.u));
+  }
+
+  static W36 ccw(unsigned op, unsigned count, unsigned addr) {
+    Channel::CCW c;
+    c.op = op;
+    c.count = count;
+    c.addr = addr;
+    return W36(c.u);
+  }
+
+  // What the CPU does between instructions, until `done` says to stop.
+  template <class F>
+  void runUntil(F done) {
+    const auto until = chrono::steady_clock::now() + chrono::seconds(10);
+
+    while (!done() && chrono::steady_clock::now() < until) {
+      if (km10.asyncAttention.load(memory_order_relaxed)) km10.serviceAsyncDevices();
+      this_thread::yield();
+    }
+  }
+};
+
+
+TEST_F(RH20Test, NewPackIsSparse) {
+  struct stat st;
+  ASSERT_EQ(stat(path.c_str(), &st), 0);
+  EXPECT_EQ((size_t) st.st_size, RP07::packWords * sizeof(W36));
+  EXPECT_LT((size_t) st.st_blocks * 512, 1024u * 1024u);
+  EXPECT_EQ(get(MassbusDrive::regDT), RP07::driveType);
+}
+
+
+TEST_F(RH20Test, WriteThenReadThroughChannel) {
+  for (unsigned k=0; k < 256; ++k) km10.physicalP[buf + k] = W36(0123456000000ull + k);
+
+  put(RP07::regDC, 5);
+  put(RP07::regDA, (3 << 8) | 7);
+  km10.physicalP[list] = ccw(Channel::ccwTransfer | Channel::ccwLast, 256, buf);
+  transfer(RP07::fnWrite, 2);
+  runUntil([&] {return rhP->status.done;});
+
+  ASSERT_TRUE(rhP->status.done);
+  EXPECT_EQ(rhP->status.u & 0775000, 0u);	// No errors
+  EXPECT_EQ(get(RP07::regDA), (3u << 8) | 9);
+
+  const size_t lba = (5 * RP07::tracks + 3) * RP07::sectors + 7;
+  EXPECT_EQ(rpP->imageP[lba * 128 + 255], W36(0123456000000ull + 255));
+
+  // Read it back into two pieces of memory.
+  put(RP07::regDA, (3 << 8) | 7);
+  km10.physicalP[list + 0] = ccw(Channel::ccwTransfer, 100, 010000);
+  km10.physicalP[list + 1] = ccw(Channel::ccwTransfer | Channel::ccwLast, 156, 020000);
+  rhP->putConditions(010);	// Clear done
+  transfer(RP07::fnRead, 2);
+  runUntil([&] {return rhP->status.done;});
+
+  ASSERT_TRUE(rhP->status.done);
+  EXPECT_EQ(rhP->status.u & 0775000, 0u);
+  EXPECT_EQ(km10.physicalP[010000 + 99], W36(0123456000000ull + 99));
+  EXPECT_EQ(km10.physicalP[020000 + 0], W36(0123456000000ull + 100));
+  EXPECT_EQ(km10.physicalP[020000 + 155], W36(0123456000000ull + 255));
+  EXPECT_EQ(km10.eptP->channelLogout[0].statusWord.u & Channel::csCountNotZero, 0u);
+}
+
+
+TEST_F(RH20Test, ShortListIsShortWordCount) {
+  put(RP07::regDA, 0);
+  km10.physicalP[list] = ccw(Channel::ccwTransfer | Channel::ccwLast, 64, buf);
+  transfer(RP07::fnRead, 1);
+  runUntil([&] {return rhP->status.done;});
+
+  EXPECT_TRUE(rhP->status.swce);
+  EXPECT_NE(km10.eptP->channelLogout[0].statusWord.u & Channel::csSWCE, 0u);
+}
+
+
+TEST_F(RH20Test, SeekRaisesAttention) {
+  rhP->putConditions(040 | 5);	// Attention enable, PI level 5
+  put(RP07::regDC, 100);
+  put(MassbusDrive::regCS1, RP07::fnSeek);
+  runUntil([&] {return rhP->status.attention;});
+
+  EXPECT_EQ(get(RP07::regCC), 100u);
+  EXPECT_EQ(get(MassbusDrive::regAS), 1u);
+  EXPECT_TRUE(rhP->intPending);
+
+  put(MassbusDrive::regAS, 1);
+  EXPECT_FALSE(rhP->status.attention);
+  EXPECT_FALSE(rhP->intPending);
+}
+
+
+// A clone would have no RH20 worker and share the RP07 pack with us,
+// so the debugger won't fork.
+TEST_F(RH20Test, NoForkWithDrives) {
+  EXPECT_EQ(km10.debugger.forkClones({"fork", "1"}), Debugger::noop);
+}
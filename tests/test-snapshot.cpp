@@ -0,0 +1,99 @@
+// These are tests of whole-machine snapshots.
+#include <gtest/gtest.h>
+#include <unistd.h>
+
+#include "word.hpp"
+#include "km10.hpp"
+#include "apr.hpp"
+#include "pi.hpp"
+#include "snapshot.hpp"
+
+
+////////////////////////////////////////////////////////////////
+struct SnapshotTest: testing::Test {
+  MachineContext context;
+  KM10 km10{256*1024, context};
+  string path;
+
+  SnapshotTest() {
+    km10.debugger.interactive = false;
+
+    char name[] = "/tmp/km10-snap-XXXXXX";
+    close(mkstemp(name));
+    path = name;
+  }
+
+  ~SnapshotTest() {
+    unlink(path.c_str());
+  }
+};
+
+
+TEST_F(SnapshotTest, SaveMutateLoad) {
+  km10.physicalP[01000] = W36(0254, 0, 0, 0, 01000);	// JRST 1000
+  km10.physicalP[0777777] = W36(0123456, 0654321);
+  km10.ACBlocks[0][1] = W36(0111);
+  km10.ACBlocks[6][3] = W36(0666);
+  km10.pc = 01000;
+  km10.flags.ov = 1;
+  km10.debugger.switches = W36(0707070);
+  km10.pi.piState.piOn = 1;
+  km10.pi.piState.levelsOn = 0125;
+  km10.apr.setIntLevel(3);
+  km10.debugger.globalSymbols["START"] = W36(01000);
+  km10.debugger.valueToSymbol[W36(01000)] = "START";
+
+  Snapshot::save(km10, path);
+
+  km10.physicalP[01000] = W36(0);
+  km10.physicalP[0777777] = W36(0);
+  km10.physicalP[020000] = W36(0222);
+  km10.ACBlocks[0][1] = W36(0);
+  km10.ACBlocks[6][3] = W36(0);
+  km10.pc = 02000;
+  km10.flags.u = 0;
+  km10.debugger.switches = W36(0);
+  km10.pi.piState.u = 0;
+  km10.apr.setIntLevel(0);
+  km10.debugger.globalSymbols["START"] = W36(02000);
+  km10.debugger.globalSymbols["LATER"] = W36(03000);
+  km10.debugger.valueToSymbol.clear();
+
+  Snapshot::restore(km10, path);
+
+  EXPECT_EQ(km10.physicalP[01000], W36(0254, 0, 0, 0, 01000));
+  EXPECT_EQ(km10.physicalP[0777777], W36(0123456, 0654321));
+  EXPECT_EQ(km10.physicalP[020000], W36(0));
+  EXPECT_EQ(km10.ACBlocks[0][1], W36(0111));
+  EXPECT_EQ(km10.ACBlocks[6][3], W36(0666));
+  EXPECT_EQ(km10.pc, W36(01000));
+  EXPECT_TRUE(km10.flags.ov);
+  EXPECT_EQ(km10.debugger.switches, W36(0707070));
+  EXPECT_TRUE(km10.pi.piState.piOn);
+  EXPECT_EQ(km10.pi.piState.levelsOn, 0125u);
+  EXPECT_EQ(km10.apr.intLevel, 3u);
+
+  EXPECT_EQ(km10.debugger.globalSymbols.size(), 1u);
+  EXPECT_EQ(km10.debugger.globalSymbols["START"], W36(01000));
+  EXPECT_EQ(km10.debugger.valueToSymbol[W36(01000)], "START");
+
+  // Memory is a private mapping of the snapshot. Changing it doesn't
+  // change the file, and the restored machine runs.
+  km10.physicalP[0777777] = W36(0);
+  km10.nSteps = 5;
+  km10.running = true;
+  km10.emulate();
+  EXPECT_EQ(km10.pc, W36(01000));
+
+  Snapshot::restore(km10, path);
+  EXPECT_EQ(km10.physicalP[0777777], W36(0123456, 0654321));
+}
+
+
+TEST_F(SnapshotTest, RejectsOtherMemorySize) {
+  Snapshot::save(km10, path);
+
+  MachineContext smallContext;
+  KM10 small{128*1024, smallContext};
+  EXPECT_THROW(Snapshot::restore(small, path), runtime_error);
+}
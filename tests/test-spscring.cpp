@@ -0,0 +1,92 @@
+// Tests for the single-producer/single-consumer ring the DTE20 uses
+// for CTY characters.
+#include <thread>
+#include <vector>
+#include <poll.h>
+
+using namespace std;
+
+#include <gtest/gtest.h>
+
+#include "spscring.hpp"
+
+
+TEST(SPSCRingTest, FillAndEmpty) {
+  SPSCRing<int, 8> r;
+  int v;
+
+  EXPECT_TRUE(r.isEmpty());
+  EXPECT_FALSE(r.dequeue(v));
+
+  for (int k=0; k < 8; ++k) EXPECT_TRUE(r.enqueue(k));
+  EXPECT_TRUE(r.isFull());
+  EXPECT_FALSE(r.enqueue(99));
+
+  for (int k=0; k < 8; ++k) {
+    EXPECT_TRUE(r.dequeue(v));
+    EXPECT_EQ(v, k);
+  }
+
+  EXPECT_TRUE(r.isEmpty());
+}
+
+
+TEST(SPSCRingTest, PeekWraps) {
+  SPSCRing<char, 8> r;
+  char c;
+
+  // Move head and tail to the middle so the next batch wraps.
+  for (int k=0; k < 6; ++k) r.enqueue('x');
+  for (int k=0; k < 6; ++k) r.dequeue(c);
+
+  EXPECT_EQ(r.enqueue("abcdefghij", 10), 8u);
+
+  const char *p0, *p1;
+  size_t n0, n1;
+  EXPECT_EQ(r.peek(p0, n0, p1, n1), 8u);
+  EXPECT_EQ(string(p0, n0), "ab");
+  EXPECT_EQ(string(p1, n1), "cdefgh");
+
+  r.consume(8);
+  EXPECT_TRUE(r.isEmpty());
+}
+
+
+TEST(SPSCRingTest, ProducerAndConsumerThreads) {
+  static const unsigned nItems = 1000000;
+  SPSCRing<unsigned, 64> r;
+  Waker waker;
+
+  thread producer([&]() {
+
+    for (unsigned k=0; k < nItems; ++k) {
+      while (!r.enqueue(k)) this_thread::yield();
+      waker.wake();
+    }
+  });
+
+  unsigned expected = 0;
+
+  while (expected < nItems) {
+    unsigned v;
+
+    if (r.dequeue(v)) {
+      ASSERT_EQ(v, expected);
+      ++expected;
+      continue;
+    }
+
+    // Sleep the way the console I/O thread does.
+    waker.prepareToSleep();
+
+    if (r.isEmpty()) {
+      struct pollfd p{.fd=waker.fd, .events=POLLIN, .revents=0};
+      poll(&p, 1, -1);
+      waker.drain();
+    }
+
+    waker.awake();
+  }
+
+  producer.join();
+}
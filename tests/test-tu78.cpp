@@ -0,0 +1,191 @@
+// These are tests of the TU78 and its tape images on an RH20.
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <chrono>
+#include <thread>
+
+#include "word.hpp"
+#include "km10.hpp"
+#include "rh20.hpp"
+#include "tu78.hpp"
+
+
+////////////////////////////////////////////////////////////////
+struct TU78Test: testing::Test {
+  static const inline unsigned list = 01000;	// Channel command list
+  static const inline unsigned buf = 02000;
+
+  MachineContext context;
+  KM10 km10{256*1024, context};
+  string path;
+  RH20 *rhP;
+  TU78 *tuP;
+
+  TU78Test() {
+    km10.debugger.interactive = false;
+
+    char name[] = "/tmp/km10-tu78-XXXXXX";
+    close(mkstemp(name));
+    path = name;
+  }
+
+  ~TU78Test() {
+    unlink(path.c_str());
+  }
+
+  void mount() {
+    rhP = new RH20(0, km10);	// km10 deletes this
+    tuP = new TU78(path);
+    rhP->attach(0, tuP);
+  }
+
+  void put(unsigned reg, unsigned v) {
+    RH20::DataWord d;
+    d.reg = reg;
+    d.load = 1;
+    d.data = v;
+    rhP->dataO(W36(d.u));
+  }
+
+  unsigned get(unsigned reg) {
+    RH20::DataWord d;
+    d.reg = reg;
+    rhP->dataO(W36(d.u));
+    return RH20::DataWord(rhP->dataI().u).data;
+  }
+
+  // Move `words` words of a record to or from `buf` and wait for it.
+  void transfer(unsigned function, unsigned words) {
+    km10.physicalP[list] = ccw(Channel::ccwTransfer | Channel::ccwLast, words, buf);
+    km10.eptP->channelLogout[0].initialCommand = ccw(Channel::ccwJump, 0, list);
+
+    RH20::TCR tcr;
+    tcr.function = function;
+    tcr.negBlocks = 02000 - 1;
+    tcr.resetCLP = 1;
+
+    RH20::DataWord d(tcr.u);
+    d.reg = RH20::regSTCR;
+    d.load = 1;
+    rhP->putConditions(010);	// Clear done
+    rhP->dataO(W36(d.u));
+    runUntil([&] {return rhP->status.done;});
+  }
+
+  // Do a non-data function `count` times and wait for it.
+  unsigned nonData(unsigned function, unsigned count = 1) {
+    put(TU78::regNDC0, ((count & 0377) << 8) | function);
+    runUntil([&] {return tuP->attention();});
+    put(MassbusDrive::regAS, 1);
+    return get(TU78::regNDI) & 077;
+  }
+
+  void writeRecord(uint64_t first, unsigned words) {
+    for (unsigned k=0; k < words; ++k) km10.physicalP[buf + k] = W36(first + k);
+    put(TU78::regBC, words * 5);
+    transfer(TU78::fnWritePE, words);
+  }
+
+  static W36 ccw(unsigned op, unsigned count, unsigned addr) {
+    Channel::CCW c;
+    c.op = op;
+    c.count = count;
+    c.addr = addr;
+    return W36(c.u);
+  }
+
+  // What the CPU does between instructions, until `done` says to stop.
+  template <class F>
+  void runUntil(F done) {
+    const auto until = chrono::steady_clock::now() + chrono::seconds(10);
+
+    while (!done() && chrono::steady_clock::now() < until) {
+      if (km10.asyncAttention.load(memory_order_relaxed)) km10.serviceAsyncDevices();
+      this_thread::yield();
+    }
+  }
+};
+
+
+TEST_F(TU78Test, WriteThenReadBack) {
+  mount();
+  EXPECT_EQ(get(MassbusDrive::regDT), TU78::driveType);
+  EXPECT_NE(get(TU78::regUS) & TU78::usBOT, 0u);
+
+  writeRecord(0123456700000, 100);
+  EXPECT_EQ(tuP->dti, (unsigned) TU78::icDone);
+  EXPECT_EQ(rhP->status.u & 0775000, 0u);	// No errors
+
+  EXPECT_EQ(nonData(TU78::fnRewind), (unsigned) TU78::icDone);
+  for (unsigned k=0; k < 100; ++k) km10.physicalP[buf + k] = W36(0);
+  transfer(TU78::fnReadForward, 100);
+
+  EXPECT_EQ(rhP->status.u & 0775000, 0u);
+  EXPECT_EQ(get(TU78::regBC), 500u);
+  EXPECT_EQ(km10.physicalP[buf], W36(0123456700000));
+  EXPECT_EQ(km10.physicalP[buf + 99], W36(0123456700000 + 99));
+}
+
+
+TEST_F(TU78Test, SpacingUsesMarks) {
+  mount();
+
+  // Two files of three records each.
+  for (unsigned file=0; file < 2; ++file) {
+    for (unsigned r=0; r < 3; ++r) writeRecord(file * 1000 + r * 10, 4);
+    EXPECT_EQ(nonData(TU78::fnWriteMarkPE), (unsigned) TU78::icDone);
+  }
+
+  EXPECT_EQ(nonData(TU78::fnRewind), (unsigned) TU78::icDone);
+  EXPECT_EQ(nonData(TU78::fnSpaceForwardFile), (unsigned) TU78::icDone);
+  EXPECT_EQ(tuP->pos, 4u);
+
+  // Spacing forward stops past the next tape mark.
+  EXPECT_EQ(nonData(TU78::fnSpaceForwardRecord, 10), (unsigned) TU78::icTapeMark);
+  EXPECT_EQ(tuP->pos, 8u);
+  EXPECT_EQ(get(TU78::regNDC0) >> 8, 6u);
+
+  // And spacing backward stops before it.
+  EXPECT_EQ(nonData(TU78::fnSpaceReverseRecord, 2), (unsigned) TU78::icTapeMark);
+  EXPECT_EQ(tuP->pos, 7u);
+  EXPECT_EQ(nonData(TU78::fnSpaceReverseRecord, 2), (unsigned) TU78::icDone);
+  EXPECT_EQ(tuP->pos, 5u);
+
+  transfer(TU78::fnReadForward, 4);
+  EXPECT_EQ(km10.physicalP[buf], W36(1010));
+
+  EXPECT_EQ(nonData(TU78::fnSpaceReverseFile, 5), (unsigned) TU78::icBOT);
+  EXPECT_EQ(tuP->pos, 0u);
+  EXPECT_NE(get(TU78::regUS) & TU78::usBOT, 0u);
+}
+
+
+// A tape made elsewhere is indexed when it's mounted.
+TEST_F(TU78Test, ReadsSIMHImage) {
+  const uint8_t image[] = {
+    6, 0, 0, 0,  1, 2, 3, 4, 5, 6,  6, 0, 0, 0,
+    0, 0, 0, 0,
+    3, 0, 0, 0,  7, 8, 9, 0,  3, 0, 0, 0,
+    0xFF, 0xFF, 0xFF, 0xFF,
+  };
+
+  const int fd = open(path.c_str(), O_WRONLY | O_TRUNC);
+  ASSERT_EQ(write(fd, image, sizeof(image)), (ssize_t) sizeof(image));
+  close(fd);
+
+  mount();
+  EXPECT_EQ(tuP->tape.recordsUpTo(10), 3u);
+  EXPECT_EQ(tuP->tape.markAtOrAfter(0), 1u);
+
+  put(TU78::regTC, TU78::fmtIndustry << 12);
+  EXPECT_EQ(nonData(TU78::fnSpaceForwardFile), (unsigned) TU78::icDone);
+  transfer(TU78::fnReadForward, 1);
+  EXPECT_EQ(get(TU78::regBC), 3u);
+  EXPECT_EQ(km10.physicalP[buf], W36(0x70809000ull));
+
+  // Past the last record is the end of the tape.
+  transfer(TU78::fnReadForward, 1);
+  EXPECT_EQ(tuP->dti, (unsigned) TU78::icEOT);
+  EXPECT_TRUE(tuP->attention());
+}
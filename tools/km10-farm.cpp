@@ -0,0 +1,302 @@
+// Run a batch of diagnostics in parallel, each in its own headless
+// KM10, and report how each one did.
+//
+// Usage: km10-farm [-p PRELOAD,...] [-j JOBS] [--insns MILLIONS]
+//                  [--seconds SECONDS] [--passes N] [--logs DIR] DIAG...
+//
+// Each DIAG is an .A10 file, loaded after the PRELOAD files (by
+// default subrtn.a10 from the same directory as the diagnostic). A
+// diagnostic passes once it has reported N "End of diagnostic PASS"
+// notices, and fails on a FAIL HALT or PROGRAM ERROR notice, on a HALT
+// instruction, or when it runs out of its instruction or time budget.
+//
+// We write one JSON object per diagnostic to stdout, in the order the
+// diagnostics were given, then a totals line. Progress goes to stderr.
+// The exit status is zero only if every diagnostic passed.
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <filesystem>
+#include <unistd.h>
+#include <fcntl.h>
+
+using namespace std;
+
+#include <CLI/CLI.hpp>
+
+#include "km10.hpp"
+
+
+struct Job {
+  string path;
+  string name;
+
+  // The machine while it runs, for stopping it when it's out of
+  // time. `m` keeps it from going away while we do that.
+  mutex m;
+  KM10 *km10P{nullptr};
+  chrono::steady_clock::time_point deadline;
+  bool timedOut{false};
+
+  string result{"not-run"};
+  unsigned passes{0};
+  uint64_t instructions{0};
+  double seconds{0};
+  double mips{0};
+  string pc;
+};
+
+
+struct Farm {
+  vector<string> preloads;
+  unsigned memoryKWords;
+  uint64_t insnBudget;
+  double secondsBudget;
+  unsigned passesWanted;
+  string logDir;
+
+  void run(Job &job);
+};
+
+
+static void load(KM10 &km10, const string &path) {
+  if (!filesystem::exists(path)) throw runtime_error("Can't open " + path);
+  km10.loadA10(path.c_str());
+}
+
+
+// Run `job` to completion on this thread.
+void Farm::run(Job &job) {
+  MachineContext context;
+  ofstream log;
+  int outputFD = -1;
+
+  if (logDir != "") {
+    const string logPath = logDir + "/" + job.name + ".log";
+    outputFD = open(logPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    log.open(logPath, ios::app);
+  } else {
+    outputFD = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    log.setstate(ios::badbit);
+  }
+
+  // The console output and our notices share the log, so keep them
+  // in order.
+  log << unitbuf;
+
+  try {
+    KM10 km10(memoryKWords * 1024, context);
+    km10.dte.setConsole(new FDConsole(-1, outputFD));
+    km10.dte.noticesP = &log;
+    km10.debugger.interactive = false;
+
+    for (auto &s: preloads) load(km10, s);
+    load(km10, job.path);
+
+    string outcome;
+
+    km10.dte.reportDiagNotice = [&](DTE20::DiagNotice status) {
+
+      switch (status) {
+      case DTE20::endOfPass:
+	if (++job.passes >= passesWanted) {
+	  outcome = "pass";
+	  km10.running = false;
+	}
+
+	break;
+
+      case DTE20::failHalt:
+	outcome = "fail-halt";
+	km10.running = false;
+	break;
+
+      case DTE20::programError:
+	outcome = "program-error";
+	km10.running = false;
+	break;
+
+      default:
+	break;
+      }
+    };
+
+    km10.nSteps = insnBudget;
+    km10.running = true;
+
+    const auto start = chrono::steady_clock::now();
+
+    {
+      lock_guard<mutex> lock(job.m);
+      job.deadline = start + chrono::duration_cast<chrono::steady_clock::duration>
+	(chrono::duration<double>(secondsBudget));
+      job.km10P = &km10;
+    }
+
+    km10.emulate();
+
+    {
+      lock_guard<mutex> lock(job.m);
+      job.km10P = nullptr;
+    }
+
+    job.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    job.instructions = km10.instructionCounter;
+    job.mips = km10.runNS ? km10.instructionCounter * 1000.0 / km10.runNS : 0;
+    job.pc = km10.pc.fmtVMA();
+
+    if (outcome != "")
+      job.result = outcome;
+    else if (job.timedOut)
+      job.result = "time-limit";
+    else if (insnBudget != 0 && km10.instructionCounter >= insnBudget)
+      job.result = "instruction-limit";
+    else
+      job.result = "halt";
+  } catch (const exception &e) {
+    lock_guard<mutex> lock(job.m);
+    job.km10P = nullptr;
+    job.result = "error";
+    cerr << "km10-farm: " << job.name << ": " << e.what() << endl;
+  }
+
+  close(outputFD);
+}
+
+
+static string jsonString(const string &s) {
+  ostringstream ss;
+  ss << '"';
+
+  for (char c: s) {
+
+    if ((unsigned char) c < 0x20) {
+      // JSON doesn't allow raw control characters in strings.
+      ss << "\\u" << hex << setw(4) << setfill('0') << (unsigned) c << dec;
+    } else {
+      if (c == '"' || c == '\\') ss << '\\';
+      ss << c;
+    }
+  }
+
+  ss << '"';
+  return ss.str();
+}
+
+
+int main(int argc, char *argv[]) {
+  CLI::App app{"Run diagnostics in parallel in headless KM10s"};
+
+  vector<string> diagsVal;
+  app.add_option("DIAG", diagsVal, ".A10 diagnostics to run")->required();
+
+  vector<string> preloadVal;
+  app.add_option("-p,--preload", preloadVal, ".A10 files to load before each diagnostic (default subrtn.a10)")
+    ->delimiter(',')
+    ->expected(0,-1);
+
+  unsigned jobsVal{thread::hardware_concurrency()};
+  app.add_option("-j,--jobs", jobsVal, "Number of diagnostics to run at once");
+
+  unsigned mVal{4096};
+  app.add_option("-m", mVal, "Size (in Kwords) of each KM10's main memory");
+
+  double insnsVal{1000};
+  app.add_option("--insns", insnsVal, "Millions of instructions each diagnostic may run (0 for no limit)");
+
+  double secondsVal{120};
+  app.add_option("--seconds", secondsVal, "Seconds each diagnostic may run");
+
+  unsigned passesVal{1};
+  app.add_option("--passes", passesVal, "Passes a diagnostic must complete to pass");
+
+  string logsVal;
+  app.add_option("--logs", logsVal, "Directory for each diagnostic's console log");
+
+  CLI11_PARSE(app, argc, argv);
+
+  Farm farm;
+  farm.preloads = preloadVal;
+  farm.memoryKWords = mVal;
+  farm.insnBudget = insnsVal * 1000 * 1000;
+  farm.secondsBudget = secondsVal;
+  farm.passesWanted = passesVal;
+  farm.logDir = logsVal;
+
+  if (farm.preloads.empty()) {
+    auto subrtn = filesystem::path(diagsVal[0]).parent_path() / "subrtn.a10";
+    farm.preloads.push_back(subrtn.string());
+  }
+
+  if (logsVal != "") filesystem::create_directories(logsVal);
+
+  vector<Job> jobs(diagsVal.size());
+
+  for (size_t k=0; k < diagsVal.size(); ++k) {
+    jobs[k].path = diagsVal[k];
+    jobs[k].name = filesystem::path(diagsVal[k]).stem().string();
+  }
+
+  atomic<size_t> nextJob{0};
+  atomic<unsigned> nDone{0};
+  mutex progressMutex;
+
+  auto worker = [&]() {
+
+    for (size_t k; (k = nextJob++) < jobs.size(); ) {
+      farm.run(jobs[k]);
+
+      lock_guard<mutex> lock(progressMutex);
+      cerr << "[" << ++nDone << "/" << jobs.size() << "] " << jobs[k].name << ": " << jobs[k].result
+	   << " (" << jobs[k].passes << " passes, " << fixed << setprecision(1) << jobs[k].mips << " MIPS)"
+	   << endl;
+    }
+  };
+
+  vector<thread> workers;
+  for (unsigned k=0; k < max(jobsVal, 1u); ++k) workers.emplace_back(worker);
+
+  // Stop each machine that runs out of time.
+  while (nDone < jobs.size()) {
+    this_thread::sleep_for(chrono::milliseconds(100));
+    const auto now = chrono::steady_clock::now();
+
+    for (auto &job: jobs) {
+      lock_guard<mutex> lock(job.m);
+
+      if (job.km10P && !job.timedOut && now >= job.deadline) {
+	job.timedOut = true;
+	job.km10P->running = false;
+      }
+    }
+  }
+
+  for (auto &t: workers) t.join();
+
+  unsigned nPassed = 0;
+  uint64_t totalInsns = 0;
+
+  for (auto &job: jobs) {
+    if (job.result == "pass") ++nPassed;
+    totalInsns += job.instructions;
+
+    fprintf(stdout,
+	    "{\"diagnostic\":%s,\"result\":%s,\"passes\":%u,\"instructions\":%llu,"
+	    "\"seconds\":%.3f,\"mips\":%.2f,\"pc\":%s}\n",
+	    jsonString(job.name).c_str(), jsonString(job.result).c_str(), job.passes,
+	    (unsigned long long) job.instructions, job.seconds, job.mips, jsonString(job.pc).c_str());
+  }
+
+  fprintf(stdout, "{\"diagnostics\":%zu,\"passed\":%u,\"failed\":%zu,\"instructions\":%llu}\n",
+	  jobs.size(), nPassed, jobs.size() - nPassed, (unsigned long long) totalInsns);
+
+  return nPassed == jobs.size() ? 0 : 1;
+}
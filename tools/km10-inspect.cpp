@@ -0,0 +1,142 @@
+// Read-only inspector for a KM10 started with `--publish NAME`.
+//
+// Usage: km10-inspect [-r file.rel ...] [-a ADDR [-n COUNT]] [-i SECONDS] NAME
+//
+// Prints a consistent snapshot of the processor and device state and
+// optionally dumps and disassembles COUNT words of physical memory
+// starting at octal ADDR, symbolized with symbols from the REL files.
+// The emulator keeps running at full speed while we look. With `-i`
+// we repeat every SECONDS until interrupted.
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+using namespace std;
+
+#include <CLI/CLI.hpp>
+
+#include "word.hpp"
+#include "symbols.hpp"
+#include "physmem.hpp"
+#include "introspect.hpp"
+
+
+// Map the shared memory object or file `path` read-only.
+static const void *mapReadOnly(const string &path, bool isShm, size_t nBytes) {
+  const int fd = isShm ? shm_open(path.c_str(), O_RDONLY, 0) : open(path.c_str(), O_RDONLY);
+  if (fd < 0) throw runtime_error("Can't open " + path);
+
+  void *p = mmap(nullptr, nBytes, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) throw runtime_error("Can't mmap " + path);
+  return p;
+}
+
+
+static void showState(const IntrospectionState &state) {
+  IntrospectionState::Registers r;
+  state.snapshot(r);
+
+  cout << "km10 pid " << dec << state.pid
+       << "  " << state.memoryWords / 1024 << "K words in " << state.memoryStore
+       << "  " << r.instructionCounter << " instructions"
+       << (r.running ? "  running" : "  stopped") << endl;
+  cout << "PC=" << W36(r.pc).fmtVMA()
+       << "  flags=" << oct << setw(5) << setfill('0') << r.flags << setfill(' ')
+       << "  AC block " << r.curACBlock << " (previous " << r.prevACBlock << ")" << endl;
+
+  for (unsigned k=0; k < 16; ++k) {
+    cout << oct << setw(2) << k << ": " << W36(r.acBlocks[r.curACBlock][k]).fmt36()
+	 << ((k % 4) == 3 ? "\n" : "   ");
+  }
+
+  cout << "APR=" << W36(r.aprConditions).fmt36()
+       << "  PI=" << W36(r.piConditions).fmt36()
+       << "  PAG=" << W36(r.pagConditions).fmt36()
+       << "  UBR=" << W36(r.processContext).fmt36() << endl
+       << "CCA=" << W36(r.ccaConditions).fmt36()
+       << "  TIM=" << W36(r.timConditions).fmt36()
+       << "  MTR=" << W36(r.mtrConditions).fmt36()
+       << "  DTE=" << W36(r.dteConditions).fmt36() << endl;
+}
+
+
+static void dumpMemory(const W36 *memP, unsigned nWords, unsigned addr, unsigned count,
+		       SymbolTable &symbols)
+{
+
+  for (unsigned a=addr; a < addr + count && a < nWords; ++a) {
+    W36 w = memP[a];
+    string label = symbols.valueToSymbol.contains(W36(a)) ? symbols.valueToSymbol[W36(a)] + ":" : "";
+    cout << left << setw(8) << label << right << W36(a).fmtVMA() << ": "
+	 << w.fmt36() << "  " << w.disasm(&symbols) << endl;
+  }
+}
+
+
+int main(int argc, char *argv[]) {
+  CLI::App app{"Inspect a running KM10 published with --publish"};
+
+  string nameVal;
+  app.add_option("NAME", nameVal, "Published shared memory object name")->required();
+
+  vector<string> rVal{};
+  app.add_option("-r,--rel", rVal, ".REL file(s) to load symbols from")
+    ->delimiter(',')
+    ->expected(0,-1);
+
+  string aVal;
+  app.add_option("-a,--address", aVal, "Octal physical address to dump from");
+
+  unsigned nVal{16};
+  app.add_option("-n,--count", nVal, "Number of words to dump");
+
+  double iVal{0};
+  app.add_option("-i,--interval", iVal, "Repeat every this many seconds");
+
+  CLI11_PARSE(app, argc, argv);
+
+  try {
+    SymbolTable symbols;
+    for (auto s: rVal) symbols.loadREL(s.c_str());
+
+    const string name = nameVal[0] == '/' ? nameVal : "/" + nameVal;
+    auto stateP = (const IntrospectionState *) mapReadOnly(name, true, sizeof(IntrospectionState));
+
+    if (stateP->magic != IntrospectionState::magicValue ||
+	stateP->version != IntrospectionState::currentVersion ||
+	stateP->stateBytes != sizeof(IntrospectionState))
+    {
+      throw runtime_error(nameVal + " is not a KM10 introspection object of this version");
+    }
+
+    const W36 *memP = nullptr;
+
+    if (aVal != "") {
+      const auto backend = PhysicalMemory::Backend::parse(stateP->memoryStore);
+      memP = (const W36 *) mapReadOnly(backend.path, backend.kind == PhysicalMemory::Backend::shared,
+				       (size_t) stateP->memoryWords * sizeof(W36));
+    }
+
+    for (;;) {
+      showState(*stateP);
+      if (memP) dumpMemory(memP, stateP->memoryWords, stoul(aVal, nullptr, 8), nVal, symbols);
+      if (iVal <= 0) break;
+
+      this_thread::sleep_for(chrono::duration<double>(iVal));
+      cout << endl;
+    }
+  } catch (const exception &e) {
+    cerr << "km10-inspect: " << e.what() << endl;
+    return 1;
+  }
+
+  return 0;
+}